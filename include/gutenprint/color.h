@@ -130,6 +130,16 @@ stp_color_get_name(const stp_color_t *c);
 extern const char *
 stp_color_get_long_name(const stp_color_t *c);
 
+/**
+ * Get the number of times that the curves for a page were found in the
+ * on-disk cache, and the number of times that they had to be computed
+ * with the cache enabled, since the process started.
+ * @param hits where to store the number of hits, or NULL.
+ * @param misses where to store the number of misses, or NULL.
+ */
+extern void
+stp_color_get_lut_cache_stats(unsigned long *hits, unsigned long *misses);
+
   /** @} */
 
 #ifdef __cplusplus
@@ -54,6 +54,7 @@ extern "C" {
 #include <gutenprint/list.h>
 #include <gutenprint/module.h>
 #include <gutenprint/path.h>
+#include <gutenprint/pipeline.h>
 #include <gutenprint/weave.h>
 #include <gutenprint/xml.h>
 
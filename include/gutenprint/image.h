@@ -124,6 +124,77 @@ typedef struct stp_image
   void *rep;
 } stp_image_t;
 
+/**
+ * Optional callbacks that an application can register for an image
+ * with stp_image_set_row_funcs().  They aren't members of stp_image_t
+ * itself, so that applications built before they were added keep
+ * working.
+ */
+typedef struct stp_image_row_funcs
+{
+  /**
+   * The size of the structure, sizeof(stp_image_row_funcs_t).  Members
+   * may be added at the end in later versions; the library treats any
+   * that lie past this size as NULL.
+   */
+  size_t size;
+  /**
+   * This optional callback lends the library a row that the
+   * application already has in memory, rather than having it copied
+   * by get_row().  The data must be laid out exactly as get_row()
+   * would have copied it, and must stay valid and unchanged until
+   * release_row() is called for it, or until the next call to
+   * lend_row() or get_row() if there is no release_row() callback.
+   * If the row can't be lent, this callback should return NULL and
+   * leave the row to be read by get_row(), which is then called for
+   * it instead.  Rows are requested in the same order as with
+   * get_row().
+   * @param image the image in use.
+   * @param byte_limit (image width * number of channels).
+   * @param row the row number.
+   * @return a pointer to byte_limit bytes of pixel data, or NULL.
+   */
+  const unsigned char *(*lend_row)(struct stp_image *image,
+				   size_t byte_limit, int row);
+  /**
+   * This optional callback is called when the library has finished
+   * with a row lent by lend_row().
+   * @param image the image in use.
+   * @param data the data returned by lend_row().
+   * @param row the row number.
+   */
+  void (*release_row)(struct stp_image *image, const unsigned char *data,
+		      int row);
+  /**
+   * This optional callback tells the application that a run of rows
+   * will not be requested, because they are scaled away or lie past
+   * the last row printed.  The application may drop them at the
+   * source (seek past them, or skip decoding them) rather than read
+   * them only to throw them away when a later row is requested.
+   * It is called, in the same order as get_row(), before the row that
+   * follows them is requested.  Without this callback the rows are
+   * simply never requested, as before.
+   * @param image the image in use.
+   * @param row the first row that will not be requested.
+   * @param count the number of rows that will not be requested.
+   * @return STP_IMAGE_STATUS_OK, or STP_IMAGE_STATUS_ABORT as for
+   * get_row().
+   */
+  stp_image_status_t (*skip_rows)(struct stp_image *image, int row,
+				  int count);
+} stp_image_row_funcs_t;
+
+/**
+ * Register optional callbacks for an image.  The callbacks are copied,
+ * and stay registered until this is called again for the same image.
+ * Pass NULL to remove them, which must be done before the image is
+ * freed or reused for a different image.
+ * @param image the image.
+ * @param funcs the callbacks, with size set; or NULL.
+ */
+extern void stp_image_set_row_funcs(stp_image_t *image,
+				    const stp_image_row_funcs_t *funcs);
+
 extern void stp_image_init(stp_image_t *image);
 extern void stp_image_reset(stp_image_t *image);
 extern int stp_image_width(stp_image_t *image);
@@ -131,6 +202,12 @@ extern int stp_image_height(stp_image_t *image);
 extern stp_image_status_t stp_image_get_row(stp_image_t *image,
 					    unsigned char *data,
 					    size_t limit, int row);
+extern const unsigned char *stp_image_lend_row(stp_image_t *image,
+					       size_t limit, int row);
+extern void stp_image_release_row(stp_image_t *image,
+				  const unsigned char *data, int row);
+extern stp_image_status_t stp_image_skip_rows(stp_image_t *image,
+					      int row, int count);
 extern const char *stp_image_get_appname(stp_image_t *image);
 extern void stp_image_conclude(stp_image_t *image);
 
@@ -45,7 +45,7 @@ extern "C" {
  * remove, iterate over the list, copy whole lists), plus some
  * (optional) less common features: finding items by index, name or
  * long name, and sorting.  These should also be fairly fast, due to
- * caching in the list head.
+ * caching and (for names) hashing in the list head.
  *
  * @defgroup list list
  * @{
@@ -321,6 +321,8 @@ extern "C" {
    * Set the data associated with a list item.
    * @warning Note that if a sortfunc is in use, changing the data
    * will NOT re-sort the list!
+   * @warning The old data must still be valid when this is called,
+   * since its names are needed to update the name indexes.
    * @param item the list item to use.
    * @param data the data to set.
    * @returns 0 on success, 1 on failure (if data is NULL).
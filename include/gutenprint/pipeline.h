@@ -0,0 +1,99 @@
+/*
+ * "$Id$"
+ *
+ *   libgimpprint header.
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Revision History:
+ *
+ *   See ChangeLog
+ */
+
+/**
+ * @file gutenprint/pipeline.h
+ * @brief Row pipeline functions.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ */
+
+#ifndef GUTENPRINT_PIPELINE_H
+#define GUTENPRINT_PIPELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The row pipeline drives the color conversion, dithering, and
+ * output of each printed row.  When the RenderThreads parameter is
+ * greater than 1 (and the library was built with thread support),
+ * color conversion and dithering run in their own threads, several
+ * rows ahead of the output stage.  The output is identical either way.
+ *
+ * When the color conversion runs in its own thread, the image's
+ * get_row(), lend_row(), release_row() and skip_rows() callbacks are
+ * called from that thread rather than from the thread that called
+ * stp_row_pipeline_run() (or stp_print()).  They are never called from
+ * two threads at once, but they must not rely on thread-local state,
+ * and must not touch anything the application changes while the page
+ * is printing without locking it.
+ *
+ * @defgroup pipeline pipeline
+ * @{
+ */
+
+typedef struct
+{
+  /** Number of rows to print; input rows are scaled to this height */
+  int out_height;
+  /**
+   * Optional; returns the dither mask for a row, or NULL.  Called
+   * from the dithering stage, so it must not use any state touched
+   * by writefunc.
+   */
+  const unsigned char *(*maskfunc)(stp_vars_t *v, int row, void *data);
+  /**
+   * Writes out one dithered row.  Always called from the thread that
+   * called stp_row_pipeline_run(), in row order, with the row in the
+   * buffers the driver registered with stp_dither_add_channel().
+   */
+  void (*writefunc)(stp_vars_t *v, int row, void *data);
+  void *data;
+} stp_row_pipeline_t;
+
+/**
+ * Color convert, dither, and write out an image.
+ * stp_color_init() and stp_dither_init() must have been called.
+ * @param v the vars to use.
+ * @param image the image to print.
+ * @param pipeline the driver's callbacks.
+ * @returns 0 on success, nonzero if the image could not be read.
+ */
+extern int stp_row_pipeline_run(stp_vars_t *v, stp_image_t *image,
+				const stp_row_pipeline_t *pipeline);
+
+/** @} */
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif /* GUTENPRINT_PIPELINE_H */
@@ -52,6 +52,16 @@ extern "C" {
  * This function must be called prior to any other use of the library.
  * It is responsible for loading modules and XML data and initialising
  * internal data structures.
+ *
+ * The library may be used by several threads at once, each printing
+ * with its own stp_vars_t (a stp_vars_t and the images and output
+ * functions attached to it must only be used by one thread at a time).
+ * Printer, paper and other data shared between jobs is loaded once,
+ * on first use, and never changes afterwards.  stp_init() may itself
+ * be called from any thread; the first call does the work.  The
+ * library does not change the process locale; where the system
+ * supports it, it switches only the calling thread to the C locale
+ * while it reads and writes numbers in XML data.
  * @returns 0 on success, 1 on failure.
  */
 extern int stp_init(void);
@@ -98,6 +108,48 @@ extern void stp_putraw(const stp_raw_t *r, const stp_vars_t *v);
 extern void stp_send_command(const stp_vars_t *v, const char *command,
 			     const char *format, ...);
 
+/*
+ * A command built up a piece at a time in a buffer on the caller's
+ * stack, and written out in one piece by stp_command_end().  Nothing
+ * is allocated, so it's suitable for commands sent for every row or
+ * pass.  Anything that doesn't fit in the buffer (such as the raster
+ * data following a command) is written out as it's added, after what
+ * is already in the buffer.
+ */
+#define STP_COMMAND_BUFFER_SIZE 128
+
+typedef struct
+{
+  const stp_vars_t *v;
+  size_t bytes;
+  char data[STP_COMMAND_BUFFER_SIZE];
+} stp_command_t;
+
+extern void stp_command_start(stp_command_t *cmd, const stp_vars_t *v);
+extern void stp_command_write(stp_command_t *cmd, const char *buf,
+			      size_t bytes);
+extern void stp_command_putc(stp_command_t *cmd, int ch);
+extern void stp_command_puts(stp_command_t *cmd, const char *s);
+extern void stp_command_put_int(stp_command_t *cmd, int value);
+extern void stp_command_put16_le(stp_command_t *cmd, unsigned short sh);
+extern void stp_command_put16_be(stp_command_t *cmd, unsigned short sh);
+extern void stp_command_put32_le(stp_command_t *cmd, unsigned int in);
+extern void stp_command_put32_be(stp_command_t *cmd, unsigned int in);
+extern void stp_command_end(stp_command_t *cmd);
+
+/*
+ * While a job is being printed, output written by the functions above is
+ * buffered and passed to the output function in larger blocks.  The
+ * buffer is flushed when stp_start_job(), stp_print() and stp_end_job()
+ * return; stp_flush_output() flushes it at any other time.
+ * stp_get_output_statistics() returns the number of calls made to the
+ * output function, and the number of bytes passed to it, since
+ * stp_start_job() (or since the first page if it was not called).
+ */
+extern void stp_flush_output(const stp_vars_t *v);
+extern void stp_get_output_statistics(const stp_vars_t *v, size_t *calls,
+				      size_t *bytes);
+
 extern void stp_erputc(int ch);
 
 extern void stp_eprintf(const stp_vars_t *v, const char *format, ...)
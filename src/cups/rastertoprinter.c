@@ -26,6 +26,8 @@
  *   cancel_job()              - Cancel the current job...
  *   Image_get_appname()       - Get the application we are running.
  *   Image_get_row()           - Get one row of the image.
+ *   Image_lend_row()          - Lend Gutenprint a row of the image.
+ *   Image_skip_rows()         - Read past rows that won't be printed.
  *   Image_height()            - Return the height of an image.
  *   Image_init()              - Initialize an image.
  *   Image_conclude()          - Close the progress display.
@@ -96,6 +98,9 @@ typedef struct
   int			adjusted_height;
   int			last_percent;
   int			shrink_to_fit;
+  unsigned char		*line;		/* Whole raster line, for lending rows */
+  unsigned		line_size;
+  int			line_row;	/* Row in line, or -1 */
   CUPS_HEADER_T		header;		/* Page header from file */
 } cups_image_t;
 
@@ -106,6 +111,10 @@ static const char *Image_get_appname(stp_image_t *image);
 static stp_image_status_t Image_get_row(stp_image_t *image,
 					unsigned char *data,
 					size_t byte_limit, int row);
+static const unsigned char *Image_lend_row(stp_image_t *image,
+					   size_t byte_limit, int row);
+static stp_image_status_t Image_skip_rows(stp_image_t *image,
+					  int row, int count);
 static int	Image_height(stp_image_t *image);
 static int	Image_width(stp_image_t *image);
 static void	Image_conclude(stp_image_t *image);
@@ -123,6 +132,14 @@ static stp_image_t theImage =
   NULL
 };
 
+static const stp_image_row_funcs_t theRowFuncs =
+{
+  sizeof(stp_image_row_funcs_t),
+  Image_lend_row,
+  NULL,				/* release_row */
+  Image_skip_rows
+};
+
 static volatile stp_image_status_t Image_status = STP_IMAGE_STATUS_OK;
 static double total_bytes_printed = 0;
 static int print_messages_as_errors = 0;
@@ -1125,6 +1142,7 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   (void) gettimeofday(&t1, &tz);
   stp_init();
+  stp_image_set_row_funcs(&theImage, &theRowFuncs);
   version_id = stp_get_version();
   release_version_id = stp_get_release_version();
   default_settings = stp_vars_create();
@@ -1310,6 +1328,8 @@ main(int  argc,				/* I - Number of command-line arguments */
   */
 
   cups.page = 0;
+  cups.line = NULL;
+  cups.line_size = 0;
 
   if (! suppress_messages)
     fprintf(stderr, "DEBUG: Gutenprint: About to start printing loop.\n");
@@ -1358,6 +1378,7 @@ main(int  argc,				/* I - Number of command-line arguments */
       stp_merge_printvars(v, stp_printer_get_defaults(printer));
       stp_set_int_parameter(v, "PageNumber", cups.page);
       cups.row = 0;
+      cups.line_row = -1;
       if (! suppress_messages)
 	print_debug_block(v, &cups);
       print_messages_as_errors = 1;
@@ -1402,9 +1423,19 @@ main(int  argc,				/* I - Number of command-line arguments */
 		aborted ? "Aborted" : "Ending");
       stp_end_job(v, &theImage);
       fflush(stdout);
+      if (! suppress_messages)
+	{
+	  size_t calls, bytes;
+	  stp_get_output_statistics(v, &calls, &bytes);
+	  fprintf(stderr, "DEBUG: Gutenprint: output %lu bytes in %lu writes\n",
+		  (unsigned long) bytes, (unsigned long) calls);
+	}
       stp_vars_destroy(v);
     }
   cupsRasterClose(cups.ras);
+  stp_image_set_row_funcs(&theImage, NULL);
+  if (cups.line)
+    stp_free(cups.line);
   (void) times(&tms);
   (void) gettimeofday(&t2, &tz);
   clocks_per_sec = sysconf(_SC_CLK_TCK);
@@ -1511,6 +1542,22 @@ throwaway_data(int amount, cups_image_t *cups)
     cupsRasterReadPixels(cups->ras, trash, leftover);
 }
 
+static void
+report_progress(cups_image_t *cups)
+{
+  int new_percent = (int) (100.0 * cups->row / cups->header.cupsHeight);
+  if (new_percent > cups->last_percent)
+    {
+      if (! suppress_messages)
+	{
+	  stp_i18n_printf(po, _("INFO: Printing page %d, %d%%\n"),
+			  cups->page + 1, new_percent);
+	  fprintf(stderr, "ATTR: job-media-progress=%d\n", new_percent);
+	}
+      cups->last_percent = new_percent;
+    }
+}
+
 static stp_image_status_t
 Image_get_row(stp_image_t   *image,	/* I - Image */
 	      unsigned char *data,	/* O - Row */
@@ -1524,7 +1571,6 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
   stp_image_status_t tmp_image_status = Image_status;
   unsigned char *orig = data;           /* Temporary pointer */
   static int warned = 0;                /* Error warning printed? */
-  int new_percent;
   int left_margin, right_margin;
 
   if ((cups = (cups_image_t *)(image->rep)) == NULL)
@@ -1615,17 +1661,7 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
 	}
     }
 
-  new_percent = (int) (100.0 * cups->row / cups->header.cupsHeight);
-  if (new_percent > cups->last_percent)
-    {
-      if (! suppress_messages)
-	{
-	  stp_i18n_printf(po, _("INFO: Printing page %d, %d%%\n"),
-			  cups->page + 1, new_percent);
-	  fprintf(stderr, "ATTR: job-media-progress=%d\n", new_percent);
-	}
-      cups->last_percent = new_percent;
-    }
+  report_progress(cups);
 
   if (tmp_image_status != STP_IMAGE_STATUS_OK)
     {
@@ -1635,6 +1671,102 @@ Image_get_row(stp_image_t   *image,	/* I - Image */
   return tmp_image_status;
 }
 
+/*
+ * Read whole raster lines into the line buffer until row rows have
+ * been read or the page runs out, leaving the last of them there.
+ */
+
+static void
+read_lines(cups_image_t *cups, int rows)
+{
+  if (cups->line_size < cups->header.cupsBytesPerLine)
+    {
+      stp_free(cups->line);
+      cups->line_size = cups->header.cupsBytesPerLine;
+      cups->line = stp_malloc(cups->line_size);
+    }
+  while (cups->row < rows && cups->row < cups->header.cupsHeight)
+    {
+      cupsRasterReadPixels(cups->ras, cups->line,
+			   cups->header.cupsBytesPerLine);
+      cups->row ++;
+    }
+  cups->line_row = cups->row - 1;
+}
+
+/*
+ * 'Image_lend_row()' - Read a whole raster line, margins and all, and
+ *                      pass the part that's printed to Gutenprint as it
+ *                      is, rather than reading it a piece at a time and
+ *                      having it copied.
+ */
+
+static const unsigned char *
+Image_lend_row(stp_image_t *image,	/* I - Image */
+	       size_t	   byte_limit,	/* I - how many bytes in the row */
+	       int         row)		/* I - Row number */
+{
+  cups_image_t	*cups;			/* CUPS image */
+  int		left_margin;
+
+  if ((cups = (cups_image_t *)(image->rep)) == NULL ||
+      Image_status != STP_IMAGE_STATUS_OK ||
+      cups->header.cupsBitsPerPixel == 1)
+    return NULL;		/* Let Image_get_row() deal with it */
+  left_margin = ((cups->left_trim * cups->header.cupsBitsPerPixel) + CHAR_BIT - 1) /
+    CHAR_BIT;
+
+  /*
+   * A row that has already been read is whatever was read last, which
+   * is only here if it was lent rather than copied.
+   */
+  if (cups->row > row)
+    {
+      if (cups->line_row == cups->row - 1)
+	return cups->line + left_margin;
+      else
+	return NULL;
+    }
+  if (cups->row >= cups->header.cupsHeight)
+    return NULL;
+
+  if (! suppress_messages && ! suppress_verbose_messages)
+    fprintf(stderr, "DEBUG2: Gutenprint: Reading %u %d\n",
+	    cups->header.cupsBytesPerLine, cups->row);
+  read_lines(cups, row + 1);
+  report_progress(cups);
+  return cups->line + left_margin;
+}
+
+
+/*
+ * 'Image_skip_rows()' - Read past rows that Gutenprint won't ask for.
+ *
+ * The raster stream can't be seeked, but each row can at least be read
+ * whole in one go, rather than piecewise around the margins the next
+ * time a row is requested.
+ */
+
+static stp_image_status_t
+Image_skip_rows(stp_image_t *image,	/* I - Image */
+		int         row,	/* I - First row skipped */
+		int         count)	/* I - Number of rows skipped */
+{
+  cups_image_t	*cups;			/* CUPS image */
+
+  if ((cups = (cups_image_t *)(image->rep)) == NULL)
+    return STP_IMAGE_STATUS_ABORT;
+  if (cups->row < row + count && cups->row < cups->header.cupsHeight)
+    {
+      if (! suppress_messages && ! suppress_verbose_messages)
+	fprintf(stderr, "DEBUG2: Gutenprint: Skipping %d rows at %d\n",
+		row + count - cups->row, cups->row);
+      read_lines(cups, row + count);
+      report_progress(cups);
+    }
+  return Image_status;
+}
+
 
 /*
  * 'Image_height()' - Return the height of an image.
@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
 #include <locale.h>
 #include <ijs.h>
 #include <ijs_server.h>
@@ -922,19 +923,21 @@ gutenprint_image_height(stp_image_t *image)
   return img->height * img->xres / img->yres;
 }
 
-static void
+static int
 throwaway_data(int amount, IMAGE *img)
 {
   char trash[4096];	/* Throwaway */
   int block_count = amount / 4096;
   int leftover = amount % 4096;
-  while (block_count > 0)
+  int status = 0;
+  while (block_count > 0 && !status)
     {
-      ijs_server_get_data(img->ctx, trash, 4096);
+      status = ijs_server_get_data(img->ctx, trash, 4096);
       block_count--;
     }
-  if (leftover)
-    ijs_server_get_data(img->ctx, trash, leftover);
+  if (leftover && !status)
+    status = ijs_server_get_data(img->ctx, trash, leftover);
+  return status;
 }
 
 static int
@@ -972,22 +975,63 @@ image_next_row(IMAGE *img)
   return status;
 }
 
-static stp_image_status_t
-gutenprint_image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
-		   int row)
+static int
+image_seek_row(IMAGE *img, int physical_row)
 {
-  IMAGE *img = (IMAGE *)(image->rep);
-  int physical_row = row * img->yres / img->xres;
-
   if ((physical_row < 0) || (physical_row >= img->height))
-    return STP_IMAGE_STATUS_ABORT;
+    return 1;
 
   /* Read until we reach the requested row. */
   while (physical_row > img->row)
     {
       if (image_next_row(img))
-	return STP_IMAGE_STATUS_ABORT;
+	return 1;
+    }
+  return 0;
+}
+
+/*
+ * Discard the rows before physical_row that haven't been read yet,
+ * reading them as a block rather than row by row.  A short last row
+ * is left to image_next_row().
+ */
+static int
+image_skip_to_row(IMAGE *img, int physical_row)
+{
+  int row_bytes = img->left_margin + img->row_width + img->right_margin;
+  int rows = physical_row - img->row - 1;
+  while (rows > 0 && img->bytes_left >= row_bytes)
+    {
+      int n = rows;
+      int status;
+      if (n > img->bytes_left / row_bytes)
+	n = (int) (img->bytes_left / row_bytes);
+      if (n > INT_MAX / row_bytes)
+	n = INT_MAX / row_bytes;
+      status = throwaway_data(n * row_bytes, img);
+      if (status)
+	{
+	  STP_DEBUG(fprintf(stderr, "ERROR: ijsgutenprint: page aborted (%d) at line %d!\n",
+			    status, img->row));
+	  job_aborted = 1;
+	  return status;
+	}
+      img->row += n;
+      img->bytes_left -= (double) n * row_bytes;
+      rows -= n;
     }
+  return 0;
+}
+
+static stp_image_status_t
+gutenprint_image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+		   int row)
+{
+  IMAGE *img = (IMAGE *)(image->rep);
+  int physical_row = row * img->yres / img->xres;
+
+  if (image_seek_row(img, physical_row))
+    return STP_IMAGE_STATUS_ABORT;
 
   if (physical_row == img->row)
     {
@@ -1028,6 +1072,37 @@ gutenprint_image_get_row(stp_image_t *image, unsigned char *data, size_t byte_li
   return STP_IMAGE_STATUS_OK;
 }
 
+/*
+ * 8 and 16 bit rows are passed to Gutenprint as they were read, so
+ * there's no need to copy them.  The row buffer isn't reused until the
+ * next row is read.
+ */
+static const unsigned char *
+gutenprint_image_lend_row(stp_image_t *image, size_t byte_limit, int row)
+{
+  IMAGE *img = (IMAGE *)(image->rep);
+  int physical_row = row * img->yres / img->xres;
+
+  if (img->bps != 8 && img->bps != 16)
+    return NULL;
+  if (image_seek_row(img, physical_row) || physical_row != img->row)
+    return NULL;
+  return (const unsigned char *) img->row_buf;
+}
+
+static stp_image_status_t
+gutenprint_image_skip_rows(stp_image_t *image, int row, int count)
+{
+  IMAGE *img = (IMAGE *)(image->rep);
+  int physical_row = (row + count) * img->yres / img->xres;
+
+  if (physical_row > img->height)
+    physical_row = img->height;
+  if (image_skip_to_row(img, physical_row))
+    return STP_IMAGE_STATUS_ABORT;
+  return STP_IMAGE_STATUS_OK;
+}
+
 
 static const char *
 gutenprint_image_get_appname(stp_image_t *image)
@@ -1242,6 +1317,7 @@ main (int argc, char **argv)
   int page = 0;
   IMAGE img;
   stp_image_t si;
+  stp_image_row_funcs_t si_funcs;
   const stp_printer_t *printer = NULL;
   FILE *f = NULL;
   int l, t, r, b, w, h;
@@ -1287,6 +1363,11 @@ main (int argc, char **argv)
   si.get_row = gutenprint_image_get_row;
   si.get_appname = gutenprint_image_get_appname;
   si.rep = &img;
+  memset(&si_funcs, 0, sizeof(si_funcs));
+  si_funcs.size = sizeof(si_funcs);
+  si_funcs.lend_row = gutenprint_image_lend_row;
+  si_funcs.skip_rows = gutenprint_image_skip_rows;
+  stp_image_set_row_funcs(&si, &si_funcs);
 
   ijs_server_install_status_cb (img.ctx, gutenprint_status_cb, &img);
   ijs_server_install_list_cb (img.ctx, gutenprint_list_cb, &img);
@@ -1554,6 +1635,7 @@ main (int argc, char **argv)
 	  page++;
 	}
     }
+  stp_image_set_row_funcs(&si, NULL);
   if (f)
     {
       fclose(f);
@@ -28,6 +28,7 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <stdlib.h>
 #include <string.h>
 #include <gutenprint/gutenprint.h>
 #include "gutenprint-internal.h"
@@ -1001,11 +1002,13 @@ stp_unpack(int length,
 	   const unsigned char *in,
 	   unsigned char **outs)
 {
-  unsigned char **touts;
+  unsigned char *stack_outs[16];
+  unsigned char **touts = stack_outs;
   int i;
   if (n < 2)
     return;
-  touts = stp_malloc(sizeof(unsigned char *) * n);
+  if (n > 16)
+    touts = stp_malloc(sizeof(unsigned char *) * n);
   for (i = 0; i < n; i++)
     touts[i] = outs[i];
   if (bits == 1)
@@ -1040,7 +1043,8 @@ stp_unpack(int length,
 	stpi_unpack_16_2(length, in, touts);
 	break;
       }
-  stp_free(touts);
+  if (touts != stack_outs)
+    stp_free(touts);
 }
 
 void
@@ -1139,29 +1143,259 @@ stp_unpack_16(int length,
   stp_unpack(length, bits, 16, in, outs);
 }
 
+/*
+ * Scanning loops for the packers below.  The plain C versions are always
+ * available; on x86 builds with a compiler that can target them there
+ * are also SSE2 and AVX2 versions, which compare 16 or 32 bytes at a
+ * time.  stpi_init_pack_kernels() picks the best set the CPU supports;
+ * setting STP_PACK_KERNELS to the name of a set ("scalar", "sse2" or
+ * "avx2") overrides the choice.
+ */
+typedef struct
+{
+  const char *name;
+  /* First byte in [p, end) that isn't c, or end */
+  const unsigned char *(*skip_byte)(const unsigned char *p,
+				    const unsigned char *end,
+				    unsigned char c);
+  /* Start of the run of c bytes that ends at end, which may be end */
+  const unsigned char *(*skip_byte_back)(const unsigned char *start,
+					 const unsigned char *end,
+					 unsigned char c);
+  /*
+   * First q in [p, end) where q[-2] == q[-1] == q[0], or end.  The two
+   * bytes before p must be readable.
+   */
+  const unsigned char *(*find_triple)(const unsigned char *p,
+				      const unsigned char *end);
+} pack_kernels_t;
+
+static const unsigned char *
+skip_byte_scalar(const unsigned char *p, const unsigned char *end,
+		 unsigned char c)
+{
+  while (p < end && *p == c)
+    p++;
+  return p;
+}
+
+static const unsigned char *
+skip_byte_back_scalar(const unsigned char *start, const unsigned char *end,
+		      unsigned char c)
+{
+  while (end > start && end[-1] == c)
+    end--;
+  return end;
+}
+
+static const unsigned char *
+find_triple_scalar(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && (p[-2] != p[-1] || p[-1] != p[0]))
+    p++;
+  return p;
+}
+
+static const pack_kernels_t scalar_pack_kernels =
+{
+  "scalar",
+  skip_byte_scalar,
+  skip_byte_back_scalar,
+  find_triple_scalar
+};
+
+#if (defined(__i386__) || defined(__x86_64__)) &&			\
+  (defined(__clang__) ||						\
+   (defined(__GNUC__) &&						\
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STPI_X86_PACK_KERNELS
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+SSE2 static const unsigned char *
+skip_byte_sse2(const unsigned char *p, const unsigned char *end,
+	       unsigned char c)
+{
+  __m128i vc = _mm_set1_epi8((char) c);
+  while (end - p >= 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) p);
+      unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc)) ^ 0xffffu;
+      if (mask)
+	return p + __builtin_ctz(mask);
+      p += 16;
+    }
+  return skip_byte_scalar(p, end, c);
+}
+
+SSE2 static const unsigned char *
+skip_byte_back_sse2(const unsigned char *start, const unsigned char *end,
+		    unsigned char c)
+{
+  __m128i vc = _mm_set1_epi8((char) c);
+  while (end - start >= 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (end - 16));
+      unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc)) ^ 0xffffu;
+      if (mask)
+	return end - __builtin_clz(mask) + 16;
+      end -= 16;
+    }
+  return skip_byte_back_scalar(start, end, c);
+}
+
+SSE2 static const unsigned char *
+find_triple_sse2(const unsigned char *p, const unsigned char *end)
+{
+  while (end - p >= 16)
+    {
+      __m128i v0 = _mm_loadu_si128((const __m128i *) (p - 2));
+      __m128i v1 = _mm_loadu_si128((const __m128i *) (p - 1));
+      __m128i v2 = _mm_loadu_si128((const __m128i *) p);
+      unsigned mask =
+	_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, v1),
+					_mm_cmpeq_epi8(v1, v2)));
+      if (mask)
+	return p + __builtin_ctz(mask);
+      p += 16;
+    }
+  return find_triple_scalar(p, end);
+}
+
+static const pack_kernels_t sse2_pack_kernels =
+{
+  "sse2",
+  skip_byte_sse2,
+  skip_byte_back_sse2,
+  find_triple_sse2
+};
+
+AVX2 static const unsigned char *
+skip_byte_avx2(const unsigned char *p, const unsigned char *end,
+	       unsigned char c)
+{
+  __m256i vc = _mm256_set1_epi8((char) c);
+  while (end - p >= 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) p);
+      unsigned mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc));
+      if (mask)
+	return p + __builtin_ctz(mask);
+      p += 32;
+    }
+  return skip_byte_scalar(p, end, c);
+}
+
+AVX2 static const unsigned char *
+skip_byte_back_avx2(const unsigned char *start, const unsigned char *end,
+		    unsigned char c)
+{
+  __m256i vc = _mm256_set1_epi8((char) c);
+  while (end - start >= 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (end - 32));
+      unsigned mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc));
+      if (mask)
+	return end - __builtin_clz(mask);
+      end -= 32;
+    }
+  return skip_byte_back_scalar(start, end, c);
+}
+
+AVX2 static const unsigned char *
+find_triple_avx2(const unsigned char *p, const unsigned char *end)
+{
+  while (end - p >= 32)
+    {
+      __m256i v0 = _mm256_loadu_si256((const __m256i *) (p - 2));
+      __m256i v1 = _mm256_loadu_si256((const __m256i *) (p - 1));
+      __m256i v2 = _mm256_loadu_si256((const __m256i *) p);
+      unsigned mask =
+	_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v0, v1),
+					      _mm256_cmpeq_epi8(v1, v2)));
+      if (mask)
+	return p + __builtin_ctz(mask);
+      p += 32;
+    }
+  return find_triple_scalar(p, end);
+}
+
+static const pack_kernels_t avx2_pack_kernels =
+{
+  "avx2",
+  skip_byte_avx2,
+  skip_byte_back_avx2,
+  find_triple_avx2
+};
+
+#endif /* STPI_X86_PACK_KERNELS */
+
+static const pack_kernels_t *pack_kernels = &scalar_pack_kernels;
+
+static const pack_kernels_t *
+find_pack_kernels(const char *name)
+{
+  if (strcmp(name, scalar_pack_kernels.name) == 0)
+    return &scalar_pack_kernels;
+#ifdef STPI_X86_PACK_KERNELS
+  __builtin_cpu_init();
+  if (strcmp(name, sse2_pack_kernels.name) == 0 &&
+      __builtin_cpu_supports("sse2"))
+    return &sse2_pack_kernels;
+  if (strcmp(name, avx2_pack_kernels.name) == 0 &&
+      __builtin_cpu_supports("avx2"))
+    return &avx2_pack_kernels;
+#endif
+  return NULL;
+}
+
+int
+stpi_set_pack_kernels(const char *name)
+{
+  const pack_kernels_t *kernels = find_pack_kernels(name);
+  if (!kernels)
+    return 0;
+  pack_kernels = kernels;
+  return 1;
+}
+
+void
+stpi_init_pack_kernels(void)
+{
+  const char *name = getenv("STP_PACK_KERNELS");
+  if (!name || !stpi_set_pack_kernels(name))
+    if (!stpi_set_pack_kernels("avx2"))
+      (void) stpi_set_pack_kernels("sse2");
+  stp_deprintf(STP_DBG_WEAVE_PARAMS, "Using %s pack kernels\n",
+	       pack_kernels->name);
+}
+
+int
+stpi_line_is_blank(const unsigned char *line, int length)
+{
+  return pack_kernels->skip_byte(line, line + length, 0) == line + length;
+}
+
 static void
 find_first_and_last(const unsigned char *line, int length,
 		    int *first, int *last)
 {
-  int i;
-  int found_first = 0;
+  const unsigned char *end = line + length;
+  const unsigned char *nz_start;
+  const unsigned char *nz_end;
   if (!first || !last)
     return;
-  *first = 0;
-  *last = 0;
-  for (i = 0; i < length; i++)
+  nz_start = pack_kernels->skip_byte(line, end, 0);
+  if (nz_start == end)
     {
-      if (line[i] == 0)
-	{
-	  if (!found_first)
-	    (*first)++;
-	}
-      else
-	{
-	  *last = i;
-	  found_first = 1;
-	}
+      *first = length;
+      *last = 0;
+      return;
     }
+  nz_end = pack_kernels->skip_byte_back(nz_start, end, 0);
+  *first = nz_start - line;
+  *last = nz_end - line - 1;
 }
 
 int
@@ -1182,6 +1416,19 @@ stp_pack_uncompressed(stp_vars_t *v,
     return 1;
 }
 
+/*
+ * Compress using TIFF "packbits" run-length encoding.
+ *
+ * The line is split into alternating literal stretches and runs: a
+ * literal stretch ends where three equal bytes in a row begin, and the
+ * run takes every following byte that is equal to them.  Near the end
+ * of the line, the last one or two bytes always form a run of their
+ * own.  Runs and literals longer than 128 bytes are split.
+ *
+ * The first and last nonzero bytes are found along the way.  A literal
+ * stretch never holds three equal bytes in a row, so its first and last
+ * nonzero bytes are within two bytes of its ends.
+ */
 int
 stp_pack_tiff(stp_vars_t *v,
 	      const unsigned char *line,
@@ -1191,97 +1438,82 @@ stp_pack_tiff(stp_vars_t *v,
 	      int *first,
 	      int *last)
 {
-  const unsigned char *start;		/* Start of compressed data */
-  unsigned char repeat;			/* Repeating char */
-  int count;			/* Count of compressed bytes */
-  int tcount;			/* Temporary count < 128 */
-  register const unsigned char *xline = line;
-  register int xlength = length;
-  find_first_and_last(line, length, first, last);
-
-  /*
-   * Compress using TIFF "packbits" run-length encoding...
-   */
-
-  (*comp_ptr) = comp_buf;
-
-  while (xlength > 0)
+  const pack_kernels_t *kernels = pack_kernels;
+  const unsigned char *end = line + length;
+  const unsigned char *xline = line;
+  const unsigned char *first_nz = NULL;
+  const unsigned char *last_nz = NULL;
+  unsigned char *out = comp_buf;
+
+  while (xline < end)
     {
+      const unsigned char *literal_end = xline;
+      const unsigned char *run_end;
+      unsigned char repeat;
+      int count;
+      int tcount;
+
       /*
-       * Get a run of non-repeated chars...
+       * Get a run of non-repeated chars, and output it (max 128 at a
+       * time).
        */
-
-      start  = xline;
-      xline   += 2;
-      xlength -= 2;
-
-      while (xlength > 0 && (xline[-2] != xline[-1] || xline[-1] != xline[0]))
+      if (end - xline > 2)
+	literal_end = kernels->find_triple(xline + 2, end) - 2;
+      if (literal_end > xline)
 	{
-	  xline ++;
-	  xlength --;
+	  const unsigned char *p;
+	  if (!first_nz)
+	    {
+	      for (p = xline; p < literal_end && *p == 0; p++)
+		;
+	      if (p < literal_end)
+		first_nz = p;
+	    }
+	  for (p = literal_end; p > xline && p[-1] == 0; p--)
+	    ;
+	  if (p > xline)
+	    last_nz = p - 1;
 	}
-
-      xline   -= 2;
-      xlength += 2;
-
-      /*
-       * Output the non-repeated sequences (max 128 at a time).
-       */
-
-      count = xline - start;
+      count = literal_end - xline;
       while (count > 0)
 	{
 	  tcount = count > 128 ? 128 : count;
-
-	  (*comp_ptr)[0] = tcount - 1;
-	  memcpy((*comp_ptr) + 1, start, tcount);
-
-	  (*comp_ptr) += tcount + 1;
-	  start    += tcount;
-	  count    -= tcount;
+	  out[0] = tcount - 1;
+	  memcpy(out + 1, xline, tcount);
+	  out += tcount + 1;
+	  xline += tcount;
+	  count -= tcount;
 	}
 
-      if (xlength <= 0)
-	break;
-
       /*
-       * Find the repeated sequences...
+       * Find the repeated sequence, and output it (max 128 at a time).
        */
-
-      start  = xline;
-      repeat = xline[0];
-
-      xline ++;
-      xlength --;
-
-      if (xlength > 0)
+      repeat = *xline;
+      run_end = kernels->skip_byte(xline + 1, end, repeat);
+      if (repeat)
 	{
-	  int ylength = xlength;
-	  while (ylength && *xline == repeat)
-	    {
-	      xline ++;
-	      ylength --;
-	    }
-	  xlength = ylength;
+	  if (!first_nz)
+	    first_nz = xline;
+	  last_nz = run_end - 1;
 	}
-
-      /*
-       * Output the repeated sequences (max 128 at a time).
-       */
-
-      count = xline - start;
+      count = run_end - xline;
       while (count > 0)
 	{
 	  tcount = count > 128 ? 128 : count;
-
-	  (*comp_ptr)[0] = 1 - tcount;
-	  (*comp_ptr)[1] = repeat;
-
-	  (*comp_ptr) += 2;
-	  count    -= tcount;
+	  out[0] = 1 - tcount;
+	  out[1] = repeat;
+	  out += 2;
+	  count -= tcount;
 	}
+      xline = run_end;
     }
-  if (first && last && *first > *last)
+  *comp_ptr = out;
+
+  if (!first || !last)
+    return 1;
+  *first = first_nz ? first_nz - line : length;
+  *last = last_nz ? last_nz - line : 0;
+  if (*first > *last)
     return 0;
   else
     return 1;
@@ -29,6 +29,7 @@ struct buffered_image_priv
 	stp_image_t* image;
 	unsigned char** buf;
 	unsigned int flags;
+	stp_image_status_t status;
 };
 
 static void
@@ -62,45 +63,71 @@ buffered_image_get_appname(stp_image_t *image)
 }
 
 
+/* Reverse the order of the pixels in a row */
+static void
+mirror_row(unsigned char *row, int width, int bytes_per_pixel)
+{
+	unsigned char tmp[STP_CHANNEL_LIMIT * 2];
+	unsigned char *left = row;
+	unsigned char *right = row + (width - 1) * bytes_per_pixel;
+	while(left < right){
+		memcpy(tmp, left, bytes_per_pixel);
+		memcpy(left, right, bytes_per_pixel);
+		memcpy(right, tmp, bytes_per_pixel);
+		left += bytes_per_pixel;
+		right -= bytes_per_pixel;
+	}
+}
+
+/*
+ * Read the whole image the first time a row is wanted.  Rows are
+ * mirrored as they're read, so that they can be used as they are.
+ */
 static stp_image_status_t
-buffered_image_get_row(stp_image_t* image,unsigned char *data, size_t byte_limit, int row)
+buffered_image_fill(stp_image_t* image, size_t byte_limit)
 {
 	struct buffered_image_priv *priv = image->rep;
 	int width = buffered_image_width(image);
 	int height = buffered_image_height(image);
 	/* FIXME this will break with padding bytes */
 	int bytes_per_pixel = byte_limit / width;
-	int inc = bytes_per_pixel;
-	unsigned char* src;
 	int i;
-	/* fill buffer */
+	if(priv->buf)
+		return priv->status;
+	priv->buf = stp_zalloc((sizeof(unsigned short*) + 1) * height);
 	if(!priv->buf){
-		priv->buf = stp_zalloc((sizeof(unsigned short*) + 1) * height);
-		if(!priv->buf){
-			return STP_IMAGE_STATUS_ABORT;
-		}
-		for(i=0;i<height;i++){
-			priv->buf[i] = stp_malloc(byte_limit);
-			if(STP_IMAGE_STATUS_OK != priv->image->get_row(priv->image,priv->buf[i],byte_limit,i))
-				return STP_IMAGE_STATUS_ABORT;
-		}
+		return STP_IMAGE_STATUS_ABORT;
 	}
-	if(priv->flags & BUFFER_FLAG_FLIP_Y)
-		row = height - row - 1;
-
-	src = priv->buf[row];
-
-	if(priv->flags & BUFFER_FLAG_FLIP_X){
-		src += byte_limit - bytes_per_pixel;
-		inc = -bytes_per_pixel;
+	for(i=0;i<height;i++){
+		priv->buf[i] = stp_malloc(byte_limit);
+		priv->status = priv->image->get_row(priv->image,priv->buf[i],byte_limit,i);
+		if(STP_IMAGE_STATUS_OK != priv->status)
+			return priv->status;
+		if(priv->flags & BUFFER_FLAG_FLIP_X)
+			mirror_row(priv->buf[i], width, bytes_per_pixel);
 	}
+	return STP_IMAGE_STATUS_OK;
+}
 
-	/* copy data */
-	for( i = 0 ; i < width ; i++){
-		memcpy(data,src,bytes_per_pixel);
-		src += inc;
-		data += bytes_per_pixel;
-	}
+static const unsigned char *
+buffered_image_lend_row(stp_image_t* image, size_t byte_limit, int row)
+{
+	struct buffered_image_priv *priv = image->rep;
+	/* fill buffer */
+	if(STP_IMAGE_STATUS_OK != buffered_image_fill(image, byte_limit))
+		return NULL;
+	if(priv->flags & BUFFER_FLAG_FLIP_Y)
+		row = buffered_image_height(image) - row - 1;
+	return priv->buf[row];
+}
+
+static stp_image_status_t
+buffered_image_get_row(stp_image_t* image,unsigned char *data, size_t byte_limit, int row)
+{
+	const unsigned char *src = buffered_image_lend_row(image, byte_limit, row);
+	if(!src)
+		return STP_IMAGE_STATUS_ABORT;
+	memcpy(data, src, byte_limit);
 	return STP_IMAGE_STATUS_OK;
 }
 
@@ -120,6 +147,7 @@ buffered_image_conclude(stp_image_t * image)
 	if(priv->image->conclude)
 		priv->image->conclude(priv->image);
 
+	stp_image_set_row_funcs(image, NULL);
 	stp_free(priv);
 	stp_free(image);
 }
@@ -128,6 +156,7 @@ stp_image_t*
 stpi_buffer_image(stp_image_t* image, unsigned int flags)
 {
 	struct buffered_image_priv *priv;
+	stp_image_row_funcs_t funcs;
 	stp_image_t* buffered_image = stp_zalloc(sizeof(stp_image_t));
 	if(!buffered_image){
 		return NULL;
@@ -148,6 +177,10 @@ stpi_buffer_image(stp_image_t* image, unsigned int flags)
 	priv->flags = flags;
 	if(image->get_appname)
 		buffered_image->get_appname = buffered_image_get_appname;
+	memset(&funcs, 0, sizeof(funcs));
+	funcs.size = sizeof(funcs);
+	funcs.lend_row = buffered_image_lend_row;
+	stp_image_set_row_funcs(buffered_image, &funcs);
 
 
 	return buffered_image;
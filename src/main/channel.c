@@ -91,6 +91,16 @@ typedef struct
   double cyan_balance;
   double magenta_balance;
   double yellow_balance;
+  /*
+   * The steps of stp_channel_convert(), and the GCR curve as a table,
+   * worked out once per page rather than on every row.
+   */
+  int special_channels;
+  int copy_channels;
+  int gcr;
+  int split;
+  int gloss;
+  const unsigned short *gcr_lookup;
 } stpi_channel_group_t;
 
 
@@ -102,6 +112,8 @@ get_channel_group(const stp_vars_t *v)
   return cg;
 }
 
+static void plan_conversion(stpi_channel_group_t *cg);
+
 static void
 clear_a_channel(stpi_channel_group_t *cg, int channel)
 {
@@ -136,6 +148,7 @@ stpi_channel_clear(void *vc)
       stp_curve_destroy(cg->gcr_curve);
       cg->gcr_curve = NULL;
     }
+  cg->gcr_lookup = NULL;
   cg->channel_count = 0;
   cg->curve_count = 0;
   cg->aux_output_channels = 0;
@@ -294,7 +307,10 @@ stp_channel_set_black_channel(stp_vars_t *v, int channel)
   stpi_channel_group_t *cg = get_channel_group(v);
   stp_dprintf(STP_DBG_INK, v, "black_channel %d\n", channel);
   if (cg)
-    cg->black_channel = channel;
+    {
+      cg->black_channel = channel;
+      plan_conversion(cg);
+    }
 }
 
 int
@@ -313,7 +329,10 @@ stp_channel_set_gloss_channel(stp_vars_t *v, int channel)
   stpi_channel_group_t *cg = get_channel_group(v);
   stp_dprintf(STP_DBG_INK, v, "gloss_channel %d\n", channel);
   if (cg)
-    cg->gloss_channel = channel;
+    {
+      cg->gloss_channel = channel;
+      plan_conversion(cg);
+    }
 }
 
 int
@@ -378,6 +397,7 @@ stp_channel_set_gcr_curve(stp_vars_t *v, const stp_curve_t *curve)
     cg->gcr_curve = stp_curve_create_copy(curve);
   else
     cg->gcr_curve = NULL;
+  plan_conversion(cg);
 }  
 
 const stp_curve_t *
@@ -423,34 +443,26 @@ stp_channel_get_curve(stp_vars_t *v, int color)
 }
 
 static int
-input_has_special_channels(const stp_vars_t *v)
+input_has_special_channels(const stpi_channel_group_t *cg)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
   return (cg->curve_count > 0);
 }
 
 static int
-output_needs_gcr(const stp_vars_t *v)
+output_needs_gcr(const stpi_channel_group_t *cg)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
   return (cg->gcr_curve && cg->black_channel == 0);
 }
 
 static int
-output_has_gloss(const stp_vars_t *v)
+output_has_gloss(const stpi_channel_group_t *cg)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
   return (cg->gloss_channel >= 0);
 }
 
 static int
-input_needs_splitting(const stp_vars_t *v)
+input_needs_splitting(const stpi_channel_group_t *cg)
 {
-  const stpi_channel_group_t *cg =
-    ((const stpi_channel_group_t *) stp_get_component_data(v, "Channel"));
 #if 0
   return cg->total_channels != cg->aux_output_channels;
 #else
@@ -465,6 +477,25 @@ input_needs_splitting(const stp_vars_t *v)
   return 0;
 #endif
 }
+
+static void
+plan_conversion(stpi_channel_group_t *cg)
+{
+  if (!cg->initialized)
+    return;
+  cg->special_channels = input_has_special_channels(cg);
+  cg->split = input_needs_splitting(cg);
+  cg->gloss = output_has_gloss(cg);
+  cg->copy_channels = !cg->special_channels && cg->gloss && !cg->split;
+  cg->gcr = output_needs_gcr(cg);
+  cg->gcr_lookup = NULL;
+  if (cg->gcr)
+    {
+      size_t count;
+      stp_curve_resample(cg->gcr_curve, 65536);
+      cg->gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
+    }
+}
   
 
 void
@@ -569,7 +600,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   if (curve_count == 0)
     {
       cg->gcr_channels = cg->input_channels;
-      if (input_needs_splitting(v))
+      if (input_needs_splitting(cg))
 	{
 	  cg->alloc_data_2 =
 	    stp_malloc(sizeof(unsigned short) * cg->input_channels * width);
@@ -597,7 +628,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
       cg->alloc_data_2 =
 	stp_malloc(sizeof(unsigned short) * cg->input_channels * width);
       cg->input_data = cg->alloc_data_2;
-      if (input_needs_splitting(v))
+      if (input_needs_splitting(cg))
 	{
 	  cg->alloc_data_3 =
 	    stp_malloc(sizeof(unsigned short) * cg->aux_output_channels * width);
@@ -616,6 +647,7 @@ stp_channel_initialize(stp_vars_t *v, stp_image_t *image,
   cg->cyan_balance = stp_get_float_parameter(v, "CyanBalance");
   cg->magenta_balance = stp_get_float_parameter(v, "MagentaBalance");
   cg->yellow_balance = stp_get_float_parameter(v, "YellowBalance");
+  plan_conversion(cg);
   stp_dprintf(STP_DBG_INK, v, "stp_channel_initialize:\n");
   stp_dprintf(STP_DBG_INK, v, "   channel_count  %d\n", cg->channel_count);
   stp_dprintf(STP_DBG_INK, v, "   total_channels %d\n", cg->total_channels);
@@ -731,11 +763,10 @@ ink_sum(const unsigned short *data, int total_channels)
 }
 
 static int
-limit_ink(const stp_vars_t *v)
+limit_ink(stpi_channel_group_t *cg)
 {
   int i;
   int retval = 0;
-  stpi_channel_group_t *cg = get_channel_group(v);
   unsigned short *ptr;
   if (!cg || cg->ink_limit == 0 || cg->ink_limit >= cg->max_density)
     return 0;
@@ -786,9 +817,8 @@ short_copy(unsigned short *out, const unsigned short *in, size_t count)
 }
 
 static void
-copy_channels(const stp_vars_t *v)
+copy_channels(stpi_channel_group_t *cg)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j, k;
   const unsigned short *input;
   unsigned short *output;
@@ -843,9 +873,8 @@ interpolate_value(const double *vec, double val)
 }
 
 static void
-generate_special_channels(const stp_vars_t *v)
+generate_special_channels(stpi_channel_group_t *cg)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j;
   const unsigned short *input_cache = NULL;
   const unsigned short *output_cache = NULL;
@@ -918,9 +947,8 @@ generate_special_channels(const stp_vars_t *v)
 }
 
 static void
-split_channels(const stp_vars_t *v, unsigned *zero_mask)
+split_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j, k;
   int nz[STP_CHANNEL_LIMIT];
   int outbytes;
@@ -1018,9 +1046,8 @@ split_channels(const stp_vars_t *v, unsigned *zero_mask)
 }
 
 static void
-scale_channels(const stp_vars_t *v, unsigned *zero_mask)
+scale_channels(stpi_channel_group_t *cg, unsigned *zero_mask)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   int i, j;
   int physical_channel = 0;
   if (!cg)
@@ -1063,9 +1090,8 @@ scale_channels(const stp_vars_t *v, unsigned *zero_mask)
 }
 
 static void
-generate_gloss(const stp_vars_t *v, unsigned *zero_mask)
+generate_gloss(stpi_channel_group_t *cg, unsigned *zero_mask)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
   unsigned short *output;
   unsigned gloss_mask;
   int i, j, k;
@@ -1107,20 +1133,12 @@ generate_gloss(const stp_vars_t *v, unsigned *zero_mask)
 }
 
 static void
-do_gcr(const stp_vars_t *v)
+do_gcr(stpi_channel_group_t *cg)
 {
-  stpi_channel_group_t *cg = get_channel_group(v);
-  const unsigned short *gcr_lookup;
-  unsigned short *output;
-  size_t count;
+  const unsigned short *gcr_lookup = cg->gcr_lookup;
+  unsigned short *output = cg->gcr_data;
   int i;
 
-  if (!cg)
-    return;
-
-  output = cg->gcr_data;
-  stp_curve_resample(cg->gcr_curve, 65536);
-  gcr_lookup = stp_curve_get_ushort_data(cg->gcr_curve, &count);
   for (i = 0; i < cg->width; i++)
     {
       unsigned k = output[0];
@@ -1143,18 +1161,22 @@ do_gcr(const stp_vars_t *v)
 void
 stp_channel_convert(const stp_vars_t *v, unsigned *zero_mask)
 {
-  if (input_has_special_channels(v))
-    generate_special_channels(v);
-  else if (output_has_gloss(v) && !input_needs_splitting(v))
-    copy_channels(v);
-  if (output_needs_gcr(v))
-    do_gcr(v);
-  if (input_needs_splitting(v))
-    split_channels(v, zero_mask);
+  stpi_channel_group_t *cg = get_channel_group(v);
+  if (!cg)
+    return;
+  if (cg->special_channels)
+    generate_special_channels(cg);
+  else if (cg->copy_channels)
+    copy_channels(cg);
+  if (cg->gcr)
+    do_gcr(cg);
+  if (cg->split)
+    split_channels(cg, zero_mask);
   else
-    scale_channels(v, zero_mask);
-  (void) limit_ink(v);
-  (void) generate_gloss(v, zero_mask);
+    scale_channels(cg, zero_mask);
+  (void) limit_ink(cg);
+  if (cg->gloss)
+    generate_gloss(cg, zero_mask);
 }
 
 unsigned short *
@@ -165,6 +165,8 @@ typedef struct
   unsigned short *gray_tmp;	/* Color -> Gray */
   unsigned short *cmy_tmp;	/* CMY -> CMYK */
   unsigned char *in_data;
+  int lattice_size;		/* Points per axis, 0 to compute exactly */
+  unsigned short *lattice;	/* RGB -> CMY, lattice_size^3 triples */
 } lut_t;
 
 extern unsigned stpi_color_convert_to_gray(const stp_vars_t *v,
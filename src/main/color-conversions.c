@@ -39,6 +39,7 @@
 #endif
 #include <string.h>
 #include "color-conversion.h"
+#include "color-kernels.h"
 
 #ifdef __GNUC__
 #define inline __inline__
@@ -339,6 +340,142 @@ lookup_rgb(lut_t *lut, unsigned short *rgbout,
     }
 }
 
+/*
+ * The full RGB -> CMY transform for one pixel; rgbout holds the input
+ * scaled to 16 bits on entry.
+ */
+static inline void
+color_transform(lut_t *lut, unsigned short *rgbout,
+		const unsigned short *contrast,
+		const unsigned short *brightness,
+		const unsigned short *red, const unsigned short *green,
+		const unsigned short *blue, unsigned steps,
+		double ssat, double isat, int compute_saturation,
+		int do_user_adjustment, int split_saturation,
+		int hue_only_color_adjustment, int bright_color_adjustment)
+{
+  lookup_rgb(lut, rgbout, contrast, contrast, contrast, steps);
+  if (compute_saturation)
+    update_saturation_from_rgb(rgbout, brightness, ssat, isat,
+			       do_user_adjustment);
+  adjust_hsl(rgbout, lut, ssat, isat, split_saturation,
+	     hue_only_color_adjustment, bright_color_adjustment);
+  lookup_rgb(lut, rgbout, red, green, blue, steps);
+}
+
+/*
+ * Precomputed color lattice.  The transform is evaluated exactly at
+ * lut->lattice_size points along each axis of the (16 bit) input cube,
+ * and everything in between is interpolated from the four corners of
+ * the enclosing tetrahedron, so the cost per pixel doesn't depend on
+ * which corrections are in effect.
+ */
+
+#define LATTICE_SCALE 65535u
+
+static void
+compute_lattice(lut_t *lut, const unsigned short *contrast,
+		const unsigned short *brightness,
+		const unsigned short *red, const unsigned short *green,
+		const unsigned short *blue, unsigned steps,
+		double ssat, double isat, int compute_saturation,
+		int do_user_adjustment, int split_saturation,
+		int hue_only_color_adjustment, int bright_color_adjustment)
+{
+  unsigned n = lut->lattice_size;
+  unsigned short *node;
+  unsigned r, g, b;
+  node = stp_malloc(n * n * n * 3 * sizeof(unsigned short));
+  lut->lattice = node;
+  for (r = 0; r < n; r++)
+    for (g = 0; g < n; g++)
+      for (b = 0; b < n; b++)
+	{
+	  node[0] = (r * LATTICE_SCALE + (n - 1) / 2) / (n - 1);
+	  node[1] = (g * LATTICE_SCALE + (n - 1) / 2) / (n - 1);
+	  node[2] = (b * LATTICE_SCALE + (n - 1) / 2) / (n - 1);
+	  color_transform(lut, node, contrast, brightness, red, green, blue,
+			  steps, ssat, isat, compute_saturation,
+			  do_user_adjustment, split_saturation,
+			  hue_only_color_adjustment, bright_color_adjustment);
+	  node += 3;
+	}
+}
+
+static inline void
+lattice_lookup(const lut_t *lut, unsigned short *rgbout)
+{
+  unsigned n = lut->lattice_size;
+  unsigned pos[3];
+  unsigned frac[3];
+  unsigned w[4];
+  size_t base = 0;
+  size_t s1, s2;
+  const size_t sr = 3 * n * n;
+  const size_t sg = 3 * n;
+  const size_t sb = 3;
+  const unsigned short *c0;
+  int i;
+  for (i = 0; i < 3; i++)
+    {
+      unsigned t = rgbout[i] * (n - 1);
+      pos[i] = t / LATTICE_SCALE;
+      frac[i] = t - pos[i] * LATTICE_SCALE;
+      if (pos[i] == n - 1)
+	{
+	  pos[i]--;
+	  frac[i] = LATTICE_SCALE;
+	}
+    }
+  base = pos[0] * sr + pos[1] * sg + pos[2] * sb;
+  c0 = lut->lattice + base;
+  /*
+   * Walk from the low corner to the high corner along the axes in
+   * decreasing order of the fractional position.
+   */
+  if (frac[0] >= frac[1])
+    {
+      if (frac[1] >= frac[2])
+	{
+	  s1 = sr; s2 = sr + sg;
+	  w[1] = frac[0] - frac[1]; w[2] = frac[1] - frac[2]; w[3] = frac[2];
+	}
+      else if (frac[0] >= frac[2])
+	{
+	  s1 = sr; s2 = sr + sb;
+	  w[1] = frac[0] - frac[2]; w[2] = frac[2] - frac[1]; w[3] = frac[1];
+	}
+      else
+	{
+	  s1 = sb; s2 = sb + sr;
+	  w[1] = frac[2] - frac[0]; w[2] = frac[0] - frac[1]; w[3] = frac[1];
+	}
+    }
+  else
+    {
+      if (frac[0] >= frac[2])
+	{
+	  s1 = sg; s2 = sg + sr;
+	  w[1] = frac[1] - frac[0]; w[2] = frac[0] - frac[2]; w[3] = frac[2];
+	}
+      else if (frac[1] >= frac[2])
+	{
+	  s1 = sg; s2 = sg + sb;
+	  w[1] = frac[1] - frac[2]; w[2] = frac[2] - frac[0]; w[3] = frac[0];
+	}
+      else
+	{
+	  s1 = sb; s2 = sb + sg;
+	  w[1] = frac[2] - frac[1]; w[2] = frac[1] - frac[0]; w[3] = frac[0];
+	}
+    }
+  w[0] = LATTICE_SCALE - w[1] - w[2] - w[3];
+  for (i = 0; i < 3; i++)
+    rgbout[i] = (c0[i] * w[0] + c0[s1 + i] * w[1] + c0[s2 + i] * w[2] +
+		 c0[sr + sg + sb + i] * w[3] + LATTICE_SCALE / 2) /
+      LATTICE_SCALE;
+}
+
 static inline int
 short_eq(const unsigned short *i1, const unsigned short *i2, size_t count)
 {
@@ -499,6 +636,11 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
     ssat = sqrt(ssat);							     \
   if (ssat > 1)								     \
     isat = 1.0 / ssat;							     \
+  if (lut->lattice_size && !lut->lattice)				     \
+    compute_lattice(lut, contrast, brightness, red, green, blue, 1 << bits,  \
+		    ssat, isat, compute_saturation, do_user_adjustment,	     \
+		    split_saturation, hue_only_color_adjustment,	     \
+		    bright_color_adjustment);				     \
   for (i = 0; i < lut->image_width; i++)				     \
     {									     \
       if (i0 == s_in[0] && i1 == s_in[1] && i2 == s_in[2])		     \
@@ -515,13 +657,14 @@ color_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,     \
 	  out[0] = i0 * (65535u / (unsigned) ((1 << bits) - 1));	     \
 	  out[1] = i1 * (65535u / (unsigned) ((1 << bits) - 1));	     \
 	  out[2] = i2 * (65535u / (unsigned) ((1 << bits) - 1));	     \
-	  lookup_rgb(lut, out, contrast, contrast, contrast, 1 << bits);     \
-	  if ((compute_saturation))					     \
-	    update_saturation_from_rgb(out, brightness, ssat, isat,	     \
-				       do_user_adjustment);		     \
-	  adjust_hsl(out, lut, ssat, isat, split_saturation,		     \
-		     hue_only_color_adjustment, bright_color_adjustment);    \
-	  lookup_rgb(lut, out, red, green, blue, 1 << bits);		     \
+	  if (lut->lattice)						     \
+	    lattice_lookup(lut, out);					     \
+	  else								     \
+	    color_transform(lut, out, contrast, brightness, red, green, blue, \
+			    1 << bits, ssat, isat, compute_saturation,	     \
+			    do_user_adjustment, split_saturation,	     \
+			    hue_only_color_adjustment,			     \
+			    bright_color_adjustment);			     \
 	  o0 = out[0];							     \
 	  o1 = out[1];							     \
 	  o2 = out[2];							     \
@@ -591,6 +734,16 @@ color_##bits##_to_color_fast(const stp_vars_t *vars, const unsigned char *in, \
   contrast =								      \
     stp_curve_cache_get_ushort_data(&(lut->contrast_correction));	      \
 									      \
+  if (!compute_saturation)						      \
+    {									      \
+      const unsigned short *tables[3];					      \
+      tables[0] = red;							      \
+      tables[1] = green;						      \
+      tables[2] = blue;							      \
+      return 7 ^ stpi_get_color_kernels()->lookup_##bits		      \
+	(in, out, lut->image_width, contrast, 1 << bits, tables);	      \
+    }									      \
+									      \
   if (saturation > 1)							      \
     isat = 1.0 / saturation;						      \
   for (i = 0; i < lut->image_width; i++)				      \
@@ -636,28 +789,13 @@ static unsigned								    \
 color_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
 			    unsigned short *out)			    \
 {									    \
-  int i;								    \
-  int j;								    \
-  int nz = 0;								    \
-  const T *s_in = (const T *) in;					    \
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
   unsigned mask = 0;							    \
   if (lut->invert_output)						    \
     mask = 0xffff;							    \
 									    \
-  for (i = 0; i < lut->image_width; i++)				    \
-    {									    \
-      unsigned bit = 1;							    \
-      for (j = 0; j < 3; j++, bit += bit)				    \
-	{								    \
-	  out[j] = (s_in[j] * (65535 / ((1 << bits) - 1))) ^ mask;	    \
-	  if (out[j])							    \
-	    nz |= bit;							    \
-	}								    \
-      s_in += 3;							    \
-      out += 3;								    \
-    }									    \
-  return nz;								    \
+  return stpi_get_color_kernels()->scale_##bits				    \
+    (in, out, 3 * lut->image_width, 3, 65535 / ((1 << bits) - 1), mask);    \
 }
 
 RAW_COLOR_TO_COLOR_FUNC(unsigned char, 8)
@@ -674,58 +812,25 @@ gray_##bits##_to_color(const stp_vars_t *vars, const unsigned char *in,	    \
 		   unsigned short *out)					    \
 {									    \
   int i;								    \
-  int i0 = -1;								    \
-  int o0 = 0;								    \
-  int o1 = 0;								    \
-  int o2 = 0;								    \
-  int nz0 = 0;								    \
-  int nz1 = 0;								    \
-  int nz2 = 0;								    \
-  const T *s_in = (const T *) in;					    \
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	    \
-  const unsigned short *red;						    \
-  const unsigned short *green;						    \
-  const unsigned short *blue;						    \
+  const unsigned short *tables[3];					    \
   const unsigned short *user;						    \
 									    \
   for (i = CHANNEL_C; i <= CHANNEL_Y; i++)				    \
     stp_curve_resample(lut->channel_curves[i].curve, 65536);		    \
   stp_curve_resample							    \
     (stp_curve_cache_get_curve(&(lut->user_color_correction)), 1 << bits);  \
-  red =									    \
+  tables[0] =								    \
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_C]));	    \
-  green =								    \
+  tables[1] =								    \
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_M]));	    \
-  blue =								    \
+  tables[2] =								    \
     stp_curve_cache_get_ushort_data(&(lut->channel_curves[CHANNEL_Y]));	    \
   user =								    \
     stp_curve_cache_get_ushort_data(&(lut->user_color_correction));	    \
 									    \
-  for (i = 0; i < lut->image_width; i++)				    \
-    {									    \
-      if (i0 == s_in[0])						    \
-	{								    \
-	  out[0] = o0;							    \
-	  out[1] = o1;							    \
-	  out[2] = o2;							    \
-	}								    \
-      else								    \
-	{								    \
-	  i0 = s_in[0];							    \
-	  out[0] = red[user[s_in[0]]];					    \
-	  out[1] = green[user[s_in[0]]];				    \
-	  out[2] = blue[user[s_in[0]]];					    \
-	  o0 = out[0];							    \
-	  o1 = out[1];							    \
-	  o2 = out[2];							    \
-	  nz0 |= o0;							    \
-	  nz1 |= o1;							    \
-	  nz2 |= o2;							    \
-	}								    \
-      s_in += 1;							    \
-      out += 3;								    \
-    }									    \
-  return (nz0 ? 0 : 1) +  (nz1 ? 0 : 2) +  (nz2 ? 0 : 4);		    \
+  return 7 ^ stpi_get_color_kernels()->gray_lookup_##bits		    \
+    (in, out, lut->image_width, user, 1 << bits, tables, 3);		    \
 }
 
 GRAY_TO_COLOR_FUNC(unsigned char, 8)
@@ -737,26 +842,13 @@ static unsigned								   \
 gray_##bits##_to_color_raw(const stp_vars_t *vars, const unsigned char *in,\
 			   unsigned short *out)				   \
 {									   \
-  int i;								   \
-  int nz = 7;								   \
-  const T *s_in = (const T *) in;					   \
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
   unsigned mask = 0;							   \
   if (lut->invert_output)						   \
     mask = 0xffff;							   \
 									   \
-  for (i = 0; i < lut->image_width; i++)				   \
-    {									   \
-      unsigned outval = (s_in[0] * (65535 / (1 << bits))) ^ mask;	   \
-      out[0] = outval;							   \
-      out[1] = outval;							   \
-      out[2] = outval;							   \
-      if (outval)							   \
-	nz = 0;								   \
-      s_in++;								   \
-      out += 3;								   \
-    }									   \
-  return nz;								   \
+  return 7 ^ stpi_get_color_kernels()->gray_expand_##bits		   \
+    (in, out, lut->image_width, 65535 / (1 << bits), mask);		   \
 }
 
 GRAY_TO_COLOR_RAW_FUNC(unsigned char, 8)
@@ -1243,13 +1335,7 @@ gray_##bits##_to_gray(const stp_vars_t *vars,				   \
 		      const unsigned char *in,				   \
 		      unsigned short *out)				   \
 {									   \
-  int i;								   \
-  int i0 = -1;								   \
-  int o0 = 0;								   \
-  int nz = 0;								   \
-  const T *s_in = (const T *) in;					   \
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	   \
-  int width = lut->image_width;						   \
   const unsigned short *composite;					   \
   const unsigned short *user;						   \
 									   \
@@ -1260,21 +1346,8 @@ gray_##bits##_to_gray(const stp_vars_t *vars,				   \
   stp_curve_resample(lut->user_color_correction.curve, 1 << bits);	   \
   user = stp_curve_cache_get_ushort_data(&(lut->user_color_correction));   \
 									   \
-  memset(out, 0, width * sizeof(unsigned short));			   \
-									   \
-  for (i = 0; i < lut->image_width; i++)				   \
-    {									   \
-      if (i0 != s_in[0])						   \
-	{								   \
-	  i0 = s_in[0];							   \
-	  o0 = composite[user[i0]];					   \
-	  nz |= o0;							   \
-	}								   \
-      out[0] = o0;							   \
-      s_in ++;								   \
-      out ++;								   \
-    }									   \
-  return nz == 0;							   \
+  return !stpi_get_color_kernels()->gray_lookup_##bits			   \
+    (in, out, lut->image_width, user, 1 << bits, &composite, 1);	   \
 }
 
 GRAY_TO_GRAY_FUNC(unsigned char, 8)
@@ -1287,14 +1360,8 @@ color_##bits##_to_gray(const stp_vars_t *vars,				      \
 		       const unsigned char *in,				      \
 		       unsigned short *out)				      \
 {									      \
-  int i;								      \
-  int i0 = -1;								      \
-  int i1 = -1;								      \
-  int i2 = -1;								      \
-  int o0 = 0;								      \
-  int nz = 0;								      \
-  const T *s_in = (const T *) in;					      \
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	      \
+  const stpi_color_kernels_t *kernels = stpi_get_color_kernels();	      \
   int l_red = LUM_RED;							      \
   int l_green = LUM_GREEN;						      \
   int l_blue = LUM_BLUE;						      \
@@ -1315,22 +1382,12 @@ color_##bits##_to_gray(const stp_vars_t *vars,				      \
       l_blue = (100 - l_blue) / 2;					      \
     }									      \
 									      \
-  for (i = 0; i < lut->image_width; i++)				      \
-    {									      \
-      if (i0 != s_in[0] || i1 != s_in[1] || i2 != s_in[2])		      \
-	{								      \
-	  i0 = s_in[0];							      \
-	  i1 = s_in[1];							      \
-	  i2 = s_in[2];							      \
-	  o0 =								      \
-	    composite[user[(i0 * l_red + i1 * l_green + i2 * l_blue) / 100]]; \
-	  nz |= o0;							      \
-	}								      \
-      out[0] = o0;							      \
-      s_in += 3;							      \
-      out ++;								      \
-    }									      \
-  return nz == 0;							      \
+  /* Luminance at the input depth, then through the curves in place */	      \
+  kernels->luminance_##bits(in, out, lut->image_width, 1,		      \
+			    l_red, l_green, l_blue, 0);			      \
+  return !kernels->gray_lookup_16((const unsigned char *) out, out,	      \
+				  lut->image_width, user, 1 << bits,	      \
+				  &composite, 1);			      \
 }
 
 COLOR_TO_GRAY_FUNC(unsigned char, 8)
@@ -1464,25 +1521,13 @@ gray_##bits##_to_gray_raw(const stp_vars_t *vars,			\
 			  const unsigned char *in,			\
 			  unsigned short *out)				\
 {									\
-  int i;								\
-  int nz = 0;								\
-  const T *s_in = (const T *) in;					\
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
-  int width = lut->image_width;						\
   unsigned mask = 0;							\
   if (lut->invert_output)						\
     mask = 0xffff;							\
 									\
-  memset(out, 0, width * sizeof(unsigned short));			\
-									\
-  for (i = 0; i < lut->image_width; i++)				\
-    {									\
-      out[0] = (s_in[0] * (65535 / ((1 << bits) - 1))) ^ mask;		\
-      nz |= out[0];							\
-      s_in ++;								\
-      out ++;								\
-    }									\
-  return nz == 0;							\
+  return !stpi_get_color_kernels()->scale_##bits			\
+    (in, out, lut->image_width, 1, 65535 / ((1 << bits) - 1), mask);	\
 }
 
 GRAY_TO_GRAY_RAW_FUNC(unsigned char, 8)
@@ -1495,13 +1540,6 @@ color_##bits##_to_gray_##name2(const stp_vars_t *vars,			\
 			       const unsigned char *in,			\
 			       unsigned short *out)			\
 {									\
-  int i;								\
-  int i0 = -1;								\
-  int i1 = -1;								\
-  int i2 = -1;								\
-  int o0 = 0;								\
-  int nz = 0;								\
-  const T *s_in = (const T *) in;					\
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
   int l_red = LUM_RED;							\
   int l_green = LUM_GREEN;						\
@@ -1517,24 +1555,9 @@ color_##bits##_to_gray_##name2(const stp_vars_t *vars,			\
       l_blue = (100 - l_blue) / 2;					\
     }									\
 									\
-  for (i = 0; i < lut->image_width; i++)				\
-    {									\
-      if (i0 != s_in[0] || i1 != s_in[1] || i2 != s_in[2])		\
-	{								\
-	  i0 = s_in[0];							\
-	  i1 = s_in[1];							\
-	  i2 = s_in[2];							\
-	  o0 = (i0 * (65535 / ((1 << bits) - 1)) * l_red +		\
-		i1 * (65535 / ((1 << bits) - 1)) * l_green +		\
-		i2 * (65535 / ((1 << bits) - 1)) * l_blue) / 100;	\
-	  o0 ^= mask;							\
-	  nz |= o0;							\
-	}								\
-      out[0] = o0;							\
-      s_in += 3;							\
-      out ++;								\
-    }									\
-  return nz == 0;							\
+  return !stpi_get_color_kernels()->luminance_##bits			\
+    (in, out, lut->image_width, 65535 / ((1 << bits) - 1),		\
+     l_red, l_green, l_blue, mask);					\
 }
 
 COLOR_TO_GRAY_RAW_FUNC(unsigned char, 8, 1, raw)
@@ -1703,28 +1726,9 @@ kcmy_##bits##_to_kcmy_raw(const stp_vars_t *vars,			\
 			  const unsigned char *in,			\
 			  unsigned short *out)				\
 {									\
-  int i;								\
-  int j;								\
-  int nz[4];								\
-  unsigned retval = 0;							\
-  const T *s_in = (const T *) in;					\
   lut_t *lut = (lut_t *)(stp_get_component_data(vars, "Color"));	\
-									\
-  memset(nz, 0, sizeof(nz));						\
-  for (i = 0; i < lut->image_width; i++)				\
-    {									\
-      for (j = 0; j < 4; j++)						\
-	{								\
-	  out[j] = s_in[j] * (65535 / ((1 << bits) - 1));		\
-	  nz[j] |= out[j];						\
-	}								\
-      s_in += 4;							\
-      out += 4;								\
-    }									\
-  for (j = 0; j < 4; j++)						\
-    if (nz[j] == 0)							\
-      retval |= (1 << j);						\
-  return retval;							\
+  return 15 ^ stpi_get_color_kernels()->scale_##bits			\
+    (in, out, 4 * lut->image_width, 4, 65535 / ((1 << bits) - 1), 0);	\
 }
 
 KCMY_TO_KCMY_RAW_FUNC(unsigned char, 8)
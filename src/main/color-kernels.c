@@ -0,0 +1,776 @@
+/*
+ * "$Id$"
+ *
+ *   Vectorized inner loops for the traditional color conversions.
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdlib.h>
+#include <string.h>
+#include "color-kernels.h"
+
+/*
+ * The vector kernels are compiled with per-function target attributes,
+ * so the rest of the library doesn't need to be built for a newer CPU.
+ */
+#if (defined(__i386__) || defined(__x86_64__)) &&			\
+  (defined(__clang__) ||						\
+   (defined(__GNUC__) &&						\
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STPI_X86_KERNELS
+#include <immintrin.h>
+#define SSE41 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+ * Plain C versions.  These are the loops that used to live in
+ * color-conversions.c, including their shortcut of reusing the previous
+ * result when a pixel repeats.
+ */
+
+#define SCALE_FUNC(T, bits)						\
+static unsigned								\
+scale_##bits##_scalar(const unsigned char *in, unsigned short *out,	\
+		      int count, int channels, unsigned scale,		\
+		      unsigned mask)					\
+{									\
+  int i;								\
+  unsigned nz = 0;							\
+  const T *s_in = (const T *) in;					\
+  for (i = 0; i < count; i++)						\
+    {									\
+      out[i] = (s_in[i] * scale) ^ mask;				\
+      if (out[i])							\
+	nz |= 1 << (i % channels);					\
+    }									\
+  return nz;								\
+}
+
+SCALE_FUNC(unsigned char, 8)
+SCALE_FUNC(unsigned short, 16)
+
+#define GRAY_EXPAND_FUNC(T, bits)					\
+static unsigned								\
+gray_expand_##bits##_scalar(const unsigned char *in,			\
+			    unsigned short *out, int width,		\
+			    unsigned scale, unsigned mask)		\
+{									\
+  int i;								\
+  unsigned nz = 0;							\
+  const T *s_in = (const T *) in;					\
+  for (i = 0; i < width; i++)						\
+    {									\
+      unsigned short outval = (s_in[i] * scale) ^ mask;		\
+      out[0] = outval;							\
+      out[1] = outval;							\
+      out[2] = outval;							\
+      nz |= outval;							\
+      out += 3;								\
+    }									\
+  return nz ? 7 : 0;							\
+}
+
+GRAY_EXPAND_FUNC(unsigned char, 8)
+GRAY_EXPAND_FUNC(unsigned short, 16)
+
+#define LUMINANCE_FUNC(T, bits)						\
+static unsigned								\
+luminance_##bits##_scalar(const unsigned char *in, unsigned short *out,	\
+			  int width, unsigned scale,			\
+			  int lr, int lg, int lb, unsigned mask)	\
+{									\
+  int i;								\
+  int i0 = -1;								\
+  int i1 = -1;								\
+  int i2 = -1;								\
+  int o0 = 0;								\
+  int nz = 0;								\
+  const T *s_in = (const T *) in;					\
+  for (i = 0; i < width; i++)						\
+    {									\
+      if (i0 != s_in[0] || i1 != s_in[1] || i2 != s_in[2])		\
+	{								\
+	  i0 = s_in[0];							\
+	  i1 = s_in[1];							\
+	  i2 = s_in[2];							\
+	  o0 = (i0 * scale * lr + i1 * scale * lg + i2 * scale * lb) / 100; \
+	  o0 ^= mask;							\
+	  nz |= o0;							\
+	}								\
+      out[0] = o0;							\
+      s_in += 3;							\
+      out ++;								\
+    }									\
+  return nz ? 1 : 0;							\
+}
+
+LUMINANCE_FUNC(unsigned char, 8)
+LUMINANCE_FUNC(unsigned short, 16)
+
+#define LOOKUP_FUNC(T, bits)						\
+static unsigned								\
+lookup_##bits##_scalar(const unsigned char *in, unsigned short *out,	\
+		       int width, const unsigned short *pre,		\
+		       int pre_size, const unsigned short *const *tables) \
+{									\
+  int i;								\
+  int i0 = -1;								\
+  int i1 = -1;								\
+  int i2 = -1;								\
+  unsigned short o0 = 0;						\
+  unsigned short o1 = 0;						\
+  unsigned short o2 = 0;						\
+  unsigned short nz0 = 0;						\
+  unsigned short nz1 = 0;						\
+  unsigned short nz2 = 0;						\
+  const T *s_in = (const T *) in;					\
+  const unsigned short *red = tables[0];				\
+  const unsigned short *green = tables[1];				\
+  const unsigned short *blue = tables[2];				\
+  (void) pre_size;							\
+  for (i = 0; i < width; i++)						\
+    {									\
+      if (i0 != s_in[0] || i1 != s_in[1] || i2 != s_in[2])		\
+	{								\
+	  i0 = s_in[0];							\
+	  i1 = s_in[1];							\
+	  i2 = s_in[2];							\
+	  o0 = red[pre[i0]];						\
+	  o1 = green[pre[i1]];						\
+	  o2 = blue[pre[i2]];						\
+	  nz0 |= o0;							\
+	  nz1 |= o1;							\
+	  nz2 |= o2;							\
+	}								\
+      out[0] = o0;							\
+      out[1] = o1;							\
+      out[2] = o2;							\
+      s_in += 3;							\
+      out += 3;								\
+    }									\
+  return (nz0 ? 1 : 0) + (nz1 ? 2 : 0) + (nz2 ? 4 : 0);			\
+}
+
+LOOKUP_FUNC(unsigned char, 8)
+LOOKUP_FUNC(unsigned short, 16)
+
+#define GRAY_LOOKUP_FUNC(T, bits)					\
+static unsigned								\
+gray_lookup_##bits##_scalar(const unsigned char *in,			\
+			    unsigned short *out, int width,		\
+			    const unsigned short *pre, int pre_size,	\
+			    const unsigned short *const *tables,	\
+			    int ntables)				\
+{									\
+  int i;								\
+  int j;								\
+  int i0 = -1;								\
+  unsigned short o[3] = { 0, 0, 0 };					\
+  unsigned short nz[3] = { 0, 0, 0 };					\
+  unsigned retval = 0;							\
+  const T *s_in = (const T *) in;					\
+  (void) pre_size;							\
+  for (i = 0; i < width; i++)						\
+    {									\
+      if (i0 != s_in[0])						\
+	{								\
+	  i0 = s_in[0];							\
+	  for (j = 0; j < ntables; j++)					\
+	    {								\
+	      o[j] = tables[j][pre[i0]];				\
+	      nz[j] |= o[j];						\
+	    }								\
+	}								\
+      for (j = 0; j < ntables; j++)					\
+	out[j] = o[j];							\
+      s_in++;								\
+      out += ntables;							\
+    }									\
+  for (j = 0; j < ntables; j++)						\
+    if (nz[j])								\
+      retval |= 1 << j;							\
+  return retval;							\
+}
+
+GRAY_LOOKUP_FUNC(unsigned char, 8)
+GRAY_LOOKUP_FUNC(unsigned short, 16)
+
+static const stpi_color_kernels_t scalar_kernels =
+{
+  "scalar",
+  scale_8_scalar,
+  scale_16_scalar,
+  gray_expand_8_scalar,
+  gray_expand_16_scalar,
+  luminance_8_scalar,
+  luminance_16_scalar,
+  lookup_8_scalar,
+  lookup_16_scalar,
+  gray_lookup_8_scalar,
+  gray_lookup_16_scalar
+};
+
+#ifdef STPI_X86_KERNELS
+
+/*
+ * pshufb controls to split eight interleaved RGB pixels into one vector
+ * of eight 16-bit samples per channel, and to put them back together.
+ * 0x80 zeroes the destination byte.
+ */
+
+/* [channel][source vector] for 16-bit input */
+static const unsigned char deinterleave_16[3][3][16] =
+{
+  { { 0x00, 0x01, 0x06, 0x07, 0x0c, 0x0d, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02, 0x03,
+      0x08, 0x09, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x04, 0x05, 0x0a, 0x0b } },
+  { { 0x02, 0x03, 0x08, 0x09, 0x0e, 0x0f, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x04, 0x05,
+      0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x00, 0x01, 0x06, 0x07, 0x0c, 0x0d } },
+  { { 0x04, 0x05, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x06, 0x07,
+      0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x02, 0x03, 0x08, 0x09, 0x0e, 0x0f } }
+};
+
+/* [channel][source vector] for 8-bit input, widening to 16 bits */
+static const unsigned char deinterleave_8[3][2][16] =
+{
+  { { 0x00, 0x80, 0x03, 0x80, 0x06, 0x80, 0x09, 0x80,
+      0x0c, 0x80, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x80, 0x80, 0x02, 0x80, 0x05, 0x80 } },
+  { { 0x01, 0x80, 0x04, 0x80, 0x07, 0x80, 0x0a, 0x80,
+      0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x00, 0x80, 0x03, 0x80, 0x06, 0x80 } },
+  { { 0x02, 0x80, 0x05, 0x80, 0x08, 0x80, 0x0b, 0x80,
+      0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+      0x80, 0x80, 0x01, 0x80, 0x04, 0x80, 0x07, 0x80 } }
+};
+
+/* [destination vector][channel] */
+static const unsigned char interleave_16[3][3][16] =
+{
+  { { 0x00, 0x01, 0x80, 0x80, 0x80, 0x80, 0x02, 0x03,
+      0x80, 0x80, 0x80, 0x80, 0x04, 0x05, 0x80, 0x80 },
+    { 0x80, 0x80, 0x00, 0x01, 0x80, 0x80, 0x80, 0x80,
+      0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x04, 0x05 },
+    { 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x80, 0x80,
+      0x80, 0x80, 0x02, 0x03, 0x80, 0x80, 0x80, 0x80 } },
+  { { 0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80,
+      0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x0a, 0x0b },
+    { 0x80, 0x80, 0x80, 0x80, 0x06, 0x07, 0x80, 0x80,
+      0x80, 0x80, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80 },
+    { 0x04, 0x05, 0x80, 0x80, 0x80, 0x80, 0x06, 0x07,
+      0x80, 0x80, 0x80, 0x80, 0x08, 0x09, 0x80, 0x80 } },
+  { { 0x80, 0x80, 0x80, 0x80, 0x0c, 0x0d, 0x80, 0x80,
+      0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80 },
+    { 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80, 0x0c, 0x0d,
+      0x80, 0x80, 0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80 },
+    { 0x80, 0x80, 0x0a, 0x0b, 0x80, 0x80, 0x80, 0x80,
+      0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x0e, 0x0f } }
+};
+
+/* [destination vector], one gray channel copied to three */
+static const unsigned char expand_16[3][16] =
+{
+  { 0x00, 0x01, 0x00, 0x01, 0x00, 0x01, 0x02, 0x03,
+    0x02, 0x03, 0x02, 0x03, 0x04, 0x05, 0x04, 0x05 },
+  { 0x04, 0x05, 0x06, 0x07, 0x06, 0x07, 0x06, 0x07,
+    0x08, 0x09, 0x08, 0x09, 0x08, 0x09, 0x0a, 0x0b },
+  { 0x0a, 0x0b, 0x0a, 0x0b, 0x0c, 0x0d, 0x0c, 0x0d,
+    0x0c, 0x0d, 0x0e, 0x0f, 0x0e, 0x0f, 0x0e, 0x0f }
+};
+
+static inline SSE41 __m128i
+shuffle(__m128i v, const unsigned char *control)
+{
+  return _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *) control));
+}
+
+static inline SSE41 void
+load_rgb_8(const unsigned char *in, __m128i *rgb)
+{
+  __m128i a = _mm_loadu_si128((const __m128i *) in);
+  __m128i b = _mm_loadl_epi64((const __m128i *) (in + 16));
+  int c;
+  for (c = 0; c < 3; c++)
+    rgb[c] = _mm_or_si128(shuffle(a, deinterleave_8[c][0]),
+			  shuffle(b, deinterleave_8[c][1]));
+}
+
+static inline SSE41 void
+load_rgb_16(const unsigned char *in, __m128i *rgb)
+{
+  const __m128i *s_in = (const __m128i *) in;
+  __m128i a = _mm_loadu_si128(s_in);
+  __m128i b = _mm_loadu_si128(s_in + 1);
+  __m128i d = _mm_loadu_si128(s_in + 2);
+  int c;
+  for (c = 0; c < 3; c++)
+    rgb[c] = _mm_or_si128(_mm_or_si128(shuffle(a, deinterleave_16[c][0]),
+				       shuffle(b, deinterleave_16[c][1])),
+			  shuffle(d, deinterleave_16[c][2]));
+}
+
+static inline SSE41 void
+store_rgb(unsigned short *out, const __m128i *rgb)
+{
+  int v;
+  for (v = 0; v < 3; v++)
+    _mm_storeu_si128((__m128i *) (out + 8 * v),
+		     _mm_or_si128(_mm_or_si128
+				  (shuffle(rgb[0], interleave_16[v][0]),
+				   shuffle(rgb[1], interleave_16[v][1])),
+				  shuffle(rgb[2], interleave_16[v][2])));
+}
+
+static inline SSE41 void
+store_gray3(unsigned short *out, __m128i gray)
+{
+  int v;
+  for (v = 0; v < 3; v++)
+    _mm_storeu_si128((__m128i *) (out + 8 * v), shuffle(gray, expand_16[v]));
+}
+
+/*
+ * The scale kernels handle 3 vectors per iteration, so sample j of
+ * accumulator k always belongs to channel (k * lanes + j) % channels
+ * for any channel count from 1 to 4.
+ */
+static unsigned
+fold_nonzero(const unsigned short *acc, int lanes, int channels)
+{
+  unsigned nz = 0;
+  int i;
+  for (i = 0; i < 3 * lanes; i++)
+    if (acc[i])
+      nz |= 1 << (i % channels);
+  return nz;
+}
+
+static inline SSE41 unsigned
+nonzero_16(__m128i v)
+{
+  return !_mm_testz_si128(v, v);
+}
+
+#define SCALE_SSE41_FUNC(T, bits, load)					\
+static SSE41 unsigned							\
+scale_##bits##_sse41(const unsigned char *in, unsigned short *out,	\
+		     int count, int channels, unsigned scale,		\
+		     unsigned mask)					\
+{									\
+  const T *s_in = (const T *) in;					\
+  __m128i vscale = _mm_set1_epi16(scale);				\
+  __m128i vmask = _mm_set1_epi16(mask);					\
+  __m128i acc[3];							\
+  unsigned short lanes[24];						\
+  unsigned nz;								\
+  int i = 0;								\
+  int k;								\
+  for (k = 0; k < 3; k++)						\
+    acc[k] = _mm_setzero_si128();					\
+  for (; i + 24 <= count; i += 24)					\
+    for (k = 0; k < 3; k++)						\
+      {									\
+	__m128i v = load(s_in + i + 8 * k);				\
+	v = _mm_xor_si128(_mm_mullo_epi16(v, vscale), vmask);		\
+	_mm_storeu_si128((__m128i *) (out + i + 8 * k), v);		\
+	acc[k] = _mm_or_si128(acc[k], v);				\
+      }									\
+  for (k = 0; k < 3; k++)						\
+    _mm_storeu_si128((__m128i *) (lanes + 8 * k), acc[k]);		\
+  nz = fold_nonzero(lanes, 8, channels);				\
+  for (; i < count; i++)						\
+    {									\
+      out[i] = (s_in[i] * scale) ^ mask;				\
+      if (out[i])							\
+	nz |= 1 << (i % channels);					\
+    }									\
+  return nz;								\
+}
+
+#define LOAD_8_SSE41(p) _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (p)))
+#define LOAD_16_SSE41(p) _mm_loadu_si128((const __m128i *) (p))
+
+SCALE_SSE41_FUNC(unsigned char, 8, LOAD_8_SSE41)
+SCALE_SSE41_FUNC(unsigned short, 16, LOAD_16_SSE41)
+
+#define GRAY_EXPAND_SSE41_FUNC(T, bits, load)				\
+static SSE41 unsigned							\
+gray_expand_##bits##_sse41(const unsigned char *in,			\
+			   unsigned short *out, int width,		\
+			   unsigned scale, unsigned mask)		\
+{									\
+  const T *s_in = (const T *) in;					\
+  __m128i vscale = _mm_set1_epi16(scale);				\
+  __m128i vmask = _mm_set1_epi16(mask);					\
+  __m128i acc = _mm_setzero_si128();					\
+  unsigned nz;								\
+  int i = 0;								\
+  for (; i + 8 <= width; i += 8)					\
+    {									\
+      __m128i v = load(s_in + i);					\
+      v = _mm_xor_si128(_mm_mullo_epi16(v, vscale), vmask);		\
+      store_gray3(out + 3 * i, v);					\
+      acc = _mm_or_si128(acc, v);					\
+    }									\
+  nz = nonzero_16(acc) ? 7 : 0;						\
+  return nz | gray_expand_##bits##_scalar((const unsigned char *) (s_in + i), \
+					  out + 3 * i, width - i,	\
+					  scale, mask);			\
+}
+
+GRAY_EXPAND_SSE41_FUNC(unsigned char, 8, LOAD_8_SSE41)
+GRAY_EXPAND_SSE41_FUNC(unsigned short, 16, LOAD_16_SSE41)
+
+/*
+ * The sum is below 2^23, so it converts to float exactly, and the
+ * correctly rounded quotient never reaches the next integer: the
+ * fractional part is at most .99 and the rounding error of a value
+ * below 65536 is at most 2^-9.
+ */
+static inline SSE41 __m128i
+luminance_quotient(__m128i r, __m128i g, __m128i b,
+		   __m128i wr, __m128i wg, __m128i wb)
+{
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, wr),
+					    _mm_mullo_epi32(g, wg)),
+			      _mm_mullo_epi32(b, wb));
+  return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sum),
+				     _mm_set1_ps(100.0f)));
+}
+
+#define LUMINANCE_SSE41_FUNC(bits)					\
+static SSE41 unsigned							\
+luminance_##bits##_sse41(const unsigned char *in, unsigned short *out,	\
+			 int width, unsigned scale,			\
+			 int lr, int lg, int lb, unsigned mask)		\
+{									\
+  __m128i wr = _mm_set1_epi32(lr * scale);				\
+  __m128i wg = _mm_set1_epi32(lg * scale);				\
+  __m128i wb = _mm_set1_epi32(lb * scale);				\
+  __m128i vmask = _mm_set1_epi16(mask);					\
+  __m128i acc = _mm_setzero_si128();					\
+  int i = 0;								\
+  for (; i + 8 <= width; i += 8)					\
+    {									\
+      __m128i rgb[3];							\
+      __m128i lo, hi, v;						\
+      load_rgb_##bits(in + 3 * i * (bits / 8), rgb);			\
+      lo = luminance_quotient(_mm_cvtepu16_epi32(rgb[0]),		\
+			      _mm_cvtepu16_epi32(rgb[1]),		\
+			      _mm_cvtepu16_epi32(rgb[2]), wr, wg, wb);	\
+      hi = luminance_quotient(_mm_unpackhi_epi16(rgb[0], _mm_setzero_si128()), \
+			      _mm_unpackhi_epi16(rgb[1], _mm_setzero_si128()), \
+			      _mm_unpackhi_epi16(rgb[2], _mm_setzero_si128()), \
+			      wr, wg, wb);				\
+      v = _mm_xor_si128(_mm_packus_epi32(lo, hi), vmask);		\
+      _mm_storeu_si128((__m128i *) (out + i), v);			\
+      acc = _mm_or_si128(acc, v);					\
+    }									\
+  return nonzero_16(acc) |						\
+    luminance_##bits##_scalar(in + 3 * i * (bits / 8), out + i,	\
+			      width - i, scale, lr, lg, lb, mask);	\
+}
+
+LUMINANCE_SSE41_FUNC(8)
+LUMINANCE_SSE41_FUNC(16)
+
+static const stpi_color_kernels_t sse41_kernels =
+{
+  "sse4.1",
+  scale_8_sse41,
+  scale_16_sse41,
+  gray_expand_8_sse41,
+  gray_expand_16_sse41,
+  luminance_8_sse41,
+  luminance_16_sse41,
+  /* Table lookups need a gather to be worth vectorizing */
+  lookup_8_scalar,
+  lookup_16_scalar,
+  gray_lookup_8_scalar,
+  gray_lookup_16_scalar
+};
+
+/*
+ * Look up eight 16-bit table entries.  A 32-bit gather at the last
+ * entry would read past the end of the table, so that lane reads the
+ * pair ending at the last entry instead and takes its upper half.
+ */
+static inline AVX2 __m256i
+gather_16(const unsigned short *table, __m256i idx, __m256i last)
+{
+  __m256i at_end = _mm256_cmpeq_epi32(idx, last);
+  __m256i v = _mm256_i32gather_epi32((const int *) table,
+				     _mm256_add_epi32(idx, at_end), 2);
+  v = _mm256_srlv_epi32(v, _mm256_and_si256(at_end, _mm256_set1_epi32(16)));
+  return _mm256_and_si256(v, _mm256_set1_epi32(0xffff));
+}
+
+static inline AVX2 __m128i
+pack_16(__m256i v)
+{
+  return _mm_packus_epi32(_mm256_castsi256_si128(v),
+			  _mm256_extracti128_si256(v, 1));
+}
+
+#define SCALE_AVX2_FUNC(T, bits, load)					\
+static AVX2 unsigned							\
+scale_##bits##_avx2(const unsigned char *in, unsigned short *out,	\
+		    int count, int channels, unsigned scale,		\
+		    unsigned mask)					\
+{									\
+  const T *s_in = (const T *) in;					\
+  __m256i vscale = _mm256_set1_epi16(scale);				\
+  __m256i vmask = _mm256_set1_epi16(mask);				\
+  __m256i acc[3];							\
+  unsigned short lanes[48];						\
+  unsigned nz;								\
+  int i = 0;								\
+  int k;								\
+  for (k = 0; k < 3; k++)						\
+    acc[k] = _mm256_setzero_si256();					\
+  for (; i + 48 <= count; i += 48)					\
+    for (k = 0; k < 3; k++)						\
+      {									\
+	__m256i v = load(s_in + i + 16 * k);				\
+	v = _mm256_xor_si256(_mm256_mullo_epi16(v, vscale), vmask);	\
+	_mm256_storeu_si256((__m256i *) (out + i + 16 * k), v);		\
+	acc[k] = _mm256_or_si256(acc[k], v);				\
+      }									\
+  for (k = 0; k < 3; k++)						\
+    _mm256_storeu_si256((__m256i *) (lanes + 16 * k), acc[k]);		\
+  nz = fold_nonzero(lanes, 16, channels);				\
+  for (; i < count; i++)						\
+    {									\
+      out[i] = (s_in[i] * scale) ^ mask;				\
+      if (out[i])							\
+	nz |= 1 << (i % channels);					\
+    }									\
+  return nz;								\
+}
+
+#define LOAD_8_AVX2(p) _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (p)))
+#define LOAD_16_AVX2(p) _mm256_loadu_si256((const __m256i *) (p))
+
+SCALE_AVX2_FUNC(unsigned char, 8, LOAD_8_AVX2)
+SCALE_AVX2_FUNC(unsigned short, 16, LOAD_16_AVX2)
+
+#define LUMINANCE_AVX2_FUNC(bits)					\
+static AVX2 unsigned							\
+luminance_##bits##_avx2(const unsigned char *in, unsigned short *out,	\
+			int width, unsigned scale,			\
+			int lr, int lg, int lb, unsigned mask)		\
+{									\
+  __m256i wr = _mm256_set1_epi32(lr * scale);				\
+  __m256i wg = _mm256_set1_epi32(lg * scale);				\
+  __m256i wb = _mm256_set1_epi32(lb * scale);				\
+  __m128i vmask = _mm_set1_epi16(mask);					\
+  __m128i acc = _mm_setzero_si128();					\
+  int i = 0;								\
+  for (; i + 8 <= width; i += 8)					\
+    {									\
+      __m128i rgb[3];							\
+      __m256i sum;							\
+      __m128i v;							\
+      load_rgb_##bits(in + 3 * i * (bits / 8), rgb);			\
+      sum = _mm256_add_epi32						\
+	(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvtepu16_epi32(rgb[0]), wr), \
+			  _mm256_mullo_epi32(_mm256_cvtepu16_epi32(rgb[1]), wg)), \
+	 _mm256_mullo_epi32(_mm256_cvtepu16_epi32(rgb[2]), wb));	\
+      sum = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(sum),	\
+					      _mm256_set1_ps(100.0f)));	\
+      v = _mm_xor_si128(pack_16(sum), vmask);				\
+      _mm_storeu_si128((__m128i *) (out + i), v);			\
+      acc = _mm_or_si128(acc, v);					\
+    }									\
+  return nonzero_16(acc) |						\
+    luminance_##bits##_scalar(in + 3 * i * (bits / 8), out + i,	\
+			      width - i, scale, lr, lg, lb, mask);	\
+}
+
+LUMINANCE_AVX2_FUNC(8)
+LUMINANCE_AVX2_FUNC(16)
+
+#define LOOKUP_AVX2_FUNC(bits)						\
+static AVX2 unsigned							\
+lookup_##bits##_avx2(const unsigned char *in, unsigned short *out,	\
+		     int width, const unsigned short *pre,		\
+		     int pre_size, const unsigned short *const *tables)	\
+{									\
+  __m256i pre_last = _mm256_set1_epi32(pre_size - 1);			\
+  __m256i table_last = _mm256_set1_epi32(65535);			\
+  __m128i acc[3];							\
+  unsigned nz = 0;							\
+  int i = 0;								\
+  int c;								\
+  for (c = 0; c < 3; c++)						\
+    acc[c] = _mm_setzero_si128();					\
+  for (; i + 8 <= width; i += 8)					\
+    {									\
+      __m128i rgb[3];							\
+      load_rgb_##bits(in + 3 * i * (bits / 8), rgb);			\
+      for (c = 0; c < 3; c++)						\
+	{								\
+	  __m256i v = gather_16(pre, _mm256_cvtepu16_epi32(rgb[c]),	\
+				pre_last);				\
+	  rgb[c] = pack_16(gather_16(tables[c], v, table_last));	\
+	  acc[c] = _mm_or_si128(acc[c], rgb[c]);			\
+	}								\
+      store_rgb(out + 3 * i, rgb);					\
+    }									\
+  for (c = 0; c < 3; c++)						\
+    if (nonzero_16(acc[c]))						\
+      nz |= 1 << c;							\
+  return nz | lookup_##bits##_scalar(in + 3 * i * (bits / 8),		\
+				     out + 3 * i, width - i,		\
+				     pre, pre_size, tables);		\
+}
+
+LOOKUP_AVX2_FUNC(8)
+LOOKUP_AVX2_FUNC(16)
+
+#define GRAY_LOOKUP_AVX2_FUNC(T, bits, load)				\
+static AVX2 unsigned							\
+gray_lookup_##bits##_avx2(const unsigned char *in,			\
+			  unsigned short *out, int width,		\
+			  const unsigned short *pre, int pre_size,	\
+			  const unsigned short *const *tables,		\
+			  int ntables)					\
+{									\
+  const T *s_in = (const T *) in;					\
+  __m256i pre_last = _mm256_set1_epi32(pre_size - 1);			\
+  __m256i table_last = _mm256_set1_epi32(65535);			\
+  __m128i acc[3];							\
+  unsigned nz = 0;							\
+  int i = 0;								\
+  int c;								\
+  for (c = 0; c < 3; c++)						\
+    acc[c] = _mm_setzero_si128();					\
+  for (; i + 8 <= width; i += 8)					\
+    {									\
+      __m128i res[3];							\
+      __m256i v = gather_16(pre, load(s_in + i), pre_last);		\
+      for (c = 0; c < ntables; c++)					\
+	{								\
+	  res[c] = pack_16(gather_16(tables[c], v, table_last));	\
+	  acc[c] = _mm_or_si128(acc[c], res[c]);			\
+	}								\
+      if (ntables == 1)							\
+	_mm_storeu_si128((__m128i *) (out + i), res[0]);		\
+      else								\
+	store_rgb(out + 3 * i, res);					\
+    }									\
+  for (c = 0; c < ntables; c++)						\
+    if (nonzero_16(acc[c]))						\
+      nz |= 1 << c;							\
+  return nz |								\
+    gray_lookup_##bits##_scalar((const unsigned char *) (s_in + i),	\
+				out + ntables * i, width - i,		\
+				pre, pre_size, tables, ntables);	\
+}
+
+#define LOAD_8_AVX2_32(p) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (p)))
+#define LOAD_16_AVX2_32(p) _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (p)))
+
+GRAY_LOOKUP_AVX2_FUNC(unsigned char, 8, LOAD_8_AVX2_32)
+GRAY_LOOKUP_AVX2_FUNC(unsigned short, 16, LOAD_16_AVX2_32)
+
+static const stpi_color_kernels_t avx2_kernels =
+{
+  "avx2",
+  scale_8_avx2,
+  scale_16_avx2,
+  /* Copying gray to three channels is limited by stores */
+  gray_expand_8_sse41,
+  gray_expand_16_sse41,
+  luminance_8_avx2,
+  luminance_16_avx2,
+  lookup_8_avx2,
+  lookup_16_avx2,
+  gray_lookup_8_avx2,
+  gray_lookup_16_avx2
+};
+
+#endif /* STPI_X86_KERNELS */
+
+static const stpi_color_kernels_t *color_kernels = &scalar_kernels;
+
+const stpi_color_kernels_t *
+stpi_find_color_kernels(const char *name)
+{
+  if (strcmp(name, scalar_kernels.name) == 0)
+    return &scalar_kernels;
+#ifdef STPI_X86_KERNELS
+  __builtin_cpu_init();
+  if (strcmp(name, sse41_kernels.name) == 0 &&
+      __builtin_cpu_supports("sse4.1"))
+    return &sse41_kernels;
+  if (strcmp(name, avx2_kernels.name) == 0 &&
+      __builtin_cpu_supports("avx2"))
+    return &avx2_kernels;
+#endif
+  return NULL;
+}
+
+const stpi_color_kernels_t *
+stpi_get_color_kernels(void)
+{
+  return color_kernels;
+}
+
+void
+stpi_init_color_kernels(void)
+{
+  const char *name = getenv("STP_COLOR_KERNELS");
+  const stpi_color_kernels_t *kernels = NULL;
+  if (name)
+    kernels = stpi_find_color_kernels(name);
+  if (!kernels)
+    kernels = stpi_find_color_kernels("avx2");
+  if (!kernels)
+    kernels = stpi_find_color_kernels("sse4.1");
+  if (kernels)
+    color_kernels = kernels;
+  stp_deprintf(STP_DBG_COLORFUNC, "Using %s color conversion kernels\n",
+	       color_kernels->name);
+}
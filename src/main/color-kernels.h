@@ -0,0 +1,111 @@
+/*
+ * "$Id$"
+ *
+ *   Vectorized inner loops for the traditional color conversions.
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * This file must include only standard C header files.  The core code must
+ * compile on generic platforms that don't support glib, gimp, gtk, etc.
+ */
+
+#ifndef GUTENPRINT_INTERNAL_COLOR_KERNELS_H
+#define GUTENPRINT_INTERNAL_COLOR_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Each set of kernels has a plain C version, which is always available,
+ * and may have SSE4.1 and AVX2 versions on x86 builds with a compiler
+ * that can target them.  stpi_init_color_kernels() picks the best set
+ * the CPU supports; setting STP_COLOR_KERNELS to the name of a set
+ * ("scalar", "sse4.1" or "avx2") overrides the choice.  All sets
+ * produce identical output.
+ *
+ * The _8 variants take 8-bit input samples and the _16 variants take
+ * 16-bit input samples; output is always 16 bits.  Each kernel returns
+ * a mask with bit N set if any output sample of channel N is nonzero.
+ */
+typedef struct
+{
+  const char *name;
+  /*
+   * out[i] = (in[i] * scale) ^ mask for count samples of channels
+   * (1 to 4) interleaved channels.
+   */
+  unsigned (*scale_8)(const unsigned char *in, unsigned short *out,
+		      int count, int channels, unsigned scale, unsigned mask);
+  unsigned (*scale_16)(const unsigned char *in, unsigned short *out,
+		       int count, int channels, unsigned scale, unsigned mask);
+  /*
+   * Gray to three identical channels:
+   * out[3i] = out[3i+1] = out[3i+2] = (in[i] * scale) ^ mask
+   */
+  unsigned (*gray_expand_8)(const unsigned char *in, unsigned short *out,
+			    int width, unsigned scale, unsigned mask);
+  unsigned (*gray_expand_16)(const unsigned char *in, unsigned short *out,
+			     int width, unsigned scale, unsigned mask);
+  /*
+   * RGB to gray:
+   * out[i] = ((in[3i] * lr + in[3i+1] * lg + in[3i+2] * lb) * scale / 100)
+   *          ^ mask
+   * where lr + lg + lb must not exceed 100.
+   */
+  unsigned (*luminance_8)(const unsigned char *in, unsigned short *out,
+			  int width, unsigned scale, int lr, int lg, int lb,
+			  unsigned mask);
+  unsigned (*luminance_16)(const unsigned char *in, unsigned short *out,
+			   int width, unsigned scale, int lr, int lg, int lb,
+			   unsigned mask);
+  /*
+   * RGB through two lookup tables:
+   * out[3i+c] = tables[c][pre[in[3i+c]]]
+   * pre has pre_size entries and each of the tables has 65536.
+   */
+  unsigned (*lookup_8)(const unsigned char *in, unsigned short *out,
+		       int width, const unsigned short *pre, int pre_size,
+		       const unsigned short *const *tables);
+  unsigned (*lookup_16)(const unsigned char *in, unsigned short *out,
+			int width, const unsigned short *pre, int pre_size,
+			const unsigned short *const *tables);
+  /*
+   * Gray through two lookup tables, to one or three channels:
+   * out[ntables*i+c] = tables[c][pre[in[i]]]
+   */
+  unsigned (*gray_lookup_8)(const unsigned char *in, unsigned short *out,
+			    int width, const unsigned short *pre,
+			    int pre_size, const unsigned short *const *tables,
+			    int ntables);
+  unsigned (*gray_lookup_16)(const unsigned char *in, unsigned short *out,
+			     int width, const unsigned short *pre,
+			     int pre_size, const unsigned short *const *tables,
+			     int ntables);
+} stpi_color_kernels_t;
+
+extern void stpi_init_color_kernels(void);
+extern const stpi_color_kernels_t *stpi_get_color_kernels(void);
+extern const stpi_color_kernels_t *stpi_find_color_kernels(const char *name);
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif /* GUTENPRINT_INTERNAL_COLOR_KERNELS_H */
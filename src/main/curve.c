@@ -461,6 +461,70 @@ stp_curve_create_copy(const stp_curve_t *curve)
   return ret;
 }
 
+/*
+ * A flat copy of a curve, so that it can be stored in a cache and made
+ * again exactly as it was.
+ */
+typedef struct
+{
+  int curve_type;
+  int wrap_mode;
+  int piecewise;
+  int pad;
+  double gamma;
+  double low;
+  double high;
+  size_t size;			/* Number of doubles that follow */
+} encoded_curve_t;
+
+char *
+stpi_curve_encode(const stp_curve_t *curve, size_t *size)
+{
+  encoded_curve_t header;
+  const double *data;
+  char *ret;
+  CHECK_CURVE(curve);
+  memset(&header, 0, sizeof(header));
+  header.curve_type = curve->curve_type;
+  header.wrap_mode = curve->wrap_mode;
+  header.piecewise = curve->piecewise;
+  header.gamma = curve->gamma;
+  stp_sequence_get_bounds(curve->seq, &header.low, &header.high);
+  stp_sequence_get_data(curve->seq, &header.size, &data);
+  *size = sizeof(header) + header.size * sizeof(double);
+  ret = stp_malloc(*size);
+  memcpy(ret, &header, sizeof(header));
+  if (header.size)
+    memcpy(ret + sizeof(header), data, header.size * sizeof(double));
+  return ret;
+}
+
+stp_curve_t *
+stpi_curve_decode(const char *data, size_t size)
+{
+  encoded_curve_t header;
+  stp_curve_t *ret;
+  if (size < sizeof(header))
+    return NULL;
+  memcpy(&header, data, sizeof(header));
+  if (header.size > 2 * (curve_point_limit + 1) ||
+      size != sizeof(header) + header.size * sizeof(double) ||
+      header.curve_type < 0 || header.curve_type >= stpi_curve_type_count ||
+      header.low > header.high)
+    return NULL;
+  ret = stp_curve_create(header.wrap_mode);
+  if (!ret)
+    return NULL;
+  ret->curve_type = header.curve_type;
+  ret->piecewise = header.piecewise;
+  ret->gamma = header.gamma;
+  stp_sequence_set_bounds(ret->seq, header.low, header.high);
+  stp_sequence_set_data(ret->seq, header.size,
+			(const double *) (data + sizeof(header)));
+  ret->recompute_interval = 1;
+  return ret;
+}
+
 void
 stp_curve_reverse(stp_curve_t *dest, const stp_curve_t *source)
 {
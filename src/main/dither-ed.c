@@ -342,7 +342,7 @@ shared_ed_initializer(stpi_dither_t *d,
 		      int **ndither)
 {
   int i, j;
-  for (i = 0; i < CHANNEL_COUNT(d); i++)
+  for (i = d->first_channel; i < d->last_channel; i++)
     CHANNEL(d, i).error_rows = 2;
   if (!duplicate_line)
     {
@@ -358,7 +358,7 @@ shared_ed_initializer(stpi_dither_t *d,
     return 0;
   else if (d->last_line_was_empty == 4)
     {
-      for (i = 0; i < CHANNEL_COUNT(d); i++)
+      for (i = d->first_channel; i < d->last_channel; i++)
 	for (j = 0; j < d->error_rows; j++)
 	  memset(stpi_dither_get_errline(d, row + j, i), 0,
 		 d->dst_width * sizeof(int));
@@ -368,7 +368,7 @@ shared_ed_initializer(stpi_dither_t *d,
 
   *error = stp_malloc(CHANNEL_COUNT(d) * sizeof(int **));
   *ndither = stp_malloc(CHANNEL_COUNT(d) * sizeof(int));
-  for (i = 0; i < CHANNEL_COUNT(d); i++)
+  for (i = d->first_channel; i < d->last_channel; i++)
     {
       (*error)[i] = stp_malloc(d->error_rows * sizeof(int *));
       for (j = 0; j < d->error_rows; j++)
@@ -390,7 +390,7 @@ shared_ed_deinitializer(stpi_dither_t *d,
 			int *ndither)
 {
   int i;
-  for (i = 0; i < CHANNEL_COUNT(d); i++)
+  for (i = d->first_channel; i < d->last_channel; i++)
     {
       STP_SAFE_FREE(error[i]);
     }
@@ -399,14 +399,13 @@ shared_ed_deinitializer(stpi_dither_t *d,
 }
 
 void
-stpi_dither_ed(stp_vars_t *v,
+stpi_dither_ed(stpi_dither_t *d,
 	       int row,
 	       const unsigned short *raw,
 	       int duplicate_line,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
     		length;
   unsigned char	bit;
@@ -423,7 +422,7 @@ stpi_dither_ed(stp_vars_t *v,
     for (i = 0; i < CHANNEL_COUNT(d); i++)
       if (CHANNEL(d, i).nlevels > 1)
 	{
-	  stpi_dither_ordered(v, row, raw, duplicate_line, zero_mask, mask);
+	  stpi_dither_ordered(d, row, raw, duplicate_line, zero_mask, mask);
 	  return;
 	}
   if (!shared_ed_initializer(d, row, duplicate_line, zero_mask, length,
@@ -442,7 +441,7 @@ stpi_dither_ed(stp_vars_t *v,
 
   for (; x != terminate; x += direction)
     {
-      for (i = 0; i < CHANNEL_COUNT(d); i++)
+      for (i = d->first_channel; i < d->last_channel; i++)
 	{
 	  if (CHANNEL(d, i).ptr)
 	    {
@@ -399,14 +399,13 @@ print_ink(stpi_dither_t *d, unsigned char *tptr, const stpi_ink_defn_t *ink,
 }
 
 void
-stpi_dither_et(stp_vars_t *v,
+stpi_dither_et(stpi_dither_t *d,
 	       int row,
 	       const unsigned short *raw,
 	       int duplicate_line,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   eventone_t *et;
 
   int		x;
@@ -522,14 +521,13 @@ stpi_dither_et(stp_vars_t *v,
 }
 
 void
-stpi_dither_ut(stp_vars_t *v,
+stpi_dither_ut(stpi_dither_t *d,
 	       int row,
 	       const unsigned short *raw,
 	       int duplicate_line,
 	       int zero_mask,
 	       const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   eventone_t *et;
 
   int		x;
@@ -545,7 +543,7 @@ stpi_dither_ut(stp_vars_t *v,
 
   if (channel_count == 1)
     {
-      stpi_dither_et(v, row, raw, duplicate_line, zero_mask, mask);
+      stpi_dither_et(d, row, raw, duplicate_line, zero_mask, mask);
       return;
     }
 
@@ -76,8 +76,10 @@ typedef struct
 
 #define MAX_SPREAD 32
 
-typedef void stpi_ditherfunc_t(stp_vars_t *, int, const unsigned short *, int,
-			       int, const unsigned char *);
+struct dither;
+
+typedef void stpi_ditherfunc_t(struct dither *, int, const unsigned short *,
+			       int, int, const unsigned char *);
 
 /*
  * An end of a dither segment, describing one ink
@@ -174,8 +176,30 @@ typedef struct dither
   stpi_ditherfunc_t *ditherfunc;
   void *aux_data;
   void (*aux_freefunc)(struct dither *);
+
+  int first_channel;		/* The channels dithered by this pass; */
+  int last_channel;		/* all of them, unless the channels are */
+				/* being dithered in parallel */
+  int threads;			/* Threads to use to dither channels */
+  stpi_thread_pool_t *pool;
+  stpi_dither_channel_t *batch_channels; /* Copies of the channels for */
+  int batch_rows;		/* each row of a batch dithered in parallel */
+  int lane;			/* Which of the dither's per-row scratch */
+				/* buffers this row uses; each row of a */
+				/* batch has its own */
+
+  unsigned char **row_buffers;	/* While the row pipeline is running, */
+  const int *row_ends;		/* the buffers supplied by the driver */
+				/* and the row ends of the row that the */
+				/* driver is currently writing out */
 } stpi_dither_t;
 
+/*
+ * At most this many rows are dithered at the same time, each with its
+ * own lane.
+ */
+#define STPI_DITHER_LANES 8
+
 #define CHANNEL(d, c) ((d)->channel[(c)])
 #define CHANNEL_COUNT(d) ((d)->total_channel_count)
 
@@ -190,11 +214,32 @@ extern stpi_ditherfunc_t stpi_dither_et;
 extern stpi_ditherfunc_t stpi_dither_ut;
 
 extern void stpi_dither_reverse_row_ends(stpi_dither_t *d);
+extern int stpi_dither_row_size(const stpi_dither_t *d, int channel);
 extern int stpi_dither_translate_channel(stp_vars_t *v, unsigned channel,
 					 unsigned subchannel);
 extern void stpi_dither_channel_destroy(stpi_dither_channel_t *channel);
 extern void stpi_dither_finalize(stp_vars_t *v);
 extern int *stpi_dither_get_errline(stpi_dither_t *d, int row, int color);
+extern void stpi_dither_ordered_init(stp_vars_t *v, stpi_dither_t *d);
+
+/*
+ * One row of a batch for stpi_dither_rows().  buffers has one entry per
+ * channel (NULL where stp_dither_add_channel() registered no buffer),
+ * and the first and last positions of each channel are returned in
+ * row_ends, two per channel.
+ */
+typedef struct
+{
+  const unsigned short *input;
+  int duplicate_line;
+  int zero_mask;
+  const unsigned char *mask;
+  unsigned char **buffers;
+  int *row_ends;
+} stpi_dither_row_t;
+
+extern void stpi_dither_rows(stp_vars_t *v, int row, int nrows,
+			     const stpi_dither_row_t *rows);
 
 
 #define ADVANCE_UNIDIRECTIONAL(d, bit, input, width, xerror, xstep, xmod) \
@@ -245,7 +290,7 @@ do									\
 {									\
   int ii;								\
   int jj;								\
-  for (ii = 0; ii < width; ii++)					\
+  for (ii = (d)->first_channel; ii < (d)->last_channel; ii++)		\
     for (jj = 0; jj < S; jj++)						\
       err[ii][jj] += dir;						\
   if (dir == 1)								\
@@ -59,10 +59,12 @@ stp_dither_get_channel(stp_vars_t *v, unsigned channel, unsigned subchannel)
 {
   stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int place = stpi_dither_translate_channel(v, channel, subchannel);
-  if (place >= 0)
-    return d->channel[place].ptr;
-  else
+  if (place < 0)
     return NULL;
+  else if (d->row_buffers)
+    return d->row_buffers[place];
+  else
+    return d->channel[place].ptr;
 }
 
 static void
@@ -178,6 +180,7 @@ stpi_dither_finalize(stp_vars_t *v)
 	  stp_dither_matrix_clone(&(d->dither_matrix), &(dc->pick),
 				   x_n * (i % rc), y_n * (i / rc));
 	}
+      stpi_dither_ordered_init(v, d);
       d->finalized = 1;
     }
 }
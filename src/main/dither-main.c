@@ -107,6 +107,20 @@ static const stp_parameter_t dither_parameters[] =
     STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_OUTPUT,
     STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "RenderThreads", N_("Rendering Threads"), "Color=No,Category=Advanced Printer Functionality",
+    N_("Number of threads to use for color conversion and dithering.  "
+       "The output is the same regardless of the number of threads."),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_OUTPUT,
+    STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
+  {
+    "DitherThreads", N_("Dithering Threads"), "Color=No,Category=Advanced Printer Functionality",
+    N_("Number of threads to use to dither the inks of each row.  "
+       "The output is the same regardless of the number of threads."),
+    STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_OUTPUT,
+    STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int dither_parameter_count =
@@ -152,6 +166,16 @@ stp_dither_describe_parameter(const stp_vars_t *v, const char *name,
       description->deflt.str =
 	stp_string_list_param(description->bounds.str, 0)->name;
     }
+  else if (strcmp(name, "RenderThreads") == 0 ||
+	   strcmp(name, "DitherThreads") == 0)
+    {
+      for (i = 0; i < dither_parameter_count; i++)
+	if (strcmp(name, dither_parameters[i].name) == 0)
+	  stp_fill_parameter_settings(description, &(dither_parameters[i]));
+      description->bounds.integer.lower = 1;
+      description->bounds.integer.upper = 64;
+      description->deflt.integer = 1;
+    }
   else
     return;
 }
@@ -327,6 +351,9 @@ stpi_dither_free(void *vd)
 {
   stpi_dither_t *d = (stpi_dither_t *) vd;
   int j;
+  if (d->pool)
+    stpi_thread_pool_destroy(d->pool);
+  STP_SAFE_FREE(d->batch_channels);
   if (d->aux_freefunc)
     (d->aux_freefunc)(d);
   for (j = 0; j < CHANNEL_COUNT(d); j++)
@@ -367,6 +394,9 @@ stp_dither_init(stp_vars_t *v, stp_image_t *image, int out_width,
     }
   d->ditherfunc = stpi_set_dither_function(v);
   d->adaptive_limit = .75 * 65535;
+  d->threads = 1;
+  if (stp_check_int_parameter(v, "DitherThreads", STP_PARAMETER_ACTIVE))
+    d->threads = stp_get_int_parameter(v, "DitherThreads");
 
   /*
    * For hybrid EvenTone we want to use the good matrix.  For regular
@@ -412,7 +442,7 @@ void
 stpi_dither_reverse_row_ends(stpi_dither_t *d)
 {
   int i;
-  for (i = 0; i < CHANNEL_COUNT(d); i++)
+  for (i = d->first_channel; i < d->last_channel; i++)
     {
       int tmp = CHANNEL(d, i).row_ends[0];
       CHANNEL(d, i).row_ends[0] =
@@ -428,6 +458,8 @@ stp_dither_get_first_position(stp_vars_t *v, int color, int subchannel)
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
+  if (d->row_ends)
+    return d->row_ends[2 * channel];
   return CHANNEL(d, channel).row_ends[0];
 }
 
@@ -438,9 +470,17 @@ stp_dither_get_last_position(stp_vars_t *v, int color, int subchannel)
   int channel = stpi_dither_translate_channel(v, color, subchannel);
   if (channel < 0)
     return -1;
+  if (d->row_ends)
+    return d->row_ends[2 * channel + 1];
   return CHANNEL(d, channel).row_ends[1];
 }
 
+int
+stpi_dither_row_size(const stpi_dither_t *d, int channel)
+{
+  return (d->dst_width + 7) / 8 * CHANNEL(d, channel).signif_bits;
+}
+
 int *
 stpi_dither_get_errline(stpi_dither_t *d, int row, int color)
 {
@@ -458,21 +498,81 @@ stpi_dither_get_errline(stpi_dither_t *d, int row, int color)
   return dc->errs[row % dc->error_rows] + MAX_SPREAD;
 }
 
-void
-stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
-		    int duplicate_line, int zero_mask,
-		    const unsigned char *mask)
+/*
+ * Parallel dithering: each task dithers a group of channels using its
+ * own copy of the dither state, restricted to those channels.  Apart
+ * from the shared input, everything the dither functions touch is
+ * either per-channel or in that copy, and every copy makes the same
+ * decisions about the row as a whole, so the result is the same as
+ * dithering the channels one after another.
+ */
+typedef struct
+{
+  stpi_dither_t *tasks;
+  int row;
+  const unsigned short *input;
+  int duplicate_line;
+  int zero_mask;
+  const unsigned char *mask;
+} stpi_dither_job_t;
+
+static stpi_thread_pool_t *
+stpi_dither_get_pool(stpi_dither_t *d)
+{
+  if (!d->pool)
+    d->pool = stpi_thread_pool_create(d->threads);
+  return d->pool;
+}
+
+static void
+stpi_dither_channels(void *data, int task)
+{
+  stpi_dither_job_t *job = (stpi_dither_job_t *) data;
+  stpi_dither_t *d = &(job->tasks[task]);
+  (d->ditherfunc)(d, job->row, job->input, job->duplicate_line,
+		  job->zero_mask, job->mask);
+}
+
+static void
+stpi_dither_parallel(stpi_dither_t *d, int row, const unsigned short *input,
+		     int duplicate_line, int zero_mask,
+		     const unsigned char *mask)
+{
+  stpi_dither_job_t job;
+  int ntasks = d->threads;
+  int i;
+  if (ntasks > CHANNEL_COUNT(d))
+    ntasks = CHANNEL_COUNT(d);
+  job.tasks = stp_malloc(ntasks * sizeof(stpi_dither_t));
+  job.row = row;
+  job.input = input;
+  job.duplicate_line = duplicate_line;
+  job.zero_mask = zero_mask;
+  job.mask = mask;
+  for (i = 0; i < ntasks; i++)
+    {
+      job.tasks[i] = *d;
+      job.tasks[i].first_channel = i * CHANNEL_COUNT(d) / ntasks;
+      job.tasks[i].last_channel = (i + 1) * CHANNEL_COUNT(d) / ntasks;
+    }
+  stpi_thread_pool_run(stpi_dither_get_pool(d), ntasks, stpi_dither_channels,
+		       &job);
+  d->last_line_was_empty = job.tasks[0].last_line_was_empty;
+  stp_free(job.tasks);
+}
+
+/*
+ * Get ready to dither a row into the channels' buffers.
+ */
+static void
+stpi_dither_start_row(stpi_dither_t *d, int row)
 {
   int i;
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
-  stpi_dither_finalize(v);
   stp_dither_matrix_set_row(&(d->dither_matrix), row);
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
-      CHANNEL(d, i).ptr = CHANNEL(d, i).ptr;
       if (CHANNEL(d, i).ptr)
-	  memset(CHANNEL(d, i).ptr, 0,
-		 (d->dst_width + 7) / 8 * CHANNEL(d, i).signif_bits);
+	  memset(CHANNEL(d, i).ptr, 0, stpi_dither_row_size(d, i));
       CHANNEL(d, i).row_ends[0] = -1;
       CHANNEL(d, i).row_ends[1] = -1;
 
@@ -480,7 +580,148 @@ stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
       stp_dither_matrix_set_row(&(CHANNEL(d, i).pick), row);
     }
   d->ptr_offset = 0;
-  (d->ditherfunc)(v, row, input, duplicate_line, zero_mask, mask);
+  d->first_channel = 0;
+  d->last_channel = CHANNEL_COUNT(d);
+}
+
+void
+stp_dither_internal(stp_vars_t *v, int row, const unsigned short *input,
+		    int duplicate_line, int zero_mask,
+		    const unsigned char *mask)
+{
+  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  stpi_dither_finalize(v);
+  stpi_dither_start_row(d, row);
+  /*
+   * EvenTone and UniTone carry error between channels, so they can
+   * only dither one channel at a time.
+   */
+  if (d->threads > 1 && CHANNEL_COUNT(d) > 1 &&
+      !(d->stpi_dither_type & (D_EVENTONE | D_UNITONE)))
+    stpi_dither_parallel(d, row, input, duplicate_line, zero_mask, mask);
+  else
+    (d->ditherfunc)(d, row, input, duplicate_line, zero_mask, mask);
+}
+
+/*
+ * The ordered dithers carry nothing from one row to the next (and
+ * neither does the adaptive hybrid when any channel has more than one
+ * level, since it then dithers everything ordered), so the rows of a
+ * batch can be dithered at the same time.  Error diffusion and EvenTone
+ * can't be: they go back and forth, so each row starts in the column
+ * where the last one finished, and needs all of its error before it
+ * can make its first decision.  Those rows are dithered in order, with
+ * the channels in parallel where possible.
+ */
+static int
+stpi_dither_rows_are_independent(const stpi_dither_t *d)
+{
+  int i;
+  if (d->ditherfunc == stpi_dither_ordered ||
+      d->ditherfunc == stpi_dither_very_fast ||
+      d->ditherfunc == stpi_dither_predithered)
+    return 1;
+  if (d->ditherfunc == stpi_dither_ed &&
+      (d->stpi_dither_type & D_ADAPTIVE_BASE))
+    for (i = 0; i < CHANNEL_COUNT(d); i++)
+      if (CHANNEL(d, i).nlevels > 1)
+	return 1;
+  return 0;
+}
+
+typedef struct
+{
+  const stpi_dither_t *d;
+  int row;
+  const stpi_dither_row_t *rows;
+  stpi_dither_channel_t *channels; /* CHANNEL_COUNT(d) for each row */
+} stpi_dither_batch_t;
+
+static void
+stpi_dither_save_row_ends(const stpi_dither_t *d, int *row_ends)
+{
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      row_ends[2 * i] = CHANNEL(d, i).row_ends[0];
+      row_ends[2 * i + 1] = CHANNEL(d, i).row_ends[1];
+    }
+}
+
+/*
+ * Each row of a batch is dithered with its own copy of the dither
+ * state and of the channels, which hold the position in the dither
+ * matrices and the output buffers, and in its own lane.
+ */
+static void
+stpi_dither_batch_row(void *data, int task)
+{
+  const stpi_dither_batch_t *batch = (const stpi_dither_batch_t *) data;
+  const stpi_dither_row_t *r = &(batch->rows[task]);
+  stpi_dither_t d = *(batch->d);
+  int i;
+  d.channel = batch->channels + task * CHANNEL_COUNT(&d);
+  d.lane = task;
+  memcpy(d.channel, batch->d->channel,
+	 CHANNEL_COUNT(&d) * sizeof(stpi_dither_channel_t));
+  for (i = 0; i < CHANNEL_COUNT(&d); i++)
+    CHANNEL(&d, i).ptr = r->buffers[i];
+  stpi_dither_start_row(&d, batch->row + task);
+  (d.ditherfunc)(&d, batch->row + task, r->input, r->duplicate_line,
+		 r->zero_mask, r->mask);
+  stpi_dither_save_row_ends(&d, r->row_ends);
+}
+
+/*
+ * Dither nrows consecutive rows starting at row, each from and into
+ * its own buffers, with the same result as calling stp_dither_internal()
+ * on each of them in turn.
+ */
+void
+stpi_dither_rows(stp_vars_t *v, int row, int nrows,
+		 const stpi_dither_row_t *rows)
+{
+  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  unsigned char **saved_ptrs;
+  int i, j;
+  stpi_dither_finalize(v);
+  if (d->threads > 1 && nrows > 1 && stpi_dither_rows_are_independent(d))
+    {
+      stpi_dither_batch_t batch;
+      int batch_rows = nrows < STPI_DITHER_LANES ? nrows : STPI_DITHER_LANES;
+      if (batch_rows > d->batch_rows)
+	{
+	  STP_SAFE_FREE(d->batch_channels);
+	  d->batch_channels = stp_malloc(batch_rows * CHANNEL_COUNT(d) *
+					 sizeof(stpi_dither_channel_t));
+	  d->batch_rows = batch_rows;
+	}
+      batch.d = d;
+      batch.channels = d->batch_channels;
+      for (j = 0; j < nrows; j += batch_rows)
+	{
+	  batch.row = row + j;
+	  batch.rows = rows + j;
+	  stpi_thread_pool_run(stpi_dither_get_pool(d),
+			       nrows - j < batch_rows ? nrows - j : batch_rows,
+			       stpi_dither_batch_row, &batch);
+	}
+      return;
+    }
+  saved_ptrs = stp_malloc(CHANNEL_COUNT(d) * sizeof(unsigned char *));
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    saved_ptrs[i] = CHANNEL(d, i).ptr;
+  for (j = 0; j < nrows; j++)
+    {
+      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	CHANNEL(d, i).ptr = rows[j].buffers[i];
+      stp_dither_internal(v, row + j, rows[j].input, rows[j].duplicate_line,
+			  rows[j].zero_mask, rows[j].mask);
+      stpi_dither_save_row_ends(d, rows[j].row_ends);
+    }
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    CHANNEL(d, i).ptr = saved_ptrs[i];
+  stp_free(saved_ptrs);
 }
 
 void
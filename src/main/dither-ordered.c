@@ -28,6 +28,8 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <stdlib.h>
+#include <string.h>
 #include <gutenprint/gutenprint.h>
 #include "gutenprint-internal.h"
 #include <gutenprint/gutenprint-intl-internal.h>
@@ -41,11 +43,21 @@ typedef struct {
   unsigned short *lut;
 } stpi_new_ordered_t;
 
+/*
+ * What the row kernels work on, for one channel of one row.
+ */
+typedef struct {
+  unsigned short *vals;		/* Input value, then threshold, of each pixel */
+  unsigned char *codes;		/* Code of each pixel, then bits of each level */
+  unsigned short *where;	/* Breakpoints of each level of each pixel */
+} stpi_ordered_scratch_t;
+
 typedef struct {
   unsigned short shift;
   unsigned short mask;
   unsigned short x_mask;
   stpi_new_ordered_t *ord_new;
+  stpi_ordered_scratch_t scratch[STPI_DITHER_LANES];
 } stpi_ordered_t;
 
 static int
@@ -272,6 +284,13 @@ free_dither_ordered(stpi_dither_t *d)
       if (dc->aux_data)
 	{
 	  stpi_ordered_t *ord = (stpi_ordered_t *) dc->aux_data;
+	  int j;
+	  for (j = 0; j < STPI_DITHER_LANES; j++)
+	    {
+	      STP_SAFE_FREE(ord->scratch[j].vals);
+	      STP_SAFE_FREE(ord->scratch[j].codes);
+	      STP_SAFE_FREE(ord->scratch[j].where);
+	    }
 	  if (ord->ord_new && (i == 0 || ord->ord_new != no0))
 	    {
 	      stpi_new_ordered_t *no = (stpi_new_ordered_t *) ord->ord_new;
@@ -288,20 +307,58 @@ free_dither_ordered(stpi_dither_t *d)
   stp_free(d->aux_data);
 }
 
+static int
+ordered_one_bit_only(const stpi_dither_t *d)
+{
+  int i;
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      const stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->nlevels != 1 || dc->ranges[0].upper->bits != 1)
+	return 0;
+    }
+  return 1;
+}
+
 static void
 init_dither_ordered(stpi_dither_t *d, stp_vars_t *v)
 {
-  int i;
-  d->aux_data = stp_malloc(1);
+  int i, x, offset;
+  int one_bit_only = ordered_one_bit_only(d);
+  int xstep = CHANNEL_COUNT(d) * (d->src_width / d->dst_width);
+  int xmod = d->src_width % d->dst_width;
+  int xerror = 0;
+  int *index = stp_malloc((d->dst_width + 1) * sizeof(int));
+
+  /*
+   * Where each pixel's input is, as ADVANCE_UNIDIRECTIONAL() would
+   * find it.  This is the same for every row.
+   */
+  for (x = 0, offset = 0; x < d->dst_width; x++)
+    {
+      index[x] = offset;
+      offset += xstep;
+      if (xmod)
+	{
+	  xerror += xmod;
+	  if (xerror >= d->dst_width)
+	    {
+	      xerror -= d->dst_width;
+	      offset += CHANNEL_COUNT(d);
+	    }
+	}
+    }
+  d->aux_data = index;
   d->aux_freefunc = &free_dither_ordered;
   stp_dprintf(STP_DBG_INK, v, "init_dither_ordered\n");
   for (i = 0; i < CHANNEL_COUNT(d); i++)
     {
       stpi_dither_channel_t *dc = &CHANNEL(d, i);
       stpi_ordered_t *s;
-      dc->aux_data = stp_malloc(sizeof(stpi_ordered_t));
+      dc->aux_data = stp_zalloc(sizeof(stpi_ordered_t));
       s = (stpi_ordered_t *) dc->aux_data;
-      s->ord_new = NULL;
+      if (one_bit_only)
+	continue;
       if (d->stpi_dither_type & D_ORDERED_SEGMENTED)
 	{
 	  s->shift = 16 - dc->signif_bits;
@@ -328,15 +385,30 @@ init_dither_ordered(stpi_dither_t *d, stp_vars_t *v)
     }
 }
 
+/*
+ * Set up the ordered dither (and the segmented and new ordered dithers,
+ * if they're needed) for any dither that uses it.  This is done once,
+ * when the dither is finalized, rather than on the first row, since
+ * the channels and rows may be dithered in parallel.
+ */
 void
-stpi_dither_ordered(stp_vars_t *v,
-		    int row,
-		    const unsigned short *raw,
-		    int duplicate_line,
-		    int zero_mask,
-		    const unsigned char *mask)
+stpi_dither_ordered_init(stp_vars_t *v, stpi_dither_t *d)
+{
+  if (! d->aux_data && d->dst_width > 0 &&
+      (d->ditherfunc == stpi_dither_ordered ||
+       (d->ditherfunc == stpi_dither_ed &&
+	(d->stpi_dither_type & D_ADAPTIVE_BASE))))
+    init_dither_ordered(d, v);
+}
+
+static void
+dither_ordered_pixels(stpi_dither_t *d,
+		      int row,
+		      const unsigned short *raw,
+		      int duplicate_line,
+		      int zero_mask,
+		      const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
 		length;
   unsigned char	bit;
@@ -365,17 +437,13 @@ stpi_dither_ordered(stp_vars_t *v,
       if (dc->nlevels != 1 || dc->ranges[0].upper->bits != 1)
 	one_bit_only = 0;
     }
-  if (! one_bit_only && ! d->aux_data &&
-      (d->stpi_dither_type & (D_ORDERED_SEGMENTED | D_ORDERED_NEW)))
-    init_dither_ordered(d, v);
-
   if (one_bit_only)
     {
       for (x = 0; x < d->dst_width; x ++)
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (raw[i] &&
 		      raw[i] >= ditherpoint(d, &(CHANNEL(d, i).dithermat), x))
@@ -395,7 +463,7 @@ stpi_dither_ordered(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  stpi_dither_channel_t *dc = &CHANNEL(d, i);
 		  stpi_ordered_t *s = (stpi_ordered_t *) dc->aux_data;
@@ -439,7 +507,7 @@ stpi_dither_ordered(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (CHANNEL(d, i).ptr && raw[i])
 		    print_color_ordered(d, &(CHANNEL(d, i)), raw[i], x, row,
@@ -456,7 +524,7 @@ stpi_dither_ordered(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (CHANNEL(d, i).ptr && raw[i])
 		    print_color_ordered_new(d, &(CHANNEL(d, i)), raw[i], x,
@@ -468,3 +536,758 @@ stpi_dither_ordered(stp_vars_t *v,
 	}
     }
 }
+
+/*
+ * Row kernels.  Rather than looking up the dither matrix and laying
+ * down the bits a pixel at a time, dither_ordered_row() collects a
+ * channel's input for the whole row, along with the row's thresholds
+ * (the current row of the channel's dither matrix, repeated across the
+ * width of the output), decides what to print for all of the pixels at
+ * once, and then packs those decisions into the bit planes.  The plain
+ * C versions are always available; on x86 builds with a compiler that
+ * can target them there are also SSE2 and AVX2 versions, which handle
+ * 16 or 32 pixels at a time.  stpi_init_dither_kernels() picks the
+ * best set the CPU supports; setting STP_DITHER_KERNELS to the name of
+ * a set ("scalar", "sse2" or "avx2") overrides the choice, and "none"
+ * dithers a pixel at a time.
+ */
+
+/*
+ * The ranges of a channel, as print_color_ordered() sees them.  bits
+ * holds the bits to print for the top of the range in its upper byte
+ * and those for the bottom in its lower byte.  span is at most 65535;
+ * print_color_ordered() doesn't scale the position within wider ranges,
+ * and comparing with a span of 65535 has the same effect.
+ */
+#define STPI_ORDERED_MAX_RANGES 16
+
+typedef struct
+{
+  int count;
+  unsigned short lower[STPI_ORDERED_MAX_RANGES];
+  unsigned short span[STPI_ORDERED_MAX_RANGES];
+  unsigned short bits[STPI_ORDERED_MAX_RANGES];
+} ordered_ranges_t;
+
+typedef struct
+{
+  const char *name;
+  /*
+   * For the highest range i with lower[i] < val[x],
+   * out[x] = the upper byte of bits[i] if
+   * (val[x] - lower[i]) * 65535 / span[i] >= thr[x],
+   * and the lower byte if not; 0 if there is no such range.
+   */
+  void (*select)(const unsigned short *val, const unsigned short *thr,
+		 const ordered_ranges_t *ranges, unsigned char *out, int n);
+  /*
+   * out[x] = bits[i] for the highest i < levels for which
+   * thr[x] < where[i * stride + x], or 0 if there is none
+   */
+  void (*select_levels)(const unsigned short *where, int stride, int levels,
+			const unsigned short *thr, const unsigned char *bits,
+			unsigned char *out, int n);
+  /*
+   * OR bit p of codes[x] into pixel x of plane p (which starts at
+   * out + p * length) for p < planes, except for the pixels that are
+   * masked off.  *first and *last are set to the first and last pixels
+   * that got any bits, or -1 if none did.
+   */
+  void (*pack)(const unsigned char *codes, int n, int planes,
+	       unsigned char *out, int length, const unsigned char *mask,
+	       int *first, int *last);
+} dither_kernels_t;
+
+/*
+ * (val - lower) * 65535 / span >= thr exactly when
+ * (val - lower) * 65535 >= thr * span, which needs no division.
+ */
+static void
+select_scalar(const unsigned short *val, const unsigned short *thr,
+	      const ordered_ranges_t *ranges, unsigned char *out, int n)
+{
+  int x, i;
+  for (x = 0; x < n; x++)
+    {
+      unsigned char code = 0;
+      for (i = ranges->count - 1; i >= 0; i--)
+	if (val[x] > ranges->lower[i])
+	  {
+	    unsigned rangepoint = (unsigned) (val[x] - ranges->lower[i]) * 65535u;
+	    if (rangepoint >= (unsigned) thr[x] * ranges->span[i])
+	      code = ranges->bits[i] >> 8;
+	    else
+	      code = ranges->bits[i] & 0xff;
+	    break;
+	  }
+      out[x] = code;
+    }
+}
+
+static void
+select_levels_scalar(const unsigned short *where, int stride, int levels,
+		     const unsigned short *thr, const unsigned char *bits,
+		     unsigned char *out, int n)
+{
+  int x, i;
+  for (x = 0; x < n; x++)
+    {
+      unsigned char code = 0;
+      for (i = 0; i < levels; i++)
+	if (thr[x] < where[i * stride + x])
+	  code = bits[i];
+      out[x] = code;
+    }
+}
+
+static void
+pack_scalar(const unsigned char *codes, int n, int planes,
+	    unsigned char *out, int length, const unsigned char *mask,
+	    int *first, int *last)
+{
+  int x, p;
+  *first = -1;
+  *last = -1;
+  for (x = 0; x < n; x++)
+    {
+      unsigned char bit = 128 >> (x & 7);
+      unsigned code = codes[x];
+      if (!code || (mask && !(mask[x / 8] & bit)))
+	continue;
+      if (*first < 0)
+	*first = x;
+      *last = x;
+      for (p = 0; p < planes; p++, code >>= 1)
+	if (code & 1)
+	  out[p * length + x / 8] |= bit;
+    }
+}
+
+static const dither_kernels_t scalar_dither_kernels =
+{
+  "scalar",
+  select_scalar,
+  select_levels_scalar,
+  pack_scalar
+};
+
+static const dither_kernels_t no_dither_kernels =
+{
+  "none",
+  NULL,
+  NULL,
+  NULL
+};
+
+#if (defined(__i386__) || defined(__x86_64__)) &&			\
+  (defined(__clang__) ||						\
+   (defined(__GNUC__) &&						\
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STPI_X86_DITHER_KERNELS
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+/*
+ * The vector pack kernels reverse the pixels within each group of
+ * eight, so that the movemask instructions put the first pixel of a
+ * group in the high bit of its byte.  The masks they work with have
+ * one byte per group of eight pixels.
+ */
+static inline int
+first_pixel(unsigned live)
+{
+  int byte = __builtin_ctz(live) / 8;
+  return byte * 8 + __builtin_clz((live >> (byte * 8)) & 0xff) - 24;
+}
+
+static inline int
+last_pixel(unsigned live)
+{
+  int byte = (31 - __builtin_clz(live)) / 8;
+  return byte * 8 + 7 - __builtin_ctz((live >> (byte * 8)) & 0xff);
+}
+
+/*
+ * Pack the rest of the row, which starts with a whole byte, a pixel at
+ * a time.
+ */
+static void
+pack_tail(const unsigned char *codes, int x, int n, int planes,
+	  unsigned char *out, int length, const unsigned char *mask,
+	  int *first, int *last)
+{
+  int tail_first, tail_last;
+  if (x >= n)
+    return;
+  pack_scalar(codes + x, n - x, planes, out + x / 8, length,
+	      mask ? mask + x / 8 : NULL, &tail_first, &tail_last);
+  if (tail_first >= 0)
+    {
+      if (*first < 0)
+	*first = x + tail_first;
+      *last = x + tail_last;
+    }
+}
+
+/*
+ * select for 8 pixels, leaving each code in a 16-bit lane.  SSE2 has
+ * no unsigned 32-bit comparison, so both sides are offset by 2^31.
+ */
+SSE2 static inline __m128i
+select_8_sse2(const unsigned short *val, const unsigned short *thr,
+	      const ordered_ranges_t *ranges)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i bias = _mm_set1_epi32((int) 0x80000000u);
+  __m128i v = _mm_loadu_si128((const __m128i *) val);
+  __m128i t = _mm_loadu_si128((const __m128i *) thr);
+  __m128i lower = zero;
+  __m128i span = zero;
+  __m128i bits = zero;
+  __m128i a, a0, a1, p_lo, p_hi, gt0, gt1, gt;
+  int i;
+  for (i = 0; i < ranges->count; i++)
+    {
+      /* The pixels with val <= lower[i] stay where they were */
+      __m128i keep =
+	_mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16((short) ranges->lower[i])),
+			zero);
+      lower = _mm_or_si128(_mm_and_si128(keep, lower),
+			   _mm_andnot_si128(keep, _mm_set1_epi16((short) ranges->lower[i])));
+      span = _mm_or_si128(_mm_and_si128(keep, span),
+			  _mm_andnot_si128(keep, _mm_set1_epi16((short) ranges->span[i])));
+      bits = _mm_or_si128(_mm_and_si128(keep, bits),
+			  _mm_andnot_si128(keep, _mm_set1_epi16((short) ranges->bits[i])));
+    }
+  a = _mm_sub_epi16(v, lower);
+  a0 = _mm_unpacklo_epi16(a, zero);
+  a1 = _mm_unpackhi_epi16(a, zero);
+  a0 = _mm_sub_epi32(_mm_slli_epi32(a0, 16), a0);
+  a1 = _mm_sub_epi32(_mm_slli_epi32(a1, 16), a1);
+  p_lo = _mm_mullo_epi16(t, span);
+  p_hi = _mm_mulhi_epu16(t, span);
+  gt0 = _mm_cmpgt_epi32(_mm_xor_si128(_mm_unpacklo_epi16(p_lo, p_hi), bias),
+			_mm_xor_si128(a0, bias));
+  gt1 = _mm_cmpgt_epi32(_mm_xor_si128(_mm_unpackhi_epi16(p_lo, p_hi), bias),
+			_mm_xor_si128(a1, bias));
+  /* Where thr * span > (val - lower) * 65535, print the lower bits */
+  gt = _mm_packs_epi32(gt0, gt1);
+  return _mm_or_si128(_mm_and_si128(gt, _mm_and_si128(bits, _mm_set1_epi16(0xff))),
+		      _mm_andnot_si128(gt, _mm_srli_epi16(bits, 8)));
+}
+
+SSE2 static void
+select_sse2(const unsigned short *val, const unsigned short *thr,
+	    const ordered_ranges_t *ranges, unsigned char *out, int n)
+{
+  int x;
+  for (x = 0; n - x >= 16; x += 16)
+    _mm_storeu_si128((__m128i *) (out + x),
+		     _mm_packus_epi16(select_8_sse2(val + x, thr + x, ranges),
+				      select_8_sse2(val + x + 8, thr + x + 8,
+						    ranges)));
+  select_scalar(val + x, thr + x, ranges, out + x, n - x);
+}
+
+SSE2 static void
+select_levels_sse2(const unsigned short *where, int stride, int levels,
+		   const unsigned short *thr, const unsigned char *bits,
+		   unsigned char *out, int n)
+{
+  __m128i zero = _mm_setzero_si128();
+  int x, i;
+  for (x = 0; n - x >= 16; x += 16)
+    {
+      __m128i thr0 = _mm_loadu_si128((const __m128i *) (thr + x));
+      __m128i thr1 = _mm_loadu_si128((const __m128i *) (thr + x + 8));
+      __m128i code = zero;
+      for (i = 0; i < levels; i++)
+	{
+	  const unsigned short *w = where + i * stride + x;
+	  /* Where the level doesn't print, where <= thr */
+	  __m128i le0 =
+	    _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128((const __m128i *) w),
+					   thr0), zero);
+	  __m128i le1 =
+	    _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128((const __m128i *) (w + 8)),
+					   thr1), zero);
+	  __m128i le = _mm_packs_epi16(le0, le1);
+	  code = _mm_or_si128(_mm_and_si128(le, code),
+			      _mm_andnot_si128(le, _mm_set1_epi8((char) bits[i])));
+	}
+      _mm_storeu_si128((__m128i *) (out + x), code);
+    }
+  select_levels_scalar(where + x, stride, levels, thr + x, bits, out + x,
+		       n - x);
+}
+
+SSE2 static void
+pack_sse2(const unsigned char *codes, int n, int planes,
+	  unsigned char *out, int length, const unsigned char *mask,
+	  int *first, int *last)
+{
+  __m128i zero = _mm_setzero_si128();
+  int x, p;
+  *first = -1;
+  *last = -1;
+  for (x = 0; n - x >= 16; x += 16)
+    {
+      __m128i c = _mm_loadu_si128((const __m128i *) (codes + x));
+      unsigned live;
+      c = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0x1b), 0x1b);
+      c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+      live = _mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)) ^ 0xffffu;
+      if (mask)
+	live &= mask[x / 8] | (mask[x / 8 + 1] << 8);
+      if (!live)
+	continue;
+      if (*first < 0)
+	*first = x + first_pixel(live);
+      *last = x + last_pixel(live);
+      for (p = 0; p < planes; p++)
+	{
+	  unsigned char *o = out + p * length + x / 8;
+	  unsigned bits =
+	    _mm_movemask_epi8(_mm_sll_epi16(c, _mm_cvtsi32_si128(7 - p))) & live;
+	  o[0] |= bits;
+	  o[1] |= bits >> 8;
+	}
+    }
+  pack_tail(codes, x, n, planes, out, length, mask, first, last);
+}
+
+static const dither_kernels_t sse2_dither_kernels =
+{
+  "sse2",
+  select_sse2,
+  select_levels_sse2,
+  pack_sse2
+};
+
+AVX2 static inline __m256i
+select_16_avx2(const unsigned short *val, const unsigned short *thr,
+	       const ordered_ranges_t *ranges)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i v = _mm256_loadu_si256((const __m256i *) val);
+  __m256i t = _mm256_loadu_si256((const __m256i *) thr);
+  __m256i lower = zero;
+  __m256i span = zero;
+  __m256i bits = zero;
+  __m256i a, a0, a1, p_lo, p_hi, p0, p1, ge;
+  int i;
+  for (i = 0; i < ranges->count; i++)
+    {
+      __m256i keep =
+	_mm256_cmpeq_epi16(_mm256_subs_epu16(v, _mm256_set1_epi16((short) ranges->lower[i])),
+			   zero);
+      lower = _mm256_blendv_epi8(_mm256_set1_epi16((short) ranges->lower[i]),
+				 lower, keep);
+      span = _mm256_blendv_epi8(_mm256_set1_epi16((short) ranges->span[i]),
+				span, keep);
+      bits = _mm256_blendv_epi8(_mm256_set1_epi16((short) ranges->bits[i]),
+				bits, keep);
+    }
+  a = _mm256_sub_epi16(v, lower);
+  a0 = _mm256_unpacklo_epi16(a, zero);
+  a1 = _mm256_unpackhi_epi16(a, zero);
+  a0 = _mm256_sub_epi32(_mm256_slli_epi32(a0, 16), a0);
+  a1 = _mm256_sub_epi32(_mm256_slli_epi32(a1, 16), a1);
+  p_lo = _mm256_mullo_epi16(t, span);
+  p_hi = _mm256_mulhi_epu16(t, span);
+  p0 = _mm256_unpacklo_epi16(p_lo, p_hi);
+  p1 = _mm256_unpackhi_epi16(p_lo, p_hi);
+  /* (val - lower) * 65535 >= thr * span */
+  ge = _mm256_packs_epi32(_mm256_cmpeq_epi32(_mm256_max_epu32(a0, p0), a0),
+			  _mm256_cmpeq_epi32(_mm256_max_epu32(a1, p1), a1));
+  return _mm256_blendv_epi8(_mm256_and_si256(bits, _mm256_set1_epi16(0xff)),
+			    _mm256_srli_epi16(bits, 8), ge);
+}
+
+AVX2 static void
+select_avx2(const unsigned short *val, const unsigned short *thr,
+	    const ordered_ranges_t *ranges, unsigned char *out, int n)
+{
+  int x;
+  for (x = 0; n - x >= 32; x += 32)
+    {
+      __m256i codes =
+	_mm256_packus_epi16(select_16_avx2(val + x, thr + x, ranges),
+			    select_16_avx2(val + x + 16, thr + x + 16, ranges));
+      /* The pack works within each half, so put the quarters back in order */
+      _mm256_storeu_si256((__m256i *) (out + x),
+			  _mm256_permute4x64_epi64(codes, 0xd8));
+    }
+  select_scalar(val + x, thr + x, ranges, out + x, n - x);
+}
+
+AVX2 static void
+select_levels_avx2(const unsigned short *where, int stride, int levels,
+		   const unsigned short *thr, const unsigned char *bits,
+		   unsigned char *out, int n)
+{
+  __m256i zero = _mm256_setzero_si256();
+  int x, i;
+  for (x = 0; n - x >= 32; x += 32)
+    {
+      __m256i thr0 = _mm256_loadu_si256((const __m256i *) (thr + x));
+      __m256i thr1 = _mm256_loadu_si256((const __m256i *) (thr + x + 16));
+      __m256i code = zero;
+      for (i = 0; i < levels; i++)
+	{
+	  const unsigned short *w = where + i * stride + x;
+	  __m256i le0 =
+	    _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_loadu_si256((const __m256i *) w),
+						 thr0), zero);
+	  __m256i le1 =
+	    _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_loadu_si256((const __m256i *) (w + 16)),
+						 thr1), zero);
+	  __m256i le =
+	    _mm256_permute4x64_epi64(_mm256_packs_epi16(le0, le1), 0xd8);
+	  code = _mm256_blendv_epi8(_mm256_set1_epi8((char) bits[i]), code, le);
+	}
+      _mm256_storeu_si256((__m256i *) (out + x), code);
+    }
+  select_levels_scalar(where + x, stride, levels, thr + x, bits, out + x,
+		       n - x);
+}
+
+AVX2 static void
+pack_avx2(const unsigned char *codes, int n, int planes,
+	  unsigned char *out, int length, const unsigned char *mask,
+	  int *first, int *last)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+				     15, 14, 13, 12, 11, 10, 9, 8,
+				     7, 6, 5, 4, 3, 2, 1, 0,
+				     15, 14, 13, 12, 11, 10, 9, 8);
+  int x, p;
+  *first = -1;
+  *last = -1;
+  for (x = 0; n - x >= 32; x += 32)
+    {
+      __m256i c =
+	_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (codes + x)),
+			    reverse);
+      unsigned live =
+	~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, zero));
+      if (mask)
+	live &= mask[x / 8] | (mask[x / 8 + 1] << 8) |
+	  (mask[x / 8 + 2] << 16) | ((unsigned) mask[x / 8 + 3] << 24);
+      if (!live)
+	continue;
+      if (*first < 0)
+	*first = x + first_pixel(live);
+      *last = x + last_pixel(live);
+      for (p = 0; p < planes; p++)
+	{
+	  unsigned char *o = out + p * length + x / 8;
+	  unsigned bits = (unsigned)
+	    _mm256_movemask_epi8(_mm256_sll_epi16(c, _mm_cvtsi32_si128(7 - p))) & live;
+	  o[0] |= bits;
+	  o[1] |= bits >> 8;
+	  o[2] |= bits >> 16;
+	  o[3] |= bits >> 24;
+	}
+    }
+  pack_tail(codes, x, n, planes, out, length, mask, first, last);
+}
+
+static const dither_kernels_t avx2_dither_kernels =
+{
+  "avx2",
+  select_avx2,
+  select_levels_avx2,
+  pack_avx2
+};
+
+#endif /* STPI_X86_DITHER_KERNELS */
+
+static const dither_kernels_t *dither_kernels = &scalar_dither_kernels;
+
+static const dither_kernels_t *
+find_dither_kernels(const char *name)
+{
+  if (strcmp(name, scalar_dither_kernels.name) == 0)
+    return &scalar_dither_kernels;
+  if (strcmp(name, no_dither_kernels.name) == 0)
+    return &no_dither_kernels;
+#ifdef STPI_X86_DITHER_KERNELS
+  __builtin_cpu_init();
+  if (strcmp(name, sse2_dither_kernels.name) == 0 &&
+      __builtin_cpu_supports("sse2"))
+    return &sse2_dither_kernels;
+  if (strcmp(name, avx2_dither_kernels.name) == 0 &&
+      __builtin_cpu_supports("avx2"))
+    return &avx2_dither_kernels;
+#endif
+  return NULL;
+}
+
+int
+stpi_set_dither_kernels(const char *name)
+{
+  const dither_kernels_t *kernels = find_dither_kernels(name);
+  if (!kernels)
+    return 0;
+  dither_kernels = kernels;
+  return 1;
+}
+
+void
+stpi_init_dither_kernels(void)
+{
+  const char *name = getenv("STP_DITHER_KERNELS");
+  if (!name || !stpi_set_dither_kernels(name))
+    if (!stpi_set_dither_kernels("avx2"))
+      (void) stpi_set_dither_kernels("sse2");
+  stp_deprintf(STP_DBG_INK, "Using %s dither kernels\n",
+	       dither_kernels->name);
+}
+
+/*
+ * Fill thr with the dither matrix's current row, starting where pixel
+ * 0 falls in it and repeated out to width pixels, so that thr[x] is
+ * what ditherpoint() returns for pixel x.  Returns 0 if any of the
+ * values doesn't fit in 16 bits.
+ */
+static int
+threshold_row(const stp_dither_matrix_impl_t *mat, unsigned short *thr,
+	      int width)
+{
+  const unsigned *matrix = mat->matrix + mat->last_y_mod;
+  int period = mat->x_size;
+  int x, col;
+  if (mat->x_offset < 0 || period <= 0)
+    return 0;
+  if (period > width)
+    period = width;
+  col = mat->x_offset % mat->x_size;
+  for (x = 0; x < period; x++)
+    {
+      if (matrix[col] > 65535)
+	return 0;
+      thr[x] = matrix[col];
+      if (++col == mat->x_size)
+	col = 0;
+    }
+  while (x < width)
+    {
+      int count = x < width - x ? x : width - x;
+      memcpy(thr + x, thr, count * sizeof(unsigned short));
+      x += count;
+    }
+  return 1;
+}
+
+/*
+ * Fill in the ranges of the channel for select.  Returns the number of
+ * bit planes it prints to, or -1 if the kernels can't handle it.
+ */
+static int
+channel_ranges(const stpi_dither_channel_t *dc, ordered_ranges_t *ranges)
+{
+  unsigned all_bits = 0;
+  int planes = 0;
+  int i;
+  if (dc->nlevels > STPI_ORDERED_MAX_RANGES)
+    return -1;
+  ranges->count = dc->nlevels;
+  for (i = 0; i < dc->nlevels; i++)
+    {
+      const stpi_dither_segment_t *dd = &(dc->ranges[i]);
+      if (dd->lower->value > 65535 || dd->lower->bits > 255 ||
+	  dd->upper->bits > 255)
+	return -1;
+      ranges->lower[i] = dd->lower->value;
+      ranges->span[i] = dd->value_span < 65535 ? dd->value_span : 65535;
+      ranges->bits[i] = (dd->upper->bits << 8) | dd->lower->bits;
+      all_bits |= dd->upper->bits | dd->lower->bits;
+    }
+  for (; all_bits; all_bits >>= 1)
+    planes++;
+  return planes;
+}
+
+typedef enum
+{
+  ORDERED_ONE_BIT,		/* Every channel has one level of one bit */
+  ORDERED_RANGES,		/* print_color_ordered() */
+  ORDERED_NEW_LEVELS		/* print_color_ordered_new() */
+} ordered_mode_t;
+
+/*
+ * Dither the row a channel at a time with the row kernels.  Any
+ * channel that they can't handle is dithered a pixel at a time.
+ * The buffers the kernels work in are allocated the first time each
+ * channel is dithered in each lane, and kept until the dither is
+ * freed.
+ */
+static void
+dither_ordered_row(stpi_dither_t *d,
+		   int row,
+		   const unsigned short *raw,
+		   int duplicate_line,
+		   int zero_mask,
+		   const unsigned char *mask,
+		   ordered_mode_t mode)
+{
+  int width = d->dst_width;
+  int length = (width + 7) / 8;
+  int first_channel = d->first_channel;
+  int last_channel = d->last_channel;
+  const int *index = (const int *) d->aux_data;
+  int i, x;
+
+  for (i = first_channel; i < last_channel; i++)
+    {
+      stpi_dither_channel_t *dc = &CHANNEL(d, i);
+      stpi_ordered_t *o = (stpi_ordered_t *) dc->aux_data;
+      stpi_ordered_scratch_t *sc = &(o->scratch[d->lane]);
+      const unsigned short *in = raw + i;
+      unsigned short *vals;
+      unsigned short *thr;
+      unsigned char *codes;
+      unsigned short any = 0;
+      int planes = -1;
+      int first, last;
+      if (!dc->ptr)
+	continue;
+      if (!sc->vals)
+	{
+	  sc->vals = stp_malloc(width * 2 * sizeof(unsigned short));
+	  sc->codes = stp_malloc(width + dc->nlevels);
+	}
+      vals = sc->vals;
+      thr = vals + width;
+      codes = sc->codes;
+      for (x = 0; x < width; x++)
+	{
+	  vals[x] = in[index[x]];
+	  any |= vals[x];
+	}
+      /* Zero is never printed */
+      if (!any)
+	continue;
+      if (threshold_row(&(dc->dithermat), thr, width))
+	switch (mode)
+	  {
+	  case ORDERED_ONE_BIT:
+	    {
+	      static const ordered_ranges_t one_bit = { 1, { 0 }, { 65535 },
+							{ 0x100 } };
+	      dither_kernels->select(vals, thr, &one_bit, codes, width);
+	      planes = 1;
+	    }
+	    break;
+	  case ORDERED_RANGES:
+	    {
+	      ordered_ranges_t ranges;
+	      planes = channel_ranges(dc, &ranges);
+	      if (planes > 0)
+		dither_kernels->select(vals, thr, &ranges, codes, width);
+	    }
+	    break;
+	  case ORDERED_NEW_LEVELS:
+	    {
+	      int nl = dc->nlevels - 1;
+	      unsigned char *level_bits = codes + width;
+	      unsigned all_bits = 0;
+	      int j;
+	      if (nl <= 0)
+		{
+		  /* Nothing is ever printed */
+		  planes = 0;
+		  break;
+		}
+	      if (!o->ord_new)
+		break;
+	      for (j = 0; j < nl; j++)
+		all_bits |= dc->ranges[j].upper->bits;
+	      if (all_bits > 255)
+		break;
+	      for (j = 0; j < nl; j++)
+		level_bits[j] = dc->ranges[j].upper->bits;
+	      if (!sc->where)
+		sc->where = stp_malloc(width * nl * sizeof(unsigned short));
+	      for (x = 0; x < width; x++)
+		{
+		  const unsigned short *w = o->ord_new->lut + vals[x] * nl;
+		  for (j = 0; j < nl; j++)
+		    sc->where[j * width + x] = vals[x] ? w[j] : 0;
+		}
+	      dither_kernels->select_levels(sc->where, width, nl, thr,
+					    level_bits, codes, width);
+	      for (planes = 0; all_bits; all_bits >>= 1)
+		planes++;
+	    }
+	    break;
+	  }
+      if (planes < 0)
+	{
+	  d->first_channel = i;
+	  d->last_channel = i + 1;
+	  d->ptr_offset = 0;
+	  dither_ordered_pixels(d, row, raw, duplicate_line, zero_mask, mask);
+	  d->first_channel = first_channel;
+	  d->last_channel = last_channel;
+	}
+      else if (planes > 0)
+	{
+	  dither_kernels->pack(codes, width, planes, dc->ptr, length, mask,
+			       &first, &last);
+	  if (first >= 0)
+	    {
+	      if (dc->row_ends[0] == -1)
+		dc->row_ends[0] = first;
+	      dc->row_ends[1] = last;
+	    }
+	}
+    }
+  d->ptr_offset = width / 8;
+}
+
+void
+stpi_dither_ordered(stpi_dither_t *d,
+		    int row,
+		    const unsigned short *raw,
+		    int duplicate_line,
+		    int zero_mask,
+		    const unsigned char *mask)
+{
+  int i;
+  int one_bit_only = 1;
+  int one_level_only = 1;
+
+  if ((zero_mask & ((1 << CHANNEL_COUNT(d)) - 1)) ==
+      ((1 << CHANNEL_COUNT(d)) - 1))
+    return;
+
+  for (i = 0; i < CHANNEL_COUNT(d); i++)
+    {
+      stpi_dither_channel_t *dc = &(CHANNEL(d, i));
+      if (dc->nlevels != 1)
+	one_level_only = 0;
+      if (dc->nlevels != 1 || dc->ranges[0].upper->bits != 1)
+	one_bit_only = 0;
+    }
+  /*
+   * The row kernels start at the beginning of the row, and the
+   * segmented dither is only done a pixel at a time.
+   */
+  if (!dither_kernels->pack || !d->aux_data || d->ptr_offset != 0)
+    dither_ordered_pixels(d, row, raw, duplicate_line, zero_mask, mask);
+  else if (one_bit_only)
+    dither_ordered_row(d, row, raw, duplicate_line, zero_mask, mask,
+		       ORDERED_ONE_BIT);
+  else if (d->stpi_dither_type & D_ORDERED_SEGMENTED)
+    dither_ordered_pixels(d, row, raw, duplicate_line, zero_mask, mask);
+  else if (one_level_only || !(d->stpi_dither_type == D_ORDERED_NEW))
+    dither_ordered_row(d, row, raw, duplicate_line, zero_mask, mask,
+		       ORDERED_RANGES);
+  else
+    dither_ordered_row(d, row, raw, duplicate_line, zero_mask, mask,
+		       ORDERED_NEW_LEVELS);
+}
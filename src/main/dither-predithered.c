@@ -53,14 +53,13 @@ print_color_very_fast(const stpi_dither_t *d, stpi_dither_channel_t *dc,
 }
 
 void
-stpi_dither_predithered(stp_vars_t *v,
+stpi_dither_predithered(stpi_dither_t *d,
 			int row,
 			const unsigned short *raw,
 			int duplicate_line,
 			int zero_mask,
 			const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
 		length;
   unsigned char	bit;
@@ -95,7 +94,7 @@ stpi_dither_predithered(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (raw[i] & 1)
 		    {
@@ -114,7 +113,7 @@ stpi_dither_predithered(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (CHANNEL(d, i).ptr && raw[i])
 		    print_color_very_fast(d, &(CHANNEL(d, i)), raw[i], x, row,
@@ -57,14 +57,13 @@ print_color_very_fast(const stpi_dither_t *d, stpi_dither_channel_t *dc,
 }
 
 void
-stpi_dither_very_fast(stp_vars_t *v,
+stpi_dither_very_fast(stpi_dither_t *d,
 		      int row,
 		      const unsigned short *raw,
 		      int duplicate_line,
 		      int zero_mask,
 		      const unsigned char *mask)
 {
-  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
   int		x,
 		length;
   unsigned char *bit_patterns;
@@ -100,7 +99,7 @@ stpi_dither_very_fast(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (raw[i] &&
 		      raw[i] >= ditherpoint(d, &(CHANNEL(d, i).dithermat), x))
@@ -120,7 +119,7 @@ stpi_dither_very_fast(stp_vars_t *v,
 	{
 	  if (!mask || (*(mask + d->ptr_offset) & bit))
 	    {
-	      for (i = 0; i < CHANNEL_COUNT(d); i++)
+	      for (i = d->first_channel; i < d->last_channel; i++)
 		{
 		  if (CHANNEL(d, i).ptr && raw[i])
 		    print_color_very_fast(d, &(CHANNEL(d, i)), raw[i], x, row,
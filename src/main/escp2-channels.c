@@ -31,6 +31,18 @@
 
 static inkgroup_t *default_black_inkgroup;
 
+/*
+ * Ink groups are never modified once loaded, and many models use the
+ * same one, so each file is only loaded once and shared.
+ */
+typedef struct
+{
+  char *file;
+  inkgroup_t *inkgroup;
+} inkgroup_cache_t;
+
+static stp_list_t *inkgroup_cache;
+
 static void
 load_subchannel(stp_mxml_node_t *node, stp_mxml_node_t *root, physical_subchannel_t *icl)
 {
@@ -409,7 +421,7 @@ load_inkgroup(const char *name)
       const char *dn = (const char *) stp_list_item_get_data(item);
       char *ffn = stpi_path_merge(dn, name);
       stp_mxml_node_t *inkgroup =
-	stp_mxmlLoadFromFile(NULL, ffn, STP_MXML_NO_CALLBACK);
+	stpi_xml_load_file(ffn);
       stp_free(ffn);
       if (inkgroup)
 	{
@@ -453,11 +465,44 @@ load_inkgroup(const char *name)
   return igl;
 }
 
+static const char *
+inkgroup_cache_namefunc(const void *item)
+{
+  const inkgroup_cache_t *ic = (const inkgroup_cache_t *) item;
+  return ic->file;
+}
+
+static inkgroup_t *
+get_inkgroup(const char *name)
+{
+  stp_list_item_t *item;
+  inkgroup_t *inkgroup;
+  stpi_data_lock();
+  if (!inkgroup_cache)
+    {
+      inkgroup_cache = stp_list_create();
+      stp_list_set_namefunc(inkgroup_cache, inkgroup_cache_namefunc);
+    }
+  item = stp_list_get_item_by_name(inkgroup_cache, name);
+  if (item)
+    inkgroup = ((inkgroup_cache_t *) stp_list_item_get_data(item))->inkgroup;
+  else
+    {
+      inkgroup_cache_t *ic = stp_malloc(sizeof(inkgroup_cache_t));
+      ic->file = stp_strdup(name);
+      ic->inkgroup = load_inkgroup(name);
+      stp_list_item_create(inkgroup_cache, NULL, ic);
+      inkgroup = ic->inkgroup;
+    }
+  stpi_data_unlock();
+  return inkgroup;
+}
+
 int
 stp_escp2_load_inkgroup(const stp_vars_t *v, const char *name)
 {
   stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
-  inkgroup_t *igl = load_inkgroup(name);
+  inkgroup_t *igl = get_inkgroup(name);
   STPI_ASSERT(igl, v);
   printdef->inkgroup = igl;
   return (igl != NULL);
@@ -466,6 +511,7 @@ stp_escp2_load_inkgroup(const stp_vars_t *v, const char *name)
 const inkname_t *
 stpi_escp2_get_default_black_inkset(void)
 {
+  stpi_data_lock();
   if (! default_black_inkgroup)
     {
       default_black_inkgroup = load_inkgroup("escp2/inks/defaultblack.xml");
@@ -473,5 +519,6 @@ stpi_escp2_get_default_black_inkset(void)
 		  default_black_inkgroup->n_inklists >= 1 &&
 		  default_black_inkgroup->inklists[0].n_inks >= 1, NULL);
     }
+  stpi_data_unlock();
   return &(default_black_inkgroup->inklists[0].inknames[0]);
 }
@@ -29,39 +29,90 @@
 #include <gutenprint/gutenprint-intl-internal.h>
 #include "print-escp2.h"
 
-static stp_mxml_node_t *
-get_media_size_xml(const stp_vars_t *v)
+/*
+ * The media, input slot and media size files are shared by many models,
+ * and their trees are only ever read once loaded, so each file is loaded
+ * once for all of the models that use it.
+ */
+typedef struct
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
-  return printdef->media_sizes;
+  char *file;
+  stp_mxml_node_t *doc;
+} xml_file_cache_t;
+
+static stp_list_t *xml_file_cache;
+
+static const char *
+xml_file_cache_namefunc(const void *item)
+{
+  const xml_file_cache_t *xc = (const xml_file_cache_t *) item;
+  return xc->file;
 }
 
-int
-stp_escp2_load_media_sizes(const stp_vars_t *v, const char *name)
+static stp_mxml_node_t *
+load_shared_xml(const char *name)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
-  stp_list_t *dirlist = stpi_data_path();
+  stp_list_t *dirlist;
   stp_list_item_t *item;
-  int found = 0;
+  xml_file_cache_t *xc;
+  stp_mxml_node_t *doc = NULL;
+  stpi_data_lock();
+  if (!xml_file_cache)
+    {
+      xml_file_cache = stp_list_create();
+      stp_list_set_namefunc(xml_file_cache, xml_file_cache_namefunc);
+    }
+  item = stp_list_get_item_by_name(xml_file_cache, name);
+  if (item)
+    {
+      doc = ((xml_file_cache_t *) stp_list_item_get_data(item))->doc;
+      stpi_data_unlock();
+      return doc;
+    }
+  dirlist = stpi_data_path();
   item = stp_list_get_start(dirlist);
   while (item)
     {
       const char *dn = (const char *) stp_list_item_get_data(item);
       char *ffn = stpi_path_merge(dn, name);
-      stp_mxml_node_t *sizes =
-	stp_mxmlLoadFromFile(NULL, ffn, STP_MXML_NO_CALLBACK);
+      doc = stpi_xml_load_file(ffn);
       stp_free(ffn);
-      if (sizes)
-	{
-	  stp_mxml_node_t **xnode =
-	    (stp_mxml_node_t **) &(printdef->media_sizes);
-	  *xnode = sizes;
-	  found = 1;
-	  break;
-	}
+      if (doc)
+	break;
       item = stp_list_item_next(item);
     }
   stp_list_destroy(dirlist);
+  if (doc)
+    {
+      xc = stp_malloc(sizeof(xml_file_cache_t));
+      xc->file = stp_strdup(name);
+      xc->doc = doc;
+      stp_list_item_create(xml_file_cache, NULL, xc);
+    }
+  stpi_data_unlock();
+  return doc;
+}
+
+static stp_mxml_node_t *
+get_media_size_xml(const stp_vars_t *v)
+{
+  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  return printdef->media_sizes;
+}
+
+int
+stp_escp2_load_media_sizes(const stp_vars_t *v, const char *name)
+{
+  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stp_mxml_node_t *sizes = load_shared_xml(name);
+  int found = 0;
+  if (sizes)
+    {
+      stp_mxml_node_t **xnode =
+	(stp_mxml_node_t **) &(printdef->media_sizes);
+      *xnode = sizes;
+      found = 1;
+    }
   STPI_ASSERT(found, v);
   return found;
 }
@@ -101,51 +152,38 @@ int
 stp_escp2_load_media(const stp_vars_t *v, const char *name)
 {
   stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
-  stp_list_t *dirlist = stpi_data_path();
-  stp_list_item_t *item;
+  stp_mxml_node_t *media = load_shared_xml(name);
   int found = 0;
-  item = stp_list_get_start(dirlist);
-  while (item)
+  if (media)
     {
-      const char *dn = (const char *) stp_list_item_get_data(item);
-      char *ffn = stpi_path_merge(dn, name);
-      stp_mxml_node_t *media =
-	stp_mxmlLoadFromFile(NULL, ffn, STP_MXML_NO_CALLBACK);
-      stp_free(ffn);
-      if (media)
+      stp_mxml_node_t **xnode =
+	(stp_mxml_node_t **) &(printdef->media);
+      stp_list_t **xlist =
+	(stp_list_t **) &(printdef->media_cache);
+      stp_string_list_t **xpapers =
+	(stp_string_list_t **) &(printdef->papers);
+      stp_mxml_node_t *node = stp_mxmlFindElement(media, media,
+						  "escp2Papers", NULL,
+						  NULL, STP_MXML_DESCEND);
+      *xnode = media;
+      *xlist = stp_list_create();
+      stp_list_set_namefunc(*xlist, paper_namefunc);
+      *xpapers = stp_string_list_create();
+      if (node)
 	{
-	  stp_mxml_node_t **xnode =
-	    (stp_mxml_node_t **) &(printdef->media);
-	  stp_list_t **xlist =
-	    (stp_list_t **) &(printdef->media_cache);
-	  stp_string_list_t **xpapers =
-	    (stp_string_list_t **) &(printdef->papers);
-	  stp_mxml_node_t *node = stp_mxmlFindElement(media, media,
-						      "escp2Papers", NULL,
-						      NULL, STP_MXML_DESCEND);
-	  *xnode = media;
-	  *xlist = stp_list_create();
-	  stp_list_set_namefunc(*xlist, paper_namefunc);
-	  *xpapers = stp_string_list_create();
-	  if (node)
+	  node = node->child;
+	  while (node)
 	    {
-	      node = node->child;
-	      while (node)
-		{
-		  if (node->type == STP_MXML_ELEMENT &&
-		      strcmp(node->value.element.name, "paper") == 0)
-		    stp_string_list_add_string(*xpapers,
-					       stp_mxmlElementGetAttr(node, "name"),
-					       stp_mxmlElementGetAttr(node, "text"));
-		  node = node->next;
-		}
+	      if (node->type == STP_MXML_ELEMENT &&
+		  strcmp(node->value.element.name, "paper") == 0)
+		stp_string_list_add_string(*xpapers,
+					   stp_mxmlElementGetAttr(node, "name"),
+					   stp_mxmlElementGetAttr(node, "text"));
+	      node = node->next;
 	    }
-	  found = 1;
-	  break;
 	}
-      item = stp_list_item_next(item);
+      found = 1;
     }
-  stp_list_destroy(dirlist);
   STPI_ASSERT(found, v);
   return found;
 }
@@ -153,14 +191,16 @@ stp_escp2_load_media(const stp_vars_t *v, const char *name)
 static stp_mxml_node_t *
 get_media_xml(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   return printdef->media;
 }
 
 static stp_list_t *
 get_media_cache(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   return printdef->media_cache;
 }
 
@@ -246,13 +286,17 @@ get_media_type_named(const stp_vars_t *v, const char *name,
 {
   paper_t *answer = NULL;
   int i;
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   const stp_string_list_t *p = printdef->papers;
   const res_t *res = ignore_res ? NULL : stp_escp2_find_resolution(v);
   const inklist_t *inklist = stp_escp2_inklist(v);
   char *media_id = build_media_id(name, inklist, res);
   stp_list_t *cache = get_media_cache(v);
-  stp_list_item_t *li = stp_list_get_item_by_name(cache, media_id);
+  stp_list_item_t *li;
+  /* The cache is shared by every job printing to this model */
+  stpi_data_lock();
+  li = stp_list_get_item_by_name(cache, media_id);
   if (li)
     {
       stp_free(media_id);
@@ -265,15 +309,9 @@ get_media_type_named(const stp_vars_t *v, const char *name,
 	{
 	  if (!strcmp(name, stp_string_list_param(p, i)->name))
 	    {
-#ifdef HAVE_LOCALE_H
-	      char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-	      setlocale(LC_ALL, "C");
-#endif
+	      stp_xml_init();
 	      answer = build_media_type(v, name, inklist, res);
-#ifdef HAVE_LOCALE_H
-	      setlocale(LC_ALL, locale);
-	      stp_free(locale);
-#endif
+	      stp_xml_exit();
 	      break;
 	    }
 	}
@@ -282,14 +320,18 @@ get_media_type_named(const stp_vars_t *v, const char *name,
 	  answer->cname = media_id;
 	  stp_list_item_create(cache, NULL, answer);
 	}
+      else
+	stp_free(media_id);
     }
+  stpi_data_unlock();
   return answer;
 }
 
 const paper_t *
 stp_escp2_get_media_type(const stp_vars_t *v, int ignore_res)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   const stp_string_list_t *p = printdef->papers;
   if (p)
     {
@@ -303,7 +345,8 @@ stp_escp2_get_media_type(const stp_vars_t *v, int ignore_res)
 const paper_t *
 stp_escp2_get_default_media_type(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   const stp_string_list_t *p = printdef->papers;
   if (p)
     {
@@ -326,51 +369,38 @@ int
 stp_escp2_load_input_slots(const stp_vars_t *v, const char *name)
 {
   stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
-  stp_list_t *dirlist = stpi_data_path();
-  stp_list_item_t *item;
+  stp_mxml_node_t *slots = load_shared_xml(name);
   int found = 0;
-  item = stp_list_get_start(dirlist);
-  while (item)
+  if (slots)
     {
-      const char *dn = (const char *) stp_list_item_get_data(item);
-      char *ffn = stpi_path_merge(dn, name);
-      stp_mxml_node_t *slots =
-	stp_mxmlLoadFromFile(NULL, ffn, STP_MXML_NO_CALLBACK);
-      stp_free(ffn);
-      if (slots)
+      stp_mxml_node_t **xnode =
+	(stp_mxml_node_t **) &(printdef->slots);
+      stp_list_t **xlist =
+	(stp_list_t **) &(printdef->slots_cache);
+      stp_string_list_t **xslots =
+	(stp_string_list_t **) &(printdef->input_slots);
+      stp_mxml_node_t *node = stp_mxmlFindElement(slots, slots,
+						  "escp2InputSlots", NULL,
+						  NULL, STP_MXML_DESCEND);
+      *xnode = slots;
+      *xlist = stp_list_create();
+      stp_list_set_namefunc(*xlist, slots_namefunc);
+      *xslots = stp_string_list_create();
+      if (node)
 	{
-	  stp_mxml_node_t **xnode =
-	    (stp_mxml_node_t **) &(printdef->slots);
-	  stp_list_t **xlist =
-	    (stp_list_t **) &(printdef->slots_cache);
-	  stp_string_list_t **xslots =
-	    (stp_string_list_t **) &(printdef->input_slots);
-	  stp_mxml_node_t *node = stp_mxmlFindElement(slots, slots,
-						      "escp2InputSlots", NULL,
-						      NULL, STP_MXML_DESCEND);
-	  *xnode = slots;
-	  *xlist = stp_list_create();
-	  stp_list_set_namefunc(*xlist, slots_namefunc);
-	  *xslots = stp_string_list_create();
-	  if (node)
+	  node = node->child;
+	  while (node)
 	    {
-	      node = node->child;
-	      while (node)
-		{
-		  if (node->type == STP_MXML_ELEMENT &&
-		      strcmp(node->value.element.name, "slot") == 0)
-		    stp_string_list_add_string(*xslots,
-					       stp_mxmlElementGetAttr(node, "name"),
-					       stp_mxmlElementGetAttr(node, "text"));
-		  node = node->next;
-		}
+	      if (node->type == STP_MXML_ELEMENT &&
+		  strcmp(node->value.element.name, "slot") == 0)
+		stp_string_list_add_string(*xslots,
+					   stp_mxmlElementGetAttr(node, "name"),
+					   stp_mxmlElementGetAttr(node, "text"));
+	      node = node->next;
 	    }
-	  found = 1;
-	  break;
 	}
-      item = stp_list_item_next(item);
+      found = 1;
     }
-  stp_list_destroy(dirlist);
   STPI_ASSERT(found, v);
   return found;
 }
@@ -378,14 +408,16 @@ stp_escp2_load_input_slots(const stp_vars_t *v, const char *name)
 static stp_mxml_node_t *
 get_slots_xml(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INPUT_SLOTS);
   return printdef->slots;
 }
 
 static stp_list_t *
 get_slots_cache(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INPUT_SLOTS);
   return printdef->slots_cache;
 }
 
@@ -472,10 +504,14 @@ get_input_slot_named(const stp_vars_t *v, const char *name)
 {
   input_slot_t *answer = NULL;
   int i;
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INPUT_SLOTS);
   const stp_string_list_t *p = printdef->input_slots;
   stp_list_t *cache = get_slots_cache(v);
-  stp_list_item_t *li = stp_list_get_item_by_name(cache, name);
+  stp_list_item_t *li;
+  /* The cache is shared by every job printing to this model */
+  stpi_data_lock();
+  li = stp_list_get_item_by_name(cache, name);
   if (li)
     answer = (input_slot_t *) stp_list_item_get_data(li);
   else
@@ -485,28 +521,24 @@ get_input_slot_named(const stp_vars_t *v, const char *name)
 	{
 	  if (!strcmp(name, stp_string_list_param(p, i)->name))
 	    {
-#ifdef HAVE_LOCALE_H
-	      char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-	      setlocale(LC_ALL, "C");
-#endif
+	      stp_xml_init();
 	      answer = build_input_slot(v, name);
-#ifdef HAVE_LOCALE_H
-	      setlocale(LC_ALL, locale);
-	      stp_free(locale);
-#endif
+	      stp_xml_exit();
 	      break;
 	    }
 	}
       if (answer)
 	stp_list_item_create(cache, NULL, answer);
     }
+  stpi_data_unlock();
   return answer;
 }
 
 const input_slot_t *
 stp_escp2_get_input_slot(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INPUT_SLOTS);
   const stp_string_list_t *p = printdef->input_slots;
   if (p)
     {
@@ -53,11 +53,176 @@ extern "C" {
 extern void stpi_init_paper(void);
 extern void stpi_init_dither(void);
 extern void stpi_init_printer(void);
+extern void stpi_init_printer_db(void);
 extern void stpi_vars_print_error(const stp_vars_t *v, const char *prefix);
 #define BUFFER_FLAG_FLIP_X	0x1
 #define BUFFER_FLAG_FLIP_Y	0x2
 extern stp_image_t* stpi_buffer_image(stp_image_t* image, unsigned int flags);
 
+/*
+ * Choose the scanning loops used by stp_pack_tiff() and
+ * stp_pack_uncompressed().  stpi_set_pack_kernels() returns 0 if the
+ * named set ("scalar", "sse2" or "avx2") can't be used.
+ */
+extern void stpi_init_pack_kernels(void);
+extern int stpi_set_pack_kernels(const char *name);
+
+/*
+ * Choose the row kernels used by the ordered dithers.
+ * stpi_set_dither_kernels() returns 0 if the named set ("scalar",
+ * "sse2", "avx2", or "none" to dither a pixel at a time) can't be used.
+ */
+extern void stpi_init_dither_kernels(void);
+extern int stpi_set_dither_kernels(const char *name);
+
+/*
+ * Weave schedules are kept in a cache shared by every page and job.
+ * stpi_set_weave_cache_size() sets how many are kept (0 computes each
+ * row's weave parameters as it is needed, without caching anything).
+ */
+extern void stpi_init_weave_cache(void);
+extern void stpi_set_weave_cache_size(int entries);
+extern void stpi_get_weave_cache_stats(unsigned long *hits,
+				       unsigned long *misses);
+
+/*
+ * Returns nonzero if the line is all zero bytes.
+ */
+extern int stpi_line_is_blank(const unsigned char *line, int length);
+
+/*
+ * Output written through stp_zfwrite(), stp_putc() and friends is
+ * collected in a buffer shared by a stp_vars_t and all of its copies.
+ * It is only used between stpi_start_output() and stpi_end_output()
+ * (i.e. while the driver is running), and is flushed by the latter.
+ */
+typedef struct stpi_output_buffer stpi_output_buffer_t;
+extern stpi_output_buffer_t *stpi_output_buffer_ref(stpi_output_buffer_t *ob);
+extern void stpi_output_buffer_release(stpi_output_buffer_t *ob);
+extern stpi_output_buffer_t *stpi_vars_get_output_buffer(const stp_vars_t *v);
+extern void stpi_vars_set_output_buffer(stp_vars_t *v,
+					stpi_output_buffer_t *outbuf);
+extern void stpi_start_output(const stp_vars_t *v, int new_job);
+extern void stpi_end_output(const stp_vars_t *v);
+
+/*
+ * Cache of parsed XML files.  stpi_xml_cache_load() returns NULL if there
+ * is no usable cache entry for the file.  stpi_xml_load_file() loads a
+ * whole file through the cache.
+ */
+extern stp_mxml_node_t *stpi_xml_load_file(const char *file);
+extern stp_mxml_node_t *stpi_xml_cache_load(const char *file);
+extern void stpi_xml_cache_save(const char *file, stp_mxml_node_t *doc);
+extern const char *stpi_xml_cache_dir(void);
+extern char *stpi_xml_cache_key(const char *file);
+
+/*
+ * Files in the cache directory.  stpi_cache_dir_writable() creates the
+ * directory if need be, and remembers whether it can be written to.
+ * stpi_cache_write_file() writes the chunks to a file atomically, and
+ * returns 1 on success.
+ */
+typedef struct
+{
+  const char *data;
+  size_t size;
+} stpi_cache_chunk_t;
+
+extern int stpi_cache_dir_writable(const char *dir);
+extern int stpi_cache_write_file(const char *file,
+				 const stpi_cache_chunk_t *chunks, int count);
+extern char *stpi_xml_cache_encode(stp_mxml_node_t *node, size_t *size);
+extern stp_mxml_node_t *stpi_xml_cache_decode(const char *data, size_t size);
+
+/*
+ * Cache of computed color curves.  The key is built up from everything
+ * that the curves are computed from.  stpi_lut_cache_load() fills in
+ * count curves (NULL where none was saved) and returns 1 if there is an
+ * entry for the key.
+ */
+typedef struct stpi_lut_cache_key stpi_lut_cache_key_t;
+extern stpi_lut_cache_key_t *stpi_lut_cache_key_create(void);
+extern void stpi_lut_cache_key_destroy(stpi_lut_cache_key_t *key);
+extern void stpi_lut_cache_key_add(stpi_lut_cache_key_t *key,
+				   const void *data, size_t size);
+extern void stpi_lut_cache_key_add_string(stpi_lut_cache_key_t *key,
+					  const char *str);
+extern void stpi_lut_cache_key_add_curve(stpi_lut_cache_key_t *key,
+					 const stp_curve_t *curve);
+extern int stpi_lut_cache_load(const stpi_lut_cache_key_t *key, int count,
+			       stp_curve_t **curves);
+extern void stpi_lut_cache_save(const stpi_lut_cache_key_t *key, int count,
+				const stp_curve_t *const *curves);
+
+/*
+ * Flat copy of a curve, which stpi_curve_decode() makes into an identical
+ * curve.  Returns NULL if the data isn't a valid curve.
+ */
+extern char *stpi_curve_encode(const stp_curve_t *curve, size_t *size);
+extern stp_curve_t *stpi_curve_decode(const char *data, size_t size);
+
+/*
+ * Read-only database of printers and paper sizes, shared between
+ * processes.  stpi_printer_db_open() returns 1 if there is a usable
+ * one; if not, the stpi_printer_db_add_*() functions collect the
+ * tables as the XML files are read, and stpi_printer_db_save() writes
+ * them out.  Strings and nodes returned by the other functions are in
+ * the database, which stays mapped for the life of the process.
+ */
+typedef struct
+{
+  const char *driver;
+  const char *long_name;
+  const char *family;
+  const char *manufacturer;
+  const char *device_id;
+  const char *foomatic_id;
+  const char *comment;
+  int model;
+  const char *node;		/* The encoded <printer> node */
+  size_t node_size;
+} stpi_printer_db_entry_t;
+
+extern int stpi_printer_db_open(void);
+extern int stpi_printer_db_building(void);
+extern void stpi_printer_db_add_printer(stp_mxml_node_t *printer,
+					const char *family,
+					const char *comment);
+extern void stpi_printer_db_add_params(stp_mxml_node_t *params,
+				       const char *family);
+extern void stpi_printer_db_add_paper(const stp_papersize_t *paper);
+extern void stpi_printer_db_save(void);
+extern int stpi_printer_db_printer_count(void);
+extern void stpi_printer_db_get_printer(int i, stpi_printer_db_entry_t *entry);
+extern int stpi_printer_db_params_count(void);
+extern const char *stpi_printer_db_get_params(int i, const char **node,
+					      size_t *node_size);
+extern int stpi_printer_db_paper_count(void);
+extern void stpi_printer_db_get_paper(int i, stp_papersize_t *paper);
+
+/*
+ * A pool of worker threads.  stpi_thread_pool_run() calls func once
+ * for each task number from 0 to ntasks - 1, spread across the
+ * workers and the calling thread, and returns when all of them have
+ * finished.  Without thread support, the tasks simply run in order.
+ */
+typedef struct stpi_thread_pool stpi_thread_pool_t;
+typedef void stpi_thread_task_t(void *data, int task);
+extern stpi_thread_pool_t *stpi_thread_pool_create(int threads);
+extern void stpi_thread_pool_destroy(stpi_thread_pool_t *pool);
+extern void stpi_thread_pool_run(stpi_thread_pool_t *pool, int ntasks,
+				 stpi_thread_task_t *func, void *data);
+
+/*
+ * Data that is loaded on first use (printer models, papers, dither
+ * matrices and the like) is shared by every job in the process and
+ * never changes once it has been loaded.  Check for it and load it
+ * while holding the data lock.  The lock may be taken recursively,
+ * since loading one thing often loads others.
+ */
+extern void stpi_data_lock(void);
+extern void stpi_data_unlock(void);
+
 #define STPI_ASSERT(x,v)						\
 do									\
 {									\
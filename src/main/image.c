@@ -26,6 +26,67 @@
 #endif
 #include <gutenprint/gutenprint.h>
 #include "gutenprint-internal.h"
+#include <string.h>
+
+/*
+ * Callbacks registered with stp_image_set_row_funcs(), by image.  There
+ * are rarely more than one or two images being printed at once.
+ */
+typedef struct image_row_funcs
+{
+  const stp_image_t *image;
+  stp_image_row_funcs_t funcs;
+  struct image_row_funcs *next;
+} image_row_funcs_t;
+
+static image_row_funcs_t *registered_row_funcs = NULL;
+
+void
+stp_image_set_row_funcs(stp_image_t *image, const stp_image_row_funcs_t *funcs)
+{
+  image_row_funcs_t **pp;
+  image_row_funcs_t *r = NULL;
+  stpi_data_lock();
+  for (pp = &registered_row_funcs; *pp; pp = &((*pp)->next))
+    if ((*pp)->image == image)
+      {
+	r = *pp;
+	*pp = r->next;
+	break;
+      }
+  if (funcs)
+    {
+      size_t size = funcs->size;
+      if (size > sizeof(stp_image_row_funcs_t))
+	size = sizeof(stp_image_row_funcs_t);
+      if (!r)
+	r = stp_malloc(sizeof(image_row_funcs_t));
+      memset(&(r->funcs), 0, sizeof(stp_image_row_funcs_t));
+      memcpy(&(r->funcs), funcs, size);
+      r->funcs.size = sizeof(stp_image_row_funcs_t);
+      r->image = image;
+      r->next = registered_row_funcs;
+      registered_row_funcs = r;
+    }
+  else
+    STP_SAFE_FREE(r);
+  stpi_data_unlock();
+}
+
+static void
+get_row_funcs(const stp_image_t *image, stp_image_row_funcs_t *funcs)
+{
+  const image_row_funcs_t *r;
+  memset(funcs, 0, sizeof(stp_image_row_funcs_t));
+  stpi_data_lock();
+  for (r = registered_row_funcs; r; r = r->next)
+    if (r->image == image)
+      {
+	*funcs = r->funcs;
+	break;
+      }
+  stpi_data_unlock();
+}
 
 void
 stp_image_init(stp_image_t *image)
@@ -60,6 +121,39 @@ stp_image_get_row(stp_image_t *image, unsigned char *data,
   return image->get_row(image, data, byte_limit, row);
 }
 
+const unsigned char *
+stp_image_lend_row(stp_image_t *image, size_t byte_limit, int row)
+{
+  stp_image_row_funcs_t funcs;
+  get_row_funcs(image, &funcs);
+  if (funcs.lend_row)
+    return funcs.lend_row(image, byte_limit, row);
+  else
+    return NULL;
+}
+
+void
+stp_image_release_row(stp_image_t *image, const unsigned char *data, int row)
+{
+  stp_image_row_funcs_t funcs;
+  get_row_funcs(image, &funcs);
+  if (funcs.release_row)
+    funcs.release_row(image, data, row);
+}
+
+stp_image_status_t
+stp_image_skip_rows(stp_image_t *image, int row, int count)
+{
+  stp_image_row_funcs_t funcs;
+  if (count <= 0)
+    return STP_IMAGE_STATUS_OK;
+  get_row_funcs(image, &funcs);
+  if (funcs.skip_rows)
+    return funcs.skip_rows(image, row, count);
+  else
+    return STP_IMAGE_STATUS_OK;
+}
+
 const char *
 stp_image_get_appname(stp_image_t *image)
 {
@@ -0,0 +1,374 @@
+/*
+ * "$Id$"
+ *
+ *   Cache of computed color curves
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Computing the gamma, contrast, brightness and GCR curves for a page
+ * means building and resampling curves of 65536 points, which takes
+ * longer than converting many rows.  Most jobs use one of a few sets of
+ * settings, so the computed curves are saved in the XML cache directory
+ * (see xml-cache.c), named after a hash of everything that they were
+ * computed from.  A page with the same settings maps the entry and
+ * copies the curves out of it.  Entries recently written to by another
+ * process are in the page cache, so this also shares them between
+ * processes.
+ *
+ * Each entry contains its full key, which is compared when it is loaded,
+ * so a hash collision only costs a recomputation.  At most
+ * LUT_CACHE_MAX_ENTRIES entries are kept; the least recently used ones
+ * are removed when a new one is saved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define LUT_CACHE_MAGIC "STPLUTC"
+#define LUT_CACHE_VERSION 1
+#define LUT_CACHE_BYTE_ORDER 0x01020304
+#define LUT_CACHE_SUFFIX ".lutc"
+#define LUT_CACHE_MAX_ENTRIES 32
+
+typedef struct
+{
+  char magic[8];
+  unsigned version;
+  unsigned byte_order;
+  unsigned header_size;		/* sizeof(lut_cache_header_t) */
+  unsigned curve_count;
+  size_t key_size;
+  size_t body_size;		/* (size, encoded curve) * curve_count */
+} lut_cache_header_t;
+
+struct stpi_lut_cache_key
+{
+  char *data;
+  size_t size;
+  size_t allocated;
+};
+
+static unsigned long lut_cache_hits = 0;
+static unsigned long lut_cache_misses = 0;
+
+stpi_lut_cache_key_t *
+stpi_lut_cache_key_create(void)
+{
+  stpi_lut_cache_key_t *key = stp_zalloc(sizeof(stpi_lut_cache_key_t));
+  stpi_lut_cache_key_add_string(key, PACKAGE_VERSION);
+  return key;
+}
+
+void
+stpi_lut_cache_key_destroy(stpi_lut_cache_key_t *key)
+{
+  STP_SAFE_FREE(key->data);
+  stp_free(key);
+}
+
+void
+stpi_lut_cache_key_add(stpi_lut_cache_key_t *key, const void *data,
+		       size_t size)
+{
+  if (key->size + size > key->allocated)
+    {
+      key->allocated = (key->size + size) * 2 + 256;
+      key->data = stp_realloc(key->data, key->allocated);
+    }
+  memcpy(key->data + key->size, data, size);
+  key->size += size;
+}
+
+void
+stpi_lut_cache_key_add_string(stpi_lut_cache_key_t *key, const char *str)
+{
+  if (str)
+    stpi_lut_cache_key_add(key, str, strlen(str) + 1);
+  else
+    stpi_lut_cache_key_add(key, "\377", 1);
+}
+
+void
+stpi_lut_cache_key_add_curve(stpi_lut_cache_key_t *key,
+			     const stp_curve_t *curve)
+{
+  size_t size = 0;
+  if (curve)
+    {
+      char *data = stpi_curve_encode(curve, &size);
+      stpi_lut_cache_key_add(key, &size, sizeof(size));
+      stpi_lut_cache_key_add(key, data, size);
+      stp_free(data);
+    }
+  else
+    stpi_lut_cache_key_add(key, &size, sizeof(size));
+}
+
+static char *
+lut_cache_file(const char *dir, const stpi_lut_cache_key_t *key)
+{
+  unsigned hash1 = 2166136261u;
+  unsigned hash2 = 5381;
+  char name[48];
+  size_t i;
+  for (i = 0; i < key->size; i++)
+    {
+      unsigned char c = key->data[i];
+      hash1 = (hash1 ^ c) * 16777619u;
+      hash2 = hash2 * 33 + c;
+    }
+  sprintf(name, "%08x%08x%s", hash1, hash2, LUT_CACHE_SUFFIX);
+  return stpi_path_merge(dir, name);
+}
+
+static int
+read_cache(const char *data, size_t size, const stpi_lut_cache_key_t *key,
+	   int count, stp_curve_t **curves)
+{
+  const lut_cache_header_t *header = (const lut_cache_header_t *) data;
+  const char *ptr = data + sizeof(lut_cache_header_t);
+  const char *end;
+  int i;
+  if (size < sizeof(lut_cache_header_t) ||
+      memcmp(header->magic, LUT_CACHE_MAGIC, sizeof(LUT_CACHE_MAGIC)) != 0 ||
+      header->version != LUT_CACHE_VERSION ||
+      header->byte_order != LUT_CACHE_BYTE_ORDER ||
+      header->header_size != sizeof(lut_cache_header_t) ||
+      header->curve_count != (unsigned) count ||
+      header->key_size != key->size ||
+      size != sizeof(lut_cache_header_t) + header->key_size +
+      header->body_size ||
+      memcmp(ptr, key->data, key->size) != 0)
+    return 0;
+  ptr += key->size;
+  end = ptr + header->body_size;
+  for (i = 0; i < count; i++)
+    curves[i] = NULL;
+  for (i = 0; i < count; i++)
+    {
+      size_t curve_size;
+      if ((size_t) (end - ptr) < sizeof(size_t))
+	break;
+      memcpy(&curve_size, ptr, sizeof(size_t));
+      ptr += sizeof(size_t);
+      if (curve_size > (size_t) (end - ptr))
+	break;
+      if (curve_size > 0)
+	{
+	  curves[i] = stpi_curve_decode(ptr, curve_size);
+	  if (!curves[i])
+	    break;
+	}
+      ptr += curve_size;
+    }
+  if (i == count && ptr == end)
+    return 1;
+  for (i = 0; i < count; i++)
+    if (curves[i])
+      {
+	stp_curve_destroy(curves[i]);
+	curves[i] = NULL;
+      }
+  return 0;
+}
+
+int
+stpi_lut_cache_load(const stpi_lut_cache_key_t *key, int count,
+		    stp_curve_t **curves)
+{
+  const char *dir = stpi_xml_cache_dir();
+  char *cache_file;
+  struct stat sbuf;
+  int ret = 0;
+  int fd;
+  if (!dir)
+    return 0;
+  cache_file = lut_cache_file(dir, key);
+  fd = open(cache_file, O_RDONLY);
+  if (fd >= 0 && fstat(fd, &sbuf) == 0 &&
+      (size_t) sbuf.st_size >= sizeof(lut_cache_header_t))
+    {
+      size_t size = sbuf.st_size;
+#ifdef HAVE_SYS_MMAN_H
+      void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+	{
+	  ret = read_cache(data, size, key, count, curves);
+	  munmap(data, size);
+	}
+#else
+      char *data = stp_malloc(size);
+      if (read(fd, data, size) == (ssize_t) size)
+	ret = read_cache(data, size, key, count, curves);
+      stp_free(data);
+#endif
+    }
+  if (fd >= 0)
+    close(fd);
+  /* Mark the entry as recently used */
+  if (ret)
+    (void) utimes(cache_file, NULL);
+  stpi_data_lock();
+  if (ret)
+    lut_cache_hits++;
+  else
+    lut_cache_misses++;
+  stpi_data_unlock();
+  stp_deprintf(STP_DBG_LUT, "stpi_lut_cache_load: %s %s\n",
+	       ret ? "using" : "no usable", cache_file);
+  stp_free(cache_file);
+  return ret;
+}
+
+/*
+ * Remove the least recently used entries until there is room for one
+ * more.
+ */
+static void
+prune_cache(const char *dir)
+{
+  DIR *dp = opendir(dir);
+  struct dirent *ent;
+  char *oldest = NULL;
+  time_t oldest_mtime = 0;
+  int entries = 0;
+  size_t suffix_len = strlen(LUT_CACHE_SUFFIX);
+  if (!dp)
+    return;
+  do
+    {
+      entries = 0;
+      STP_SAFE_FREE(oldest);
+      rewinddir(dp);
+      while ((ent = readdir(dp)) != NULL)
+	{
+	  size_t len = strlen(ent->d_name);
+	  struct stat sbuf;
+	  char *file;
+	  if (len <= suffix_len ||
+	      strcmp(ent->d_name + len - suffix_len, LUT_CACHE_SUFFIX) != 0)
+	    continue;
+	  file = stpi_path_merge(dir, ent->d_name);
+	  if (stat(file, &sbuf) == 0)
+	    {
+	      entries++;
+	      if (!oldest || sbuf.st_mtime < oldest_mtime)
+		{
+		  STP_SAFE_FREE(oldest);
+		  oldest = file;
+		  oldest_mtime = sbuf.st_mtime;
+		  continue;
+		}
+	    }
+	  stp_free(file);
+	}
+      if (oldest && entries >= LUT_CACHE_MAX_ENTRIES)
+	{
+	  stp_deprintf(STP_DBG_LUT, "stpi_lut_cache_save: removing %s\n",
+		       oldest);
+	  if (unlink(oldest) != 0)
+	    break;
+	}
+    }
+  while (entries > LUT_CACHE_MAX_ENTRIES);
+  STP_SAFE_FREE(oldest);
+  closedir(dp);
+}
+
+void
+stpi_lut_cache_save(const stpi_lut_cache_key_t *key, int count,
+		    const stp_curve_t *const *curves)
+{
+  const char *dir = stpi_xml_cache_dir();
+  lut_cache_header_t header;
+  stpi_cache_chunk_t *chunks;
+  char **data;
+  size_t *sizes;
+  char *cache_file;
+  int i;
+  if (!dir || !stpi_cache_dir_writable(dir))
+    return;
+
+  data = stp_zalloc(sizeof(char *) * count);
+  sizes = stp_zalloc(sizeof(size_t) * count);
+  chunks = stp_malloc(sizeof(stpi_cache_chunk_t) * (2 + 2 * count));
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, LUT_CACHE_MAGIC);
+  header.version = LUT_CACHE_VERSION;
+  header.byte_order = LUT_CACHE_BYTE_ORDER;
+  header.header_size = sizeof(lut_cache_header_t);
+  header.curve_count = count;
+  header.key_size = key->size;
+  chunks[0].data = (const char *) &header;
+  chunks[0].size = sizeof(header);
+  chunks[1].data = key->data;
+  chunks[1].size = key->size;
+  for (i = 0; i < count; i++)
+    {
+      if (curves[i])
+	data[i] = stpi_curve_encode(curves[i], &(sizes[i]));
+      header.body_size += sizeof(size_t) + sizes[i];
+      chunks[2 + 2 * i].data = (const char *) &(sizes[i]);
+      chunks[2 + 2 * i].size = sizeof(size_t);
+      chunks[3 + 2 * i].data = data[i];
+      chunks[3 + 2 * i].size = sizes[i];
+    }
+
+  prune_cache(dir);
+  cache_file = lut_cache_file(dir, key);
+  if (stpi_cache_write_file(cache_file, chunks, 2 + 2 * count))
+    stp_deprintf(STP_DBG_LUT, "stpi_lut_cache_save: wrote %s\n", cache_file);
+  stp_free(cache_file);
+  for (i = 0; i < count; i++)
+    STP_SAFE_FREE(data[i]);
+  stp_free(chunks);
+  stp_free(data);
+  stp_free(sizes);
+}
+
+void
+stp_color_get_lut_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+  stpi_data_lock();
+  if (hits)
+    *hits = lut_cache_hits;
+  if (misses)
+    *misses = lut_cache_misses;
+  stpi_data_unlock();
+}
@@ -32,16 +32,20 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-static int stpi_path_check(const struct dirent *module);
+/* What stpi_path_check() looks for */
+typedef struct
+{
+  const char *path;		/* Directory being searched */
+  const char *suffix;		/* Required filename suffix */
+} path_check_t;
+
+static int stpi_path_check(const struct dirent *module, const void *data);
 static int stpi_scandir (const char *dir,
 			 struct dirent ***namelist,
-			 int (*sel) (const struct dirent *),
+			 int (*sel) (const struct dirent *, const void *),
+			 const void *sel_data,
 			 int (*cmp) (const void *, const void *));
 
-/* WARNING: This is not thread safe! -- rlk 20030721 */
-static const char *path_check_path;   /* Path for stpi_scandir() callback */
-static const char *path_check_suffix; /* Suffix for stpi_scandir() callback */
-
 
 static int
 dirent_sort(const void *a,
@@ -64,11 +68,12 @@ stp_path_search(stp_list_t *dirlist, /* List of directories to search */
   struct dirent** module_dir = NULL; /* Current directory contents */
   char *module_name;                 /* File name to check */
   int n;                             /* Number of directory entries */
+  path_check_t check;                /* What to look for */
 
   if (!dirlist)
     return NULL;
 
-  path_check_suffix = suffix;
+  check.suffix = suffix;
 
   findlist = stp_list_create();
   if (!findlist)
@@ -78,11 +83,11 @@ stp_path_search(stp_list_t *dirlist, /* List of directories to search */
   diritem = stp_list_get_start(dirlist);
   while (diritem)
     {
-      path_check_path = (const char *) stp_list_item_get_data(diritem);
+      check.path = (const char *) stp_list_item_get_data(diritem);
       stp_deprintf(STP_DBG_PATH, "stp-path: directory: %s\n",
 		   (const char *) stp_list_item_get_data(diritem));
       n = stpi_scandir ((const char *) stp_list_item_get_data(diritem),
-			&module_dir, stpi_path_check, dirent_sort);
+			&module_dir, stpi_path_check, &check, dirent_sort);
       if (n >= 0)
 	{
 	  int idx;
@@ -106,8 +111,10 @@ stp_path_search(stp_list_t *dirlist, /* List of directories to search */
  * correct mode bits and suffix.
  */
 static int
-stpi_path_check(const struct dirent *module) /* File to check */
+stpi_path_check(const struct dirent *module, /* File to check */
+		const void *data)	      /* What to look for */
 {
+  const path_check_t *check = (const path_check_t *) data;
   int namelen;                              /* Filename length */
   int status = 0;                           /* Error status */
   int savederr;                             /* Saved errno */
@@ -117,21 +124,21 @@ stpi_path_check(const struct dirent *module) /* File to check */
   savederr = errno; /* since we are a callback, preserve
 		       stpi_scandir() state */
 
-  filename = stpi_path_merge(path_check_path, module->d_name);
+  filename = stpi_path_merge(check->path, module->d_name);
 
   namelen = strlen(filename);
   /* make sure we can take off suffix (e.g. .la)
      and still have a sane filename */
-  if (namelen >= strlen(path_check_suffix) + 1) 
+  if (namelen >= strlen(check->suffix) + 1) 
     {
       if (!stat (filename, &modstat))
 	{
 	  /* check file exists, and is a regular file */
 	  if (S_ISREG(modstat.st_mode))
 	    status = 1;
-	  if (strncmp(filename + (namelen - strlen(path_check_suffix)),
-		      path_check_suffix,
-		      strlen(path_check_suffix)))
+	  if (strncmp(filename + (namelen - strlen(check->suffix)),
+		      check->suffix,
+		      strlen(check->suffix)))
 	    {
 	      status = 0;
 	    }
@@ -268,7 +275,8 @@ stp_path_split(stp_list_t *list, /* List to add directories to */
 static int
 stpi_scandir (const char *dir,
 	      struct dirent ***namelist,
-	      int (*sel) (const struct dirent *),
+	      int (*sel) (const struct dirent *, const void *),
+	      const void *sel_data,
 	      int (*cmp) (const void *, const void *))
 {
   DIR *dp = opendir (dir);
@@ -285,7 +293,7 @@ stpi_scandir (const char *dir,
 
   i = 0;
   while ((d = readdir (dp)) != NULL)
-    if (sel == NULL || (*sel) (d))
+    if (sel == NULL || (*sel) (d, sel_data))
       {
 	struct dirent *vnew;
 	size_t dsize;
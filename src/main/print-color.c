@@ -275,6 +275,16 @@ static const float_param_t float_parameters[] =
       STP_PARAMETER_LEVEL_ADVANCED3, 1, 1, -1, 1, 0
     }, 0.0, 0.0, 0.0, CMASK_ALL, 0, -1
   },
+  {
+    {
+      "ColorLatticeSize", N_("Color Lattice Size"), "Color=Yes,Category=Advanced Image Control",
+      N_("Interpolate colors from a precomputed table with this many "
+	 "points along each axis rather than computing every color "
+	 "exactly (0 to compute exactly)"),
+      STP_PARAMETER_TYPE_INT, STP_PARAMETER_CLASS_OUTPUT,
+      STP_PARAMETER_LEVEL_ADVANCED4, 0, 1, -1, 1, 0
+    }, 0.0, 129.0, 0.0, CMASK_ALL, 1, -1
+  },
   {
     {
       "Gamma", N_("Composite Gamma"), "Color=Yes,Category=Gamma",
@@ -760,15 +770,28 @@ stpi_color_traditional_get_row(stp_vars_t *v,
 			       unsigned *zero_mask)
 {
   const lut_t *lut = (const lut_t *)(stp_get_component_data(v, "Color"));
+  size_t row_size =
+    lut->image_width * lut->in_channels * lut->channel_depth / 8;
+  const unsigned char *in;
   unsigned zero;
-  if (stp_image_get_row(image, lut->in_data,
-			lut->image_width * lut->in_channels * lut->channel_depth / 8, row)
-      != STP_IMAGE_STATUS_OK)
-    return 2;
+  /*
+   * Convert straight from the application's row if it can lend it to
+   * us, rather than having it copied into in_data.
+   */
+  in = stp_image_lend_row(image, row_size, row);
+  if (!in)
+    {
+      if (stp_image_get_row(image, lut->in_data, row_size, row)
+	  != STP_IMAGE_STATUS_OK)
+	return 2;
+      in = lut->in_data;
+    }
   if (!lut->channels_are_initialized)
     initialize_channels(v, image);
   zero = (lut->output_color_description->conversion_function)
-    (v, lut->in_data, stp_channel_get_input(v));
+    (v, in, stp_channel_get_input(v));
+  if (in != lut->in_data)
+    stp_image_release_row(image, in, row);
   if (zero_mask)
     *zero_mask = zero;
   stp_channel_convert(v, zero_mask);
@@ -842,6 +865,14 @@ copy_lut(void *vlut)
   stp_curve_cache_copy(&(dest->hue_map), &(src->hue_map));
   stp_curve_cache_copy(&(dest->lum_map), &(src->lum_map));
   stp_curve_cache_copy(&(dest->sat_map), &(src->sat_map));
+  dest->lattice_size = src->lattice_size;
+  if (src->lattice)
+    {
+      size_t bytes = src->lattice_size * src->lattice_size *
+	src->lattice_size * 3 * sizeof(unsigned short);
+      dest->lattice = stp_malloc(bytes);
+      memcpy(dest->lattice, src->lattice, bytes);
+    }
   /* Don't copy gray_tmp */
   /* Don't copy cmy_tmp */
   if (src->in_data)
@@ -866,6 +897,7 @@ free_lut(void *vlut)
   STP_SAFE_FREE(lut->gray_tmp);
   STP_SAFE_FREE(lut->cmy_tmp);
   STP_SAFE_FREE(lut->in_data);
+  STP_SAFE_FREE(lut->lattice);
   memset(lut, 0, sizeof(lut_t));
   stp_free(lut);
 }
@@ -1321,7 +1353,157 @@ setup_channel(stp_vars_t *v, int i, const channel_param_t *p)
       (&(lut->channel_curves[i]), stp_get_curve_parameter(v, curve_name));
 
   stp_dprintf(STP_DBG_LUT, v, " %s %.3f\n", gamma_name, lut->gamma_values[i]);
-  compute_one_lut(lut, i);
+}
+
+static const channel_param_t *
+get_channel_param(const lut_t *lut, int i)
+{
+  if (lut->output_color_description->channel_count < 1 &&
+      i < lut->out_channels)
+    return &(raw_channel_params[i]);
+  else if (i < channel_param_count &&
+	   lut->output_color_description->channels & (1 << i))
+    return &(channel_params[i]);
+  else
+    return NULL;
+}
+
+static int
+lut_uses_gcr(const lut_t *lut)
+{
+  return (((lut->output_color_description->channels & CMASK_CMYK) ==
+	   CMASK_CMYK) &&
+	  (lut->color_correction->correction == COLOR_CORRECTION_DESATURATED ||
+	   lut->input_color_description->color_id == COLOR_ID_GRAY ||
+	   lut->input_color_description->color_id == COLOR_ID_WHITE ||
+	   lut->input_color_description->color_id == COLOR_ID_RGB ||
+	   lut->input_color_description->color_id == COLOR_ID_CMY));
+}
+
+/*
+ * The curves saved in the LUT cache: the user, brightness and contrast
+ * corrections, one for each channel, and the GCR curve.
+ */
+#define LUT_CACHE_USER		0
+#define LUT_CACHE_BRIGHTNESS	1
+#define LUT_CACHE_CONTRAST	2
+#define LUT_CACHE_CHANNELS	3
+#define LUT_CACHE_GCR		(LUT_CACHE_CHANNELS + STP_CHANNEL_LIMIT)
+#define LUT_CACHE_CURVES	(LUT_CACHE_GCR + 1)
+
+static void
+add_float_key(stpi_lut_cache_key_t *key, const stp_vars_t *v,
+	      const char *name)
+{
+  int set = stp_check_float_parameter(v, name, STP_PARAMETER_DEFAULTED);
+  stpi_lut_cache_key_add(key, &set, sizeof(set));
+  if (set)
+    {
+      double value = stp_get_float_parameter(v, name);
+      stpi_lut_cache_key_add(key, &value, sizeof(value));
+    }
+}
+
+/*
+ * Everything that the curves are computed from, once the parameters have
+ * been read into the LUT.
+ */
+static stpi_lut_cache_key_t *
+lut_cache_key(const stp_vars_t *v, lut_t *lut)
+{
+  stpi_lut_cache_key_t *key = stpi_lut_cache_key_create();
+  int i;
+  stpi_lut_cache_key_add_string(key, lut->input_color_description->name);
+  stpi_lut_cache_key_add_string(key, lut->output_color_description->name);
+  stpi_lut_cache_key_add_string(key, lut->color_correction->name);
+  stpi_lut_cache_key_add(key, &(lut->steps), sizeof(lut->steps));
+  stpi_lut_cache_key_add(key, &(lut->out_channels), sizeof(lut->out_channels));
+  stpi_lut_cache_key_add(key, &(lut->linear_contrast_adjustment),
+			 sizeof(lut->linear_contrast_adjustment));
+  stpi_lut_cache_key_add(key, &(lut->simple_gamma_correction),
+			 sizeof(lut->simple_gamma_correction));
+  stpi_lut_cache_key_add(key, &(lut->print_gamma), sizeof(lut->print_gamma));
+  stpi_lut_cache_key_add(key, &(lut->app_gamma), sizeof(lut->app_gamma));
+  stpi_lut_cache_key_add(key, &(lut->contrast), sizeof(lut->contrast));
+  stpi_lut_cache_key_add(key, &(lut->brightness), sizeof(lut->brightness));
+  for (i = 0; i < STP_CHANNEL_LIMIT; i++)
+    if (get_channel_param(lut, i))
+      {
+	stpi_lut_cache_key_add(key, &i, sizeof(i));
+	stpi_lut_cache_key_add(key, &(lut->gamma_values[i]),
+			       sizeof(lut->gamma_values[i]));
+	stpi_lut_cache_key_add_curve
+	  (key, stp_curve_cache_get_curve(&(lut->channel_curves[i])));
+      }
+  stpi_lut_cache_key_add_curve
+    (key, stp_curve_cache_get_curve(&(lut->hue_map)));
+  stpi_lut_cache_key_add_curve
+    (key, stp_curve_cache_get_curve(&(lut->lum_map)));
+  stpi_lut_cache_key_add_curve
+    (key, stp_curve_cache_get_curve(&(lut->sat_map)));
+  if (lut_uses_gcr(lut))
+    {
+      stpi_lut_cache_key_add_string(key, "GCR");
+      if (stp_check_curve_parameter(v, "GCRCurve", STP_PARAMETER_DEFAULTED))
+	stpi_lut_cache_key_add_curve(key,
+				     stp_get_curve_parameter(v, "GCRCurve"));
+      else
+	{
+	  add_float_key(key, v, "GCRUpper");
+	  add_float_key(key, v, "GCRLower");
+	  add_float_key(key, v, "BlackTrans");
+	}
+    }
+  return key;
+}
+
+static int
+load_lut_curves(stp_vars_t *v, lut_t *lut, const stpi_lut_cache_key_t *key)
+{
+  stp_curve_t *curves[LUT_CACHE_CURVES];
+  int i;
+  if (!stpi_lut_cache_load(key, LUT_CACHE_CURVES, curves))
+    return 0;
+  stp_curve_free_curve_cache(&(lut->user_color_correction));
+  stp_curve_cache_set_curve(&(lut->user_color_correction),
+			    curves[LUT_CACHE_USER]);
+  stp_curve_free_curve_cache(&(lut->brightness_correction));
+  stp_curve_cache_set_curve(&(lut->brightness_correction),
+			    curves[LUT_CACHE_BRIGHTNESS]);
+  stp_curve_free_curve_cache(&(lut->contrast_correction));
+  stp_curve_cache_set_curve(&(lut->contrast_correction),
+			    curves[LUT_CACHE_CONTRAST]);
+  for (i = 0; i < STP_CHANNEL_LIMIT; i++)
+    {
+      stp_curve_free_curve_cache(&(lut->channel_curves[i]));
+      stp_curve_cache_set_curve(&(lut->channel_curves[i]),
+				curves[LUT_CACHE_CHANNELS + i]);
+    }
+  if (curves[LUT_CACHE_GCR])
+    {
+      stp_channel_set_gcr_curve(v, curves[LUT_CACHE_GCR]);
+      stp_curve_destroy(curves[LUT_CACHE_GCR]);
+    }
+  return 1;
+}
+
+static void
+save_lut_curves(stp_vars_t *v, lut_t *lut, const stpi_lut_cache_key_t *key)
+{
+  const stp_curve_t *curves[LUT_CACHE_CURVES];
+  int i;
+  curves[LUT_CACHE_USER] =
+    stp_curve_cache_get_curve(&(lut->user_color_correction));
+  curves[LUT_CACHE_BRIGHTNESS] =
+    stp_curve_cache_get_curve(&(lut->brightness_correction));
+  curves[LUT_CACHE_CONTRAST] =
+    stp_curve_cache_get_curve(&(lut->contrast_correction));
+  for (i = 0; i < STP_CHANNEL_LIMIT; i++)
+    curves[LUT_CACHE_CHANNELS + i] =
+      stp_curve_cache_get_curve(&(lut->channel_curves[i]));
+  curves[LUT_CACHE_GCR] =
+    lut_uses_gcr(lut) ? stp_channel_get_gcr_curve(v) : NULL;
+  stpi_lut_cache_save(key, LUT_CACHE_CURVES, curves);
 }
 
 static void
@@ -1394,6 +1576,7 @@ stpi_compute_lut(stp_vars_t *v)
   int i;
   lut_t *lut = (lut_t *)(stp_get_component_data(v, "Color"));
   stp_curve_t *curve;
+  stpi_lut_cache_key_t *key;
   stp_dprintf(STP_DBG_LUT, v, "stpi_compute_lut\n");
 
   if (lut->input_color_description->color_model == COLOR_UNKNOWN ||
@@ -1426,19 +1609,16 @@ stpi_compute_lut(stp_vars_t *v)
   if (stp_check_boolean_parameter(v, "SimpleGamma", STP_PARAMETER_ACTIVE))
     lut->simple_gamma_correction = stp_get_boolean_parameter(v, "SimpleGamma");
   lut->screen_gamma = lut->app_gamma / 4.0; /* "Empirical" */
-  curve = stp_curve_create_copy(color_curve_bounds);
-  stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
-		    STP_CURVE_BOUNDS_RESCALE);
-  stp_curve_cache_set_curve(&(lut->user_color_correction), curve);
-  curve = stp_curve_create_copy(color_curve_bounds);
-  stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
-		    STP_CURVE_BOUNDS_RESCALE);
-  stp_curve_cache_set_curve(&(lut->brightness_correction), curve);
-  curve = stp_curve_create_copy(color_curve_bounds);
-  stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
-		    STP_CURVE_BOUNDS_RESCALE);
-  stp_curve_cache_set_curve(&(lut->contrast_correction), curve);
-  compute_user_correction(lut);
+
+  /*
+   * The lattice itself is filled in by the first row converted, once the
+   * curves have been resampled to the input depth.
+   */
+  lut->lattice_size = 0;
+  STP_SAFE_FREE(lut->lattice);
+  if (stp_check_int_parameter(v, "ColorLatticeSize", STP_PARAMETER_ACTIVE) &&
+      stp_get_int_parameter(v, "ColorLatticeSize") >= 2)
+    lut->lattice_size = stp_get_int_parameter(v, "ColorLatticeSize");
 
   /*
    * TODO check that these are wraparound curves and all that
@@ -1473,23 +1653,39 @@ stpi_compute_lut(stp_vars_t *v)
   stp_dprintf(STP_DBG_LUT, v, " contrast %.3f\n", lut->contrast);
   stp_dprintf(STP_DBG_LUT, v, " brightness %.3f\n", lut->brightness);
   stp_dprintf(STP_DBG_LUT, v, " screen_gamma %.3f\n", lut->screen_gamma);
+  stp_dprintf(STP_DBG_LUT, v, " lattice_size %d\n", lut->lattice_size);
 
   for (i = 0; i < STP_CHANNEL_LIMIT; i++)
     {
-      if (lut->output_color_description->channel_count < 1 &&
-	  i < lut->out_channels)
-	setup_channel(v, i, &(raw_channel_params[i]));
-      else if (i < channel_param_count &&
-	       lut->output_color_description->channels & (1 << i))
-	setup_channel(v, i, &(channel_params[i]));
+      const channel_param_t *p = get_channel_param(lut, i);
+      if (p)
+	setup_channel(v, i, p);
+    }
+
+  key = lut_cache_key(v, lut);
+  if (!load_lut_curves(v, lut, key))
+    {
+      curve = stp_curve_create_copy(color_curve_bounds);
+      stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
+			STP_CURVE_BOUNDS_RESCALE);
+      stp_curve_cache_set_curve(&(lut->user_color_correction), curve);
+      curve = stp_curve_create_copy(color_curve_bounds);
+      stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
+			STP_CURVE_BOUNDS_RESCALE);
+      stp_curve_cache_set_curve(&(lut->brightness_correction), curve);
+      curve = stp_curve_create_copy(color_curve_bounds);
+      stp_curve_rescale(curve, 65535.0, STP_CURVE_COMPOSE_MULTIPLY,
+			STP_CURVE_BOUNDS_RESCALE);
+      stp_curve_cache_set_curve(&(lut->contrast_correction), curve);
+      compute_user_correction(lut);
+      for (i = 0; i < STP_CHANNEL_LIMIT; i++)
+	if (get_channel_param(lut, i))
+	  compute_one_lut(lut, i);
+      if (lut_uses_gcr(lut))
+	initialize_gcr_curve(v);
+      save_lut_curves(v, lut, key);
     }
-  if (((lut->output_color_description->channels & CMASK_CMYK) == CMASK_CMYK) &&
-      (lut->color_correction->correction == COLOR_CORRECTION_DESATURATED ||
-       lut->input_color_description->color_id == COLOR_ID_GRAY ||
-       lut->input_color_description->color_id == COLOR_ID_WHITE ||
-       lut->input_color_description->color_id == COLOR_ID_RGB ||
-       lut->input_color_description->color_id == COLOR_ID_CMY))
-    initialize_gcr_curve(v);
+  stpi_lut_cache_key_destroy(key);
   if (stp_check_file_parameter(v, "LUTDumpFile", STP_PARAMETER_ACTIVE))
     stpi_dump_lut_to_file(v, stp_get_file_parameter(v, "LUTDumpFile"));
 }
@@ -1572,6 +1768,7 @@ stpi_color_traditional_init(stp_vars_t *v,
 static void
 initialize_standard_curves(void)
 {
+  stpi_data_lock();
   if (!standard_curves_initialized)
     {
       int i;
@@ -1624,6 +1821,7 @@ initialize_standard_curves(void)
 	 *(curve_parameters[i].defval);
       standard_curves_initialized = 1;
     }
+  stpi_data_unlock();
 }
 
 static stp_parameter_list_t
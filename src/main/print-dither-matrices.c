@@ -33,6 +33,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 #include "dither-impl.h"
 
 #ifdef __GNUC__
@@ -500,8 +501,11 @@ stp_xml_dither_cache_set(int x, int y, const char *filename)
     dither_matrix_cache = stp_list_create();
 
   if (stp_xml_dither_cache_get(x, y))
+    {
       /* Already cached for this x and y aspect */
-    return;
+      stp_xml_exit();
+      return;
+    }
 
   cacheval = stp_malloc(sizeof(stp_xml_dither_cache_t));
   cacheval->x = x;
@@ -626,27 +630,22 @@ stpi_dither_array_create_from_file(const char* file, int x, int y)
   stp_mxml_node_t *doc;
   stp_array_t *ret = NULL;
 
-  FILE *fp = fopen(file, "r");
-  if (!fp)
-    {
-      stp_erprintf("stp_curve_create_from_file: unable to open %s: %s\n",
-		   file, strerror(errno));
-      return NULL;
-    }
-
   stp_xml_init();
 
   stp_deprintf(STP_DBG_XML,
 	       "stpi_dither_array_create_from_file: reading `%s'...\n", file);
 
-  doc = stp_mxmlLoadFile(NULL, fp, STP_MXML_NO_CALLBACK);
-  (void) fclose(fp);
+  errno = 0;
+  doc = stpi_xml_load_file(file);
 
   if (doc)
     {
       ret = xml_doc_get_dither_array(doc, x, y);
       stp_mxmlDelete(doc);
     }
+  else
+    stp_erprintf("stp_curve_create_from_file: unable to open %s: %s\n",
+		 file, errno ? strerror(errno) : "parse error");
 
   stp_xml_exit();
 
@@ -657,29 +656,28 @@ static stp_array_t *
 stp_xml_get_dither_array(int x, int y)
 {
   stp_xml_dither_cache_t *cachedval;
-  stp_array_t *ret;
+  stp_array_t *ret = NULL;
 
+  stpi_data_lock();
   cachedval = stp_xml_dither_cache_get(x, y);
 
-  if (cachedval && cachedval->dither_array)
-    return stp_array_create_copy(cachedval->dither_array);
-
   if (!cachedval)
     {
       char buf[1024];
       (void) sprintf(buf, "dither-matrix-%dx%d.xml", x, y);
       stp_xml_parse_file_named(buf);
       cachedval = stp_xml_dither_cache_get(x, y);
-      if (cachedval == NULL || cachedval->filename == NULL)
-	{
-	  return NULL;
-	}
     }
 
-  ret = stpi_dither_array_create_from_file(cachedval->filename, x, y);
-
-  cachedval->dither_array = ret;
-  return stp_array_create_copy(ret);
+  if (cachedval && cachedval->filename)
+    {
+      if (!cachedval->dither_array)
+	cachedval->dither_array =
+	  stpi_dither_array_create_from_file(cachedval->filename, x, y);
+      ret = stp_array_create_copy(cachedval->dither_array);
+    }
+  stpi_data_unlock();
+  return ret;
 }
 
 void
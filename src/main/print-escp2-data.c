@@ -51,10 +51,21 @@ static const escp2_printer_attr_t escp2_printer_attrs[] =
   { "envelope_landscape",      14, 1 },
 };
 
-static stpi_escp2_printer_t *escp2_model_capabilities;
+/*
+ * Each model is allocated separately, so that the data that other jobs
+ * are using doesn't move when the array grows.
+ */
+static stpi_escp2_printer_t **escp2_model_capabilities;
 
 static int escp2_model_count = 0;
 
+static void
+defer_data(stpi_escp2_printer_t *p, escp2_model_data_t data, const char *name)
+{
+  STP_SAFE_FREE(p->deferred_data[data]);
+  p->deferred_data[data] = stp_strdup(name);
+}
+
 static void
 load_model_from_file(const stp_vars_t *v, stp_mxml_node_t *xmod, int model)
 {
@@ -78,19 +89,19 @@ load_model_from_file(const stp_vars_t *v, stp_mxml_node_t *xmod, int model)
 	  if (target)
 	    {
 	      if (!strcmp(name, "media"))
-		stp_escp2_load_media(v, target);
+		defer_data(p, ESCP2_DATA_MEDIA, target);
 	      else if (!strcmp(name, "inputSlots"))
-		stp_escp2_load_input_slots(v, target);
+		defer_data(p, ESCP2_DATA_INPUT_SLOTS, target);
 	      else if (!strcmp(name, "mediaSizes"))
 		stp_escp2_load_media_sizes(v, target);
 	      else if (!strcmp(name, "printerWeaves"))
 		stp_escp2_load_printer_weaves(v, target);
 	      else if (!strcmp(name, "qualityPresets"))
-		stp_escp2_load_quality_presets(v, target);
+		defer_data(p, ESCP2_DATA_QUALITY_PRESETS, target);
 	      else if (!strcmp(name, "resolutions"))
 		stp_escp2_load_resolutions(v, target);
 	      else if (!strcmp(name, "inkGroup"))
-		stp_escp2_load_inkgroup(v, target);
+		defer_data(p, ESCP2_DATA_INKGROUP, target);
 	    }
 	  else if (tmp->child && tmp->child->type == STP_MXML_TEXT)
 	    {
@@ -401,7 +412,7 @@ stp_escp2_load_model(const stp_vars_t *v, int model)
     {
       const char *dn = (const char *) stp_list_item_get_data(item);
       char *fn = stpi_path_merge(dn, buf);
-      stp_mxml_node_t *doc = stp_mxmlLoadFromFile(NULL, fn, STP_MXML_NO_CALLBACK);
+      stp_mxml_node_t *doc = stpi_xml_load_file(fn);
       stp_free(fn);
       if (doc)
 	{
@@ -430,36 +441,70 @@ stpi_escp2_printer_t *
 stp_escp2_get_printer(const stp_vars_t *v)
 {
   int model = stp_get_model_id(v);
+  stpi_escp2_printer_t *printdef;
   STPI_ASSERT(model >= 0, v);
-  if (!escp2_model_capabilities)
-    {
-      escp2_model_capabilities =
-	stp_zalloc(sizeof(stpi_escp2_printer_t) * (model + 1));
-      escp2_model_count = model + 1;
-    }
-  else if (model >= escp2_model_count)
+  stpi_data_lock();
+  if (model >= escp2_model_count)
     {
       escp2_model_capabilities =
 	stp_realloc(escp2_model_capabilities,
-		    sizeof(stpi_escp2_printer_t) * (model + 1));
+		    sizeof(stpi_escp2_printer_t *) * (model + 1));
       (void) memset(escp2_model_capabilities + escp2_model_count, 0,
-		    sizeof(stpi_escp2_printer_t) * (model + 1 - escp2_model_count));
+		    sizeof(stpi_escp2_printer_t *) *
+		    (model + 1 - escp2_model_count));
       escp2_model_count = model + 1;
     }
-  if (!(escp2_model_capabilities[model].active))
+  if (!escp2_model_capabilities[model])
+    escp2_model_capabilities[model] = stp_zalloc(sizeof(stpi_escp2_printer_t));
+  printdef = escp2_model_capabilities[model];
+  if (!(printdef->active))
     {
-#ifdef HAVE_LOCALE_H
-      char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-      setlocale(LC_ALL, "C");
-#endif
-      escp2_model_capabilities[model].active = 1;
+      stp_xml_init();
+      printdef->active = 1;
       stp_escp2_load_model(v, model);
-#ifdef HAVE_LOCALE_H
-      setlocale(LC_ALL, locale);
-      stp_free(locale);
-#endif
+      stp_xml_exit();
+    }
+  stpi_data_unlock();
+  return printdef;
+}
+
+/*
+ * Return the printer, having first loaded the given part of its data if
+ * that hasn't been done yet.
+ */
+stpi_escp2_printer_t *
+stp_escp2_get_printer_data(const stp_vars_t *v, escp2_model_data_t data)
+{
+  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  char *name;
+  stpi_data_lock();
+  name = printdef->deferred_data[data];
+  if (name)
+    {
+      printdef->deferred_data[data] = NULL;
+      stp_xml_init();
+      switch (data)
+	{
+	case ESCP2_DATA_MEDIA:
+	  stp_escp2_load_media(v, name);
+	  break;
+	case ESCP2_DATA_INPUT_SLOTS:
+	  stp_escp2_load_input_slots(v, name);
+	  break;
+	case ESCP2_DATA_QUALITY_PRESETS:
+	  stp_escp2_load_quality_presets(v, name);
+	  break;
+	case ESCP2_DATA_INKGROUP:
+	  stp_escp2_load_inkgroup(v, name);
+	  break;
+	default:
+	  break;
+	}
+      stp_xml_exit();
+      stp_free(name);
     }
-  return &(escp2_model_capabilities[model]);
+  stpi_data_unlock();
+  return printdef;
 }
 
 model_featureset_t
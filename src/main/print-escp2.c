@@ -1163,14 +1163,16 @@ escp2_channel_names(const stp_vars_t *v)
 static inline const inkgroup_t *
 escp2_inkgroup(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INKGROUP);
   return (printdef->inkgroup);
 }
 
 static inline const quality_list_t *
 escp2_quality_list(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_QUALITY_PRESETS);
   return printdef->quality_list;
 }
 
@@ -1401,14 +1403,16 @@ escp2_free_shades(shade_t *shades)
 static const stp_string_list_t *
 escp2_paperlist(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_MEDIA);
   return printdef->papers;
 }
 
 static const stp_string_list_t *
 escp2_slotlist(const stp_vars_t *v)
 {
-  stpi_escp2_printer_t *printdef = stp_escp2_get_printer(v);
+  stpi_escp2_printer_t *printdef =
+    stp_escp2_get_printer_data(v, ESCP2_DATA_INPUT_SLOTS);
   return printdef->input_slots;
 }
 
@@ -4267,80 +4271,83 @@ set_mask(unsigned char *cd_mask, int x_center, int scaled_x_where,
     }
 }
 
-static int
-escp2_print_data(stp_vars_t *v, stp_image_t *image)
+typedef struct
+{
+  double outer_r_sq;
+  double inner_r_sq;
+  int x_center;
+  unsigned char *cd_mask;
+} escp2_cd_mask_t;
+
+static const unsigned char *
+escp2_row_mask(stp_vars_t *v, int y, void *data)
 {
   escp2_privdata_t *pd = get_privdata(v);
-  int errdiv  = stp_image_height(image) / pd->image_printed_height;
-  int errmod  = stp_image_height(image) % pd->image_printed_height;
-  int errval  = 0;
-  int errlast = -1;
-  int errline  = 0;
-  int y;
-  double outer_r_sq = 0;
-  double inner_r_sq = 0;
-  int x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
-  unsigned char *cd_mask = NULL;
-  if (pd->cd_outer_radius > 0)
-    {
-      cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
-      outer_r_sq = (double) pd->cd_outer_radius * (double) pd->cd_outer_radius;
-      inner_r_sq = (double) pd->cd_inner_radius * (double) pd->cd_inner_radius;
-    }
-
-  for (y = 0; y < pd->image_printed_height; y ++)
-    {
-      int duplicate_line = 1;
-      unsigned zero_mask;
-
-      if (errline != errlast)
+  escp2_cd_mask_t *cd = (escp2_cd_mask_t *) data;
+  unsigned char *cd_mask = cd->cd_mask;
+  int y_distance_from_center =
+    pd->cd_outer_radius -
+    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
+  if (!cd_mask)
+    return NULL;
+  if (y_distance_from_center < 0)
+    y_distance_from_center = -y_distance_from_center;
+  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
+  if (y_distance_from_center < pd->cd_outer_radius)
+    {
+      double y_sq = (double) y_distance_from_center *
+	(double) y_distance_from_center;
+      int x_where = sqrt(cd->outer_r_sq - y_sq) + .5;
+      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+      set_mask(cd_mask, cd->x_center, scaled_x_where,
+	       pd->image_printed_width, 1, 0);
+      if (y_distance_from_center < pd->cd_inner_radius)
 	{
-	  errlast = errline;
-	  duplicate_line = 0;
-	  if (stp_color_get_row(v, image, errline, &zero_mask))
-	    return 2;
+	  x_where = sqrt(cd->inner_r_sq - y_sq) + .5;
+	  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
+	  set_mask(cd_mask, cd->x_center, scaled_x_where,
+		   pd->image_printed_width, 1, 1);
 	}
+    }
+  return cd_mask;
+}
 
-      if (cd_mask)
-	{
-	  int y_distance_from_center =
-	    pd->cd_outer_radius -
-	    ((y + pd->cd_y_offset) * pd->micro_units / pd->res->printed_vres);
-	  if (y_distance_from_center < 0)
-	    y_distance_from_center = -y_distance_from_center;
-	  memset(cd_mask, 0, (pd->image_printed_width + 7) / 8);
-	  if (y_distance_from_center < pd->cd_outer_radius)
-	    {
-	      double y_sq = (double) y_distance_from_center *
-		(double) y_distance_from_center;
-	      int x_where = sqrt(outer_r_sq - y_sq) + .5;
-	      int scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-	      set_mask(cd_mask, x_center, scaled_x_where,
-		       pd->image_printed_width, 1, 0);
-	      if (y_distance_from_center < pd->cd_inner_radius)
-		{
-		  x_where = sqrt(inner_r_sq - y_sq) + .5;
-		  scaled_x_where = x_where * pd->res->printed_hres / pd->micro_units;
-		  set_mask(cd_mask, x_center, scaled_x_where,
-			   pd->image_printed_width, 1, 1);
-		}
-	    }
-	}
+static void
+escp2_write_row(stp_vars_t *v, int y, void *data)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  (void) y;
+  (void) data;
+  stp_write_weave(v, pd->cols);
+}
 
-      stp_dither(v, y, duplicate_line, zero_mask, cd_mask);
+static int
+escp2_print_data(stp_vars_t *v, stp_image_t *image)
+{
+  escp2_privdata_t *pd = get_privdata(v);
+  escp2_cd_mask_t cd;
+  stp_row_pipeline_t pipeline;
+  int status;
 
-      stp_write_weave(v, pd->cols);
-      errval += errmod;
-      errline += errdiv;
-      if (errval >= pd->image_printed_height)
-	{
-	  errval -= pd->image_printed_height;
-	  errline ++;
-	}
+  cd.outer_r_sq = 0;
+  cd.inner_r_sq = 0;
+  cd.x_center = pd->cd_x_offset * pd->res->printed_hres / pd->micro_units;
+  cd.cd_mask = NULL;
+  if (pd->cd_outer_radius > 0)
+    {
+      cd.cd_mask = stp_malloc(1 + (pd->image_printed_width + 7) / 8);
+      cd.outer_r_sq = (double) pd->cd_outer_radius * (double) pd->cd_outer_radius;
+      cd.inner_r_sq = (double) pd->cd_inner_radius * (double) pd->cd_inner_radius;
     }
-  if (cd_mask)
-    stp_free(cd_mask);
-  return 1;
+
+  pipeline.out_height = pd->image_printed_height;
+  pipeline.maskfunc = cd.cd_mask ? escp2_row_mask : NULL;
+  pipeline.writefunc = escp2_write_row;
+  pipeline.data = &cd;
+  status = stp_row_pipeline_run(v, image, &pipeline);
+  if (cd.cd_mask)
+    stp_free(cd.cd_mask);
+  return status ? 2 : 1;
 }
 
 static int
@@ -322,6 +322,19 @@ typedef enum
   MODEL_LIMIT
 } escp2_model_option_t;
 
+/*
+ * Parts of a model's data that live in files of their own, and are only
+ * read when they are first needed.
+ */
+typedef enum
+{
+  ESCP2_DATA_MEDIA,
+  ESCP2_DATA_INPUT_SLOTS,
+  ESCP2_DATA_QUALITY_PRESETS,
+  ESCP2_DATA_INKGROUP,
+  ESCP2_DATA_COUNT
+} escp2_model_data_t;
+
 typedef struct escp2_printer
 {
   int		active;
@@ -454,6 +467,8 @@ typedef struct escp2_printer
   quality_list_t *quality_list;
 /*****************/
   inkgroup_t *inkgroup;
+/*****************/
+  char *deferred_data[ESCP2_DATA_COUNT]; /* Files not yet loaded */
 } stpi_escp2_printer_t;
 
 /* From escp2-channels.c: */
@@ -491,6 +506,8 @@ extern const inklist_t *stp_escp2_inklist(const stp_vars_t *v);
 /* From print-escp2-data.c: */
 extern void stp_escp2_load_model(const stp_vars_t *v, int model);
 extern stpi_escp2_printer_t *stp_escp2_get_printer(const stp_vars_t *v);
+extern stpi_escp2_printer_t *stp_escp2_get_printer_data(const stp_vars_t *v,
+						       escp2_model_data_t data);
 extern model_featureset_t stp_escp2_get_cap(const stp_vars_t *v,
 					    escp2_model_option_t feature);
 extern int stp_escp2_has_cap(const stp_vars_t *v, escp2_model_option_t feature,
@@ -624,9 +624,6 @@ static const lexmark_inkname_t ink_types_z52[] =
 #define LXM3200_LEFTOFFS 6254
 #define LXM3200_RIGHTOFFS (LXM3200_LEFTOFFS-2120)
 
-static int lxm3200_headpos = 0;
-static int lxm3200_linetoeject = 0;
-
 #define LXM_3200_HEADERSIZE 24
 static const char outbufHeader_3200[LXM_3200_HEADERSIZE] =
 {
@@ -789,6 +786,8 @@ typedef struct lexm_privdata_weave {
   int bitwidth;
   int ncolors;
   int horizontal_weave;
+  int lxm3200_headpos;		/* 3200 print head position */
+  int lxm3200_linetoeject;	/* 3200 lines left to eject the page */
   unsigned char *outbuf;
 } lexm_privdata_weave;
 
@@ -1458,6 +1457,8 @@ lexmark_init_printer(const stp_vars_t *v, const lexmark_cap_t * caps,
 
 static void lexmark_deinit_printer(const stp_vars_t *v, const lexmark_cap_t * caps)
 {
+  lexm_privdata_weave *pd =
+    (lexm_privdata_weave *) stp_get_component_data(v, "Driver");
 
 	switch(caps->model)	{
 		case m_z52:
@@ -1498,14 +1499,14 @@ static void lexmark_deinit_printer(const stp_vars_t *v, const lexmark_cap_t * ca
 		    0x1b, 0x33, 0x10, 0x00, 0x00, 0x00, 0x00, 0x33
 		  };
 
-			stp_dprintf(STP_DBG_LEXMARK, v, "Headpos: %d\n", lxm3200_headpos);
+			stp_dprintf(STP_DBG_LEXMARK, v, "Headpos: %d\n", pd->lxm3200_headpos);
 
-			lxm3200_linetoeject += 2400;
-			buffer[3] = lxm3200_linetoeject >> 8;
-			buffer[4] = lxm3200_linetoeject & 0xff;
+			pd->lxm3200_linetoeject += 2400;
+			buffer[3] = pd->lxm3200_linetoeject >> 8;
+			buffer[4] = pd->lxm3200_linetoeject & 0xff;
 			buffer[7] = lexmark_calc_3200_checksum(&buffer[0]);
-			buffer[11] = lxm3200_headpos >> 8;
-			buffer[12] = lxm3200_headpos & 0xff;
+			buffer[11] = pd->lxm3200_headpos >> 8;
+			buffer[12] = pd->lxm3200_headpos & 0xff;
 			buffer[15] = lexmark_calc_3200_checksum(&buffer[8]);
 
 			stp_zfwrite((const char *)buffer, 24, 1, v);
@@ -1523,6 +1524,8 @@ static void lexmark_deinit_printer(const stp_vars_t *v, const lexmark_cap_t * ca
  */
 static void paper_shift(const stp_vars_t *v, int offset, const lexmark_cap_t * caps)
 {
+  lexm_privdata_weave *pd =
+    (lexm_privdata_weave *) stp_get_component_data(v, "Driver");
 	switch(caps->model)	{
 		case m_z52:
 		case m_z42:
@@ -1542,7 +1545,7 @@ static void paper_shift(const stp_vars_t *v, int offset, const lexmark_cap_t * c
 		{
 			unsigned char buf[8] = {0x1b, 0x23, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00};
 			if(offset == 0)return;
-			lxm3200_linetoeject -= offset;
+			pd->lxm3200_linetoeject -= offset;
 			buf[3] = (unsigned char)(offset >> 8);
 			buf[4] = (unsigned char)(offset & 0xff);
 			buf[7] = lexmark_calc_3200_checksum(buf);
@@ -1554,7 +1557,7 @@ static void paper_shift(const stp_vars_t *v, int offset, const lexmark_cap_t * c
 			break;
 	}
 
-	stp_dprintf(STP_DBG_LEXMARK, v, "Lines to eject: %d\n", lxm3200_linetoeject);
+	stp_dprintf(STP_DBG_LEXMARK, v, "Lines to eject: %d\n", pd->lxm3200_linetoeject);
 }
 
 /*
@@ -1583,6 +1586,14 @@ get_double_param(stp_vars_t *v, const char *param)
     return 1.0;
 }
 
+static void
+lexmark_write_row(stp_vars_t *v, int y, void *data)
+{
+  lexmark_linebufs_t *cols = (lexmark_linebufs_t *) data;
+  (void) y;
+  stp_write_weave(v, (unsigned char **)cols->v);
+}
+
 /**********************************************************
  * lexmark_print() - Print an image to a LEXMARK printer.
  **********************************************************/
@@ -1597,7 +1608,6 @@ static int
 lexmark_do_print(stp_vars_t *v, stp_image_t *image)
 {
   int		status = 1;
-  int		y;		/* Looping vars */
   int		xdpi, ydpi;	/* Resolution */
   int		n;		/* Output number */
   int page_width,	/* Width of page */
@@ -1610,14 +1620,7 @@ lexmark_do_print(stp_vars_t *v, stp_image_t *image)
     out_width,	/* Width of image on page in pixels */
     out_height,	/* Length of image on page */
     length,		/* Length of raster data in bytes*/
-    buf_length,     /* Length of raster data buffer (dmt) */
-    errdiv,		/* Error dividend */
-    errmod,		/* Error modulus */
-    errval,		/* Current error value */
-    errline,	/* Current raster line */
-    errlast;	/* Last raster line loaded */
-  unsigned      zero_mask;
-  int           image_height;
+    buf_length;     /* Length of raster data buffer (dmt) */
   int           use_dmt = 0;
   int pass_length=0;              /* count of inkjets for one pass */
   int add_top_offset=0;              /* additional top offset */
@@ -1635,6 +1638,7 @@ lexmark_do_print(stp_vars_t *v, stp_image_t *image)
 
   /* weave parameters */
   lexmark_linebufs_t cols;
+  stp_row_pipeline_t pipeline;
   int  nozzle_separation;
   int  horizontal_passes;
   int  ncolors;
@@ -1779,10 +1783,9 @@ densityDivisor /= 1.2;
 
   stp_dprintf(STP_DBG_LEXMARK, v, "page_right %d, page_left %d, page_top %d, page_bottom %d, left %d, top %d\n",page_right, page_left, page_top, page_bottom,left, top);
 
-  image_height = stp_image_height(image);
-
   stp_default_media_size(v, &n, &page_true_height);
-  lxm3200_linetoeject = (page_true_height * 1200) / 72;
+  privdata.lxm3200_headpos = 0;
+  privdata.lxm3200_linetoeject = (page_true_height * 1200) / 72;
 
 
   if (!lexmark_init_printer(v, caps, printing_color,
@@ -2093,12 +2096,6 @@ densityDivisor /= 1.2;
   /* calculate the memory we need for one line of the printer image (hopefully we are right) */
   stp_dprintf(STP_DBG_LEXMARK, v, "---------- buffer mem size = %d\n", (((((pass_length/8)*11)/10)+40) * out_width)+200);
 
-  errdiv  = image_height / out_height;
-  errmod  = image_height % out_height;
-  errval  = 0;
-  errlast = -1;
-  errline  = 0;
-
   privdata.hoffset = left;
   privdata.ydpi = ydpi;
   privdata.model = model;
@@ -2107,31 +2104,12 @@ densityDivisor /= 1.2;
   privdata.physical_xdpi = physical_xdpi;
   privdata.bitwidth = 1;
 
-  for (y = 0; y < out_height; y ++)
-    {
-      int duplicate_line = 1;
-
-      if (errline != errlast)
-	{
-	  errlast = errline;
-	  duplicate_line = 0;
-	  if (stp_color_get_row(v, image, errline, &zero_mask))
-	    {
-	      status = 2;
-	      break;
-	    }
-	}
-      stp_dither(v, y, duplicate_line, zero_mask, NULL);
-      stp_write_weave(v, (unsigned char **)cols.v);
-
-      errval += errmod;
-      errline += errdiv;
-      if (errval >= out_height)
-	{
-	  errval -= out_height;
-	  errline ++;
-	}
-    }
+  pipeline.out_height = out_height;
+  pipeline.maskfunc = NULL;
+  pipeline.writefunc = lexmark_write_row;
+  pipeline.data = &cols;
+  if (stp_row_pipeline_run(v, image, &pipeline))
+    status = 2;
   stp_image_conclude(image);
 
   stp_flush_all(v);
@@ -2199,7 +2177,8 @@ lexmark_init_line(int mode, unsigned char *prnBuf,
 		  int offset,    /* offset from left in 1/"x_raster_res" DIP (printer resolution)*/
 		  int width, int direction,
 		  const lexmark_inkparam_t *ink_parameter,
-		  const lexmark_cap_t *   caps	        /* I - Printer model */
+		  const lexmark_cap_t *   caps,	        /* I - Printer model */
+		  int *headpos	/* IO - 3200 print head position */
 		  )
 {
   int pos1 = 0;
@@ -2355,20 +2334,20 @@ lexmark_init_line(int mode, unsigned char *prnBuf,
       prnBuf[22] = (unsigned char)(pos1 & 0xFF);
 
       abspos = ((((pos2 - 3600) >> 3) & 0xfff0) + 9);
-      prnBuf[5] = (abspos-lxm3200_headpos) >> 8;
-      prnBuf[6] = (abspos-lxm3200_headpos) & 0xff;
+      prnBuf[5] = (abspos - *headpos) >> 8;
+      prnBuf[6] = (abspos - *headpos) & 0xff;
 
-      lxm3200_headpos = abspos;
+      *headpos = abspos;
 
       if(LXM3200_RIGHTOFFS > 4816)
 	abspos = (((LXM3200_RIGHTOFFS - 4800) >> 3) & 0xfff0);
       else
 	abspos = (((LXM3200_RIGHTOFFS - 3600) >> 3) & 0xfff0);
 
-      prnBuf[11] = (lxm3200_headpos-abspos) >> 8;
-      prnBuf[12] = (lxm3200_headpos-abspos) & 0xff;
+      prnBuf[11] = (*headpos - abspos) >> 8;
+      prnBuf[12] = (*headpos - abspos) & 0xff;
 
-      lxm3200_headpos = abspos;
+      *headpos = abspos;
 
       prnBuf[7] = (unsigned char)lexmark_calc_3200_checksum(&prnBuf[0]);
       prnBuf[15] = (unsigned char)lexmark_calc_3200_checksum(&prnBuf[8]);
@@ -2420,6 +2399,8 @@ lexmark_write(const stp_vars_t *v,		/* I - Print file or command */
 	      int           offset, 	/* I - Offset from left side in lexmark_cap_t.x_raster_res DPI */
 	      int           dmt)
 {
+  lexm_privdata_weave *pd =
+    (lexm_privdata_weave *) stp_get_component_data(v, "Driver");
   unsigned char *tbits=NULL, *p=NULL;
   int clen;
   int x;  /* actual vertical position */
@@ -2467,7 +2448,7 @@ lexmark_write(const stp_vars_t *v,		/* I - Print file or command */
 
   p = lexmark_init_line(mode, prnBuf, pass_length, offset, rwidth,
 			direction,  /* direction */
-			ink_parameter, caps);
+			ink_parameter, caps, &(pd->lxm3200_headpos));
 
 
   stp_dprintf(STP_DBG_LEXMARK, v, "lexmark: xStart %d, xEnd %d, xIter %d.\n", xStart, xEnd, xIter);
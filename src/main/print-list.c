@@ -44,76 +44,297 @@ struct stp_list_item
   void *data;			/*!< Data		*/
   struct stp_list_item *prev;	/*!< Previous node	*/
   struct stp_list_item *next;	/*!< Next node		*/
+  struct stp_list *list;	/*!< List the node is in	*/
 };
 
+/** An entry in a name index of a list. */
+typedef struct
+{
+  unsigned hash;			/*!< Hash of the node's name	*/
+  struct stp_list_item *node;		/*!< Node, or NULL if free	*/
+} name_index_entry_t;
+
+/** An index of the nodes of a list by name or by long name. */
+typedef struct
+{
+  name_index_entry_t *entries;		/*!< Nodes hashed by name, or NULL	*/
+  int size;				/*!< Slots in entries (power of 2)	*/
+  int count;				/*!< Slots in use			*/
+  int duplicates;			/*!< Two nodes have shared a name	*/
+} name_index_t;
+
 /** The internal representation of an stp_list_t list. */
 struct stp_list
 {
-  int index_cache;				/*!< Cached node index			*/
   struct stp_list_item *start;			/*!< Start node				*/
   struct stp_list_item *end;			/*!< End node				*/
-  struct stp_list_item *index_cache_node;	/*!< Cached node (for index)		*/
+  struct stp_list_item **nodes;			/*!< Nodes in order, or NULL		*/
+  int nodes_size;				/*!< Slots allocated in nodes		*/
   int length;					/*!< Number of nodes			*/
   stp_node_freefunc freefunc;			/*!< Callback to free node data		*/
   stp_node_copyfunc copyfunc;			/*!< Callback to copy node		*/
   stp_node_namefunc namefunc;			/*!< Callback to get node name		*/
   stp_node_namefunc long_namefunc;		/*!< Callback to get node long name	*/
   stp_node_sortfunc sortfunc;			/*!< Callback to compare (sort) nodes	*/
-  char *name_cache;				/*!< Cached name			*/
-  struct stp_list_item *name_cache_node;	/*!< Cached node (for name)		*/
-  char *long_name_cache;			/*!< Cached long name			*/
-  struct stp_list_item *long_name_cache_node;	/*!< Cached node (for long name)	*/
+  name_index_t name_index;			/*!< Nodes by name			*/
+  name_index_t long_name_index;			/*!< Nodes by long name			*/
 };
 
+/*
+ * Lookups never modify a list, so any number of threads may look things
+ * up in a list at once as long as nothing is adding or removing nodes.
+ * The nodes are also kept in an array in list order, so that lookups
+ * by index don't have to walk the list.
+ *
+ * Lists with a name function and more than a handful of nodes keep an
+ * open-addressed (linearly probed) hash index from name to the first
+ * node with that name, so that lookups by name don't have to walk the
+ * list, and likewise for long names.  The indexes are kept up to date
+ * whenever a node is added or removed, or its data is replaced, rather
+ * than built by the first lookup, so that concurrent lookups remain
+ * safe.
+ */
+#define NAME_INDEX_MIN_LENGTH 8
+
+static inline unsigned
+name_hash(const char *name)
+{
+  unsigned hash = 2166136261u;
+  while (*name)
+    {
+      hash ^= (unsigned char) *name++;
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
 /**
- * Cache a list node by its short name.
- * @param list the list to use.
- * @param name the short name.
- * @param cache the node to cache.
+ * The function giving the names that an index is keyed on.
+ */
+static inline stp_node_namefunc
+index_namefunc(const stp_list_t *list, const name_index_t *index)
+{
+  return index == &(list->name_index) ? list->namefunc : list->long_namefunc;
+}
+
+/**
+ * Find the slot holding the node with the given name.
+ * @returns the slot, or the free slot where the name belongs.
  */
+static inline name_index_entry_t *
+name_index_find(const stp_list_t *list, const name_index_t *index,
+		const char *name, unsigned hash)
+{
+  stp_node_namefunc namefunc = index_namefunc(list, index);
+  unsigned mask = index->size - 1;
+  unsigned i = hash & mask;
+  while (index->entries[i].node)
+    {
+      if (index->entries[i].hash == hash &&
+	  strcmp(name, namefunc(index->entries[i].node->data)) == 0)
+	break;
+      i = (i + 1) & mask;
+    }
+  return &(index->entries[i]);
+}
+
+static void
+name_index_add(stp_list_t *list, name_index_t *index, stp_list_item_t *node)
+{
+  stp_node_namefunc namefunc = index_namefunc(list, index);
+  const char *name = namefunc(node->data);
+  unsigned hash;
+  name_index_entry_t *slot;
+  if (!name)
+    return;
+  hash = name_hash(name);
+  slot = name_index_find(list, index, name, hash);
+  if (slot->node)
+    {
+      /* Whichever node comes first in the list is the one to find */
+      index->duplicates = 1;
+      if (slot->node != node)
+	{
+	  stp_list_item_t *first = list->start;
+	  while (first && strcmp(name, namefunc(first->data)))
+	    first = first->next;
+	  slot->node = first;
+	}
+      return;
+    }
+  slot->hash = hash;
+  slot->node = node;
+  index->count++;
+}
+
 static void
-set_name_cache(stp_list_t *list,
-	       const char *name,
-	       stp_list_item_t *cache)
+rebuild_name_index(stp_list_t *list, name_index_t *index)
 {
-  if (list->name_cache)
-    stp_free(list->name_cache);
-  list->name_cache = NULL;
-  if (name)
-    list->name_cache = stp_strdup(name);
-  list->name_cache_node = cache;
+  stp_list_item_t *node = list->start;
+  int size = 2 * NAME_INDEX_MIN_LENGTH;
+  while (size < 2 * (list->length + 1))
+    size *= 2;
+  STP_SAFE_FREE(index->entries);
+  index->entries = stp_zalloc(size * sizeof(name_index_entry_t));
+  index->size = size;
+  index->count = 0;
+  index->duplicates = 0;
+  while (node)
+    {
+      name_index_add(list, index, node);
+      node = node->next;
+    }
 }
 
 /**
- * Cache a list node by its long name.
- * @param list the list to use.
- * @param long_name the long name.
- * @param cache the node to cache.
+ * Double the size of an index.  The names are already known to be
+ * distinct and their hashes are stored, so they needn't be looked at.
+ */
+static void
+grow_name_index(name_index_t *index)
+{
+  name_index_entry_t *old_entries = index->entries;
+  int old_size = index->size;
+  unsigned mask = 2 * old_size - 1;
+  int i;
+  index->entries = stp_zalloc(2 * old_size * sizeof(name_index_entry_t));
+  index->size = 2 * old_size;
+  for (i = 0; i < old_size; i++)
+    if (old_entries[i].node)
+      {
+	unsigned j = old_entries[i].hash & mask;
+	while (index->entries[j].node)
+	  j = (j + 1) & mask;
+	index->entries[j] = old_entries[i];
+      }
+  stp_free(old_entries);
+}
+
+/**
+ * Add a node that has just been linked into the list to an index,
+ * creating or growing the index if need be.
  */
 static void
-set_long_name_cache(stp_list_t *list,
-		    const char *long_name,
-		    stp_list_item_t *cache)
+name_index_insert(stp_list_t *list, name_index_t *index,
+		  stp_list_item_t *node)
 {
-  if (list->long_name_cache)
-    stp_free(list->long_name_cache);
-  list->long_name_cache = NULL;
-  if (long_name)
-    list->long_name_cache = stp_strdup(long_name);
-  list->long_name_cache_node = cache;
+  if (!index_namefunc(list, index))
+    return;
+  if (!index->entries)
+    {
+      if (list->length >= NAME_INDEX_MIN_LENGTH)
+	rebuild_name_index(list, index);
+    }
+  else
+    {
+      if (2 * (index->count + 1) > index->size)
+	grow_name_index(index);
+      name_index_add(list, index, node);
+    }
 }
 
 /**
- * Clear cached nodes.
- * @param list the list to use.
+ * Remove a node that is about to be unlinked from the list (but whose
+ * data is still valid) from an index.
+ */
+static void
+name_index_remove(stp_list_t *list, name_index_t *index,
+		  stp_list_item_t *node)
+{
+  stp_node_namefunc namefunc = index_namefunc(list, index);
+  const char *name;
+  unsigned mask = index->size - 1;
+  unsigned i, j;
+  if (!index->entries || !(name = namefunc(node->data)))
+    return;
+  i = name_index_find(list, index, name, name_hash(name)) - index->entries;
+  if (index->entries[i].node != node)
+    return;
+  if (index->duplicates)
+    {
+      stp_list_item_t *other = node->next;
+      while (other && strcmp(name, namefunc(other->data)))
+	other = other->next;
+      if (other)
+	{
+	  index->entries[i].node = other;
+	  return;
+	}
+    }
+  /* Shift back any entries that probed past the slot being freed */
+  index->entries[i].node = NULL;
+  index->count--;
+  for (j = (i + 1) & mask; index->entries[j].node; j = (j + 1) & mask)
+    {
+      unsigned home = index->entries[j].hash & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	  index->entries[i] = index->entries[j];
+	  index->entries[j].node = NULL;
+	  i = j;
+	}
+    }
+}
+
+/**
+ * Would replacing a node's data change the name it has in an index?
+ */
+static int
+name_index_changed(const stp_list_t *list, const name_index_t *index,
+		   const void *old_data, const void *new_data)
+{
+  stp_node_namefunc namefunc = index_namefunc(list, index);
+  const char *old_name;
+  const char *new_name;
+  if (!index->entries)
+    return 0;
+  old_name = namefunc(old_data);
+  new_name = namefunc(new_data);
+  return (old_name != new_name &&
+	  (!old_name || !new_name || strcmp(old_name, new_name) != 0));
+}
+
+/**
+ * Add a node that has just been linked into the list to the node array.
+ */
+static void
+nodes_insert(stp_list_t *list, stp_list_item_t *node)
+{
+  int i;
+  if (list->length > list->nodes_size)
+    {
+      list->nodes_size = list->nodes_size ? list->nodes_size * 2 : 8;
+      list->nodes = stp_realloc(list->nodes,
+				list->nodes_size * sizeof(stp_list_item_t *));
+    }
+  if (!node->next)
+    i = list->length - 1;
+  else
+    {
+      for (i = 0; list->nodes[i] != node->next; i++)
+	;
+      memmove(list->nodes + i + 1, list->nodes + i,
+	      (list->length - 1 - i) * sizeof(stp_list_item_t *));
+    }
+  list->nodes[i] = node;
+}
+
+/**
+ * Remove a node that is about to be unlinked from the node array.
  */
-static inline void
-clear_cache(stp_list_t *list)
+static void
+nodes_remove(stp_list_t *list, stp_list_item_t *node)
 {
-  list->index_cache = 0;
-  list->index_cache_node = NULL;
-  set_name_cache(list, NULL, NULL);
-  set_long_name_cache(list, NULL, NULL);
+  int i;
+  if (!list->nodes)
+    return;
+  if (node == list->end)
+    i = list->length - 1;
+  else
+    for (i = 0; list->nodes[i] != node; i++)
+      ;
+  memmove(list->nodes + i, list->nodes + i + 1,
+	  (list->length - 1 - i) * sizeof(stp_list_item_t *));
 }
 
 void
@@ -138,20 +359,24 @@ stp_list_create(void)
     stp_malloc(sizeof(stp_list_t));
 
   /* initialise an empty list */
-  list->index_cache = 0;
   list->length = 0;
   list->start = NULL;
   list->end = NULL;
-  list->index_cache_node = NULL;
+  list->nodes = NULL;
+  list->nodes_size = 0;
   list->freefunc = NULL;
   list->namefunc = NULL;
   list->long_namefunc = NULL;
   list->sortfunc = NULL;
   list->copyfunc = NULL;
-  list->name_cache = NULL;
-  list->name_cache_node = NULL;
-  list->long_name_cache = NULL;
-  list->long_name_cache_node = NULL;
+  list->name_index.entries = NULL;
+  list->name_index.size = 0;
+  list->name_index.count = 0;
+  list->name_index.duplicates = 0;
+  list->long_name_index.entries = NULL;
+  list->long_name_index.size = 0;
+  list->long_name_index.count = 0;
+  list->long_name_index.duplicates = 0;
 
   stp_deprintf(STP_DBG_LIST, "stp_list_head constructor\n");
   return list;
@@ -194,7 +419,10 @@ stp_list_destroy(stp_list_t *list)
   stp_list_item_t *next;
 
   check_list(list);
-  clear_cache(list);
+  /* Nodes are destroyed in order, so there's no point in keeping these */
+  STP_SAFE_FREE(list->nodes);
+  STP_SAFE_FREE(list->name_index.entries);
+  STP_SAFE_FREE(list->long_name_index.entries);
   cur = list->start;
   while(cur)
     {
@@ -233,94 +461,18 @@ stp_list_get_end(const stp_list_t *list)
   return list->end;
 }
 
-static inline stp_list_t *
-deconst_list(const stp_list_t *list)
-{
-  return (stp_list_t *) stpi_cast_safe(list);
-}
-
 /* get the node by its place in the list */
 stp_list_item_t *
 stp_list_get_item_by_index(const stp_list_t *list, int idx)
 {
-  stp_list_item_t *node = NULL;
-  stp_list_t *ulist = deconst_list(list);
-  int i; /* current index */
-  int d = 0; /* direction of list traversal, 0=forward */
-  int c = 0; /* use cache? */
   check_list(list);
-
-  if (idx >= list->length)
+  if (idx < 0 || idx >= list->length)
     return NULL;
-
-  /* see if using the cache is worthwhile */
-  if (list->index_cache)
-    {
-      if (idx < (list->length/2))
-	{
-	  if (idx > abs(idx - list->index_cache))
-	    c = 1;
-	  else
-	    d = 0;
-	}
-      else
-	{
-	  if (list->length - 1 - idx >
-	      abs (list->length - 1 - idx - list->index_cache))
-	    c = 1;
-	  else
-	    d = 1;
-	}
-    }
-
-
-  if (c) /* use the cached index and node */
-    {
-      if (idx > list->index_cache) /* forward */
-	d = 0;
-      else /* backward */
-	d = 1;
-      i = list->index_cache;
-      node = list->index_cache_node;
-    }
-  else /* start from one end of the list */
-    {
-      if (d)
-	{
-	  i = list->length - 1;
-	  node = list->end;
-	}
-      else
-	{
-	  i = 0;
-	  node = list->start;
-	}
-    }
-
-  while (node && i != idx)
-    {
-      if (d)
-	{
-	  i--;
-	  node = node->prev;
-	}
-      else
-	{
-	  i++;
-	  node = node->next;
-	}
-    }
-
-  /* update cache */
-  ulist->index_cache = i;
-  ulist->index_cache_node = node;
-
-  return node;
+  return list->nodes[idx];
 }
 
 /**
  * Find an item in a list by its name.
- * This internal helper is not optimised to use any caching.
  * @param list the list to use.
  * @param name the name to find.
  * @returns a pointer to the list item, or NULL if the name is
@@ -342,58 +494,21 @@ stp_list_get_item_by_name_internal(const stp_list_t *list, const char *name)
 stp_list_item_t *
 stp_list_get_item_by_name(const stp_list_t *list, const char *name)
 {
-  stp_list_item_t *node = NULL;
-  stp_list_t *ulist = deconst_list(list);
   check_list(list);
 
   if (!list->namefunc || !name)
     return NULL;
 
-  if (list->name_cache && list->name_cache_node)
-    {
-      const char *new_name;
-      node = list->name_cache_node;
-      /* Is this the item we've cached? */
-      if (strcmp(name, list->name_cache) == 0 &&
-	  strcmp(name, list->namefunc(node->data)) == 0)
-	return node;
-
-      /* If not, check the next item in case we're searching the list */
-      node = node->next;
-      if (node)
-	{
-	  new_name = list->namefunc(node->data);
-	  if (strcmp(name, new_name) == 0)
-	    {
-	      set_name_cache(ulist, new_name, node);
-	      return node;
-	    }
-	}
-      /* If not, check the index cache */
-      node = list->index_cache_node;
-      if (node)
-	{
-	  new_name = list->namefunc(node->data);
-	  if (strcmp(name, new_name) == 0)
-	    {
-	      set_name_cache(ulist, new_name, node);
-	      return node;
-	    }
-	}
-    }
-
-  node = stp_list_get_item_by_name_internal(list, name);
-
-  if (node)
-    set_name_cache(ulist, name, node);
-
-  return node;
+  if (list->name_index.entries)
+    return name_index_find(list, &(list->name_index), name,
+			   name_hash(name))->node;
+  else
+    return stp_list_get_item_by_name_internal(list, name);
 }
 
 
 /**
  * Find an item in a list by its long name.
- * This internal helper is not optimised to use any caching.
  * @param list the list to use.
  * @param long_name the long name to find.
  * @returns a pointer to the list item, or NULL if the long name is
@@ -416,52 +531,16 @@ stp_list_get_item_by_long_name_internal(const stp_list_t *list,
 stp_list_item_t *
 stp_list_get_item_by_long_name(const stp_list_t *list, const char *long_name)
 {
-  stp_list_item_t *node = NULL;
-  stp_list_t *ulist = deconst_list(list);
   check_list(list);
 
   if (!list->long_namefunc || !long_name)
     return NULL;
 
-  if (list->long_name_cache && list->long_name_cache_node)
-    {
-      const char *new_long_name;
-      node = list->long_name_cache_node;
-      /* Is this the item we've cached? */
-      if (strcmp(long_name, list->long_name_cache) == 0 &&
-	  strcmp(long_name, list->long_namefunc(node->data)) == 0)
-	return node;
-
-      /* If not, check the next item in case we're searching the list */
-      node = node->next;
-      if (node)
-	{
-	  new_long_name = list->long_namefunc(node->data);
-	  if (strcmp(long_name, new_long_name) == 0)
-	    {
-	      set_long_name_cache(ulist, new_long_name, node);
-	      return node;
-	    }
-	}
-      /* If not, check the index cache */
-      node = list->index_cache_node;
-      if (node)
-	{
-	  new_long_name = list->long_namefunc(node->data);
-	  if (strcmp(long_name, new_long_name) == 0)
-	    {
-	      set_long_name_cache(ulist, new_long_name, node);
-	      return node;
-	    }
-	}
-    }
-
-  node = stp_list_get_item_by_long_name_internal(list, long_name);
-
-  if (node)
-    set_long_name_cache(ulist, long_name, node);
-
-  return node;
+  if (list->long_name_index.entries)
+    return name_index_find(list, &(list->long_name_index), long_name,
+			   name_hash(long_name))->node;
+  else
+    return stp_list_get_item_by_long_name_internal(list, long_name);
 }
 
 
@@ -501,6 +580,9 @@ stp_list_set_namefunc(stp_list_t *list, stp_node_namefunc namefunc)
 {
   check_list(list);
   list->namefunc = namefunc;
+  STP_SAFE_FREE(list->name_index.entries);
+  if (namefunc && list->length >= NAME_INDEX_MIN_LENGTH)
+    rebuild_name_index(list, &(list->name_index));
 }
 
 stp_node_namefunc
@@ -516,6 +598,9 @@ stp_list_set_long_namefunc(stp_list_t *list, stp_node_namefunc long_namefunc)
 {
   check_list(list);
   list->long_namefunc = long_namefunc;
+  STP_SAFE_FREE(list->long_name_index.entries);
+  if (long_namefunc && list->length >= NAME_INDEX_MIN_LENGTH)
+    rebuild_name_index(list, &(list->long_name_index));
 }
 
 stp_node_namefunc
@@ -562,10 +647,9 @@ stp_list_item_create(stp_list_t *list,
 
   check_list(list);
 
-  clear_cache(list);
-
   ln = stp_malloc(sizeof(stp_list_item_t));
   ln->prev = ln->next = NULL;
+  ln->list = list;
 
   if (data)
     ln->data = stpi_cast_safe(data);
@@ -645,6 +729,9 @@ stp_list_item_create(stp_list_t *list,
 
   /* increment reference count */
   list->length++;
+  nodes_insert(list, ln);
+  name_index_insert(list, &(list->name_index), ln);
+  name_index_insert(list, &(list->long_name_index), ln);
 
   stp_deprintf(STP_DBG_LIST, "stp_list_node constructor\n");
   return 0;
@@ -656,7 +743,9 @@ stp_list_item_destroy(stp_list_t *list, stp_list_item_t *item)
 {
   check_list(list);
 
-  clear_cache(list);
+  nodes_remove(list, item);
+  name_index_remove(list, &(list->name_index), item);
+  name_index_remove(list, &(list->long_name_index), item);
   /* decrement reference count */
   list->length--;
 
@@ -703,7 +792,21 @@ stp_list_item_set_data(stp_list_item_t *item, void *data)
 {
   if (data)
     {
+      stp_list_t *list = item->list;
+      /* The new data may have a different name or long name */
+      int name_changed =
+	name_index_changed(list, &(list->name_index), item->data, data);
+      int long_name_changed =
+	name_index_changed(list, &(list->long_name_index), item->data, data);
+      if (name_changed)
+	name_index_remove(list, &(list->name_index), item);
+      if (long_name_changed)
+	name_index_remove(list, &(list->long_name_index), item);
       item->data = data;
+      if (name_changed)
+	name_index_insert(list, &(list->name_index), item);
+      if (long_name_changed)
+	name_index_insert(list, &(list->long_name_index), item);
       return 0;
     }
   return 1; /* return error if data was NULL */
@@ -37,6 +37,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 
 #ifdef __GNUC__
 #define inline __inline__
@@ -192,9 +193,40 @@ typedef struct
   char nputc_buf[NPUTC_BUFSIZE];
 } dyesub_privdata_t;
 
-static dyesub_privdata_t privdata;
+static dyesub_privdata_t *
+get_privdata(stp_vars_t *v)
+{
+  return (dyesub_privdata_t *) stp_get_component_data(v, "Driver");
+}
+
+struct dyesub_print_vars;
+struct dyesub_resampler;
+
+/*
+ * Fixed point filter taps for resampling one axis of the image.  Output
+ * pixel i is the sum of ntaps source pixels starting at start[i], each
+ * multiplied by the corresponding weight.  The weights of each output
+ * pixel add up to DYESUB_RESAMPLE_ONE.
+ */
+#define DYESUB_RESAMPLE_BITS 14
+#define DYESUB_RESAMPLE_ONE (1 << DYESUB_RESAMPLE_BITS)
 
 typedef struct {
+  int ntaps;
+  int *start;
+  int *weights;
+} dyesub_filter_t;
+
+/*
+ * Convert and pack one row of pixels.  chans lists the ink channels
+ * to write for each pixel, in order.
+ */
+typedef void (*dyesub_row_emitter_t)(const struct dyesub_print_vars *pv,
+				     const unsigned short *row_data,
+				     const int *chans, int nchans,
+				     unsigned char *out);
+
+typedef struct dyesub_print_vars {
   int out_channels;
   int ink_channels;
   const char *ink_order;
@@ -204,13 +236,29 @@ typedef struct {
   int plane_interlacing;
   int row_interlacing;
   unsigned char empty_byte[MAX_INK_CHANNELS];  /* one for each color plane */
-  unsigned short **image_data;
+  unsigned short *image_data;	/* The whole image, unless streaming */
+  size_t image_stride;		/* Shorts from one stored row to the next */
+  int image_streaming;		/* Rows are converted as they're printed */
+  const unsigned short *image_row;	/* Current row when streaming */
+  stp_image_t *image;
   int outh_px, outw_px, outt_px, outb_px, outl_px, outr_px;
   int imgh_px, imgw_px;
   int prnh_px, prnw_px, prnt_px, prnb_px, prnl_px, prnr_px;
   int print_mode;	/* portrait or landscape */
   int image_rows;
   int plane_lefttoright;
+  int ycbcr;			/* Convert RGB to YCbCr */
+  dyesub_row_emitter_t emit_row;
+  int *col_offset;		/* Where each output pixel comes from */
+  int col_identity;		/* Output pixels are input pixels in order */
+  unsigned char *row_buf;
+  const struct dyesub_resampler *resampler;	/* NULL for nearest pixel */
+  dyesub_filter_t hfilter, vfilter;
+  unsigned short *window;	/* Recent source rows, resampled across */
+  int *window_rows;		/* Source row in each slot of the window */
+  unsigned short *resampled_row;
+  int *resample_acc;
+  int resampled_y;		/* Output row in resampled_row */
 } dyesub_print_vars_t;
 
 typedef struct /* printer specific parameters */
@@ -301,8 +349,9 @@ LIST(dyesub_printsize_list_t, p10_printsize_list, dyesub_printsize_t, p10_prints
 
 static void p10_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\033R\033M\033S\2\033N\1\033D\1\033Y", 1, 15, v);
-  stp_write_raw(&(privdata.laminate->seq), v); /* laminate */
+  stp_write_raw(&(pd->laminate->seq), v); /* laminate */
   stp_zfwrite("\033Z\0", 1, 3, v);
 }
 
@@ -313,11 +362,12 @@ static void p10_printer_end_func(stp_vars_t *v)
 
 static void p10_block_init_func(stp_vars_t *v)
 {
-  stp_zprintf(v, "\033T%c", privdata.plane);
-  stp_put16_le(privdata.block_min_w, v);
-  stp_put16_le(privdata.block_min_h, v);
-  stp_put16_le(privdata.block_max_w + 1, v);
-  stp_put16_le(privdata.block_max_h + 1, v);
+  dyesub_privdata_t *pd = get_privdata(v);
+  stp_zprintf(v, "\033T%c", pd->plane);
+  stp_put16_le(pd->block_min_w, v);
+  stp_put16_le(pd->block_min_h, v);
+  stp_put16_le(pd->block_max_w + 1, v);
+  stp_put16_le(pd->block_max_h + 1, v);
 }
 
 static const laminate_t p10_laminate[] =
@@ -360,8 +410,9 @@ static void p200_printer_init_func(stp_vars_t *v)
 
 static void p200_plane_init_func(stp_vars_t *v)
 {
-  stp_zprintf(v, "P0%d9999", 3 - privdata.plane+1 );
-  stp_put32_be(privdata.w_size * privdata.h_size, v);
+  dyesub_privdata_t *pd = get_privdata(v);
+  stp_zprintf(v, "P0%d9999", 3 - pd->plane+1 );
+  stp_put32_be(pd->w_size * pd->h_size, v);
 }
 
 static void p200_printer_end_func(stp_vars_t *v)
@@ -413,32 +464,35 @@ LIST(dyesub_printsize_list_t, p300_printsize_list, dyesub_printsize_t, p300_prin
 
 static void p300_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\033\033\033C\033N\1\033F\0\1\033MS\xff\xff\xff"
 	      "\033Z", 1, 19, v);
-  stp_put16_be(privdata.w_dpi, v);
-  stp_put16_be(privdata.h_dpi, v);
+  stp_put16_be(pd->w_dpi, v);
+  stp_put16_be(pd->h_dpi, v);
 }
 
 static void p300_plane_end_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   const char *c = "CMY";
-  stp_zprintf(v, "\033\033\033P%cS", c[privdata.plane-1]);
+  stp_zprintf(v, "\033\033\033P%cS", c[pd->plane-1]);
   stp_deprintf(STP_DBG_DYESUB, "dyesub: p300_plane_end_func: %c\n",
-	c[privdata.plane-1]);
+	c[pd->plane-1]);
 }
 
 static void p300_block_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   const char *c = "CMY";
-  stp_zprintf(v, "\033\033\033W%c", c[privdata.plane-1]);
-  stp_put16_be(privdata.block_min_h, v);
-  stp_put16_be(privdata.block_min_w, v);
-  stp_put16_be(privdata.block_max_h, v);
-  stp_put16_be(privdata.block_max_w, v);
+  stp_zprintf(v, "\033\033\033W%c", c[pd->plane-1]);
+  stp_put16_be(pd->block_min_h, v);
+  stp_put16_be(pd->block_min_w, v);
+  stp_put16_be(pd->block_max_h, v);
+  stp_put16_be(pd->block_max_w, v);
 
   stp_deprintf(STP_DBG_DYESUB, "dyesub: p300_block_init_func: %d-%dx%d-%d\n",
-	privdata.block_min_w, privdata.block_max_w,
-	privdata.block_min_h, privdata.block_max_h);
+	pd->block_min_w, pd->block_max_w,
+	pd->block_min_h, pd->block_max_h);
 }
 
 static const char p300_adj_cyan[] =
@@ -511,8 +565,9 @@ LIST(dyesub_printsize_list_t, p400_printsize_list, dyesub_printsize_t, p400_prin
 
 static void p400_printer_init_func(stp_vars_t *v)
 {
-  int wide = (strcmp(privdata.pagesize, "c8x10") == 0
-		  || strcmp(privdata.pagesize, "C6") == 0);
+  dyesub_privdata_t *pd = get_privdata(v);
+  int wide = (strcmp(pd->pagesize, "c8x10") == 0
+		  || strcmp(pd->pagesize, "C6") == 0);
 
   stp_zprintf(v, "\033ZQ"); dyesub_nputc(v, '\0', 61);
   stp_zprintf(v, "\033FP"); dyesub_nputc(v, '\0', 61);
@@ -521,13 +576,13 @@ static void p400_printer_init_func(stp_vars_t *v)
   stp_zprintf(v, "\033ZS");
   if (wide)
     {
-      stp_put16_be(privdata.h_size, v);
-      stp_put16_be(privdata.w_size, v);
+      stp_put16_be(pd->h_size, v);
+      stp_put16_be(pd->w_size, v);
     }
   else
     {
-      stp_put16_be(privdata.w_size, v);
-      stp_put16_be(privdata.h_size, v);
+      stp_put16_be(pd->w_size, v);
+      stp_put16_be(pd->h_size, v);
     }
   dyesub_nputc(v, '\0', 57);
   stp_zprintf(v, "\033ZP"); dyesub_nputc(v, '\0', 61);
@@ -545,23 +600,24 @@ static void p400_plane_end_func(stp_vars_t *v)
 
 static void p400_block_init_func(stp_vars_t *v)
 {
-  int wide = (strcmp(privdata.pagesize, "c8x10") == 0
-		  || strcmp(privdata.pagesize, "C6") == 0);
+  dyesub_privdata_t *pd = get_privdata(v);
+  int wide = (strcmp(pd->pagesize, "c8x10") == 0
+		  || strcmp(pd->pagesize, "C6") == 0);
 
-  stp_zprintf(v, "\033Z%c", '3' - privdata.plane + 1);
+  stp_zprintf(v, "\033Z%c", '3' - pd->plane + 1);
   if (wide)
     {
-      stp_put16_be(privdata.h_size - privdata.block_max_h - 1, v);
-      stp_put16_be(privdata.w_size - privdata.block_max_w - 1, v);
-      stp_put16_be(privdata.block_max_h - privdata.block_min_h + 1, v);
-      stp_put16_be(privdata.block_max_w - privdata.block_min_w + 1, v);
+      stp_put16_be(pd->h_size - pd->block_max_h - 1, v);
+      stp_put16_be(pd->w_size - pd->block_max_w - 1, v);
+      stp_put16_be(pd->block_max_h - pd->block_min_h + 1, v);
+      stp_put16_be(pd->block_max_w - pd->block_min_w + 1, v);
     }
   else
     {
-      stp_put16_be(privdata.block_min_w, v);
-      stp_put16_be(privdata.block_min_h, v);
-      stp_put16_be(privdata.block_max_w - privdata.block_min_w + 1, v);
-      stp_put16_be(privdata.block_max_h - privdata.block_min_h + 1, v);
+      stp_put16_be(pd->block_min_w, v);
+      stp_put16_be(pd->block_min_h, v);
+      stp_put16_be(pd->block_max_w - pd->block_min_w + 1, v);
+      stp_put16_be(pd->block_max_h - pd->block_min_h + 1, v);
     }
   dyesub_nputc(v, '\0', 53);
 }
@@ -631,12 +687,13 @@ LIST(dyesub_printsize_list_t, p440_printsize_list, dyesub_printsize_t, p440_prin
 
 static void p440_printer_init_func(stp_vars_t *v)
 {
-  int wide = ! (strcmp(privdata.pagesize, "A4") == 0
-		  || strcmp(privdata.pagesize, "Custom") == 0);
+  dyesub_privdata_t *pd = get_privdata(v);
+  int wide = ! (strcmp(pd->pagesize, "A4") == 0
+		  || strcmp(pd->pagesize, "Custom") == 0);
 
   stp_zprintf(v, "\033FP"); dyesub_nputc(v, '\0', 61);
   stp_zprintf(v, "\033Y");
-  stp_write_raw(&(privdata.laminate->seq), v); /* laminate */ 
+  stp_write_raw(&(pd->laminate->seq), v); /* laminate */ 
   dyesub_nputc(v, '\0', 61);
   stp_zprintf(v, "\033FC"); dyesub_nputc(v, '\0', 61);
   stp_zprintf(v, "\033ZF");
@@ -645,16 +702,16 @@ static void p440_printer_init_func(stp_vars_t *v)
   stp_zprintf(v, "\033ZS");
   if (wide)
     {
-      stp_put16_be(privdata.h_size, v);
-      stp_put16_be(privdata.w_size, v);
+      stp_put16_be(pd->h_size, v);
+      stp_put16_be(pd->w_size, v);
     }
   else
     {
-      stp_put16_be(privdata.w_size, v);
-      stp_put16_be(privdata.h_size, v);
+      stp_put16_be(pd->w_size, v);
+      stp_put16_be(pd->h_size, v);
     }
   dyesub_nputc(v, '\0', 57);
-  if (strcmp(privdata.pagesize, "C6") == 0)
+  if (strcmp(pd->pagesize, "C6") == 0)
     {
       stp_zprintf(v, "\033ZC"); dyesub_nputc(v, '\0', 61);
     }
@@ -667,35 +724,37 @@ static void p440_printer_end_func(stp_vars_t *v)
 
 static void p440_block_init_func(stp_vars_t *v)
 {
-  int wide = ! (strcmp(privdata.pagesize, "A4") == 0
-		  || strcmp(privdata.pagesize, "Custom") == 0);
+  dyesub_privdata_t *pd = get_privdata(v);
+  int wide = ! (strcmp(pd->pagesize, "A4") == 0
+		  || strcmp(pd->pagesize, "Custom") == 0);
 
   stp_zprintf(v, "\033ZT");
   if (wide)
     {
-      stp_put16_be(privdata.h_size - privdata.block_max_h - 1, v);
-      stp_put16_be(privdata.w_size - privdata.block_max_w - 1, v);
-      stp_put16_be(privdata.block_max_h - privdata.block_min_h + 1, v);
-      stp_put16_be(privdata.block_max_w - privdata.block_min_w + 1, v);
+      stp_put16_be(pd->h_size - pd->block_max_h - 1, v);
+      stp_put16_be(pd->w_size - pd->block_max_w - 1, v);
+      stp_put16_be(pd->block_max_h - pd->block_min_h + 1, v);
+      stp_put16_be(pd->block_max_w - pd->block_min_w + 1, v);
     }
   else
     {
-      stp_put16_be(privdata.block_min_w, v);
-      stp_put16_be(privdata.block_min_h, v);
-      stp_put16_be(privdata.block_max_w - privdata.block_min_w + 1, v);
-      stp_put16_be(privdata.block_max_h - privdata.block_min_h + 1, v);
+      stp_put16_be(pd->block_min_w, v);
+      stp_put16_be(pd->block_min_h, v);
+      stp_put16_be(pd->block_max_w - pd->block_min_w + 1, v);
+      stp_put16_be(pd->block_max_h - pd->block_min_h + 1, v);
     }
   dyesub_nputc(v, '\0', 53);
 }
 
 static void p440_block_end_func(stp_vars_t *v)
 {
-  int pad = (64 - (((privdata.block_max_w - privdata.block_min_w + 1)
-	  * (privdata.block_max_h - privdata.block_min_h + 1) * 3) % 64)) % 64;
+  dyesub_privdata_t *pd = get_privdata(v);
+  int pad = (64 - (((pd->block_max_w - pd->block_min_w + 1)
+	  * (pd->block_max_h - pd->block_min_h + 1) * 3) % 64)) % 64;
   stp_deprintf(STP_DBG_DYESUB,
 		  "dyesub: max_x %d min_x %d max_y %d min_y %d\n",
-  		  privdata.block_max_w, privdata.block_min_w,
-	  	  privdata.block_max_h, privdata.block_min_h);
+  		  pd->block_max_w, pd->block_min_w,
+	  	  pd->block_max_h, pd->block_min_h);
   stp_deprintf(STP_DBG_DYESUB, "dyesub: olympus-p440 padding=%d\n", pad);
   dyesub_nputc(v, '\0', pad);
 }
@@ -722,6 +781,7 @@ LIST(dyesub_printsize_list_t, ps100_printsize_list, dyesub_printsize_t, ps100_pr
 
 static void ps100_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zprintf(v, "\033U"); dyesub_nputc(v, '\0', 62);
   
   /* stp_zprintf(v, "\033ZC"); dyesub_nputc(v, '\0', 61); */
@@ -729,8 +789,8 @@ static void ps100_printer_init_func(stp_vars_t *v)
   stp_zprintf(v, "\033W"); dyesub_nputc(v, '\0', 62);
   
   stp_zfwrite("\x30\x2e\x00\xa2\x00\xa0\x00\xa0", 1, 8, v);
-  stp_put16_be(privdata.h_size, v);	/* paper height (px) */
-  stp_put16_be(privdata.w_size, v);	/* paper width (px) */
+  stp_put16_be(pd->h_size, v);	/* paper height (px) */
+  stp_put16_be(pd->w_size, v);	/* paper width (px) */
   dyesub_nputc(v, '\0', 3);
   stp_putc('\1', v);	/* number of copies */
   dyesub_nputc(v, '\0', 8);
@@ -742,19 +802,20 @@ static void ps100_printer_init_func(stp_vars_t *v)
   stp_zfwrite("\033ZT\0", 1, 4, v);
   stp_put16_be(0, v);			/* image width offset (px) */
   stp_put16_be(0, v);			/* image height offset (px) */
-  stp_put16_be(privdata.w_size, v);	/* image width (px) */
-  stp_put16_be(privdata.h_size, v);	/* image height (px) */
+  stp_put16_be(pd->w_size, v);	/* image width (px) */
+  stp_put16_be(pd->h_size, v);	/* image height (px) */
   dyesub_nputc(v, '\0', 52);
 }
 
 static void ps100_printer_end_func(stp_vars_t *v)
 {
-  int pad = (64 - (((privdata.block_max_w - privdata.block_min_w + 1)
-	  * (privdata.block_max_h - privdata.block_min_h + 1) * 3) % 64)) % 64;
+  dyesub_privdata_t *pd = get_privdata(v);
+  int pad = (64 - (((pd->block_max_w - pd->block_min_w + 1)
+	  * (pd->block_max_h - pd->block_min_h + 1) * 3) % 64)) % 64;
   stp_deprintf(STP_DBG_DYESUB,
 		  "dyesub: max_x %d min_x %d max_y %d min_y %d\n",
-  		  privdata.block_max_w, privdata.block_min_w,
-	  	  privdata.block_max_h, privdata.block_min_h);
+  		  pd->block_max_w, pd->block_min_w,
+	  	  pd->block_max_h, pd->block_min_h);
   stp_deprintf(STP_DBG_DYESUB, "dyesub: olympus-ps100 padding=%d\n", pad);
   dyesub_nputc(v, '\0', pad);		/* padding to 64B blocks */
 
@@ -812,12 +873,13 @@ static void cp10_printer_init_func(stp_vars_t *v)
 
 static void cpx00_printer_init_func(stp_vars_t *v)
 {
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? '\1' :
-		(strcmp(privdata.pagesize, "w253h337") == 0 ? '\2' :
-		(strcmp(privdata.pagesize, "w155h244") == 0 ? 
+  dyesub_privdata_t *pd = get_privdata(v);
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? '\1' :
+		(strcmp(pd->pagesize, "w253h337") == 0 ? '\2' :
+		(strcmp(pd->pagesize, "w155h244") == 0 ? 
 			(strcmp(stp_get_driver(v),"canon-cp10") == 0 ?
 				'\0' : '\3' ) :
-		(strcmp(privdata.pagesize, "w283h566") == 0 ? '\4' :
+		(strcmp(pd->pagesize, "w283h566") == 0 ? '\4' :
 		 '\1' ))));
 
   stp_put16_be(0x4000, v);
@@ -828,10 +890,11 @@ static void cpx00_printer_init_func(stp_vars_t *v)
 
 static void cpx00_plane_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_put16_be(0x4001, v);
-  stp_putc(3 - privdata.plane, v);
+  stp_putc(3 - pd->plane, v);
   stp_putc('\0', v);
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
   dyesub_nputc(v, '\0', 4);
 }
 
@@ -899,25 +962,27 @@ LIST(dyesub_printsize_list_t, cp220_printsize_list, dyesub_printsize_t, cp220_pr
 /* Canon SELPHY CP790 */
 static void cp790_printer_init_func(stp_vars_t *v)
 {
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? '\0' :
-		(strcmp(privdata.pagesize, "w253h337") == 0 ? '\1' :
-		(strcmp(privdata.pagesize, "w155h244") == 0 ? '\2' :
-		(strcmp(privdata.pagesize, "w283h566") == 0 ? '\3' : 
+  dyesub_privdata_t *pd = get_privdata(v);
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? '\0' :
+		(strcmp(pd->pagesize, "w253h337") == 0 ? '\1' :
+		(strcmp(pd->pagesize, "w155h244") == 0 ? '\2' :
+		(strcmp(pd->pagesize, "w283h566") == 0 ? '\3' : 
 		 '\0' ))));
 
   stp_put16_be(0x4000, v);
   stp_putc(pg, v);
   stp_putc('\0', v);
   dyesub_nputc(v, '\0', 8);
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
 }
 
 /* Canon SELPHY ES series */
 static void es1_printer_init_func(stp_vars_t *v)
 {
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x11 :
-	     (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x12 :
-	      (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x13 : 0x11)));
+  dyesub_privdata_t *pd = get_privdata(v);
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x11 :
+	     (strcmp(pd->pagesize, "w253h337") == 0 ? 0x12 :
+	      (strcmp(pd->pagesize, "w155h244") == 0 ? 0x13 : 0x11)));
 
   stp_put16_be(0x4000, v);
   stp_putc(0x10, v);  /* 0x20 for P-BW */
@@ -927,9 +992,10 @@ static void es1_printer_init_func(stp_vars_t *v)
 
 static void es1_plane_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   unsigned char plane = 0;
 
-  switch (privdata.plane) {
+  switch (pd->plane) {
   case 3: /* Y */
     plane = 0x01;
     break;
@@ -944,16 +1010,17 @@ static void es1_plane_init_func(stp_vars_t *v)
   stp_put16_be(0x4001, v);
   stp_putc(0x1, v); /* 0x02 for P-BW */
   stp_putc(plane, v);
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
   dyesub_nputc(v, '\0', 4);
 }
 
 static void es2_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   char pg2 = 0x0;
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x1:
-	     (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x2 :
-	      (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x3 : 0x1)));
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x1:
+	     (strcmp(pd->pagesize, "w253h337") == 0 ? 0x2 :
+	      (strcmp(pd->pagesize, "w155h244") == 0 ? 0x3 : 0x1)));
 
   if (pg == 0x03)
     pg2 = 0x01;
@@ -968,22 +1035,24 @@ static void es2_printer_init_func(stp_vars_t *v)
 
   dyesub_nputc(v, 0x0, 3);
   stp_putc(pg2, v);
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
 }
 
 static void es2_plane_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_put16_be(0x4001, v);
-  stp_putc(4 - privdata.plane, v);  
+  stp_putc(4 - pd->plane, v);  
   stp_putc(0x0, v);
   dyesub_nputc(v, '\0', 8);
 }
 
 static void es3_printer_init_func(stp_vars_t *v)
 {
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x1:
-	     (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x2 :
-	      (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x3 : 0x1)));
+  dyesub_privdata_t *pd = get_privdata(v);
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x1:
+	     (strcmp(pd->pagesize, "w253h337") == 0 ? 0x2 :
+	      (strcmp(pd->pagesize, "w155h244") == 0 ? 0x3 : 0x1)));
 
     /* We also have Pg and Ps  (Gold/Silver) papers on the ES3/30/40 */
 
@@ -991,7 +1060,7 @@ static void es3_printer_init_func(stp_vars_t *v)
   stp_putc(pg, v);
   stp_putc(0x0, v);  /* 0x1 for P-BW */
   dyesub_nputc(v, 0x0, 8);
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
 }
 
 static void es3_printer_end_func(stp_vars_t *v)
@@ -1002,9 +1071,10 @@ static void es3_printer_end_func(stp_vars_t *v)
 
 static void es40_printer_init_func(stp_vars_t *v)
 {
-  char pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x0:
-	     (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x1 :
-	      (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x2 : 0x0)));
+  dyesub_privdata_t *pd = get_privdata(v);
+  char pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x0:
+	     (strcmp(pd->pagesize, "w253h337") == 0 ? 0x1 :
+	      (strcmp(pd->pagesize, "w155h244") == 0 ? 0x2 : 0x0)));
 
     /* We also have Pg and Ps  (Gold/Silver) papers on the ES3/30/40 */
 
@@ -1013,7 +1083,7 @@ static void es40_printer_init_func(stp_vars_t *v)
   stp_putc(0x0, v);  /*  0x1 for P-BW */
   dyesub_nputc(v, 0x0, 8);
 
-  stp_put32_le(privdata.w_size * privdata.h_size, v);
+  stp_put32_le(pd->w_size * pd->h_size, v);
 }
 
 /* Canon SELPHY CP900 */
@@ -1043,6 +1113,7 @@ LIST(dyesub_printsize_list_t, cp910_printsize_list, dyesub_printsize_t, cp910_pr
 
 static void cp910_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   char pg;
 
   stp_zfwrite("\x0f\x00\x00\x40\x00\x00\x00\x00", 1, 8, v);
@@ -1050,32 +1121,32 @@ static void cp910_printer_init_func(stp_vars_t *v)
   stp_putc(0x01, v);
   stp_putc(0x00, v);
 
-  pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x50 :
-                (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x4c :
-                (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x43 :
+  pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x50 :
+                (strcmp(pd->pagesize, "w253h337") == 0 ? 0x4c :
+                (strcmp(pd->pagesize, "w155h244") == 0 ? 0x43 :
                  0x50 )));
   stp_putc(pg, v);
 
   dyesub_nputc(v, '\0', 5);
 
-  pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0xe0 :
-                (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x80 :
-                (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x40 :
+  pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0xe0 :
+                (strcmp(pd->pagesize, "w253h337") == 0 ? 0x80 :
+                (strcmp(pd->pagesize, "w155h244") == 0 ? 0x40 :
                  0xe0 )));
   stp_putc(pg, v);
 
   stp_putc(0x04, v);
   dyesub_nputc(v, '\0', 2);
 
-  pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x50 :
-                (strcmp(privdata.pagesize, "w253h337") == 0 ? 0xc0 :
-                (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x9c :
+  pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x50 :
+                (strcmp(pd->pagesize, "w253h337") == 0 ? 0xc0 :
+                (strcmp(pd->pagesize, "w155h244") == 0 ? 0x9c :
                  0x50 )));
   stp_putc(pg, v);
 
-  pg = (strcmp(privdata.pagesize, "Postcard") == 0 ? 0x07 :
-                (strcmp(privdata.pagesize, "w253h337") == 0 ? 0x05 :
-                (strcmp(privdata.pagesize, "w155h244") == 0 ? 0x02 :
+  pg = (strcmp(pd->pagesize, "Postcard") == 0 ? 0x07 :
+                (strcmp(pd->pagesize, "w253h337") == 0 ? 0x05 :
+                (strcmp(pd->pagesize, "w155h244") == 0 ? 0x02 :
                  0x07 )));
   stp_putc(pg, v);
 
@@ -1111,11 +1182,12 @@ LIST(dyesub_printsize_list_t, dppex5_printsize_list, dyesub_printsize_t, dppex5_
 
 static void dppex5_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("DPEX\0\0\0\x80", 1, 8, v);
   stp_zfwrite("DPEX\0\0\0\x82", 1, 8, v);
   stp_zfwrite("DPEX\0\0\0\x84", 1, 8, v);
-  stp_put32_be(privdata.w_size, v);
-  stp_put32_be(privdata.h_size, v);
+  stp_put32_be(pd->w_size, v);
+  stp_put32_be(pd->h_size, v);
   stp_zfwrite("S\0o\0n\0y\0 \0D\0P\0P\0-\0E\0X\0\x35\0", 1, 24, v);
   dyesub_nputc(v, '\0', 40);
   stp_zfwrite("\1\4\0\4\xdc\0\x24\0\3\3\1\0\1\0\x82\0", 1, 16, v);
@@ -1129,17 +1201,18 @@ static void dppex5_printer_init(stp_vars_t *v)
   dyesub_nputc(v, '\0', 19);
   stp_zprintf(v, "5EPD");
   dyesub_nputc(v, '\0', 4);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v); /*laminate pattern*/
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v); /*laminate pattern*/
   stp_zfwrite("\0d\0d\0d", 1, 6, v);
   dyesub_nputc(v, '\0', 21);
 }
 
 static void dppex5_block_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("DPEX\0\0\0\x85", 1, 8, v);
-  stp_put32_be((privdata.block_max_w - privdata.block_min_w + 1)
-  		* (privdata.block_max_h - privdata.block_min_h + 1) * 3, v);
+  stp_put32_be((pd->block_max_w - pd->block_min_w + 1)
+  		* (pd->block_max_h - pd->block_min_h + 1) * 3, v);
 }
 
 static void dppex5_printer_end(stp_vars_t *v)
@@ -1182,24 +1255,25 @@ LIST(dyesub_printsize_list_t, updp10_printsize_list, dyesub_printsize_t, updp10_
 
 static void updp10_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\x98\xff\xff\xff\xff\xff\xff\xff"
 	      "\x09\x00\x00\x00\x1b\xee\x00\x00"
 	      "\x00\x02\x00\x00\x01\x12\x00\x00"
 	      "\x00\x1b\xe1\x00\x00\x00\x0b\x00"
 	      "\x00\x04", 1, 34, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v); /*laminate pattern*/
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v); /*laminate pattern*/
   stp_zfwrite("\x00\x00\x00\x00", 1, 4, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   stp_zfwrite("\x14\x00\x00\x00\x1b\x15\x00\x00"
 	      "\x00\x0d\x00\x00\x00\x00\x00\x07"
 	      "\x00\x00\x00\x00", 1, 20, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
-  stp_put32_le(privdata.w_size*privdata.h_size*3+11, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
+  stp_put32_le(pd->w_size*pd->h_size*3+11, v);
   stp_zfwrite("\x1b\xea\x00\x00\x00\x00", 1, 6, v);
-  stp_put32_be(privdata.w_size*privdata.h_size*3, v);
+  stp_put32_be(pd->w_size*pd->h_size*3, v);
   stp_zfwrite("\x00", 1, 1, v);
 }
 
@@ -1286,11 +1360,12 @@ LIST(dyesub_printsize_list_t, updr100_printsize_list, dyesub_printsize_t, updr10
 
 static void updr100_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("UPD8D\x00\x00\x00\x10\x03\x00\x00", 1, 12, v);
-  stp_put32_le(privdata.w_size, v);
-  stp_put32_le(privdata.h_size, v);
+  stp_put32_le(pd->w_size, v);
+  stp_put32_le(pd->h_size, v);
   stp_zfwrite("\x1e\x00\x03\x00\x01\x00\x4e\x01\x00\x00", 1, 10, v);
-  stp_write_raw(&(privdata.laminate->seq), v); /* laminate pattern */
+  stp_write_raw(&(pd->laminate->seq), v); /* laminate pattern */
   dyesub_nputc(v, '\0', 13);
   stp_zfwrite("\x01\x00\x01\x00\x03", 1, 5, v);
   dyesub_nputc(v, '\0', 19);
@@ -1347,24 +1422,25 @@ LIST(dyesub_printsize_list_t, updr150_printsize_list, dyesub_printsize_t, updr15
 
 static void updr150_200_printer_init_func(stp_vars_t *v, int updr200)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   char pg;
 
   stp_zfwrite("\x6a\xff\xff\xff"
 	      "\xef\xff\xff\xff", 1, 8, v);
 
-  if (strcmp(privdata.pagesize,"B7") == 0)
+  if (strcmp(pd->pagesize,"B7") == 0)
     pg = '\x01';
-  else if (strcmp(privdata.pagesize,"w288h432") == 0)
+  else if (strcmp(pd->pagesize,"w288h432") == 0)
     pg = '\x02';
-  else if (updr200 && strcmp(privdata.pagesize,"w288h432-div2") == 0)
+  else if (updr200 && strcmp(pd->pagesize,"w288h432-div2") == 0)
     pg = '\x02';
-  else if (strcmp(privdata.pagesize,"w360h504") == 0)
+  else if (strcmp(pd->pagesize,"w360h504") == 0)
     pg = '\x03';
-  else if (updr200 && strcmp(privdata.pagesize,"w360h504-div2") == 0)
+  else if (updr200 && strcmp(pd->pagesize,"w360h504-div2") == 0)
     pg = '\x03';
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     pg = '\x04';
-  else if (updr200 && strcmp(privdata.pagesize,"w432h576-div2") == 0)
+  else if (updr200 && strcmp(pd->pagesize,"w432h576-div2") == 0)
     pg = '\x04';
   else
     pg = 0;
@@ -1379,9 +1455,9 @@ static void updr150_200_printer_init_func(stp_vars_t *v, int updr200)
 
   /* Multicut mode */
   if (updr200) {
-    if (!strcmp(privdata.pagesize,"w288h432-div2") ||
-	!strcmp(privdata.pagesize,"w360h504-div2") ||
-	!strcmp(privdata.pagesize,"w432h576-div2"))
+    if (!strcmp(pd->pagesize,"w288h432-div2") ||
+	!strcmp(pd->pagesize,"w360h504-div2") ||
+	!strcmp(pd->pagesize,"w432h576-div2"))
       pg = 0x01;
     else
       pg = 0x02;
@@ -1411,9 +1487,9 @@ static void updr150_200_printer_init_func(stp_vars_t *v, int updr200)
 
   /* Multicut mode */
   if (updr200) {
-    if (!strcmp(privdata.pagesize,"w288h432-div2") ||
-	!strcmp(privdata.pagesize,"w360h504-div2") ||
-	!strcmp(privdata.pagesize,"w432h576-div2"))
+    if (!strcmp(pd->pagesize,"w288h432-div2") ||
+	!strcmp(pd->pagesize,"w360h504-div2") ||
+	!strcmp(pd->pagesize,"w432h576-div2"))
       stp_putc(0x02, v);
     else
       stp_putc(0x00, v);
@@ -1426,29 +1502,29 @@ static void updr150_200_printer_init_func(stp_vars_t *v, int updr200)
 	      "\x0d\x00\x00\x00"
 	      "\x00\x00\x00\x00\x07\x00\x00\x00\x00", 1, 24, v);
 
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   
   stp_zfwrite("\xf9\xff\xff\xff",
 	      1, 4, v);
   stp_zfwrite("\x07\x00\x00\x00"
 	      "\x1b\xe1\x00\x00\x00\x0b\x00"
 	      "\x0b\x00\x00\x00\x00\x80", 1, 17, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v); /*laminate pattern*/
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v); /*laminate pattern*/
 
   stp_zfwrite("\x00\x00\x00\x00", 1, 4, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   stp_zfwrite("\xf8\xff\xff\xff", 1, 4, v);
 
   /* Each data block has this header.  Can actually have multiple blocks! */
   stp_zfwrite("\xec\xff\xff\xff", 1, 4, v);  
   stp_zfwrite("\x0b\x00\x00\x00\x1b\xea"
 	      "\x00\x00\x00\x00", 1, 10, v);
-  stp_put32_be(privdata.w_size*privdata.h_size*3, v);
+  stp_put32_be(pd->w_size*pd->h_size*3, v);
   stp_zfwrite("\x00", 1, 1, v);
-  stp_put32_le(privdata.w_size*privdata.h_size*3, v);
+  stp_put32_le(pd->w_size*pd->h_size*3, v);
 }
 
 static void updr150_printer_init_func(stp_vars_t *v)
@@ -1534,23 +1610,25 @@ LIST(dyesub_printsize_list_t, upcr10_printsize_list, dyesub_printsize_t, upcr10_
 
 static void upcr10_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
 	stp_zfwrite("\x60\xff\xff\xff"
 		    "\xf8\xff\xff\xff"
 		    "\xfd\xff\xff\xff\x14\x00\x00\x00"
 		    "\x1b\x15\x00\x00\x00\x0d\x00\x00"
 		    "\x00\x00\x00\x07\x00\x00\x00\x00", 1, 32, v);
-	stp_put16_be(privdata.w_size, v);
-	stp_put16_be(privdata.h_size, v);
+	stp_put16_be(pd->w_size, v);
+	stp_put16_be(pd->h_size, v);
 	stp_zfwrite("\xfb\xff\xff\xff"
 		    "\xf4\xff\xff\xff\x0b\x00\x00\x00"
 		    "\x1b\xea\x00\x00\x00\x00", 1, 18, v);
-	stp_put32_be(privdata.w_size * privdata.h_size * 3, v);
+	stp_put32_be(pd->w_size * pd->h_size * 3, v);
 	stp_putc(0, v);
-	stp_put32_le(privdata.w_size * privdata.h_size * 3, v);
+	stp_put32_le(pd->w_size * pd->h_size * 3, v);
 }
 
 static void upcr10_printer_end_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
 	stp_zfwrite("\xf3\xff\xff\xff"
 		    "\x0f\x00\x00\x00"
 		    "\x1b\xe5\x00\x00\x00\x08\x00\x00"
@@ -1558,8 +1636,8 @@ static void upcr10_printer_end_func(stp_vars_t *v)
 	stp_zfwrite("\x12\x00\x00\x00\x1b\xe1\x00\x00"
 		    "\x000x0b\x00\x00\x80\x08\x00\x00"
 		    "\x00\x00", 1, 18, v);
-	stp_put16_be(privdata.w_size, v);
-	stp_put16_be(privdata.h_size, v);
+	stp_put16_be(pd->w_size, v);
+	stp_put16_be(pd->h_size, v);
 	stp_zfwrite("\xfa\xff\xff\xff"
 		    "\x09\x00\x00\x00"
 		    "\x1b\xee\x00\x00\x00\x02\x00\x00", 1, 16, v);
@@ -1596,6 +1674,7 @@ LIST(dyesub_printsize_list_t, cx400_printsize_list, dyesub_printsize_t, cx400_pr
 
 static void cx400_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   char pg = '\0';
   const char *pname = "XXXXXX";
 
@@ -1609,13 +1688,13 @@ static void cx400_printer_init_func(stp_vars_t *v)
   stp_zfwrite("FUJIFILM", 1, 8, v);
   stp_zfwrite(pname, 1, 6, v);
   stp_putc('\0', v);
-  stp_put16_le(privdata.w_size, v);
-  stp_put16_le(privdata.h_size, v);
-  if (strcmp(privdata.pagesize,"w288h504") == 0)
+  stp_put16_le(pd->w_size, v);
+  stp_put16_le(pd->h_size, v);
+  if (strcmp(pd->pagesize,"w288h504") == 0)
     pg = '\x0d';
-  else if (strcmp(privdata.pagesize,"w288h432") == 0)
+  else if (strcmp(pd->pagesize,"w288h432") == 0)
     pg = '\x0c';
-  else if (strcmp(privdata.pagesize,"w288h387") == 0)
+  else if (strcmp(pd->pagesize,"w288h387") == 0)
     pg = '\x0b';
   stp_putc(pg, v);
   stp_zfwrite("\x00\x00\x00\x00\x00\x01\x00\x01\x00\x00\x00\x00"
@@ -1652,14 +1731,15 @@ LIST(dyesub_printsize_list_t, nx500_printsize_list, dyesub_printsize_t, nx500_pr
 
 static void nx500_printer_init_func(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("INFO-QX-20--MKS\x00\x00\x00M\x00W\00A\x00R\00E", 1, 27, v);
   dyesub_nputc(v, '\0', 21);
   stp_zfwrite("\x80\x00\x02", 1, 3, v);
   dyesub_nputc(v, '\0', 20);
   stp_zfwrite("\x02\x01\x01", 1, 3, v);
   dyesub_nputc(v, '\0', 2);
-  stp_put16_le(privdata.h_size, v);
-  stp_put16_le(privdata.w_size, v);
+  stp_put16_le(pd->h_size, v);
+  stp_put16_le(pd->w_size, v);
   stp_zfwrite("\x00\x02\x00\x70\x2f", 1, 5, v);
   dyesub_nputc(v, '\0', 43);
 }
@@ -1692,9 +1772,10 @@ static void kodak_dock_printer_init(stp_vars_t *v)
 
 static void kodak_dock_plane_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_put16_be(0x3001, v);
-  stp_put16_le(3 - privdata.plane, v);
-  stp_put32_le(privdata.w_size*privdata.h_size, v);
+  stp_put16_le(3 - pd->plane, v);
+  stp_put32_le(pd->w_size*pd->h_size, v);
   dyesub_nputc(v, '\0', 4);
 }
 
@@ -1749,22 +1830,23 @@ LIST(dyesub_printsize_list_t, kodak_6850_printsize_list, dyesub_printsize_t, kod
 
 static void kodak_68xx_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\x03\x1b\x43\x48\x43\x0a\x00\x01", 1, 8, v);
   stp_put16_be(0x01, v); /* Number of copies in BCD */
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
 
-  if (!strcmp(privdata.pagesize,"w288h432"))
+  if (!strcmp(pd->pagesize,"w288h432"))
 	  stp_putc(0x00, v);
-  else if (!strcmp(privdata.pagesize,"w432h576"))
+  else if (!strcmp(pd->pagesize,"w432h576"))
 	  stp_putc(0x06, v);
-  else if (!strcmp(privdata.pagesize,"w360h504"))
+  else if (!strcmp(pd->pagesize,"w360h504"))
 	  stp_putc(0x07, v);
   else
 	  stp_putc(0x00, v); /* Just in case */
 
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   stp_putc(0x00, v);
 }
 
@@ -1792,23 +1874,24 @@ LIST(dyesub_printsize_list_t, kodak_605_printsize_list, dyesub_printsize_t, koda
 
 static void kodak_605_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\x01\x40\x0a\x00\x01", 1, 5, v);
   stp_putc(0x01, v); /* Number of copies */
   stp_putc(0x00, v);
-  stp_put16_le(privdata.w_size, v);
-  stp_put16_le(privdata.h_size, v);
+  stp_put16_le(pd->w_size, v);
+  stp_put16_le(pd->h_size, v);
 
-  if (!strcmp(privdata.pagesize,"w288h432"))
+  if (!strcmp(pd->pagesize,"w288h432"))
 	  stp_putc(0x01, v);
-  else if (!strcmp(privdata.pagesize,"w432h576"))
+  else if (!strcmp(pd->pagesize,"w432h576"))
 	  stp_putc(0x03, v);
-  else if (!strcmp(privdata.pagesize,"w360h504"))
+  else if (!strcmp(pd->pagesize,"w360h504"))
 	  stp_putc(0x02, v);
   else
 	  stp_putc(0x01, v);
 
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   stp_putc(0x00, v);
 }
 
@@ -1875,18 +1958,19 @@ LIST(dyesub_printsize_list_t, kodak_1400_printsize_list, dyesub_printsize_t, kod
 
 static void kodak_1400_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("PGHD", 1, 4, v);
-  stp_put16_le(privdata.w_size, v);
+  stp_put16_le(pd->w_size, v);
   dyesub_nputc(v, 0x00, 2);
-  stp_put16_le(privdata.h_size, v);
+  stp_put16_le(pd->h_size, v);
   dyesub_nputc(v, 0x00, 2);
-  stp_put32_le(privdata.h_size*privdata.w_size, v);
+  stp_put32_le(pd->h_size*pd->w_size, v);
   dyesub_nputc(v, 0x00, 4);
-  stp_zfwrite((privdata.media->seq).data, 1, 1, v);  /* Matte or Glossy? */
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->media->seq).data, 1, 1, v);  /* Matte or Glossy? */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   stp_putc(0x01, v);
-  stp_zfwrite((const char*)((privdata.media->seq).data) + 1, 1, 1, v); /* Lamination intensity */
+  stp_zfwrite((const char*)((pd->media->seq).data) + 1, 1, 1, v); /* Lamination intensity */
   dyesub_nputc(v, 0x00, 12);
 }
 
@@ -1911,15 +1995,16 @@ LIST(dyesub_printsize_list_t, kodak_805_printsize_list, dyesub_printsize_t, koda
 
 static void kodak_805_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("PGHD", 1, 4, v);
-  stp_put16_le(privdata.w_size, v);
+  stp_put16_le(pd->w_size, v);
   dyesub_nputc(v, 0x00, 2);
-  stp_put16_le(privdata.h_size, v);
+  stp_put16_le(pd->h_size, v);
   dyesub_nputc(v, 0x00, 2);
-  stp_put32_le(privdata.h_size*privdata.w_size, v);
+  stp_put32_le(pd->h_size*pd->w_size, v);
   dyesub_nputc(v, 0x00, 5);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   stp_putc(0x01, v);
   stp_putc(0x3c, v); /* Lamination intensity; fixed on glossy media */
   dyesub_nputc(v, 0x00, 12);
@@ -1951,6 +2036,7 @@ LIST(laminate_list_t, kodak_9810_laminate_list, laminate_t, kodak_9810_laminate)
 
 static void kodak_9810_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Command stream header */
   stp_putc(0x1b, v);
   stp_zfwrite("MndROSETTA V001.00100000020525072696E74657242696E4D6F74726C", 1, 59, v);
@@ -1973,7 +2059,7 @@ static void kodak_9810_printer_init(stp_vars_t *v)
   stp_zfwrite("FlsJbMkMed Name    ", 1, 19, v);
   dyesub_nputc(v, 0x00, 4);
   stp_put32_be(64, v);
-  if (privdata.h_size == 3624) {
+  if (pd->h_size == 3624) {
     stp_zfwrite("YMCX 8x12 Glossy", 1, 16, v);
   } else {
     stp_zfwrite("YMCX 8x10 Glossy", 1, 16, v);
@@ -1991,8 +2077,8 @@ static void kodak_9810_printer_init(stp_vars_t *v)
   /* Lamination */
   stp_putc(0x1b, v);
   stp_zfwrite("FlsJbLam   ", 1, 11, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   dyesub_nputc(v, 0x20, 5);
   dyesub_nputc(v, 0x00, 4);
   stp_put32_be(0, v);
@@ -2015,17 +2101,17 @@ static void kodak_9810_printer_init(stp_vars_t *v)
   stp_zfwrite("MndSetLPage        ", 1, 19, v);
   dyesub_nputc(v, 0x00, 4);
   stp_put32_be(8, v);
-  stp_put32_be(privdata.w_size, v);
-  stp_put32_be(privdata.h_size, v);
+  stp_put32_be(pd->w_size, v);
+  stp_put32_be(pd->h_size, v);
 
   /* Page dimensions II -- maybe this is image data size? */
   stp_putc(0x1b, v);
   stp_zfwrite("MndImSpec  Size    ", 1, 19, v);
   dyesub_nputc(v, 0x00, 4);
   stp_put32_be(16, v);
-  stp_put32_be(privdata.w_size, v);
-  stp_put32_be(privdata.h_size, v);
-  stp_put32_be(privdata.w_size, v);
+  stp_put32_be(pd->w_size, v);
+  stp_put32_be(pd->h_size, v);
+  stp_put32_be(pd->w_size, v);
   stp_put32_be(0, v);
 
   /* Positioning within page? */
@@ -2070,7 +2156,7 @@ static void kodak_9810_printer_init(stp_vars_t *v)
   stp_put32_be(4, v);
 
   /* Cut at start/end of sheet */
-  if (privdata.h_size == 3624) {
+  if (pd->h_size == 3624) {
     stp_zfwrite("\x00\x0c\x0e\x1c", 1, 4, v);
   } else {
     stp_zfwrite("\x00\x0c\x0b\xc4", 1, 4, v);
@@ -2079,14 +2165,14 @@ static void kodak_9810_printer_init(stp_vars_t *v)
 #if 0  /* Additional Known Cut lists */
   /* Single cut, down the center */
   stp_put32_be(6, v);
-  if (privdata.h_size == 3624) {
+  if (pd->h_size == 3624) {
     stp_zfwrite("\x00\x0c\x07\x14\x0e\x1c", 1, 6, v);
   } else {
     stp_zfwrite("\x00\x0c\x05\xe8\x0b\xc4", 1, 6, v);
   }
   /* Double-Slug Cut, down the center */
   stp_put32_be(8, v);
-  if (privdata.h_size == 3624) {
+  if (pd->h_size == 3624) {
     stp_zfwrite("\x00\x0c\x07\x01\x07\x27\x0e\x1c", 1, 6, v);
   } else {
     stp_zfwrite("\x00\x0c\x05\xd5\x05\xfb\x0b\xc4", 1, 6, v);
@@ -2112,11 +2198,12 @@ static void kodak_9810_printer_end(stp_vars_t *v)
 
 static void kodak_9810_plane_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Data block */
   stp_putc(0x1b, v);
   stp_zfwrite("FlsData    Block   ", 1, 19, v);
   dyesub_nputc(v, 0x00, 4);
-  stp_put32_be((privdata.w_size * privdata.h_size) + 8, v);
+  stp_put32_be((pd->w_size * pd->h_size) + 8, v);
   stp_zfwrite("Image   ", 1, 8, v);
 }
 
@@ -2151,19 +2238,20 @@ LIST(laminate_list_t, kodak_8810_laminate_list, laminate_t, kodak_8810_laminate)
 
 static void kodak_8810_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_putc(0x01, v);
   stp_putc(0x40, v);
   stp_putc(0x12, v);
   stp_putc(0x00, v);
   stp_putc(0x01, v);
   stp_put16_le(0x01, v); /* Actually, # of copies */
-  stp_put16_le(privdata.w_size, v);
-  stp_put16_le(privdata.h_size, v);
-  stp_put16_le(privdata.w_size, v);
-  stp_put16_le(privdata.h_size, v);
+  stp_put16_le(pd->w_size, v);
+  stp_put16_le(pd->h_size, v);
+  stp_put16_le(pd->w_size, v);
+  stp_put16_le(pd->h_size, v);
   dyesub_nputc(v, 0, 4);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v);
   stp_putc(0x00, v); /* Method -- 00 is normal, 02 is x2, 03 is x3 */    
   stp_putc(0x00, v); /* Reserved */
 }
@@ -2196,22 +2284,23 @@ LIST(laminate_list_t, kodak_7000_laminate_list, laminate_t, kodak_7000_laminate)
 
 static void kodak_70xx_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   stp_zfwrite("\x01\x40\x0a\x00\x01", 1, 5, v);
   stp_put16_le(0x01, v); /* Actually, # of copies */
-  stp_put16_le(privdata.w_size, v);
-  stp_put16_le(privdata.h_size, v);
+  stp_put16_le(pd->w_size, v);
+  stp_put16_le(pd->h_size, v);
 
-  if (!strcmp(privdata.pagesize,"w288h432"))
+  if (!strcmp(pd->pagesize,"w288h432"))
 	  stp_putc(0x01, v);
-  else if (!strcmp(privdata.pagesize,"w432h576"))
+  else if (!strcmp(pd->pagesize,"w432h576"))
 	  stp_putc(0x03, v);
-  else if (!strcmp(privdata.pagesize,"w360h504"))
+  else if (!strcmp(pd->pagesize,"w360h504"))
 	  stp_putc(0x06, v);
   else
 	  stp_putc(0x01, v);
 
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-			(privdata.laminate->seq).bytes, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+			(pd->laminate->seq).bytes, v);
   stp_putc(0x00, v);
 }
 
@@ -2275,6 +2364,7 @@ LIST(laminate_list_t, kodak_8500_laminate_list, laminate_t, kodak_8500_laminate)
 
 static void kodak_8500_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Start with NULL block */
   dyesub_nputc(v, 0x00, 64);
   /* Number of copies */
@@ -2292,8 +2382,8 @@ static void kodak_8500_printer_init(stp_vars_t *v)
   stp_putc(0x1b, v);
   stp_putc(0x5a, v);
   stp_putc(0x53, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   dyesub_nputc(v, 0x00, 57);
   /* Sharpening -- XXX not exported. */
   stp_putc(0x1b, v);
@@ -2304,12 +2394,12 @@ static void kodak_8500_printer_init(stp_vars_t *v)
   /* Lamination */
   stp_putc(0x1b, v);
   stp_putc(0x59, v);
-  if (*((const char*)((privdata.laminate->seq).data)) == 0x02) { /* None */
+  if (*((const char*)((pd->laminate->seq).data)) == 0x02) { /* None */
     stp_putc(0x02, v);
     stp_putc(0x00, v);
   } else {
-    stp_zfwrite((const char*)((privdata.media->seq).data), 1, 
-		(privdata.media->seq).bytes, v);
+    stp_zfwrite((const char*)((pd->media->seq).data), 1, 
+		(pd->media->seq).bytes, v);
   }
   dyesub_nputc(v, 0x00, 60);
   /* Unknown */
@@ -2325,15 +2415,16 @@ static void kodak_8500_printer_init(stp_vars_t *v)
   stp_putc(0x54, v);
   dyesub_nputc(v, 0x00, 2);
   stp_put16_be(0, v); /* Starting row for this block */
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v); /* Number of rows in this block */
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v); /* Number of rows in this block */
   dyesub_nputc(v, 0x00, 53);
 }
 
 static void kodak_8500_printer_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Pad data to 64-byte block */
-  unsigned int length = privdata.w_size * privdata.h_size * 3;
+  unsigned int length = pd->w_size * pd->h_size * 3;
   length %= 64;
   if (length) {
     length = 64 - length;
@@ -2365,6 +2456,7 @@ LIST(dyesub_printsize_list_t, mitsu_cp3020d_printsize_list, dyesub_printsize_t,
 
 static void mitsu_cp3020d_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Start with NULL block */
   dyesub_nputc(v, 0x00, 64);
   /* Unknown */
@@ -2375,7 +2467,7 @@ static void mitsu_cp3020d_printer_init(stp_vars_t *v)
   stp_putc(0x1b, v);
   stp_putc(0x5a, v);
   stp_putc(0x46, v);
-  if (privdata.h_size == 3762)
+  if (pd->h_size == 3762)
     stp_putc(0x04, v);
   else
     stp_putc(0x00, v);
@@ -2404,8 +2496,8 @@ static void mitsu_cp3020d_printer_init(stp_vars_t *v)
   stp_putc(0x1b, v);
   stp_putc(0x5a, v);
   stp_putc(0x53, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   dyesub_nputc(v, 0x00, 57);
 }
 
@@ -2419,21 +2511,23 @@ static void mitsu_cp3020d_printer_end(stp_vars_t *v)
 
 static void mitsu_cp3020d_plane_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Plane data header */
   stp_putc(0x1b, v);
   stp_putc(0x5a, v);
-  stp_putc(0x30 + 4 - privdata.plane, v); /* Y = x31, M = x32, C = x33 */
+  stp_putc(0x30 + 4 - pd->plane, v); /* Y = x31, M = x32, C = x33 */
   dyesub_nputc(v, 0x00, 2);
   stp_put16_be(0, v); /* Starting row for this block */
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v); /* Number of rows in this block */
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v); /* Number of rows in this block */
   dyesub_nputc(v, 0x00, 53);
 }
 
 static void mitsu_cp3020d_plane_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Pad data to 64-byte block */
-  unsigned int length = privdata.w_size * privdata.h_size;
+  unsigned int length = pd->w_size * pd->h_size;
   length %= 64;
   if (length) {
     length = 64 - length;
@@ -2444,6 +2538,7 @@ static void mitsu_cp3020d_plane_end(stp_vars_t *v)
 /* Mitsubishi CP3020DA/DAE */
 static void mitsu_cp3020da_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Init */
   stp_putc(0x1b, v);
   stp_putc(0x57, v);
@@ -2453,8 +2548,8 @@ static void mitsu_cp3020da_printer_init(stp_vars_t *v)
   stp_putc(0x0a, v);
   stp_putc(0x10, v);
   dyesub_nputc(v, 0x00, 7);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   dyesub_nputc(v, 0x00, 32);
   /* Page count */
   stp_putc(0x1b, v);
@@ -2503,15 +2598,16 @@ static void mitsu_cp3020da_printer_end(stp_vars_t *v)
 
 static void mitsu_cp3020da_plane_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Plane data header */
   stp_putc(0x1b, v);
   stp_putc(0x5a, v);
   stp_putc(0x54, v);
-  stp_putc((privdata.bpp > 8) ? 0x10: 0x00, v);
+  stp_putc((pd->bpp > 8) ? 0x10: 0x00, v);
   dyesub_nputc(v, 0x00, 2);
   stp_put16_be(0, v); /* Starting row for this block */
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v); /* Number of rows in this block */
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v); /* Number of rows in this block */
 }
 
 /* Mitsubishi 9550D/DW */
@@ -2557,6 +2653,7 @@ LIST(dyesub_printsize_list_t, mitsu_cp9550_printsize_list, dyesub_printsize_t, m
 
 static void mitsu_cp9550_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Init */
   stp_putc(0x1b, v);
   stp_putc(0x57, v);
@@ -2566,8 +2663,8 @@ static void mitsu_cp9550_printer_init(stp_vars_t *v)
   stp_putc(0x0a, v);
   stp_putc(0x10, v);
   dyesub_nputc(v, 0x00, 7);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
   dyesub_nputc(v, 0x00, 32);
   /* Parameters 1 */
   stp_putc(0x1b, v);
@@ -2583,7 +2680,7 @@ static void mitsu_cp9550_printer_init(stp_vars_t *v)
   dyesub_nputc(v, 0x00, 19);
   stp_putc(0x01, v);  /* This is Copies on other models.. */
   dyesub_nputc(v, 0x00, 2);
-  if (strcmp(privdata.pagesize,"w288h432-div2") == 0)
+  if (strcmp(pd->pagesize,"w288h432-div2") == 0)
     stp_putc(0x83, v);
   else
     stp_putc(0x00, v);
@@ -2664,6 +2761,7 @@ LIST(laminate_list_t, mitsu_cp9810_laminate_list, laminate_t, mitsu_cp9810_lamin
 
 static void mitsu_cp9810_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Init */
   stp_putc(0x1b, v);
   stp_putc(0x57, v);
@@ -2673,10 +2771,10 @@ static void mitsu_cp9810_printer_init(stp_vars_t *v)
   stp_putc(0x0a, v);
   stp_putc(0x90, v);
   dyesub_nputc(v, 0x00, 7);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Lamination */
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Lamination */
   dyesub_nputc(v, 0x00, 31);
   /* Parameters 1 */
   stp_putc(0x1b, v);
@@ -2710,13 +2808,14 @@ static void mitsu_cp9810_printer_init(stp_vars_t *v)
 
 static void mitsu_cp9810_printer_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Job Footer */
   stp_putc(0x1b, v);
   stp_putc(0x50, v);
   stp_putc(0x4c, v);
   stp_putc(0x00, v);
 
-  if (*((const char*)((privdata.laminate->seq).data)) == 0x01) {
+  if (*((const char*)((pd->laminate->seq).data)) == 0x01) {
 
     /* Generate a full plane of lamination data */
 
@@ -2733,8 +2832,8 @@ static void mitsu_cp9810_printer_end(stp_vars_t *v)
     mitsu_cp3020da_plane_init(v); /* First generate plane header */
 
     /* Now generate lamination pattern */
-    for (c = 0 ; c < privdata.w_size ; c++) {
-      for (r = 0 ; r < privdata.h_size ; r++) {
+    for (c = 0 ; c < pd->w_size ; c++) {
+      for (r = 0 ; r < pd->h_size ; r++) {
 	int i = xrand(&seed) & 0x1f;
 	if (i < 16)
 	  stp_put16_be(0x0202, v);
@@ -2808,6 +2907,7 @@ LIST(laminate_list_t, mitsu_cpd70x_laminate_list, laminate_t, mitsu_cpd70x_lamin
 
 static void mitsu_cpd70k60_printer_init(stp_vars_t *v, unsigned char model)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Printer wakeup */
   stp_putc(0x1b, v);
   stp_putc(0x45, v);
@@ -2822,12 +2922,12 @@ static void mitsu_cpd70k60_printer_init(stp_vars_t *v, unsigned char model)
   stp_putc(model, v); /* k60 == x02, 305 == x90, d70x == x01 */
   dyesub_nputc(v, 0x00, 12);
 
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
-  if (*((const char*)((privdata.laminate->seq).data)) != 0x00) {
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
+  if (*((const char*)((pd->laminate->seq).data)) != 0x00) {
     /* Laminate a slightly larger boundary in Matte mode */
-    stp_put16_be(privdata.w_size, v);
-    stp_put16_be(privdata.h_size + 12, v);
+    stp_put16_be(pd->w_size, v);
+    stp_put16_be(pd->h_size + 12, v);
     if (model == 0x02) {
       stp_putc(0x04, v); /* Matte Lamination forces UltraFine on K60 */
     } else {
@@ -2849,16 +2949,16 @@ static void mitsu_cpd70k60_printer_init(stp_vars_t *v, unsigned char model)
   dyesub_nputc(v, 0x00, 7);
 
   stp_putc(0x00, v); /* Lamination always enabled */
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Lamination mode */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Lamination mode */
   dyesub_nputc(v, 0x00, 6);
 
   /* Multi-cut controlx */
-  if (strcmp(privdata.pagesize,"w432h576-div2") == 0) {
+  if (strcmp(pd->pagesize,"w432h576-div2") == 0) {
     stp_putc(0x01, v);
-  } else if (strcmp(privdata.pagesize,"w360h504-div2") == 0) {
+  } else if (strcmp(pd->pagesize,"w360h504-div2") == 0) {
     stp_putc(0x01, v);
-  } else if (strcmp(privdata.pagesize,"w288h432-div2") == 0) {
+  } else if (strcmp(pd->pagesize,"w288h432-div2") == 0) {
     stp_putc(0x05, v);
   } else {
     stp_putc(0x00, v);
@@ -2875,8 +2975,9 @@ static void mitsu_cpd70x_printer_init(stp_vars_t *v)
 
 static void mitsu_cpd70x_printer_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* If Matte lamination is enabled, generate a lamination plane */
-  if (*((const char*)((privdata.laminate->seq).data)) != 0x00) {
+  if (*((const char*)((pd->laminate->seq).data)) != 0x00) {
 
     /* The Windows drivers generate a lamination pattern consisting of
        three values: 0xe84b, 0x286a, 0x6c22 */
@@ -2885,8 +2986,8 @@ static void mitsu_cpd70x_printer_end(stp_vars_t *v)
     unsigned long seed = 1;
 
     /* Now generate lamination pattern */
-    for (c = 0 ; c < privdata.w_size ; c++) {
-      for (r = 0 ; r < privdata.h_size + 12 ; r++) {
+    for (c = 0 ; c < pd->w_size ; c++) {
+      for (r = 0 ; r < pd->h_size + 12 ; r++) {
 	int i = xrand(&seed) & 0x3f;
 	if (i < 42)
 	  stp_put16_be(0xe84b, v);
@@ -2897,14 +2998,15 @@ static void mitsu_cpd70x_printer_end(stp_vars_t *v)
       }
     }
     /* Pad up to a 512-byte block */
-    dyesub_nputc(v, 0x00, 512 - ((privdata.w_size * (privdata.h_size + 12) * 2) % 512));
+    dyesub_nputc(v, 0x00, 512 - ((pd->w_size * (pd->h_size + 12) * 2) % 512));
   }
 }
 
 static void mitsu_cpk60_printer_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* If Matte lamination is enabled, generate a lamination plane */
-  if (*((const char*)((privdata.laminate->seq).data)) != 0x00) {
+  if (*((const char*)((pd->laminate->seq).data)) != 0x00) {
 
     /* The Windows drivers generate a lamination pattern consisting of
        three values: 0x9d00, 0x6500, 0x2900 */
@@ -2913,8 +3015,8 @@ static void mitsu_cpk60_printer_end(stp_vars_t *v)
     unsigned long seed = 1;
 
     /* Now generate lamination pattern */
-    for (c = 0 ; c < privdata.w_size ; c++) {
-      for (r = 0 ; r < privdata.h_size + 12 ; r++) {
+    for (c = 0 ; c < pd->w_size ; c++) {
+      for (r = 0 ; r < pd->h_size + 12 ; r++) {
 	int i = xrand(&seed) & 0x3f;
 	if (i < 42)
 	  stp_put16_be(0x9d00, v);
@@ -2925,15 +3027,16 @@ static void mitsu_cpk60_printer_end(stp_vars_t *v)
       }
     }
     /* Pad up to a 512-byte block */
-    dyesub_nputc(v, 0x00, 512 - ((privdata.w_size * (privdata.h_size + 12) * 2) % 512));
+    dyesub_nputc(v, 0x00, 512 - ((pd->w_size * (pd->h_size + 12) * 2) % 512));
   }
 }
 
 
 static void mitsu_cpd70x_plane_end(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Pad up to a 512-byte block */
-  dyesub_nputc(v, 0x00, 512 - ((privdata.h_size * privdata.w_size * 2) % 512));
+  dyesub_nputc(v, 0x00, 512 - ((pd->h_size * pd->w_size * 2) % 512));
 }
 
 /* Mitsubishi CP-K60D */
@@ -3069,21 +3172,22 @@ LIST(dyesub_printsize_list_t, shinko_chcs9045_printsize_list, dyesub_printsize_t
 
 static void shinko_chcs9045_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   char pg = '\0';
   char sticker = '\0';
 
   stp_zprintf(v, "\033CHC\n");
   stp_put16_be(1, v);
   stp_put16_be(1, v);
-  stp_put16_be(privdata.w_size, v);
-  stp_put16_be(privdata.h_size, v);
-  if (strcmp(privdata.pagesize,"B7") == 0)
+  stp_put16_be(pd->w_size, v);
+  stp_put16_be(pd->h_size, v);
+  if (strcmp(pd->pagesize,"B7") == 0)
     pg = '\1';
-  else if (strcmp(privdata.pagesize,"w360h504") == 0)
+  else if (strcmp(pd->pagesize,"w360h504") == 0)
     pg = '\3';
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     pg = '\5';
-  else if (strcmp(privdata.pagesize,"w283h425") == 0)
+  else if (strcmp(pd->pagesize,"w283h425") == 0)
     sticker = '\3';
   stp_putc(pg, v);
   stp_putc('\0', v);
@@ -3143,23 +3247,24 @@ LIST(laminate_list_t, shinko_chcs2145_laminate_list, laminate_t, shinko_chcs2145
 
 static void shinko_chcs2145_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   int media = 0;
 
-  if (strcmp(privdata.pagesize,"w288h432") == 0)
+  if (strcmp(pd->pagesize,"w288h432") == 0)
     media = '\0';
-  else if (strcmp(privdata.pagesize,"w288h432-div2") == 0)
+  else if (strcmp(pd->pagesize,"w288h432-div2") == 0)
     media = '\0';
-  else if (strcmp(privdata.pagesize,"B7") == 0)
+  else if (strcmp(pd->pagesize,"B7") == 0)
     media = '\1';
-  else if (strcmp(privdata.pagesize,"w360h504") == 0)
+  else if (strcmp(pd->pagesize,"w360h504") == 0)
     media = '\3';
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     media = '\6';
-  else if (strcmp(privdata.pagesize,"w432h648") == 0)
+  else if (strcmp(pd->pagesize,"w432h648") == 0)
     media = '\5';
-  else if (strcmp(privdata.pagesize,"w432h576-div2") == 0)
+  else if (strcmp(pd->pagesize,"w432h576-div2") == 0)
     media = '\5';
-  else if (strcmp(privdata.pagesize,"w144h432") == 0)
+  else if (strcmp(pd->pagesize,"w144h432") == 0)
     media = '\7';
 
   stp_put32_le(0x10, v);
@@ -3172,22 +3277,22 @@ static void shinko_chcs2145_printer_init(stp_vars_t *v)
   stp_put32_le(media, v);  /* Media Type */
   stp_put32_le(0x00, v);
 
-  if (strcmp(privdata.pagesize,"w432h576-div2") == 0) {
+  if (strcmp(pd->pagesize,"w432h576-div2") == 0) {
     stp_put32_le(0x02, v);
-  } else if (strcmp(privdata.pagesize,"w288h432-div2") == 0) {
+  } else if (strcmp(pd->pagesize,"w288h432-div2") == 0) {
     stp_put32_le(0x04, v);
   } else {
     stp_put32_le(0x00, v);  /* Print Method */
   }
 
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Print Mode */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Print Mode */
   stp_put32_le(0x00, v);
   stp_put32_le(0x00, v);
 
   stp_put32_le(0x00, v);
-  stp_put32_le(privdata.w_size, v); /* Columns */
-  stp_put32_le(privdata.h_size, v); /* Rows */
+  stp_put32_le(pd->w_size, v); /* Columns */
+  stp_put32_le(pd->h_size, v); /* Rows */
   stp_put32_le(0x01, v);            /* Copies */
 
   stp_put32_le(0x00, v);
@@ -3197,7 +3302,7 @@ static void shinko_chcs2145_printer_init(stp_vars_t *v)
 
   stp_put32_le(0x00, v);
   stp_put32_le(0xffffffce, v);
-  stp_put32_le(privdata.w_dpi, v);  /* Dots Per Inch */
+  stp_put32_le(pd->w_dpi, v);  /* Dots Per Inch */
   stp_put32_le(0xffffffce, v);
 
   stp_put32_le(0x00, v);
@@ -3264,29 +3369,30 @@ LIST(laminate_list_t, shinko_chcs1245_laminate_list, laminate_t, shinko_chcs1245
 
 static void shinko_chcs1245_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   int media = 0;
 
-  if (strcmp(privdata.pagesize,"w288h576") == 0)
+  if (strcmp(pd->pagesize,"w288h576") == 0)
     media = 5;
-  else if (strcmp(privdata.pagesize,"w360h576") == 0)
+  else if (strcmp(pd->pagesize,"w360h576") == 0)
     media = 4;
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     media = 6;
-  else if (strcmp(privdata.pagesize,"w576h576") == 0)
+  else if (strcmp(pd->pagesize,"w576h576") == 0)
     media = 9;
-  else if (strcmp(privdata.pagesize,"w576h576-div2") == 0)
+  else if (strcmp(pd->pagesize,"w576h576-div2") == 0)
     media = 2;    
-  else if (strcmp(privdata.pagesize,"c8x10") == 0)
+  else if (strcmp(pd->pagesize,"c8x10") == 0)
     media = 0;
-  else if (strcmp(privdata.pagesize,"c8x10-w576h432_w576h288") == 0)
+  else if (strcmp(pd->pagesize,"c8x10-w576h432_w576h288") == 0)
     media = 3;    
-  else if (strcmp(privdata.pagesize,"c8x10-div2") == 0)
+  else if (strcmp(pd->pagesize,"c8x10-div2") == 0)
     media = 1;  
-  else if (strcmp(privdata.pagesize,"w576h864") == 0)
+  else if (strcmp(pd->pagesize,"w576h864") == 0)
     media = 0;
-  else if (strcmp(privdata.pagesize,"w576h864-div2") == 0)
+  else if (strcmp(pd->pagesize,"w576h864-div2") == 0)
     media = 7;  
-  else if (strcmp(privdata.pagesize,"w576h864-div3") == 0)
+  else if (strcmp(pd->pagesize,"w576h864-div3") == 0)
     media = 8;  
 
   stp_put32_le(0x10, v);
@@ -3300,19 +3406,19 @@ static void shinko_chcs1245_printer_init(stp_vars_t *v)
   stp_put32_le(0x00, v);
 
   stp_put32_le(media, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Print Mode */  
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Print Mode */  
   stp_put32_le(0x00, v);
-  if (((const unsigned char*)(privdata.laminate->seq).data)[0] == 0x02 ||
-      ((const unsigned char*)(privdata.laminate->seq).data)[0] == 0x03) {
+  if (((const unsigned char*)(pd->laminate->seq).data)[0] == 0x02 ||
+      ((const unsigned char*)(pd->laminate->seq).data)[0] == 0x03) {
 	  stp_put32_le(0x07fffffff, v);  /* Glossy */
   } else {
 	  stp_put32_le(0x0, v);  /* XXX -25>0>+25 */
   }
 
   stp_put32_le(0x00, v); /* XXX 0x00 printer default, 0x02 for "dust removal" on, 0x01 for off. */
-  stp_put32_le(privdata.w_size, v); /* Columns */
-  stp_put32_le(privdata.h_size, v); /* Rows */
+  stp_put32_le(pd->w_size, v); /* Columns */
+  stp_put32_le(pd->h_size, v); /* Rows */
   stp_put32_le(0x01, v);            /* Copies */
 
   stp_put32_le(0x00, v);
@@ -3322,7 +3428,7 @@ static void shinko_chcs1245_printer_init(stp_vars_t *v)
 
   stp_put32_le(0x00, v);
   stp_put32_le(0xffffffce, v);
-  stp_put32_le(privdata.w_dpi, v);  /* Dots Per Inch */
+  stp_put32_le(pd->w_dpi, v);  /* Dots Per Inch */
   stp_put32_le(0xffffffce, v);
 
   stp_put32_le(0x00, v);
@@ -3377,27 +3483,28 @@ LIST(laminate_list_t, shinko_chcs6245_laminate_list, laminate_t, shinko_chcs6245
 
 static void shinko_chcs6245_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   int media = 0;
 
-  if (strcmp(privdata.pagesize,"w288h576") == 0)
+  if (strcmp(pd->pagesize,"w288h576") == 0)
     media = 0x20;
-  else if (strcmp(privdata.pagesize,"w360h576") == 0)
+  else if (strcmp(pd->pagesize,"w360h576") == 0)
     media = 0x21;
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     media = 0x22;
-  else if (strcmp(privdata.pagesize,"w576h576") == 0)
+  else if (strcmp(pd->pagesize,"w576h576") == 0)
     media = 0x23;
-  else if (strcmp(privdata.pagesize,"c8x10") == 0)
+  else if (strcmp(pd->pagesize,"c8x10") == 0)
     media = 0x10;
-  else if (strcmp(privdata.pagesize,"w576h864") == 0)
+  else if (strcmp(pd->pagesize,"w576h864") == 0)
     media = 0x11;
-  else if (strcmp(privdata.pagesize,"w576h576-div2") == 0)
+  else if (strcmp(pd->pagesize,"w576h576-div2") == 0)
     media = 0x30;
-  else if (strcmp(privdata.pagesize,"c8x10-div2") == 0)
+  else if (strcmp(pd->pagesize,"c8x10-div2") == 0)
     media = 0x31;
-  else if (strcmp(privdata.pagesize,"w576h864-div2") == 0)
+  else if (strcmp(pd->pagesize,"w576h864-div2") == 0)
     media = 0x32;
-  else if (strcmp(privdata.pagesize,"w576h864-div3") == 0)
+  else if (strcmp(pd->pagesize,"w576h864-div3") == 0)
     media = 0x40;
 
   stp_put32_le(0x10, v);
@@ -3412,13 +3519,13 @@ static void shinko_chcs6245_printer_init(stp_vars_t *v)
 
   stp_put32_le(0x00, v);
   stp_put32_le(0x00, v);
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Lamination */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Lamination */
   stp_put32_le(0x00, v);
 
   stp_put32_le(0x00, v);
-  stp_put32_le(privdata.w_size, v); /* Columns */
-  stp_put32_le(privdata.h_size, v); /* Rows */
+  stp_put32_le(pd->w_size, v); /* Columns */
+  stp_put32_le(pd->h_size, v); /* Rows */
   stp_put32_le(0x01, v);            /* Copies */
 
   stp_put32_le(0x00, v);
@@ -3428,7 +3535,7 @@ static void shinko_chcs6245_printer_init(stp_vars_t *v)
 
   stp_put32_le(0x00, v);
   stp_put32_le(0xffffffce, v);
-  stp_put32_le(privdata.w_dpi, v);  /* Dots Per Inch */
+  stp_put32_le(pd->w_dpi, v);  /* Dots Per Inch */
   stp_put32_le(0xffffffce, v);
 
   stp_put32_le(0x00, v);
@@ -3494,33 +3601,34 @@ LIST(laminate_list_t, shinko_chcs6145_laminate_list, laminate_t, shinko_chcs6145
 
 static void shinko_chcs6145_printer_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   int media = 0;
 
-  if (strcmp(privdata.pagesize,"w288h432") == 0)
+  if (strcmp(pd->pagesize,"w288h432") == 0)
     media = 0x00;
-  else if (strcmp(privdata.pagesize,"w288h432-div2") == 0)
+  else if (strcmp(pd->pagesize,"w288h432-div2") == 0)
     media = 0x00;
-  else if (strcmp(privdata.pagesize,"w360h360") == 0)
+  else if (strcmp(pd->pagesize,"w360h360") == 0)
     media = 0x08;
-  else if (strcmp(privdata.pagesize,"w360h504") == 0)
+  else if (strcmp(pd->pagesize,"w360h504") == 0)
     media = 0x03;
-  else if (strcmp(privdata.pagesize,"w432h432") == 0)
+  else if (strcmp(pd->pagesize,"w432h432") == 0)
     media = 0x06;
-  else if (strcmp(privdata.pagesize,"w432h576") == 0)
+  else if (strcmp(pd->pagesize,"w432h576") == 0)
     media = 0x06;
-  else if (strcmp(privdata.pagesize,"w144h432") == 0)
+  else if (strcmp(pd->pagesize,"w144h432") == 0)
     media = 0x07;
-  else if (strcmp(privdata.pagesize,"w432h576-w432h432_w432h144") == 0)
+  else if (strcmp(pd->pagesize,"w432h576-w432h432_w432h144") == 0)
     media = 0x06;
-  else if (strcmp(privdata.pagesize,"w432h576-div2") == 0)
+  else if (strcmp(pd->pagesize,"w432h576-div2") == 0)
     media = 0x06;
-  else if (strcmp(privdata.pagesize,"w432h648") == 0)
+  else if (strcmp(pd->pagesize,"w432h648") == 0)
     media = 0x05;
 
   stp_put32_le(0x10, v);
   stp_put32_le(6145, v);  /* Printer Model */
-  if (!strcmp(privdata.pagesize,"w360h360") ||
-      !strcmp(privdata.pagesize,"w360h504"))
+  if (!strcmp(pd->pagesize,"w360h360") ||
+      !strcmp(pd->pagesize,"w360h504"))
 	  stp_put32_le(0x02, v); /* 5" media */
   else
 	  stp_put32_le(0x03, v); /* 6" media */
@@ -3531,23 +3639,23 @@ static void shinko_chcs6145_printer_init(stp_vars_t *v)
   stp_put32_le(media, v);  /* Media Type */
   stp_put32_le(0x00, v);
 
-  if (strcmp(privdata.pagesize,"w432h576-w432h432_w432h144") == 0) {
+  if (strcmp(pd->pagesize,"w432h576-w432h432_w432h144") == 0) {
     stp_put32_le(0x05, v);
-  } else if (strcmp(privdata.pagesize,"w288h432-div2") == 0) {
+  } else if (strcmp(pd->pagesize,"w288h432-div2") == 0) {
     stp_put32_le(0x04, v);
-  } else if (strcmp(privdata.pagesize,"w432h576-div2") == 0) {
+  } else if (strcmp(pd->pagesize,"w432h576-div2") == 0) {
     stp_put32_le(0x02, v);
   } else {
     stp_put32_le(0x00, v);
   }
   stp_put32_le(0x00, v);  /* XXX quality; 00 == default, 0x01 == std */
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Lamination */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Lamination */
   stp_put32_le(0x00, v);
 
   stp_put32_le(0x00, v);
-  stp_put32_le(privdata.w_size, v); /* Columns */
-  stp_put32_le(privdata.h_size, v); /* Rows */
+  stp_put32_le(pd->w_size, v); /* Columns */
+  stp_put32_le(pd->h_size, v); /* Rows */
   stp_put32_le(0x01, v);            /* Copies */
 
   stp_put32_le(0x00, v);
@@ -3557,7 +3665,7 @@ static void shinko_chcs6145_printer_init(stp_vars_t *v)
 
   stp_put32_le(0x00, v);
   stp_put32_le(0xffffffce, v);
-  stp_put32_le(privdata.w_dpi, v);  /* Dots Per Inch */
+  stp_put32_le(pd->w_dpi, v);  /* Dots Per Inch */
   stp_put32_le(0xffffffce, v);
 
   stp_put32_le(0x00, v);
@@ -3659,10 +3767,11 @@ LIST(laminate_list_t, dnpds40_laminate_list, laminate_t, dnpds40_laminate);
 
 static void dnp_printer_start_common(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Configure Lamination */
   stp_zprintf(v, "\033PCNTRL OVERCOAT        00000008000000");
-  stp_zfwrite((privdata.laminate->seq).data, 1,
-	      (privdata.laminate->seq).bytes, v); /* Lamination mode */
+  stp_zfwrite((pd->laminate->seq).data, 1,
+	      (pd->laminate->seq).bytes, v); /* Lamination mode */
 
   /* Set quantity.. Backend overrides as needed. */
   stp_zprintf(v, "\033PCNTRL QTY             000000080000001\r");
@@ -3670,14 +3779,15 @@ static void dnp_printer_start_common(stp_vars_t *v)
 
 static void dnpds40_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Common code */
   dnp_printer_start_common(v);
 
   /* Set cutter option to "normal" */
   stp_zprintf(v, "\033PCNTRL CUTTER          0000000800000");
-  if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "120");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "120");
   } else {
     stp_zprintf(v, "000");
@@ -3686,23 +3796,23 @@ static void dnpds40_printer_start(stp_vars_t *v)
   /* Configure multi-cut/page size */
   stp_zprintf(v, "\033PIMAGE MULTICUT        00000008000000");
 
-  if (!strcmp(privdata.pagesize, "B7")) {
+  if (!strcmp(pd->pagesize, "B7")) {
     stp_zprintf(v, "01");
-  } else if (!strcmp(privdata.pagesize, "w288h432")) {
+  } else if (!strcmp(pd->pagesize, "w288h432")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w360h504")) {
+  } else if (!strcmp(pd->pagesize, "w360h504")) {
     stp_zprintf(v, "03");
-  } else if (!strcmp(privdata.pagesize, "w360h504-div2")) {
+  } else if (!strcmp(pd->pagesize, "w360h504-div2")) {
     stp_zprintf(v, "22");
-  } else if (!strcmp(privdata.pagesize, "w432h576")) {
+  } else if (!strcmp(pd->pagesize, "w432h576")) {
     stp_zprintf(v, "04");
-  } else if (!strcmp(privdata.pagesize, "w432h648")) {
+  } else if (!strcmp(pd->pagesize, "w432h648")) {
     stp_zprintf(v, "05");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div2")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div2")) {
     stp_zprintf(v, "12");
-  } else if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  } else if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "04");
   } else {
     stp_zprintf(v, "00"); /* should be impossible. */
@@ -3716,12 +3826,13 @@ static void dnpds40_printer_end(stp_vars_t *v)
 
 static void dnpds40_plane_init(stp_vars_t *v)
 {
-  char p = (privdata.plane == 3 ? 'Y' :
-	    (privdata.plane == 2 ? 'M' :
+  dyesub_privdata_t *pd = get_privdata(v);
+  char p = (pd->plane == 3 ? 'Y' :
+	    (pd->plane == 2 ? 'M' :
 	     'C' ));
 
   long PadSize = 10;
-  long FSize = (privdata.w_size*privdata.h_size) + 1024 + 54 + PadSize;
+  long FSize = (pd->w_size*pd->h_size) + 1024 + 54 + PadSize;
 
   /* Printer command plus length of data to follow */
   stp_zprintf(v, "\033PIMAGE %cPLANE          %08ld", p, FSize);
@@ -3736,13 +3847,13 @@ static void dnpds40_plane_init(stp_vars_t *v)
 
   /* DIB header */
   stp_put32_le(40, v); /* DIB header size */
-  stp_put32_le(privdata.w_size, v);
-  stp_put32_le(privdata.h_size, v);
+  stp_put32_le(pd->w_size, v);
+  stp_put32_le(pd->h_size, v);
   stp_put16_le(1, v); /* single channel */
   stp_put16_le(8, v); /* 8bpp */
   dyesub_nputc(v, '\0', 8); /* compression + image size are ignored */
   stp_put32_le(11808, v); /* horizontal pixels per meter, fixed at 300dpi */
-  if (privdata.h_dpi == 600)
+  if (pd->h_dpi == 600)
     stp_put32_le(23615, v); /* vertical pixels per meter @ 600dpi */
   else
     stp_put32_le(11808, v); /* vertical pixels per meter @ 300dpi */
@@ -3814,6 +3925,7 @@ LIST(dyesub_printsize_list_t, dnpds80_printsize_list, dyesub_printsize_t, dnpds8
 
 static void dnpds80_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Common code */
   dnp_printer_start_common(v);
 
@@ -3823,35 +3935,35 @@ static void dnpds80_printer_start(stp_vars_t *v)
   /* Configure multi-cut/page size */
   stp_zprintf(v, "\033PIMAGE MULTICUT        00000008000000");
 
-  if (!strcmp(privdata.pagesize, "c8x10")) {
+  if (!strcmp(pd->pagesize, "c8x10")) {
     stp_zprintf(v, "06");
-  } else if (!strcmp(privdata.pagesize, "w576h864")) {
+  } else if (!strcmp(pd->pagesize, "w576h864")) {
     stp_zprintf(v, "07");
-  } else if (!strcmp(privdata.pagesize, "w288h576")) {
+  } else if (!strcmp(pd->pagesize, "w288h576")) {
     stp_zprintf(v, "08");
-  } else if (!strcmp(privdata.pagesize, "w360h576")) {
+  } else if (!strcmp(pd->pagesize, "w360h576")) {
     stp_zprintf(v, "09");
-  } else if (!strcmp(privdata.pagesize, "w432h576")) {
+  } else if (!strcmp(pd->pagesize, "w432h576")) {
     stp_zprintf(v, "10");
-  } else if (!strcmp(privdata.pagesize, "w576h576")) {
+  } else if (!strcmp(pd->pagesize, "w576h576")) {
     stp_zprintf(v, "11");
-  } else if (!strcmp(privdata.pagesize, "w576h576-div2")) {
+  } else if (!strcmp(pd->pagesize, "w576h576-div2")) {
     stp_zprintf(v, "13");
-  } else if (!strcmp(privdata.pagesize, "c8x10-div2")) {
+  } else if (!strcmp(pd->pagesize, "c8x10-div2")) {
     stp_zprintf(v, "14");
-  } else if (!strcmp(privdata.pagesize, "w576h864-div2")) {
+  } else if (!strcmp(pd->pagesize, "w576h864-div2")) {
     stp_zprintf(v, "15");
-  } else if (!strcmp(privdata.pagesize, "w576h648-w576h360_w576h288")) {
+  } else if (!strcmp(pd->pagesize, "w576h648-w576h360_w576h288")) {
     stp_zprintf(v, "16");
-  } else if (!strcmp(privdata.pagesize, "c8x10-w576h432_w576h288")) {
+  } else if (!strcmp(pd->pagesize, "c8x10-w576h432_w576h288")) {
     stp_zprintf(v, "17");
-  } else if (!strcmp(privdata.pagesize, "w576h792-w576h432_w576h360")) {
+  } else if (!strcmp(pd->pagesize, "w576h792-w576h432_w576h360")) {
     stp_zprintf(v, "18");
-  } else if (!strcmp(privdata.pagesize, "w576h864-w576h576_w576h288")) {
+  } else if (!strcmp(pd->pagesize, "w576h864-w576h576_w576h288")) {
     stp_zprintf(v, "19");
-  } else if (!strcmp(privdata.pagesize, "w576h864-div3")) {
+  } else if (!strcmp(pd->pagesize, "w576h864-div3")) {
     stp_zprintf(v, "20");
-  } else if (!strcmp(privdata.pagesize, "A4")) {
+  } else if (!strcmp(pd->pagesize, "A4")) {
     stp_zprintf(v, "21");
   } else {
     stp_zprintf(v, "00"); /* should not be possible */
@@ -3962,10 +4074,11 @@ LIST(dyesub_printsize_list_t, dnpds80dx_printsize_list, dyesub_printsize_t, dnpd
 
 static void dnpds80dx_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   int multicut;
 	
   /* If we're using roll media, act the same as a standard DS80 */
-  if (!strcmp(privdata.media->name, "Roll"))
+  if (!strcmp(pd->media->name, "Roll"))
     {
       dnpds80_printer_start(v);
       return;
@@ -3977,38 +4090,38 @@ static void dnpds80dx_printer_start(stp_vars_t *v)
   /* Set cutter option to "normal" */
   stp_zprintf(v, "\033PCNTRL CUTTER          0000000800000000");
 
-  if (!strcmp(privdata.pagesize, "c8x10")) {
+  if (!strcmp(pd->pagesize, "c8x10")) {
     multicut = 6;
-  } else if (!strcmp(privdata.pagesize, "w576h864")) {
+  } else if (!strcmp(pd->pagesize, "w576h864")) {
     multicut = 7;
-  } else if (!strcmp(privdata.pagesize, "w288h576")) {
+  } else if (!strcmp(pd->pagesize, "w288h576")) {
     multicut = 8;
-  } else if (!strcmp(privdata.pagesize, "w360h576")) {
+  } else if (!strcmp(pd->pagesize, "w360h576")) {
     multicut = 9;
-  } else if (!strcmp(privdata.pagesize, "w432h576")) {
+  } else if (!strcmp(pd->pagesize, "w432h576")) {
     multicut = 10;
-  } else if (!strcmp(privdata.pagesize, "w576h576")) {
+  } else if (!strcmp(pd->pagesize, "w576h576")) {
     multicut = 11;
-  } else if (!strcmp(privdata.pagesize, "w576h774-w576h756")) {
+  } else if (!strcmp(pd->pagesize, "w576h774-w576h756")) {
     multicut = 25;
-  } else if (!strcmp(privdata.pagesize, "w576h774")) {
+  } else if (!strcmp(pd->pagesize, "w576h774")) {
     multicut = 26;
-  } else if (!strcmp(privdata.pagesize, "w576h576-div2")) {
+  } else if (!strcmp(pd->pagesize, "w576h576-div2")) {
     multicut = 13;
-  } else if (!strcmp(privdata.pagesize, "c8x10-div2")) {
+  } else if (!strcmp(pd->pagesize, "c8x10-div2")) {
     multicut = 14;
-  } else if (!strcmp(privdata.pagesize, "w576h864-div2")) {
+  } else if (!strcmp(pd->pagesize, "w576h864-div2")) {
     multicut = 15;
-  } else if (!strcmp(privdata.pagesize, "w576h864-div3sheet")) {
+  } else if (!strcmp(pd->pagesize, "w576h864-div3sheet")) {
     multicut = 28;
   } else {
     multicut = 0;
   }
 
   /* Add correct offset to multicut mode based on duplex state */
-  if (!strcmp(privdata.duplex_mode, "None"))
+  if (!strcmp(pd->duplex_mode, "None"))
      multicut += 100; /* Simplex */
-  else if (privdata.page_number & 1)
+  else if (pd->page_number & 1)
      multicut += 300; /* Duplex, back */
   else
      multicut += 200; /* Duplex, front */
@@ -4054,14 +4167,15 @@ LIST(dyesub_printsize_list_t, dnpsrx1_printsize_list, dyesub_printsize_t, dnpsrx
 
 static void dnpdsrx1_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Common code */
   dnp_printer_start_common(v);
 
   /* Set cutter option to "normal" */
   stp_zprintf(v, "\033PCNTRL CUTTER          0000000800000");
-  if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "120");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "120");
   } else {
     stp_zprintf(v, "000");
@@ -4070,19 +4184,19 @@ static void dnpdsrx1_printer_start(stp_vars_t *v)
   /* Configure multi-cut/page size */
   stp_zprintf(v, "\033PIMAGE MULTICUT        00000008000000");
 
-  if (!strcmp(privdata.pagesize, "B7")) {
+  if (!strcmp(pd->pagesize, "B7")) {
     stp_zprintf(v, "01");
-  } else if (!strcmp(privdata.pagesize, "w288h432")) {
+  } else if (!strcmp(pd->pagesize, "w288h432")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w360h504")) {
+  } else if (!strcmp(pd->pagesize, "w360h504")) {
     stp_zprintf(v, "03");
-  } else if (!strcmp(privdata.pagesize, "w432h576")) {
+  } else if (!strcmp(pd->pagesize, "w432h576")) {
     stp_zprintf(v, "04");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div2")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div2")) {
     stp_zprintf(v, "12");
-  } else if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  } else if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "04");
   } else {
     stp_zprintf(v, "00");
@@ -4148,54 +4262,55 @@ LIST(dyesub_printsize_list_t, dnpds620_printsize_list, dyesub_printsize_t, dnpds
 
 static void dnpds620_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   /* Common code */
   dnp_printer_start_common(v);
 
   /* Multicut when 8x6 media is in use */
-  if (!strcmp(privdata.pagesize, "w432h576") &&
-      !strcmp(privdata.pagesize, "w432h648")) {
+  if (!strcmp(pd->pagesize, "w432h576") &&
+      !strcmp(pd->pagesize, "w432h648")) {
     stp_zprintf(v, "\033PCNTRL FULL_CUTTER_SET 00000016");
     stp_zprintf(v, "0000000000000000");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "\033PCNTRL FULL_CUTTER_SET 00000016");
     stp_zprintf(v, "0200200200200000");
-  } else if (!strcmp(privdata.pagesize, "w432h576-w432h432_w432h144")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-w432h432_w432h144")) {
     stp_zprintf(v, "\033PCNTRL FULL_CUTTER_SET 00000016");
     stp_zprintf(v, "0600200000000000");
-  } else if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  } else if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "\033PCNTRL CUTTER          00000008");
     stp_zprintf(v, "00000120");
   }
 
   /* Configure multi-cut/page size */
   stp_zprintf(v, "\033PIMAGE MULTICUT        00000008000000");
-  if (!strcmp(privdata.pagesize, "B7")) {
+  if (!strcmp(pd->pagesize, "B7")) {
     stp_zprintf(v, "01");
-  } else if (!strcmp(privdata.pagesize, "w288h432")) {
+  } else if (!strcmp(pd->pagesize, "w288h432")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w288h432-div2")) {
+  } else if (!strcmp(pd->pagesize, "w288h432-div2")) {
     stp_zprintf(v, "02");
-  } else if (!strcmp(privdata.pagesize, "w324h432")) {
+  } else if (!strcmp(pd->pagesize, "w324h432")) {
     stp_zprintf(v, "30");
-  } else if (!strcmp(privdata.pagesize, "w360h360")) {
+  } else if (!strcmp(pd->pagesize, "w360h360")) {
     stp_zprintf(v, "29");
-  } else if (!strcmp(privdata.pagesize, "w360h504")) {
+  } else if (!strcmp(pd->pagesize, "w360h504")) {
     stp_zprintf(v, "03");
-  } else if (!strcmp(privdata.pagesize, "w360h504-div2")) {
+  } else if (!strcmp(pd->pagesize, "w360h504-div2")) {
     stp_zprintf(v, "22");
-  } else if (!strcmp(privdata.pagesize, "w432h432")) {
+  } else if (!strcmp(pd->pagesize, "w432h432")) {
     stp_zprintf(v, "27");
-  } else if (!strcmp(privdata.pagesize, "w432h576")) {
+  } else if (!strcmp(pd->pagesize, "w432h576")) {
     stp_zprintf(v, "04");
-  } else if (!strcmp(privdata.pagesize, "w432h576-w432h432_w432h144")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-w432h432_w432h144")) {
     stp_zprintf(v, "04");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div4")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div4")) {
     stp_zprintf(v, "04");
-  } else if (!strcmp(privdata.pagesize, "w432h576-div2")) {
+  } else if (!strcmp(pd->pagesize, "w432h576-div2")) {
     stp_zprintf(v, "12");
-  } else if (!strcmp(privdata.pagesize, "w432h648")) {
+  } else if (!strcmp(pd->pagesize, "w432h648")) {
     stp_zprintf(v, "05");
-  } else if (!strcmp(privdata.pagesize, "w432h648-div2")) {
+  } else if (!strcmp(pd->pagesize, "w432h648-div2")) {
     stp_zprintf(v, "31");
   } else {
     stp_zprintf(v, "00"); /* Should be impossible */
@@ -4246,25 +4361,26 @@ LIST(dyesub_printsize_list_t, citizen_cw01_printsize_list, dyesub_printsize_t, c
 
 static void citizen_cw01_printer_start(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
 	int media = 0;
 
-	if (strcmp(privdata.pagesize,"w252h338") == 0)
+	if (strcmp(pd->pagesize,"w252h338") == 0)
 		media = 0x00;
-	else if (strcmp(privdata.pagesize,"B7") == 0)
+	else if (strcmp(pd->pagesize,"B7") == 0)
 		media = 0x01;
-	else if (strcmp(privdata.pagesize,"w288h432") == 0)
+	else if (strcmp(pd->pagesize,"w288h432") == 0)
 		media = 0x02;
-	else if (strcmp(privdata.pagesize,"w338h504") == 0)
+	else if (strcmp(pd->pagesize,"w338h504") == 0)
 		media = 0x03;
-	else if (strcmp(privdata.pagesize,"w360h504") == 0)
+	else if (strcmp(pd->pagesize,"w360h504") == 0)
 		media = 0x04;
-	else if (strcmp(privdata.pagesize,"w432h576") == 0)
+	else if (strcmp(pd->pagesize,"w432h576") == 0)
 		media = 0x05;
-	else if (strcmp(privdata.pagesize,"w432h576") == 0)
+	else if (strcmp(pd->pagesize,"w432h576") == 0)
 		media = 0x06;
 
 	stp_putc(media, v);
-	if (privdata.h_dpi == 600) {
+	if (pd->h_dpi == 600) {
 		stp_putc(0x01, v);
 	} else {
 		stp_putc(0x00, v);
@@ -4273,7 +4389,7 @@ static void citizen_cw01_printer_start(stp_vars_t *v)
 	stp_putc(0x00, v);
 
 	/* Compute plane size */
-	media = (privdata.w_size * privdata.h_size) + 1024 + 40;
+	media = (pd->w_size * pd->h_size) + 1024 + 40;
 
 	stp_put32_le(media, v);
 	stp_put32_le(0x0, v);
@@ -4281,17 +4397,18 @@ static void citizen_cw01_printer_start(stp_vars_t *v)
 
 static void citizen_cw01_plane_init(stp_vars_t *v)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
 	int i;
 
 	stp_put32_le(0x28, v);
 	stp_put32_le(0x0800, v);
-	stp_put16_le(privdata.h_size, v);  /* number of rows */
+	stp_put16_le(pd->h_size, v);  /* number of rows */
 	stp_put16_le(0x0, v);
 	stp_put32_le(0x080001, v);
 	stp_put32_le(0x00, v);
 	stp_put32_le(0x00, v);
 	stp_put32_le(0x335a, v);
-	if (privdata.h_dpi == 600) {
+	if (pd->h_dpi == 600) {
 		stp_put32_le(0x5c40, v);
 	} else {
 		stp_put32_le(0x335a, v);
@@ -5228,6 +5345,63 @@ static const dyesub_cap_t dyesub_model_capabilities[] =
   },
 };
 
+/*
+ * Resampling filters, as a function of the distance from the center
+ * of the output pixel, in source pixels.
+ */
+static double
+dyesub_kernel_triangle(double x)
+{
+  x = fabs(x);
+  return x < 1 ? 1 - x : 0;
+}
+
+static double
+dyesub_kernel_cubic(double x)
+{
+  /* Keys cubic convolution, a = -0.5 (Catmull-Rom) */
+  x = fabs(x);
+  if (x < 1)
+    return (1.5 * x - 2.5) * x * x + 1;
+  else if (x < 2)
+    return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+  else
+    return 0;
+}
+
+static double
+dyesub_sinc(double x)
+{
+  if (x == 0)
+    return 1;
+  x *= 3.14159265358979323846;
+  return sin(x) / x;
+}
+
+static double
+dyesub_kernel_lanczos3(double x)
+{
+  x = fabs(x);
+  return x < 3 ? dyesub_sinc(x) * dyesub_sinc(x / 3) : 0;
+}
+
+typedef struct dyesub_resampler {
+  const char *name;
+  const char *text;
+  double radius;
+  double (*kernel)(double x);
+} dyesub_resampler_t;
+
+static const dyesub_resampler_t dyesub_resamplers[] =
+{
+  { "Bilinear", N_("Bilinear"), 1, dyesub_kernel_triangle },
+  { "Bicubic", N_("Bicubic"), 2, dyesub_kernel_cubic },
+  { "Lanczos", N_("Lanczos"), 3, dyesub_kernel_lanczos3 },
+};
+
+static const int dyesub_resampler_count =
+sizeof(dyesub_resamplers) / sizeof(dyesub_resampler_t);
+
 static const stp_parameter_t the_parameters[] =
 {
   {
@@ -5276,6 +5450,12 @@ static const stp_parameter_t the_parameters[] =
     STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_FEATURE,
     STP_PARAMETER_LEVEL_BASIC, 1, 0, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "Resampling", N_("Image Resampling"), "Color=Yes,Category=Advanced Printer Setup",
+    N_("How the image is scaled to the printer's resolution"),
+    STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_FEATURE,
+    STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
+  },
   {
     "PrintingMode", N_("Printing Mode"), "Color=Yes,Category=Core Parameter",
     N_("Printing Output Mode"),
@@ -5589,6 +5769,18 @@ dyesub_parameters(const stp_vars_t *v, const char *name,
       if (dyesub_feature(caps, DYESUB_FEATURE_BORDERLESS)) 
         description->is_active = 1;
     }
+  else if (strcmp(name, "Resampling") == 0)
+    {
+      description->bounds.str = stp_string_list_create();
+      stp_string_list_add_string
+	(description->bounds.str, "None", _("None (Nearest Pixel)"));
+      for (i = 0; i < dyesub_resampler_count; i++)
+	stp_string_list_add_string(description->bounds.str,
+				   dyesub_resamplers[i].name,
+				   gettext(dyesub_resamplers[i].text));
+      description->deflt.str =
+	stp_string_list_param(description->bounds.str, 0)->name;
+    }
   else if (strcmp(name, "PrintingMode") == 0)
     {
       description->bounds.str = stp_string_list_create();
@@ -5828,12 +6020,13 @@ dyesub_describe_output(const stp_vars_t *v)
 static void
 dyesub_nputc(stp_vars_t *v, char byte, int count)
 {
+  dyesub_privdata_t *pd = get_privdata(v);
   if (count == 1)
     stp_putc(byte, v);
   else
     {
       int i;
-      char *buf = privdata.nputc_buf;
+      char *buf = pd->nputc_buf;
       int size = count;
       int blocks = size / NPUTC_BUFSIZE;
       int leftover = size % NPUTC_BUFSIZE;
@@ -5898,176 +6091,611 @@ dyesub_interpolate(int oldval, int oldsize, int newsize)
 static void
 dyesub_free_image(dyesub_print_vars_t *pv, stp_image_t *image)
 {
-  unsigned short** image_data = pv->image_data;
-  int image_px_height = pv->image_rows;
-  int i;
+  STP_SAFE_FREE(pv->image_data);
+}
 
-  for (i = 0; i< image_px_height; i++)
-    if (image_data[i])
-      stp_free(image_data[i]);
-  if (image_data)
-    stp_free(image_data);
+static int
+dyesub_convert_row(stp_vars_t *v,
+		dyesub_print_vars_t *pv,
+		int row)
+{
+  unsigned int zero_mask;
+  if (stp_color_get_row(v, pv->image, row, &zero_mask))
+    {
+      stp_deprintf(STP_DBG_DYESUB,
+		   "dyesub_convert_row: "
+		   "stp_color_get_row(..., %d, ...) == 0\n", row);
+      return 0;
+    }
+  pv->image_rows = row + 1;
+  return 1;
 }
 
-static unsigned short **
+/*
+ * Rotate the image into the buffer, so that each stored row is one
+ * column of the image, bottom to top.  The image is converted a band
+ * of rows at a time so that what gets written out to each stored row
+ * is a run of pixels rather than a single one.
+ */
+#define DYESUB_ROTATE_BAND 16
+
+static int
+dyesub_read_image_rotated(stp_vars_t *v,
+		dyesub_print_vars_t *pv,
+		int image_px_width,
+		int image_px_height)
+{
+  size_t row_size = image_px_width * pv->ink_channels;
+  size_t pixel_size = pv->out_channels * sizeof(short);
+  unsigned short *band = stp_malloc(DYESUB_ROTATE_BAND * row_size *
+				    sizeof(short));
+  int y, x, i;
+
+  pv->image_stride = image_px_height * pv->out_channels;
+  for (y = 0; y < image_px_height; y += DYESUB_ROTATE_BAND)
+    {
+      int rows = MIN(DYESUB_ROTATE_BAND, image_px_height - y);
+      for (i = 0; i < rows; i++)
+	{
+	  if (!dyesub_convert_row(v, pv, y + i))
+	    {
+	      stp_free(band);
+	      return 0;
+	    }
+	  memcpy(band + i * row_size, stp_channel_get_output(v),
+		 row_size * sizeof(short));
+	}
+      for (x = 0; x < image_px_width; x++)
+	{
+	  unsigned short *out = pv->image_data + x * pv->image_stride +
+	    (image_px_height - y - rows) * pv->out_channels;
+	  for (i = rows - 1; i >= 0; i--)
+	    {
+	      memcpy(out, band + i * row_size + x * pv->out_channels,
+		     pixel_size);
+	      out += pv->out_channels;
+	    }
+	}
+    }
+  stp_free(band);
+  return 1;
+}
+
+/*
+ * A page printed top to bottom in one pass only ever needs the row
+ * it's printing, so its rows are converted as they're printed (see
+ * dyesub_get_row()).  Otherwise the whole image is converted up
+ * front into a single buffer, rotated if the page is printed in
+ * landscape mode.
+ */
+static int
 dyesub_read_image(stp_vars_t *v,
 		dyesub_print_vars_t *pv,
 		stp_image_t *image)
 {
   int image_px_width  = stp_image_width(image);
   int image_px_height = stp_image_height(image);
-  int row_size = image_px_width * pv->ink_channels * sizeof(short);
-  unsigned short **image_data;
-  unsigned int zero_mask;
+  size_t row_size = image_px_width * pv->ink_channels;
   int i;
 
-  image_data = stp_zalloc(image_px_height * sizeof(unsigned short *));
+  pv->image = image;
   pv->image_rows = 0;
-  if (!image_data)
-    return NULL;	/* ? out of memory ? */
+  if (pv->print_mode != DYESUB_LANDSCAPE && !pv->plane_interlacing)
+    {
+      pv->image_streaming = 1;
+      return 1;
+    }
 
-  for (i = 0; i < image_px_height; i++)
+  if (pv->print_mode == DYESUB_LANDSCAPE)
     {
-      if (stp_color_get_row(v, image, i, &zero_mask))
-        {
-	  stp_deprintf(STP_DBG_DYESUB,
-	  	"dyesub_read_image: "
-		"stp_color_get_row(..., %d, ...) == 0\n", i);
+      pv->image_data = stp_malloc((size_t) image_px_width * image_px_height *
+				  pv->out_channels * sizeof(short));
+      if (!dyesub_read_image_rotated(v, pv, image_px_width, image_px_height))
+	{
 	  dyesub_free_image(pv, image);
-	  return NULL;
-	}	
-      image_data[i] = stp_malloc(row_size);
-      pv->image_rows = i+1;
-      if (!image_data[i])
-        {
-	  stp_deprintf(STP_DBG_DYESUB,
-	  	"dyesub_read_image: "
-		"(image_data[%d] = stp_malloc()) == NULL\n", i);
+	  return 0;
+	}
+      return 1;
+    }
+
+  pv->image_stride = row_size;
+  pv->image_data = stp_malloc(image_px_height * row_size * sizeof(short));
+  for (i = 0; i < image_px_height; i++)
+    {
+      if (!dyesub_convert_row(v, pv, i))
+	{
 	  dyesub_free_image(pv, image);
-	  return NULL;
-	}	
-      memcpy(image_data[i], stp_channel_get_output(v), row_size);
+	  return 0;
+	}
+      memcpy(pv->image_data + i * row_size, stp_channel_get_output(v),
+	     row_size * sizeof(short));
     }
-  return image_data;
+  return 1;
 }
 
-static int
-dyesub_print_pixel(stp_vars_t *v,
+/*
+ * Rows are only ever requested in order.  Rows that are scaled away
+ * are skipped rather than converted.
+ */
+static const unsigned short *
+dyesub_get_row(stp_vars_t *v,
 		dyesub_print_vars_t *pv,
-		const dyesub_cap_t *caps,
-		int row,
-		int col,
-		int plane)
+		int row)
 {
-  unsigned short ink[MAX_INK_CHANNELS], *out;
-  int i, j, b;
+  if (!pv->image_streaming)
+    return pv->image_data + row * pv->image_stride;
+  if (pv->image_rows <= row)
+    {
+      if (stp_image_skip_rows(pv->image, pv->image_rows,
+			      row - pv->image_rows) != STP_IMAGE_STATUS_OK ||
+	  !dyesub_convert_row(v, pv, row))
+	return NULL;
+      pv->image_row = stp_channel_get_output(v);
+    }
+  return pv->image_row;
+}
 
-  if (pv->print_mode == DYESUB_LANDSCAPE)
-    { /* "rotate" image */
-      dyesub_swap_ints(&col, &row);
-      row = (pv->imgw_px - 1) - row;
+/*
+ * Skip whatever rows weren't printed, so that the image knows it's
+ * done with, whichever way it was printed.
+ */
+static void
+dyesub_finish_image(dyesub_print_vars_t *pv)
+{
+  int image_px_height = stp_image_height(pv->image);
+  if (pv->image_streaming)
+    stp_image_skip_rows(pv->image, pv->image_rows,
+			image_px_height - pv->image_rows);
+}
+
+/*
+ * Resampling is done in fixed point, across each source row as it is
+ * read, and then down through a window of the most recent of those
+ * rows.  Source rows are only ever needed in increasing order (within
+ * each plane), so this works with rows streamed from the image.
+ */
+static void
+dyesub_filter_init(dyesub_filter_t *f, const dyesub_resampler_t *r,
+		   int in_size, int out_size)
+{
+  double scale = (double) in_size / out_size;
+  double fscale = scale > 1 ? scale : 1;
+  double support = r->radius * fscale;
+  int raw_taps = (int) ceil(2 * support);
+  double *w = stp_malloc(raw_taps * sizeof(double));
+  int i, j;
+
+  f->ntaps = raw_taps < in_size ? raw_taps : in_size;
+  f->start = stp_malloc(out_size * sizeof(int));
+  f->weights = stp_zalloc(out_size * f->ntaps * sizeof(int));
+  for (i = 0; i < out_size; i++)
+    {
+      double center = (i + 0.5) * scale - 0.5;
+      int first = (int) floor(center - support) + 1;
+      int start = first;
+      int *weights = f->weights + i * f->ntaps;
+      double total = 0;
+      int sum = 0;
+      int biggest = 0;
+      if (start > in_size - f->ntaps)
+	start = in_size - f->ntaps;
+      if (start < 0)
+	start = 0;
+      f->start[i] = start;
+      for (j = 0; j < raw_taps; j++)
+	{
+	  w[j] = (r->kernel)((first + j - center) / fscale);
+	  total += w[j];
+	}
+      /* Taps beyond the edges of the image fall on the edge pixel */
+      for (j = 0; j < raw_taps; j++)
+	{
+	  int src = first + j;
+	  if (src < 0)
+	    src = 0;
+	  else if (src >= in_size)
+	    src = in_size - 1;
+	  weights[src - start] += (int) floor(w[j] / total *
+					      DYESUB_RESAMPLE_ONE + 0.5);
+	}
+      for (j = 0; j < f->ntaps; j++)
+	{
+	  sum += weights[j];
+	  if (weights[j] > weights[biggest])
+	    biggest = j;
+	}
+      weights[biggest] += DYESUB_RESAMPLE_ONE - sum;
+    }
+  stp_free(w);
+}
+
+static void
+dyesub_filter_free(dyesub_filter_t *f)
+{
+  STP_SAFE_FREE(f->start);
+  STP_SAFE_FREE(f->weights);
+}
+
+static inline unsigned short
+dyesub_resample_clamp(int value)
+{
+  if (value <= 0)
+    return 0;
+  value = (value + DYESUB_RESAMPLE_ONE / 2) >> DYESUB_RESAMPLE_BITS;
+  return value > 65535 ? 65535 : value;
+}
+
+static void
+dyesub_resample_across(const dyesub_print_vars_t *pv,
+		       const unsigned short *in, unsigned short *out)
+{
+  const dyesub_filter_t *f = &(pv->hfilter);
+  int channels = pv->out_channels;
+  int i, j, c;
+
+  if (channels == 3)
+    for (i = 0; i < pv->outw_px; i++)
+      {
+	const int *weights = f->weights + i * f->ntaps;
+	const unsigned short *src = in + f->start[i] * 3;
+	int v0 = 0, v1 = 0, v2 = 0;
+	for (j = 0; j < f->ntaps; j++)
+	  {
+	    v0 += weights[j] * src[0];
+	    v1 += weights[j] * src[1];
+	    v2 += weights[j] * src[2];
+	    src += 3;
+	  }
+	out[0] = dyesub_resample_clamp(v0);
+	out[1] = dyesub_resample_clamp(v1);
+	out[2] = dyesub_resample_clamp(v2);
+	out += 3;
+      }
+  else
+    for (i = 0; i < pv->outw_px; i++)
+      {
+	const int *weights = f->weights + i * f->ntaps;
+	const unsigned short *src = in + f->start[i] * channels;
+	for (c = 0; c < channels; c++)
+	  {
+	    int value = 0;
+	    for (j = 0; j < f->ntaps; j++)
+	      value += weights[j] * src[j * channels + c];
+	    *out++ = dyesub_resample_clamp(value);
+	  }
+      }
+}
+
+static const unsigned short *
+dyesub_resample_row(stp_vars_t *v, dyesub_print_vars_t *pv, int y)
+{
+  const dyesub_filter_t *f = &(pv->vfilter);
+  const int *weights = f->weights + y * f->ntaps;
+  int row_size = pv->outw_px * pv->out_channels;
+  int *acc = pv->resample_acc;
+  int i, j;
+
+  if (y == pv->resampled_y)
+    return pv->resampled_row;
+  for (j = 0; j < f->ntaps; j++)
+    {
+      int src_row = f->start[y] + j;
+      int slot = src_row % f->ntaps;
+      const unsigned short *row = pv->window + slot * row_size;
+      int weight = weights[j];
+      if (pv->window_rows[slot] != src_row)
+	{
+	  const unsigned short *in = dyesub_get_row(v, pv, src_row);
+	  if (!in)
+	    return NULL;
+	  dyesub_resample_across(pv, in, pv->window + slot * row_size);
+	  pv->window_rows[slot] = src_row;
+	}
+      if (j == 0)
+	for (i = 0; i < row_size; i++)
+	  acc[i] = weight * row[i];
+      else if (weight != 0)
+	for (i = 0; i < row_size; i++)
+	  acc[i] += weight * row[i];
     }
+  for (i = 0; i < row_size; i++)
+    pv->resampled_row[i] = dyesub_resample_clamp(acc[i]);
+  pv->resampled_y = y;
+  return pv->resampled_row;
+}
+
+/*
+ * Set up resampling of the image to the output size, if it's been
+ * asked for and the image needs scaling.  This must be called after
+ * the image dimensions have been swapped for landscape pages.
+ */
+static void
+dyesub_setup_resampling(const stp_vars_t *v, dyesub_print_vars_t *pv)
+{
+  const char *name = stp_get_string_parameter(v, "Resampling");
+  int i;
 
-  out = &(pv->image_data[row][col * pv->out_channels]);
+  pv->resampler = NULL;
+  if (!name || (pv->outw_px == pv->imgw_px && pv->outh_px == pv->imgh_px))
+    return;
+  for (i = 0; i < dyesub_resampler_count; i++)
+    if (strcmp(name, dyesub_resamplers[i].name) == 0)
+      pv->resampler = &(dyesub_resamplers[i]);
+  if (!pv->resampler)
+    return;
+  dyesub_filter_init(&(pv->hfilter), pv->resampler,
+		     pv->imgw_px, pv->outw_px);
+  dyesub_filter_init(&(pv->vfilter), pv->resampler,
+		     pv->imgh_px, pv->outh_px);
+  pv->window = stp_malloc(pv->vfilter.ntaps * pv->outw_px *
+			  pv->out_channels * sizeof(unsigned short));
+  pv->window_rows = stp_malloc(pv->vfilter.ntaps * sizeof(int));
+  for (i = 0; i < pv->vfilter.ntaps; i++)
+    pv->window_rows[i] = -1;
+  pv->resampled_row = stp_malloc(pv->outw_px * pv->out_channels *
+				 sizeof(unsigned short));
+  pv->resample_acc = stp_malloc(pv->outw_px * pv->out_channels * sizeof(int));
+  pv->resampled_y = -1;
+  stp_deprintf(STP_DBG_DYESUB, "dyesub: %s resampling, %d x %d taps\n",
+	       pv->resampler->name, pv->hfilter.ntaps, pv->vfilter.ntaps);
+}
 
-  for (i = 0; i < pv->ink_channels; i++)
+static void
+dyesub_free_resampling(dyesub_print_vars_t *pv)
+{
+  if (pv->resampler)
     {
-      if (pv->out_channels == pv->ink_channels)
-        { /* copy out_channel (image) to equiv ink_channel (printer) */
-		if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR)) {
-			/* Convert RGB -> YCbCr (JPEG YCbCr444 coefficients) */
-			double R, G, B;
-			double Y, Cr, Cb;
-			R = out[0];
-			G = out[1];
-			B = out[2];
-			
-			Y  = R *  0.29900 + G *  0.58700 + B *  0.11400;
-			Cb = R * -0.16874 + G * -0.33126 + B *  0.50000 + 32768;
-			Cr = R *  0.50000 + G * -0.41869 + B * -0.08131 + 32768;
-			
-			ink[0] = Y;
-			ink[1] = Cb;
-			ink[2] = Cr;
-
-			/* XXX this is sub-optimal; we compute the full YCbCr
-			   values and throw away 2/3 for each pixel printed
-			   if we are plane or row interleaved */
-		} else {
-			ink[i] = out[i];
-		}
-        }
-      else if (pv->out_channels < pv->ink_channels)
-        { /* several ink_channels (printer) "share" same out_channel (image) */
-          ink[i] = out[i * pv->out_channels / pv->ink_channels];
-        }
-      else /* (pv->out_channels > pv->ink_channels) */
-        { /* merge several out_channels (image) into ink_channel (printer) */
-          int avg = 0;
-          for (j = 0; j < pv->out_channels / pv->ink_channels; j++)
-            avg += out[j + i * pv->out_channels / pv->ink_channels];
+      dyesub_filter_free(&(pv->hfilter));
+      dyesub_filter_free(&(pv->vfilter));
+      STP_SAFE_FREE(pv->window);
+      STP_SAFE_FREE(pv->window_rows);
+      STP_SAFE_FREE(pv->resampled_row);
+      STP_SAFE_FREE(pv->resample_acc);
+    }
+}
+
+/*
+ * Return output row y of the image (counting from the top of the image
+ * area), before columns are mapped to the output.
+ */
+static const unsigned short *
+dyesub_get_output_row(stp_vars_t *v, dyesub_print_vars_t *pv, int y)
+{
+  int row;
+  if (pv->resampler)
+    return dyesub_resample_row(v, pv, y);
+  row = dyesub_interpolate(y, pv->outh_px, pv->imgh_px);
+  stp_deprintf(STP_DBG_DYESUB,
+	       "dyesub_get_output_row: y = %d, row = %d\n", y, row);
+  return dyesub_get_row(v, pv, row);
+}
+
+/*
+ * Compute the ink values of one pixel.
+ */
+static void
+dyesub_pixel_inks(const dyesub_print_vars_t *pv, const unsigned short *out,
+		  unsigned short *ink)
+{
+  int i, j;
+
+  if (pv->out_channels == pv->ink_channels)
+    {
+      if (pv->ycbcr)
+	{
+	  /* Convert RGB -> YCbCr (JPEG YCbCr444 coefficients) */
+	  double R = out[0];
+	  double G = out[1];
+	  double B = out[2];
+
+	  ink[0] = R *  0.29900 + G *  0.58700 + B *  0.11400;
+	  ink[1] = R * -0.16874 + G * -0.33126 + B *  0.50000 + 32768;
+	  ink[2] = R *  0.50000 + G * -0.41869 + B * -0.08131 + 32768;
+	}
+      else
+	/* copy out_channel (image) to equiv ink_channel (printer) */
+	for (i = 0; i < pv->ink_channels; i++)
+	  ink[i] = out[i];
+    }
+  else if (pv->out_channels < pv->ink_channels)
+    { /* several ink_channels (printer) "share" same out_channel (image) */
+      for (i = 0; i < pv->ink_channels; i++)
+	ink[i] = out[i * pv->out_channels / pv->ink_channels];
+    }
+  else /* (pv->out_channels > pv->ink_channels) */
+    { /* merge several out_channels (image) into ink_channel (printer) */
+      for (i = 0; i < pv->ink_channels; i++)
+	{
+	  int avg = 0;
+	  for (j = 0; j < pv->out_channels / pv->ink_channels; j++)
+	    avg += out[j + i * pv->out_channels / pv->ink_channels];
 	  ink[i] = avg * pv->ink_channels / pv->out_channels;
 	}
     }
-   
-  /* Downscale 16bpp to output bpp */
-  /* FIXME:  Do we want to round? */
-  if (pv->bytes_per_ink_channel == 1) 
+}
+
+/*
+ * Downscale 16bpp to output bpp, and byteswap as needed.
+ * FIXME:  Do we want to round?
+ */
+static inline unsigned char *
+dyesub_put_ink(const dyesub_print_vars_t *pv, unsigned short ink,
+	       unsigned char *out)
+{
+  if (pv->bytes_per_ink_channel == 1)
+    *out++ = ink / 257;
+  else
     {
-      unsigned char *ink_u8 = (unsigned char *) ink;
-      for (i = 0; i < pv->ink_channels; i++) {
-#if 0
-             if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR))
-                     ink_u8[i] = ink[i] >> 8;
-             else
-#endif
-                     ink_u8[i] = ink[i] / 257;
-      }
-    } 
-  else if (pv->bits_per_ink_channel != 16)
+      if (pv->bits_per_ink_channel != 16)
+	ink = ink >> (16 - pv->bits_per_ink_channel);
+      if (pv->byteswap)
+	ink = ((ink >> 8) & 0xff) | ((ink & 0xff) << 8);
+      memcpy(out, &ink, 2);
+      out += 2;
+    }
+  return out;
+}
+
+/*
+ * Any combination of image and ink channels.
+ */
+static void
+dyesub_emit_row_generic(const dyesub_print_vars_t *pv,
+			const unsigned short *row_data,
+			const int *chans, int nchans, unsigned char *out)
+{
+  unsigned short ink[MAX_INK_CHANNELS];
+  int w, b;
+
+  for (w = 0; w < pv->outw_px; w++)
     {
-      for (i = 0; i < pv->ink_channels; i++)
-	ink[i] = ink[i] >> (16 - pv->bits_per_ink_channel);
+      dyesub_pixel_inks(pv, row_data + pv->col_offset[w], ink);
+      for (b = 0; b < nchans; b++)
+	out = dyesub_put_ink(pv, ink[chans[b]], out);
     }
+}
 
-  /* Byteswap as needed */
-  if (pv->bytes_per_ink_channel == 2 && pv->byteswap)
-    for (i = 0; i < pv->ink_channels; i++)
-      ink[i] = ((ink[i] >> 8) & 0xff) | ((ink[i] & 0xff) << 8);
+/*
+ * One ink channel for each image channel, 8 bits per channel.
+ */
+static void
+dyesub_emit_row_8(const dyesub_print_vars_t *pv,
+		  const unsigned short *row_data,
+		  const int *chans, int nchans, unsigned char *out)
+{
+  int w;
 
-  if (pv->plane_interlacing || pv->row_interlacing)
-    stp_zfwrite((char *) ink + (plane * pv->bytes_per_ink_channel), 
-		pv->bytes_per_ink_channel, 1, v);
+  if (pv->col_identity && nchans == pv->out_channels &&
+      (nchans == 1 || (nchans == 3 && chans[0] == 0 && chans[1] == 1 &&
+		       chans[2] == 2)))
+    {
+      int count = pv->outw_px * nchans;
+      for (w = 0; w < count; w++)
+	out[w] = row_data[w] / 257;
+    }
+  else if (nchans == 1)
+    {
+      const unsigned short *in = row_data + chans[0];
+      for (w = 0; w < pv->outw_px; w++)
+	out[w] = in[pv->col_offset[w]] / 257;
+    }
+  else if (nchans == 3)
+    {
+      int c0 = chans[0], c1 = chans[1], c2 = chans[2];
+      for (w = 0; w < pv->outw_px; w++)
+	{
+	  const unsigned short *in = row_data + pv->col_offset[w];
+	  out[0] = in[c0] / 257;
+	  out[1] = in[c1] / 257;
+	  out[2] = in[c2] / 257;
+	  out += 3;
+	}
+    }
   else
-      /* print inks in correct order, eg. RGB  BGR */
-      for (b = 0; b < pv->ink_channels; b++)
-	stp_zfwrite((char *) ink + (pv->bytes_per_ink_channel * (pv->ink_order[b]-1)), 
-		    pv->bytes_per_ink_channel, 1, v);
+    for (w = 0; w < pv->outw_px; w++)
+      {
+	const unsigned short *in = row_data + pv->col_offset[w];
+	int b;
+	for (b = 0; b < nchans; b++)
+	  *out++ = in[chans[b]] / 257;
+      }
+}
 
-  return 1;
+/*
+ * One ink channel for each image channel, 2 bytes per channel.
+ */
+static void
+dyesub_emit_row_16(const dyesub_print_vars_t *pv,
+		   const unsigned short *row_data,
+		   const int *chans, int nchans, unsigned char *out)
+{
+  int shift = 16 - pv->bits_per_ink_channel;
+  int swap = pv->byteswap;
+  int w, b;
+
+  for (w = 0; w < pv->outw_px; w++)
+    {
+      const unsigned short *in = row_data + pv->col_offset[w];
+      for (b = 0; b < nchans; b++)
+	{
+	  unsigned short ink = in[chans[b]] >> shift;
+	  if (swap)
+	    ink = (unsigned short) ((ink >> 8) | (ink << 8));
+	  memcpy(out, &ink, 2);
+	  out += 2;
+	}
+    }
+}
+
+/*
+ * Choose the row emitter for the page, and work out where each output
+ * pixel of a row comes from.  This must be called after
+ * dyesub_setup_resampling().
+ */
+static void
+dyesub_setup_row_emitter(dyesub_print_vars_t *pv, const dyesub_cap_t *caps)
+{
+  int nchans = (pv->plane_interlacing || pv->row_interlacing) ?
+    1 : pv->ink_channels;
+  int src_width;
+  int w;
+
+  pv->ycbcr = dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR);
+  if (pv->out_channels != pv->ink_channels || pv->ycbcr)
+    pv->emit_row = dyesub_emit_row_generic;
+  else if (pv->bytes_per_ink_channel == 1)
+    pv->emit_row = dyesub_emit_row_8;
+  else
+    pv->emit_row = dyesub_emit_row_16;
+
+  /* Resampled rows are already the output width */
+  src_width = pv->resampler ? pv->outw_px : pv->imgw_px;
+  pv->col_offset = stp_malloc(pv->outw_px * sizeof(int));
+  pv->col_identity = !pv->plane_lefttoright && pv->outw_px == src_width;
+  for (w = 0; w < pv->outw_px; w++)
+    {
+      int col = dyesub_interpolate(w, pv->outw_px, src_width);
+      if (pv->plane_lefttoright)
+	col = src_width - col - 1;
+      pv->col_offset[w] = col * pv->out_channels;
+    }
+  pv->row_buf = stp_malloc(pv->outw_px * nchans * pv->bytes_per_ink_channel);
+}
+
+static void
+dyesub_free_row_emitter(dyesub_print_vars_t *pv)
+{
+  STP_SAFE_FREE(pv->col_offset);
+  STP_SAFE_FREE(pv->row_buf);
 }
 
 static int
 dyesub_print_row(stp_vars_t *v,
 		dyesub_print_vars_t *pv,
-		const dyesub_cap_t *caps,
-		int row,
+		int y,
 		int plane)
 {
-  int ret = 0;
-  int w, col;
-  
-  for (w = 0; w < pv->outw_px; w++)
+  int chans[MAX_INK_CHANNELS];
+  int nchans;
+  const unsigned short *row_data = dyesub_get_output_row(v, pv, y);
+
+  if (!row_data)
+    return 0;
+  if (pv->plane_interlacing || pv->row_interlacing)
     {
-      col = dyesub_interpolate(w, pv->outw_px, pv->imgw_px);
-      if (pv->plane_lefttoright)
-	      ret = dyesub_print_pixel(v, pv, caps, row, pv->imgw_px - col - 1, plane);
-      else
-	      ret = dyesub_print_pixel(v, pv, caps, row, col, plane);
-      if (ret > 1)
-      	break;
+      chans[0] = plane;
+      nchans = 1;
     }
-  return ret;
+  else
+    {
+      /* print inks in correct order, eg. RGB  BGR */
+      for (nchans = 0; nchans < pv->ink_channels; nchans++)
+	chans[nchans] = pv->ink_order[nchans] - 1;
+    }
+  (pv->emit_row)(pv, row_data, chans, nchans, pv->row_buf);
+  stp_zfwrite((const char *) pv->row_buf,
+	      pv->outw_px * nchans * pv->bytes_per_ink_channel, 1, v);
+  return 1;
 }
 
 static int
@@ -6076,8 +6704,9 @@ dyesub_print_plane(stp_vars_t *v,
 		const dyesub_cap_t *caps,
 		int plane)
 {
-  int ret = 0;
-  int h, row, p;
+  dyesub_privdata_t *pd = get_privdata(v);
+  int ret = 1;
+  int h, p;
   int out_bytes = ((pv->plane_interlacing || pv->row_interlacing) ? 1 : pv->ink_channels)
   					* pv->bytes_per_ink_channel;
 
@@ -6089,11 +6718,11 @@ dyesub_print_plane(stp_vars_t *v,
 
       if (h % caps->block_size == 0)
         { /* block init */
-	  privdata.block_min_h = h + pv->prnt_px;
-	  privdata.block_min_w = pv->prnl_px;
-	  privdata.block_max_h = MIN(h + pv->prnt_px + caps->block_size - 1,
+	  pd->block_min_h = h + pv->prnt_px;
+	  pd->block_min_w = pv->prnl_px;
+	  pd->block_max_h = MIN(h + pv->prnt_px + caps->block_size - 1,
 	  					pv->prnb_px);
-	  privdata.block_max_w = pv->prnr_px;
+	  pd->block_max_w = pv->prnr_px;
 
 	  dyesub_exec(v, caps->block_init_func, "caps->block_init");
 	}
@@ -6110,11 +6739,9 @@ dyesub_print_plane(stp_vars_t *v,
               dyesub_nputc(v, pv->empty_byte[plane], out_bytes * pv->outl_px);
 	    }
 
-	  row = dyesub_interpolate(h + pv->prnt_px - pv->outt_px,
-	  					pv->outh_px, pv->imgh_px);
-	  stp_deprintf(STP_DBG_DYESUB,
-	  	"dyesub_print_plane: h = %d, row = %d\n", h, row);
-	  ret = dyesub_print_row(v, pv, caps, row, p);
+	  ret = dyesub_print_row(v, pv, h + pv->prnt_px - pv->outt_px, p);
+	  if (!ret)
+	    return 0;
 
 	  if (dyesub_feature(caps, DYESUB_FEATURE_FULL_WIDTH)
 	  	&& pv->outr_px < pv->prnw_px)
@@ -6124,7 +6751,7 @@ dyesub_print_plane(stp_vars_t *v,
 	    }
 	}
 
-      if (h + pv->prnt_px == privdata.block_max_h)
+      if (h + pv->prnt_px == pd->block_max_h)
         { /* block end */
 	  dyesub_exec(v, caps->block_end_func, "caps->block_end");
 	}
@@ -6156,6 +6783,7 @@ int IsBigEndian()
 static int
 dyesub_do_print(stp_vars_t *v, stp_image_t *image)
 {
+  dyesub_privdata_t *pd;
   int i;
   dyesub_print_vars_t pv;
   int status = 1;
@@ -6191,6 +6819,9 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
     }
   (void) memset(&pv, 0, sizeof(pv));
 
+  pd = (dyesub_privdata_t *) stp_zalloc(sizeof(dyesub_privdata_t));
+  stp_allocate_component_data(v, "Driver", NULL, NULL, pd);
+
   stp_image_init(image);
   pv.imgw_px = stp_image_width(image);
   pv.imgh_px = stp_image_height(image);
@@ -6199,16 +6830,16 @@ dyesub_do_print(stp_vars_t *v, stp_image_t *image)
   dyesub_printsize(v, &max_print_px_width, &max_print_px_height);
 
   /* Duplex processing -- Rotate even pages for DuplexNoTumble */
-  privdata.duplex_mode = stp_get_string_parameter(v, "Duplex");
-  privdata.page_number = stp_get_int_parameter(v, "PageNumber");
-  if((privdata.page_number & 1) && privdata.duplex_mode && !strcmp(privdata.duplex_mode,"DuplexNoTumble"))
+  pd->duplex_mode = stp_get_string_parameter(v, "Duplex");
+  pd->page_number = stp_get_int_parameter(v, "PageNumber");
+  if((pd->page_number & 1) && pd->duplex_mode && !strcmp(pd->duplex_mode,"DuplexNoTumble"))
     image = stpi_buffer_image(image,BUFFER_FLAG_FLIP_X | BUFFER_FLAG_FLIP_Y);
 
-  privdata.pagesize = stp_get_string_parameter(v, "PageSize");
+  pd->pagesize = stp_get_string_parameter(v, "PageSize");
   if (caps->laminate)
-	  privdata.laminate = dyesub_get_laminate_pattern(v);
+	  pd->laminate = dyesub_get_laminate_pattern(v);
   if (caps->media)
-	  privdata.media = dyesub_get_mediatype(v);
+	  pd->media = dyesub_get_mediatype(v);
 
   dyesub_imageable_area_internal(v, 
   	(dyesub_feature(caps, DYESUB_FEATURE_WHITE_BORDER) ? 1 : 0),
@@ -6295,7 +6926,17 @@ else //if(IsBigEndian == 0 )
     pv.byteswap = !dyesub_feature(caps, DYESUB_FEATURE_BIGENDIAN);
   }
 
-  pv.image_data = dyesub_read_image(v, &pv, image);
+  pv.plane_interlacing = dyesub_feature(caps, DYESUB_FEATURE_PLANE_INTERLACE);
+  pv.row_interlacing = dyesub_feature(caps, DYESUB_FEATURE_ROW_INTERLACE);
+  pv.plane_lefttoright = dyesub_feature(caps, DYESUB_FEATURE_PLANE_LEFTTORIGHT);
+  pv.print_mode = page_mode;
+  if (!dyesub_read_image(v, &pv, image))
+    {
+      stp_image_conclude(image);
+      stp_destroy_component_data(v, "Driver");
+      stp_free(pd);
+      return 2;
+    }
   if (ink_type) {
 	  if (dyesub_feature(caps, DYESUB_FEATURE_RGBtoYCBCR)) {
 		  pv.empty_byte[0] = 0xff; /* Y */
@@ -6315,16 +6956,6 @@ else //if(IsBigEndian == 0 )
 	  pv.empty_byte[1] = 0x0;
 	  pv.empty_byte[2] = 0x0;
   }
-  
-  pv.plane_interlacing = dyesub_feature(caps, DYESUB_FEATURE_PLANE_INTERLACE);
-  pv.row_interlacing = dyesub_feature(caps, DYESUB_FEATURE_ROW_INTERLACE);
-  pv.plane_lefttoright = dyesub_feature(caps, DYESUB_FEATURE_PLANE_LEFTTORIGHT);
-  pv.print_mode = page_mode;
-  if (!pv.image_data)
-    {
-      stp_image_conclude(image);
-      return 2;
-    }
   /* /FIXME */
 
   /* FIXME:  Provide a way of disabling/altering these curves */
@@ -6376,35 +7007,46 @@ else //if(IsBigEndian == 0 )
     }
 
   /* assign private data *after* swaping image dimensions */
-  privdata.w_dpi = w_dpi;
-  privdata.h_dpi = h_dpi;
-  privdata.w_size = pv.prnw_px;
-  privdata.h_size = pv.prnh_px;
-  privdata.print_mode = pv.print_mode;
-  privdata.bpp = pv.bits_per_ink_channel;
+  pd->w_dpi = w_dpi;
+  pd->h_dpi = h_dpi;
+  pd->w_size = pv.prnw_px;
+  pd->h_size = pv.prnh_px;
+  pd->print_mode = pv.print_mode;
+  pd->bpp = pv.bits_per_ink_channel;
   
+  dyesub_setup_resampling(v, &pv);
+  dyesub_setup_row_emitter(&pv, caps);
+
   /* printer init */
   dyesub_exec(v, caps->printer_init_func, "caps->printer_init");
 
   for (pl = 0; pl < (pv.plane_interlacing ? pv.ink_channels : 1); pl++)
     {
-      privdata.plane = pv.ink_order[pl];
-      stp_deprintf(STP_DBG_DYESUB, "dyesub: plane %d\n", privdata.plane);
+      pd->plane = pv.ink_order[pl];
+      stp_deprintf(STP_DBG_DYESUB, "dyesub: plane %d\n", pd->plane);
 
       /* plane init */
       dyesub_exec(v, caps->plane_init_func, "caps->plane_init");
   
-      dyesub_print_plane(v, &pv, caps, (int) pv.ink_order[pl] - 1);
+      if (!dyesub_print_plane(v, &pv, caps, (int) pv.ink_order[pl] - 1))
+	status = 2;
 
       /* plane end */
       dyesub_exec(v, caps->plane_end_func, "caps->plane_end");
+      if (status != 1)
+	break;
     }
 
   /* printer end */
   dyesub_exec(v, caps->printer_end_func, "caps->printer_end");
 
+  dyesub_finish_image(&pv);
+  dyesub_free_row_emitter(&pv);
+  dyesub_free_resampling(&pv);
   dyesub_free_image(&pv, image);
   stp_image_conclude(image);
+  stp_destroy_component_data(v, "Driver");
+  stp_free(pd);
   return status;
 }
 
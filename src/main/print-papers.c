@@ -79,10 +79,33 @@ stpi_paper_list_init(void)
   return 0;
 }
 
+/*
+ * Papers from the printer database stay there; they're never freed.
+ */
+static int
+stpi_paper_list_load_db(void)
+{
+  int count = stpi_printer_db_paper_count();
+  stp_papersize_t *papers;
+  int i;
+  if (count == 0)
+    return 0;
+  stpi_paper_list_init();
+  stp_list_set_freefunc(paper_list, NULL);
+  papers = stp_zalloc(count * sizeof(stp_papersize_t));
+  for (i = 0; i < count; i++)
+    {
+      stpi_printer_db_get_paper(i, &(papers[i]));
+      stp_list_item_create(paper_list, NULL, &(papers[i]));
+    }
+  return 1;
+}
+
 static inline void
 check_paperlist(void)
 {
-  if (paper_list == NULL)
+  stpi_data_lock();
+  if (paper_list == NULL && !stpi_paper_list_load_db())
     {
       stp_xml_parse_file_named("papers.xml");
       if (paper_list == NULL)
@@ -91,6 +114,7 @@ check_paperlist(void)
 	  stpi_paper_list_init();
 	}
     }
+  stpi_data_unlock();
 }
 
 static int
@@ -420,8 +444,8 @@ stp_xml_process_paperdef(stp_mxml_node_t *paperdef, const char *file) /* The pap
 	  if (!strcmp(paper_name, "paper"))
 	    {
 	      outpaper = stp_xml_process_paper(paper);
-	      if (outpaper)
-		stpi_paper_create(outpaper);
+	      if (outpaper && stpi_paper_create(outpaper) == 0)
+		stpi_printer_db_add_paper(outpaper);
 	    }
 	}
       paper = paper->next;
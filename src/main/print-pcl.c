@@ -44,6 +44,7 @@
  */
 static void	pcl_mode0(stp_vars_t *, unsigned char *, int, int);
 static void	pcl_mode2(stp_vars_t *, unsigned char *, int, int);
+static void	pcl_mode3(stp_vars_t *, unsigned char *, int, int);
 
 #ifndef MAX
 #  define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -54,6 +55,13 @@ typedef struct
   int do_blank;
   int blank_lines;
   unsigned char *comp_buf;
+  unsigned char *delta_buf;	/* Mode 3 (delta row) compressed data */
+  unsigned char *seed_rows;	/* Last row sent for each plane */
+  int seed_planes;		/* Most planes sent for each row */
+  int plane;			/* Plane being sent within the row */
+  int compression;		/* Compression mode the printer is in */
+  unsigned long tiff_bytes;	/* Raster data if sent in mode 2 alone */
+  unsigned long sent_bytes;	/* Raster data actually sent */
   void (*writefunc)(stp_vars_t *, unsigned char *, int, int);	/* PCL output function */
   int do_cret;
   int do_cretb;
@@ -336,6 +344,7 @@ typedef struct {
 #define PCL_PRINTER_BLANKLINE	64	/* Blank line removal supported */
 #define PCL_PRINTER_DUPLEX	128	/* Printer can have duplexer */
 #define PCL_PRINTER_LABEL       256     /* Datamax-O'Neil PCL Label Printer */
+#define PCL_PRINTER_DELTAROW	512	/* Use delta row compression too */
 
 /*
  * FIXME - the 520 shouldn't be lumped in with the 500 as it supports
@@ -920,7 +929,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {7, 41, 18, 18},
     {7, 41, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_DJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_DJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     dj500_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -933,7 +943,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {7, 33, 18, 18},
     {7, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMY,
-    PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     dj500_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -947,7 +958,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {7, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMY,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj540_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -960,7 +971,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {3, 33, 18, 18},
     {5, 33, 10, 10},
     PCL_COLOR_CMYK,
-    PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
 /* The 550/560 support COM10 and DL envelope, but the control codes
    are negative, indicating landscape mode. This needs thinking about! */
     dj340_papersizes,
@@ -976,7 +988,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {0, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMY,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -990,7 +1002,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {0, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -1004,7 +1016,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {0, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK | PCL_COLOR_CMYKcm,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -1018,7 +1030,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {5, 33, 10, 10},
     PCL_COLOR_CMYK | PCL_COLOR_CMYK4,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -1032,7 +1044,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {0, 33, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK | PCL_COLOR_CMYK4b,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -1046,7 +1058,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {5, 33, 10, 10},	/* Oliver Vecernik */
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DUPLEX |
+      PCL_PRINTER_DELTAROW,
     dj600_papersizes,
     basic_papertypes,
     emptylist,
@@ -1060,7 +1073,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {5, 33, 10, 10},
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj1220_papersizes,
     basic_papertypes,
     emptylist,
@@ -1074,7 +1087,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {5, 33, 10, 10},
     PCL_COLOR_CMYK | PCL_COLOR_CMYK4,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj1100_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -1088,7 +1101,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMY,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj1200_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -1102,7 +1115,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj1200_papersizes,
     basic_papertypes,
     dj_papersources,
@@ -1116,7 +1129,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {0, 35, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj2000_papersizes,
     new_papertypes,
     dj_papersources,
@@ -1130,7 +1143,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_CMYK,
     PCL_PRINTER_DJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_MEDIATYPE |
-      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE,
+      PCL_PRINTER_CUSTOM_SIZE | PCL_PRINTER_BLANKLINE | PCL_PRINTER_DELTAROW,
     dj2500_papersizes,
     new_papertypes,
     dj2500_papersources,
@@ -1208,7 +1221,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1221,7 +1235,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1234,7 +1249,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1247,7 +1263,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1260,7 +1277,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1273,7 +1291,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljtabloid_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1286,7 +1305,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1299,7 +1319,8 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
-    PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE,
+    PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
+      PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1313,7 +1334,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1327,7 +1348,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1341,7 +1362,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1355,7 +1376,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljsmall_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1369,7 +1390,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1383,7 +1404,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 18, 18},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljtabloid_papersizes,
     emptylist,
     laserjet_papersources,
@@ -1397,7 +1418,7 @@ static const pcl_cap_t pcl_model_capabilities[] =
     {12, 12, 10, 10},	/* Check/Fix */
     PCL_COLOR_NONE,
     PCL_PRINTER_LJ | PCL_PRINTER_NEW_ERG | PCL_PRINTER_TIFF | PCL_PRINTER_BLANKLINE |
-      PCL_PRINTER_DUPLEX,
+      PCL_PRINTER_DUPLEX | PCL_PRINTER_DELTAROW,
     ljbig_papersizes,
     emptylist,
     laserjet_papersources,
@@ -2432,6 +2453,8 @@ pcl_printfunc(stp_vars_t *v)
 	      stp_deprintf(STP_DBG_PCL, "Blank Lines = %d\n", pd->blank_lines);
 	      stp_zprintf(v, "\033*b%dY", pd->blank_lines);
 	      pd->blank_lines=0;
+	      if (pd->seed_rows)	/* Y offset zeroes the seed rows */
+		memset(pd->seed_rows, 0, pd->seed_planes * pd->height);
 	    }
 	  else;
 	}
@@ -2517,6 +2540,14 @@ get_double_param(stp_vars_t *v, const char *param)
     return 1.0;
 }
 
+static void
+pcl_write_row(stp_vars_t *v, int y, void *data)
+{
+  (void) data;
+  pcl_printfunc(v);
+  stp_deprintf(STP_DBG_PCL, "pcl_print: y = %d\n", y);
+}
+
 static int
 pcl_do_print(stp_vars_t *v, stp_image_t *image)
 {
@@ -2537,7 +2568,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   int		printing_color = 0;
   int		top = stp_get_top(v);
   int		left = stp_get_left(v);
-  int		y;		/* Looping vars */
   int		xdpi, ydpi;	/* Resolution */
   unsigned char *black,		/* Black bitmap data */
 		*cyan,		/* Cyan bitmap data */
@@ -2550,14 +2580,8 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 		page_right,
 		page_bottom,
 		out_width,	/* Width of image on page */
-		out_height,	/* Height of image on page */
-		errdiv,		/* Error dividend */
-		errmod,		/* Error modulus */
-		errval,		/* Current error value */
-		errline,	/* Current raster line */
-		errlast;	/* Last raster line loaded */
-  unsigned	zero_mask;
-  int           image_height;
+		out_height;	/* Height of image on page */
+  stp_row_pipeline_t pipeline;
   const pcl_cap_t *caps;		/* Printer capabilities */
   int		planes = 3;	/* # of output planes */
   int		pcl_media_size; /* PCL media size code */
@@ -2587,7 +2611,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   */
 
   stp_image_init(image);
-  image_height = stp_image_height(image);
 
  /*
   * Figure out the output resolution...
@@ -2647,8 +2670,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
   left -= page_left;
   top -= page_top;
 
-  image_height = stp_image_height(image);
-
  /*
   * Set media size here because it is needed by the margin calculation code.
   */
@@ -3122,6 +3143,27 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
     privdata.writefunc = pcl_mode0;
   }
 
+/* ...and for pcl_mode3 delta row compression where the printer has it */
+
+  privdata.delta_buf = NULL;
+  privdata.seed_rows = NULL;
+  privdata.seed_planes = 0;
+  privdata.plane = 0;
+  privdata.compression = 2;
+  privdata.tiff_bytes = 0;
+  privdata.sent_bytes = 0;
+  if (privdata.comp_buf &&
+      (caps->stp_printer_type & PCL_PRINTER_DELTAROW) == PCL_PRINTER_DELTAROW)
+  {
+    /* Worst case is one command byte for every byte changed */
+    privdata.delta_buf = stp_malloc(privdata.height * 2 + 16);
+    /* Two planes (for CRet) of each of four or six colors */
+    privdata.seed_planes =
+      (privdata.do_cret ? 2 : 1) * (privdata.do_6color ? 6 : 4);
+    privdata.seed_rows = stp_zalloc(privdata.seed_planes * privdata.height);
+    privdata.writefunc = pcl_mode3;
+  }
+
 /* Set up dithering for special printers. */
 
 #if 1		/* Leave alone for now */
@@ -3239,11 +3281,6 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 
   (void) stp_color_init(v, image, 65536);
 
-  errdiv  = image_height / out_height;
-  errmod  = image_height % out_height;
-  errval  = 0;
-  errlast = -1;
-  errline  = 0;
   privdata.blank_lines = 0;
 #ifndef PCL_DEBUG_DISABLE_BLANKLINE_REMOVAL
   privdata.do_blank = ((caps->stp_printer_type & PCL_PRINTER_BLANKLINE) ==
@@ -3253,31 +3290,12 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 #endif
   stp_allocate_component_data(v, "Driver", NULL, NULL, &privdata);
 
-  for (y = 0; y < out_height; y ++)
-  {
-    int duplicate_line = 1;
-    if (errline != errlast)
-    {
-      errlast = errline;
-      duplicate_line = 0;
-      if (stp_color_get_row(v, image, errline, &zero_mask))
-	{
-	  status = 2;
-	  break;
-	}
-    }
-    stp_dither(v, y, duplicate_line, zero_mask, NULL);
-    pcl_printfunc(v);
-    stp_deprintf(STP_DBG_PCL,"pcl_print: y = %d, line = %d, val = %d, mod = %d, height = %d\n",
-		  y, errline, errval, errmod, out_height);
-    errval += errmod;
-    errline += errdiv;
-    if (errval >= out_height)
-    {
-      errval -= out_height;
-      errline ++;
-    }
-  }
+  pipeline.out_height = out_height;
+  pipeline.maskfunc = NULL;
+  pipeline.writefunc = pcl_write_row;
+  pipeline.data = NULL;
+  if (stp_row_pipeline_run(v, image, &pipeline))
+    status = 2;
 
 /* Output trailing blank lines (may not be required?) */
 
@@ -3311,6 +3329,13 @@ pcl_do_print(stp_vars_t *v, stp_image_t *image)
 
   if (privdata.comp_buf != NULL)
     stp_free(privdata.comp_buf);
+  if (privdata.seed_rows != NULL)
+  {
+    stp_deprintf(STP_DBG_PCL, "Delta row compression: %lu bytes, %lu in mode 2\n",
+		 privdata.sent_bytes, privdata.tiff_bytes);
+    stp_free(privdata.delta_buf);
+    stp_free(privdata.seed_rows);
+  }
 
   if ((caps->stp_printer_type & PCL_PRINTER_NEW_ERG) == PCL_PRINTER_NEW_ERG)
     stp_puts("\033*rC", v);
@@ -3358,6 +3383,35 @@ static const stp_printfuncs_t print_pcl_printfuncs =
 };
 
 
+/*
+ * 'pcl_send_plane()' - Send one plane of a row of raster graphics,
+ *                      switching to the given compression mode first
+ *                      unless it's negative.
+ */
+
+static void
+pcl_send_plane(stp_vars_t *v,		/* I - Print file or command */
+	       int           mode,		/* I - New mode, or -1 */
+	       const unsigned char *data,	/* I - Raster data */
+	       int           length,		/* I - Length of raster data */
+	       int           last_plane)	/* I - True if this is the last plane */
+{
+  stp_command_t cmd;
+
+  stp_command_start(&cmd, v);
+  stp_command_puts(&cmd, "\033*b");
+  if (mode >= 0)
+    {
+      stp_command_put_int(&cmd, mode);
+      stp_command_putc(&cmd, 'm');
+    }
+  stp_command_put_int(&cmd, length);
+  stp_command_putc(&cmd, last_plane ? 'W' : 'V');
+  stp_command_write(&cmd, (const char *) data, length);
+  stp_command_end(&cmd);
+}
+
+
 /*
  * 'pcl_mode0()' - Send PCL graphics using mode 0 (no) compression.
  */
@@ -3368,8 +3422,7 @@ pcl_mode0(stp_vars_t *v,		/* I - Print file or command */
           int           height,		/* I - Height of bitmap data */
           int           last_plane)	/* I - True if this is the last plane */
 {
-  stp_zprintf(v, "\033*b%d%c", height, last_plane ? 'W' : 'V');
-  stp_zfwrite((const char *) line, height, 1, v);
+  pcl_send_plane(v, -1, line, height, last_plane);
 }
 
 
@@ -3394,8 +3447,118 @@ pcl_mode2(stp_vars_t *v,		/* I - Print file or command */
   * Send a line of raster graphics...
   */
 
-  stp_zprintf(v, "\033*b%d%c", (int)(comp_ptr - comp_buf), last_plane ? 'W' : 'V');
-  stp_zfwrite((const char *)comp_buf, comp_ptr - comp_buf, 1, v);
+  pcl_send_plane(v, -1, comp_buf, comp_ptr - comp_buf, last_plane);
+}
+
+
+/*
+ * 'pcl_pack_delta_row()' - Compress a row against the seed row (the last
+ *                          row sent for the same plane) using mode 3.
+ *
+ * Each run of up to 8 bytes that differ from the seed row is sent as a
+ * command byte followed by the replacement bytes.  The command byte
+ * holds the number of bytes less one in its top 3 bits and the offset
+ * from the end of the last run in the other 5; an offset of 31 or more
+ * continues in further bytes, added together, until one less than 255.
+ */
+
+static int
+pcl_pack_delta_row(const unsigned char *line,	/* I - Row to send */
+		   const unsigned char *seed,	/* I - Last row sent */
+		   int           height,	/* I - Bytes in the row */
+		   unsigned char *comp_buf)	/* O - Compressed data */
+{
+  unsigned char	*comp_ptr = comp_buf;
+  int		last = 0;		/* End of the last run */
+  int		i = 0;
+
+  while (i < height)
+    {
+      int start, count, offset;
+      if (line[i] == seed[i])
+	{
+	  i++;
+	  continue;
+	}
+      start = i;
+      while (i < height && i - start < 8 && line[i] != seed[i])
+	i++;
+      count = i - start;
+      offset = start - last;
+      if (offset < 31)
+	*comp_ptr++ = ((count - 1) << 5) | offset;
+      else
+	{
+	  *comp_ptr++ = ((count - 1) << 5) | 31;
+	  for (offset -= 31; offset >= 255; offset -= 255)
+	    *comp_ptr++ = 255;
+	  *comp_ptr++ = offset;
+	}
+      memcpy(comp_ptr, line + start, count);
+      comp_ptr += count;
+      last = i;
+    }
+  return comp_ptr - comp_buf;
+}
+
+
+/*
+ * 'pcl_mode3()' - Send PCL graphics using mode 3 (delta row) or mode 2
+ *                 (TIFF) compression, whichever is shorter.
+ *
+ * Changing mode costs two bytes ("\033*b3m" rather than "\033*b"), so
+ * that's taken into account.  Every row updates the seed row for its
+ * plane, whichever mode it's sent in.
+ */
+
+static void
+pcl_mode3(stp_vars_t *v,		/* I - Print file or command */
+          unsigned char *line,		/* I - Output bitmap data */
+          int           height,		/* I - Height of bitmap data */
+          int           last_plane)	/* I - True if this is the last plane */
+{
+  pcl_privdata_t *privdata =
+    (pcl_privdata_t *) stp_get_component_data(v, "Driver");
+  unsigned char *seed;
+  unsigned char *comp_buf = privdata->comp_buf;
+  unsigned char	*comp_ptr;		/* Current slot in buffer */
+  int		tiff_length;
+  int		delta_length;
+  int		mode;
+  int		length;
+
+  STPI_ASSERT(privdata->plane < privdata->seed_planes, v);
+  seed = privdata->seed_rows + privdata->plane * privdata->height;
+
+  stp_pack_tiff(v, line, height, comp_buf, &comp_ptr, NULL, NULL);
+  tiff_length = comp_ptr - comp_buf;
+  delta_length = pcl_pack_delta_row(line, seed, height, privdata->delta_buf);
+  if (delta_length + (privdata->compression != 3 ? 2 : 0) <
+      tiff_length + (privdata->compression != 2 ? 2 : 0))
+    {
+      mode = 3;
+      comp_buf = privdata->delta_buf;
+      length = delta_length;
+    }
+  else
+    {
+      mode = 2;
+      length = tiff_length;
+    }
+
+  privdata->tiff_bytes += tiff_length;
+  privdata->sent_bytes += length;
+  if (mode != privdata->compression)
+    {
+      pcl_send_plane(v, mode, comp_buf, length, last_plane);
+      privdata->compression = mode;
+      privdata->sent_bytes += 2;
+    }
+  else
+    pcl_send_plane(v, -1, comp_buf, length, last_plane);
+
+  memcpy(seed, line, height);
+  privdata->plane = last_plane ? 0 : privdata->plane + 1;
 }
 
 
@@ -0,0 +1,442 @@
+/*
+ * "$Id$"
+ *
+ *   Row pipeline: color conversion, dithering and output of each row
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Revision History:
+ *
+ *   See ChangeLog
+ */
+
+/*
+ * Every driver used to run the same loop: fetch and color convert a
+ * source row (scaling the image vertically with an error term), dither
+ * it, and hand the dithered row to the weave or the driver's own
+ * output routine.  That loop lives here now.
+ *
+ * If RenderThreads is greater than 1, the color conversion runs in a
+ * thread of its own, and with 3 or more threads so does dithering.
+ * Each stage works on its own slot of a small ring, so the stages can
+ * be up to PIPELINE_SLOTS rows apart.  The dither state is only ever
+ * touched by one thread, and the rows are produced in the same order
+ * as in the serial loop, so the output is identical; the driver's
+ * output routine still runs in the calling thread, in row order.
+ *
+ * The dither stage takes all of the rows that have been color
+ * converted as one batch, so that with DitherThreads they can be
+ * dithered side by side when the dither algorithm allows it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "dither-impl.h"
+
+#define PIPELINE_SLOTS 8
+
+typedef struct
+{
+  int errdiv;
+  int errmod;
+  int errval;
+  int errlast;
+  int errline;
+  int image_height;
+} pipeline_step_t;
+
+static void
+pipeline_step_init(pipeline_step_t *s, int image_height, int out_height)
+{
+  s->image_height = image_height;
+  s->errdiv  = image_height / out_height;
+  s->errmod  = image_height % out_height;
+  s->errval  = 0;
+  s->errlast = -1;
+  s->errline = 0;
+}
+
+static void
+pipeline_step(pipeline_step_t *s, int out_height)
+{
+  s->errval += s->errmod;
+  s->errline += s->errdiv;
+  if (s->errval >= out_height)
+    {
+      s->errval -= out_height;
+      s->errline ++;
+    }
+}
+
+/*
+ * When the output is shorter than the image, the rows stepped over
+ * are never read; let the image know, so that it can drop them
+ * rather than read them when the next row is requested.  Returns
+ * nonzero if the image aborted.
+ */
+static int
+pipeline_skip_rows(stp_image_t *image, const pipeline_step_t *s, int next)
+{
+  return stp_image_skip_rows(image, s->errlast + 1, next - s->errlast - 1) !=
+    STP_IMAGE_STATUS_OK;
+}
+
+static int
+pipeline_run_serial(stp_vars_t *v, stp_image_t *image,
+		    const stp_row_pipeline_t *p)
+{
+  pipeline_step_t step;
+  unsigned zero_mask = 0;
+  int y;
+  pipeline_step_init(&step, stp_image_height(image), p->out_height);
+  for (y = 0; y < p->out_height; y++)
+    {
+      int duplicate_line = 1;
+      const unsigned char *mask = NULL;
+      if (step.errline != step.errlast)
+	{
+	  if (pipeline_skip_rows(image, &step, step.errline))
+	    return 1;
+	  step.errlast = step.errline;
+	  duplicate_line = 0;
+	  if (stp_color_get_row(v, image, step.errline, &zero_mask))
+	    return 1;
+	}
+      if (p->maskfunc)
+	mask = (p->maskfunc)(v, y, p->data);
+      stp_dither(v, y, duplicate_line, zero_mask, mask);
+      (p->writefunc)(v, y, p->data);
+      pipeline_step(&step, p->out_height);
+    }
+  return pipeline_skip_rows(image, &step, step.image_height);
+}
+
+#ifdef HAVE_PTHREAD
+
+typedef struct
+{
+  int duplicate_line;
+  unsigned zero_mask;
+  unsigned short *input;
+  unsigned char *mask;
+  unsigned char **buffers;
+  int *row_ends;
+} pipeline_slot_t;
+
+typedef struct
+{
+  stp_vars_t *v;
+  stp_image_t *image;
+  const stp_row_pipeline_t *p;
+  stpi_dither_t *d;
+  size_t input_size;
+  pipeline_step_t step;
+  unsigned zero_mask;		/* Carries over to duplicated rows */
+  pipeline_slot_t slots[PIPELINE_SLOTS];
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int colored;			/* Rows handed to the dither stage */
+  int dithered;			/* Rows handed to the output stage */
+  int written;			/* Rows whose slots may be reused */
+  int last_row;			/* Less than out_height if reading failed */
+} pipeline_t;
+
+/*
+ * Wait until *counter passes row, or until row is known to be past
+ * the last row.  Returns 0 in the latter case.
+ */
+static int
+pipeline_wait_for(pipeline_t *pl, const int *counter, int row)
+{
+  int ret;
+  pthread_mutex_lock(&(pl->lock));
+  while (*counter <= row && row < pl->last_row)
+    pthread_cond_wait(&(pl->cond), &(pl->lock));
+  ret = *counter > row;
+  pthread_mutex_unlock(&(pl->lock));
+  return ret;
+}
+
+static void
+pipeline_publish(pipeline_t *pl, int *counter)
+{
+  pthread_mutex_lock(&(pl->lock));
+  (*counter)++;
+  pthread_cond_broadcast(&(pl->cond));
+  pthread_mutex_unlock(&(pl->lock));
+}
+
+static int
+pipeline_color_row(pipeline_t *pl, int y)
+{
+  pipeline_slot_t *slot = &(pl->slots[y % PIPELINE_SLOTS]);
+  slot->duplicate_line = 1;
+  if (pl->step.errline != pl->step.errlast)
+    {
+      if (pipeline_skip_rows(pl->image, &(pl->step), pl->step.errline))
+	return 1;
+      pl->step.errlast = pl->step.errline;
+      slot->duplicate_line = 0;
+      if (stp_color_get_row(pl->v, pl->image, pl->step.errline,
+			    &(pl->zero_mask)))
+	return 1;
+    }
+  slot->zero_mask = pl->zero_mask;
+  memcpy(slot->input, stp_channel_get_output(pl->v), pl->input_size);
+  pipeline_step(&(pl->step), pl->p->out_height);
+  return 0;
+}
+
+/*
+ * Returns the number of rows starting at y that have been color
+ * converted, waiting for at least one of them; 0 if there are none.
+ */
+static int
+pipeline_wait_for_rows(pipeline_t *pl, int y)
+{
+  int ret;
+  if (!pipeline_wait_for(pl, &(pl->colored), y))
+    return 0;
+  pthread_mutex_lock(&(pl->lock));
+  ret = pl->colored - y;
+  pthread_mutex_unlock(&(pl->lock));
+  return ret;
+}
+
+/*
+ * The driver's mask function may reuse its buffer, so the masks are
+ * copied into the slots before any of the rows are dithered.
+ */
+static void
+pipeline_dither_rows(pipeline_t *pl, int y, int nrows)
+{
+  stpi_dither_row_t rows[PIPELINE_SLOTS];
+  int i;
+  for (i = 0; i < nrows; i++)
+    {
+      pipeline_slot_t *slot = &(pl->slots[(y + i) % PIPELINE_SLOTS]);
+      rows[i].input = slot->input;
+      rows[i].duplicate_line = slot->duplicate_line;
+      rows[i].zero_mask = slot->zero_mask;
+      rows[i].mask = NULL;
+      rows[i].buffers = slot->buffers;
+      rows[i].row_ends = slot->row_ends;
+      if (pl->p->maskfunc)
+	{
+	  const unsigned char *mask =
+	    (pl->p->maskfunc)(pl->v, y + i, pl->p->data);
+	  if (mask)
+	    {
+	      memcpy(slot->mask, mask, (pl->d->dst_width + 7) / 8);
+	      rows[i].mask = slot->mask;
+	    }
+	}
+    }
+  stpi_dither_rows(pl->v, y, nrows, rows);
+}
+
+static void *
+pipeline_color_thread(void *arg)
+{
+  pipeline_t *pl = (pipeline_t *) arg;
+  int y;
+  for (y = 0; y < pl->p->out_height; y++)
+    {
+      if (y >= PIPELINE_SLOTS &&
+	  !pipeline_wait_for(pl, &(pl->written), y - PIPELINE_SLOTS))
+	break;
+      if (pipeline_color_row(pl, y))
+	{
+	  pthread_mutex_lock(&(pl->lock));
+	  pl->last_row = y;
+	  pthread_cond_broadcast(&(pl->cond));
+	  pthread_mutex_unlock(&(pl->lock));
+	  break;
+	}
+      pipeline_publish(pl, &(pl->colored));
+    }
+  return NULL;
+}
+
+static void *
+pipeline_dither_thread(void *arg)
+{
+  pipeline_t *pl = (pipeline_t *) arg;
+  int y = 0;
+  while (y < pl->p->out_height)
+    {
+      int nrows = pipeline_wait_for_rows(pl, y);
+      if (nrows == 0)
+	break;
+      pipeline_dither_rows(pl, y, nrows);
+      pthread_mutex_lock(&(pl->lock));
+      pl->dithered += nrows;
+      pthread_cond_broadcast(&(pl->cond));
+      pthread_mutex_unlock(&(pl->lock));
+      y += nrows;
+    }
+  return NULL;
+}
+
+static void
+pipeline_free_slots(pipeline_t *pl)
+{
+  int i;
+  unsigned j;
+  for (i = 0; i < PIPELINE_SLOTS; i++)
+    {
+      pipeline_slot_t *slot = &(pl->slots[i]);
+      if (slot->buffers)
+	{
+	  for (j = 0; j < CHANNEL_COUNT(pl->d); j++)
+	    STP_SAFE_FREE(slot->buffers[j]);
+	  stp_free(slot->buffers);
+	}
+      STP_SAFE_FREE(slot->input);
+      STP_SAFE_FREE(slot->mask);
+      STP_SAFE_FREE(slot->row_ends);
+    }
+}
+
+static int
+pipeline_run_threaded(stp_vars_t *v, stp_image_t *image,
+		      const stp_row_pipeline_t *p, int threads)
+{
+  stpi_dither_t *d = (stpi_dither_t *) stp_get_component_data(v, "Dither");
+  pipeline_t pl;
+  pthread_t color_thread;
+  pthread_t dither_thread;
+  int dither_threaded = 0;
+  int undithered = 0;		/* First row not yet dithered */
+  int status;
+  int i;
+  unsigned j;
+
+  (void) memset(&pl, 0, sizeof(pl));
+  pl.v = v;
+  pl.image = image;
+  pl.p = p;
+  pl.d = d;
+  pl.input_size = d->src_width * CHANNEL_COUNT(d) * sizeof(unsigned short);
+  pl.last_row = p->out_height;
+  pipeline_step_init(&(pl.step), stp_image_height(image), p->out_height);
+  for (i = 0; i < PIPELINE_SLOTS; i++)
+    {
+      pipeline_slot_t *slot = &(pl.slots[i]);
+      slot->input = stp_malloc(pl.input_size);
+      if (p->maskfunc)
+	slot->mask = stp_malloc((d->dst_width + 7) / 8);
+      slot->row_ends = stp_malloc(2 * CHANNEL_COUNT(d) * sizeof(int));
+      slot->buffers = stp_zalloc(CHANNEL_COUNT(d) * sizeof(unsigned char *));
+      for (j = 0; j < CHANNEL_COUNT(d); j++)
+	if (CHANNEL(d, j).ptr)
+	  slot->buffers[j] = stp_malloc(stpi_dither_row_size(d, j));
+    }
+
+  /*
+   * From here until the end, the dither stage writes into the slots,
+   * and stp_dither_get_channel() and friends report the row being
+   * written out.
+   */
+  d->row_buffers = stp_malloc(CHANNEL_COUNT(d) * sizeof(unsigned char *));
+  for (j = 0; j < CHANNEL_COUNT(d); j++)
+    d->row_buffers[j] = CHANNEL(d, j).ptr;
+  d->row_ends = pl.slots[0].row_ends;
+
+  pthread_mutex_init(&(pl.lock), NULL);
+  pthread_cond_init(&(pl.cond), NULL);
+  if (pthread_create(&color_thread, NULL, pipeline_color_thread, &pl) != 0)
+    {
+      stp_dprintf(STP_DBG_COLORFUNC, v,
+		  "stp_row_pipeline_run: cannot create color thread\n");
+      status = -1;
+      goto cleanup;
+    }
+  if (threads > 2 &&
+      pthread_create(&dither_thread, NULL, pipeline_dither_thread, &pl) == 0)
+    dither_threaded = 1;
+
+  for (i = 0; i < p->out_height; i++)
+    {
+      pipeline_slot_t *slot = &(pl.slots[i % PIPELINE_SLOTS]);
+      if (dither_threaded)
+	{
+	  if (!pipeline_wait_for(&pl, &(pl.dithered), i))
+	    break;
+	}
+      else if (i >= undithered)
+	{
+	  int nrows = pipeline_wait_for_rows(&pl, i);
+	  if (nrows == 0)
+	    break;
+	  pipeline_dither_rows(&pl, i, nrows);
+	  undithered = i + nrows;
+	}
+      for (j = 0; j < CHANNEL_COUNT(d); j++)
+	if (d->row_buffers[j])
+	  memcpy(d->row_buffers[j], slot->buffers[j],
+		 stpi_dither_row_size(d, j));
+      d->row_ends = slot->row_ends;
+      (p->writefunc)(v, i, p->data);
+      pipeline_publish(&pl, &(pl.written));
+    }
+
+  pthread_join(color_thread, NULL);
+  if (dither_threaded)
+    pthread_join(dither_thread, NULL);
+  status = pl.last_row < p->out_height;
+  if (!status)
+    status = pipeline_skip_rows(image, &(pl.step), pl.step.image_height);
+
+ cleanup:
+  pthread_cond_destroy(&(pl.cond));
+  pthread_mutex_destroy(&(pl.lock));
+  for (j = 0; j < CHANNEL_COUNT(d); j++)
+    CHANNEL(d, j).ptr = d->row_buffers[j];
+  stp_free(d->row_buffers);
+  d->row_buffers = NULL;
+  d->row_ends = NULL;
+  pipeline_free_slots(&pl);
+  return status;
+}
+#endif /* HAVE_PTHREAD */
+
+int
+stp_row_pipeline_run(stp_vars_t *v, stp_image_t *image,
+		     const stp_row_pipeline_t *pipeline)
+{
+#ifdef HAVE_PTHREAD
+  int threads = 1;
+  if (stp_check_int_parameter(v, "RenderThreads", STP_PARAMETER_ACTIVE))
+    threads = stp_get_int_parameter(v, "RenderThreads");
+  if (threads > 1 && pipeline->out_height > 1)
+    {
+      int status = pipeline_run_threaded(v, image, pipeline, threads);
+      if (status >= 0)
+	return status;
+    }
+#endif
+  return pipeline_run_serial(v, image, pipeline);
+}
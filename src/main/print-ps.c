@@ -40,6 +40,8 @@
 #endif
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "xmlppd.h"
 
 #ifdef _MSC_VER
@@ -51,16 +53,69 @@
  * Local variables...
  */
 
-static char *m_ppd_file = NULL;
-static stp_mxml_node_t *m_ppd = NULL;
+/*
+ * PPD files are shared by every job using them, and kept for later
+ * jobs.  A file is read again if it has changed (its device, inode,
+ * size or modification time differs), and only the PPD_CACHE_SIZE
+ * most recently used files are kept.  Every get_ppd_file() must be
+ * matched by a release_ppd_file(); a PPD file that has been replaced
+ * or dropped is freed once nothing is using it.
+ */
+#define PPD_CACHE_SIZE 8
+
+typedef struct
+{
+  char *filename;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  stp_mxml_node_t *ppd;
+  int users;			/* Calls using the PPD file now */
+  int stale;			/* Replaced or dropped from the cache */
+  unsigned long last_used;
+} ppd_cache_t;
+
+static stp_list_t *ppd_cache = NULL;
+static unsigned long ppd_cache_clock = 0;
 
 
 /*
  * Local functions...
  */
 
+/*
+ * Level 2 image data is passed through an optional compression filter,
+ * and then either encoded as ASCII85 or (if the connection to the
+ * printer passes all 8 bits of every byte) sent as it is.
+ */
+
+#define PS_COMPRESSION_NONE		0
+#define PS_COMPRESSION_RUNLENGTH	1
+#define PS_COMPRESSION_FLATE		2
+
+#define PS_OUTBUF_SIZE 4096
+
+typedef struct ps_deflate ps_deflate_t;
+
+typedef struct
+{
+  const stp_vars_t *v;
+  int compression;
+  int binary;
+  int column;			/* Output column (ASCII85) */
+  int pending;			/* Bytes waiting to make up a group of 4 */
+  unsigned char group[4];
+  unsigned char *packed;	/* Run length encoded row */
+  ps_deflate_t *deflate;
+  int bytes;			/* Bytes waiting in buffer */
+  unsigned char buffer[PS_OUTBUF_SIZE + 8];
+} ps_encoder_t;
+
 static void	ps_hex(const stp_vars_t *, unsigned short *, int);
-static void	ps_ascii85(const stp_vars_t *, unsigned short *, int, int);
+static ps_encoder_t *ps_encoder_create(const stp_vars_t *, int, int, int);
+static void	ps_encode_row(ps_encoder_t *, const unsigned char *, int);
+static void	ps_encoder_destroy(ps_encoder_t *);
 
 static const stp_parameter_t the_parameters[] =
 {
@@ -88,6 +143,19 @@ static const stp_parameter_t the_parameters[] =
     STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_CORE,
     STP_PARAMETER_LEVEL_BASIC, 1, 1, STP_CHANNEL_NONE, 1, 0
   },
+  {
+    "ImageCompression", N_("Image Compression"), "Color=No,Category=Advanced Printer Setup",
+    N_("Compression of the image data sent to the printer"),
+    STP_PARAMETER_TYPE_STRING_LIST, STP_PARAMETER_CLASS_FEATURE,
+    STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
+  },
+  {
+    "BinaryImageData", N_("Binary Image Data"), "Color=No,Category=Advanced Printer Setup",
+    N_("Send the image data as binary rather than text.  "
+       "The connection to the printer must pass all 8 bits of every byte."),
+    STP_PARAMETER_TYPE_BOOLEAN, STP_PARAMETER_CLASS_FEATURE,
+    STP_PARAMETER_LEVEL_ADVANCED, 1, 1, STP_CHANNEL_NONE, 1, 0
+  },
 };
 
 static const int the_parameter_count =
@@ -193,51 +261,143 @@ ppd_whitespace_callback(stp_mxml_node_t *node, int where)
   return 0;
 }
 
-static int
-check_ppd_file(const stp_vars_t *v)
+static void
+ppd_cache_freefunc(void *item)
+{
+  ppd_cache_t *pc = (ppd_cache_t *) item;
+  stp_mxmlDelete(pc->ppd);
+  stp_free(pc->filename);
+  stp_free(pc);
+}
+
+/*
+ * Stop handing out a cached PPD file, and free it if nothing is using
+ * it.  Called with the data lock held.
+ */
+static void
+retire_ppd_file(stp_list_item_t *item)
+{
+  ppd_cache_t *pc = (ppd_cache_t *) stp_list_item_get_data(item);
+  pc->stale = 1;
+  if (pc->users == 0)
+    stp_list_item_destroy(ppd_cache, item);
+}
+
+/*
+ * Return the PPD file named by the PPDFile parameter, or NULL if there
+ * isn't one.  The result must be passed to release_ppd_file().
+ */
+static stp_mxml_node_t *
+get_ppd_file(const stp_vars_t *v)
 {
   const char *ppd_file = stp_get_file_parameter(v, "PPDFile");
+  struct stat sbuf;
+  stp_list_item_t *item;
+  stp_list_item_t *next;
+  stp_list_item_t *oldest = NULL;
+  ppd_cache_t *pc;
+  stp_mxml_node_t *ppd = NULL;
+  int cached = 0;
 
   if (ppd_file == NULL || ppd_file[0] == 0)
     {
       stp_dprintf(STP_DBG_PS, v, "Empty PPD file\n");
-      return 0;
+      return NULL;
     }
-  else if (m_ppd_file && strcmp(m_ppd_file, ppd_file) == 0)
+  if (stat(ppd_file, &sbuf) != 0)
     {
-      stp_dprintf(STP_DBG_PS, v, "Not replacing PPD file %s\n", m_ppd_file);
-      return 1;
+      stp_eprintf(v, "Unable to open PPD file %s\n", ppd_file);
+      return NULL;
     }
-  else
+  stpi_data_lock();
+  if (!ppd_cache)
+    {
+      ppd_cache = stp_list_create();
+      stp_list_set_freefunc(ppd_cache, ppd_cache_freefunc);
+    }
+  for (item = stp_list_get_start(ppd_cache); item && !ppd; item = next)
     {
-      stp_dprintf(STP_DBG_PS, v, "Replacing PPD file %s with %s\n",
-		  m_ppd_file ? m_ppd_file : "(null)",
-		  ppd_file ? ppd_file : "(null)");
-      if (m_ppd != NULL)
-	stp_mxmlDelete(m_ppd);
-      m_ppd = NULL;
-
-      if (m_ppd_file)
-	stp_free(m_ppd_file);
-      m_ppd_file = NULL;
-
-      if ((m_ppd = stpi_xmlppd_read_ppd_file(ppd_file)) == NULL)
+      next = stp_list_item_next(item);
+      pc = (ppd_cache_t *) stp_list_item_get_data(item);
+      if (pc->stale)
+	continue;
+      if (strcmp(pc->filename, ppd_file) != 0)
 	{
-	  stp_eprintf(v, "Unable to open PPD file %s\n", ppd_file);
-	  return 0;
+	  cached++;
+	  if (!oldest || pc->last_used <
+	      ((ppd_cache_t *) stp_list_item_get_data(oldest))->last_used)
+	    oldest = item;
 	}
+      else if (pc->dev == sbuf.st_dev && pc->ino == sbuf.st_ino &&
+	       pc->size == sbuf.st_size && pc->mtime == sbuf.st_mtime)
+	{
+	  stp_dprintf(STP_DBG_PS, v, "Using PPD file %s\n", ppd_file);
+	  pc->users++;
+	  pc->last_used = ++ppd_cache_clock;
+	  ppd = pc->ppd;
+	}
+      else
+	{
+	  stp_dprintf(STP_DBG_PS, v, "PPD file %s has changed\n", ppd_file);
+	  retire_ppd_file(item);
+	}
+    }
+  if (ppd)
+    {
+      stpi_data_unlock();
+      return ppd;
+    }
+  if ((ppd = stpi_xmlppd_read_ppd_file(ppd_file)) == NULL)
+    stp_eprintf(v, "Unable to open PPD file %s\n", ppd_file);
+  else
+    {
+      stp_dprintf(STP_DBG_PS, v, "Reading PPD file %s\n", ppd_file);
       if (stp_get_debug_level() & STP_DBG_PS)
 	{
-	  char *ppd_stuff = stp_mxmlSaveAllocString(m_ppd, ppd_whitespace_callback);
+	  char *ppd_stuff = stp_mxmlSaveAllocString(ppd, ppd_whitespace_callback);
 	  stp_dprintf(STP_DBG_PS, v, "%s", ppd_stuff);
 	  stp_free(ppd_stuff);
 	}
+      if (cached >= PPD_CACHE_SIZE)
+	retire_ppd_file(oldest);
+      pc = stp_malloc(sizeof(ppd_cache_t));
+      pc->filename = stp_strdup(ppd_file);
+      pc->dev = sbuf.st_dev;
+      pc->ino = sbuf.st_ino;
+      pc->size = sbuf.st_size;
+      pc->mtime = sbuf.st_mtime;
+      pc->ppd = ppd;
+      pc->users = 1;
+      pc->stale = 0;
+      pc->last_used = ++ppd_cache_clock;
+      stp_list_item_create(ppd_cache, NULL, pc);
+    }
+  stpi_data_unlock();
+  return ppd;
+}
 
-      m_ppd_file = stp_strdup(ppd_file);
-      return 1;
+static void
+release_ppd_file(stp_mxml_node_t *ppd)
+{
+  stp_list_item_t *item;
+  if (!ppd)
+    return;
+  stpi_data_lock();
+  item = stp_list_get_start(ppd_cache);
+  while (item)
+    {
+      ppd_cache_t *pc = (ppd_cache_t *) stp_list_item_get_data(item);
+      if (pc->ppd == ppd)
+	{
+	  pc->users--;
+	  if (pc->stale && pc->users == 0)
+	    stp_list_item_destroy(ppd_cache, item);
+	  break;
+	}
+      item = stp_list_item_next(item);
     }
-}    
-  
+  stpi_data_unlock();
+}
 
 static stp_parameter_list_t
 ps_list_parameters(const stp_vars_t *v)
@@ -245,22 +405,23 @@ ps_list_parameters(const stp_vars_t *v)
   stp_parameter_list_t *ret = stp_parameter_list_create();
   stp_mxml_node_t *option;
   int i;
-  int status = check_ppd_file(v);
+  stp_mxml_node_t *ppd = get_ppd_file(v);
+  const char *ppd_file = stp_get_file_parameter(v, "PPDFile");
   stp_dprintf(STP_DBG_PS, v, "Adding parameters from %s (%d)\n",
-	      m_ppd_file ? m_ppd_file : "(null)", status);
+	      ppd_file ? ppd_file : "(null)", ppd != NULL);
 
   for (i = 0; i < the_parameter_count; i++)
     stp_parameter_list_add_param(ret, &(the_parameters[i]));
 
-  if (status)
+  if (ppd)
     {
-      int num_options = stpi_xmlppd_find_option_count(m_ppd);
+      int num_options = stpi_xmlppd_find_option_count(ppd);
       stp_dprintf(STP_DBG_PS, v, "Found %d parameters\n", num_options);
       for (i=0; i < num_options; i++)
 	{
 	  /* MEMORY LEAK!!! */
 	  stp_parameter_t *param = stp_malloc(sizeof(stp_parameter_t));
-	  option = stpi_xmlppd_find_option_index(m_ppd, i);
+	  option = stpi_xmlppd_find_option_index(ppd, i);
 	  if (option)
 	    {
 	      ps_option_to_param(param, option);
@@ -277,16 +438,16 @@ ps_list_parameters(const stp_vars_t *v)
 	    }
 	}
     }
+  release_ppd_file(ppd);
   return ret;
 }
 
 static void
 ps_parameters_internal(const stp_vars_t *v, const char *name,
-		       stp_parameter_t *description)
+		       stp_parameter_t *description, stp_mxml_node_t *ppd)
 {
   int		i;
   stp_mxml_node_t *option;
-  int status = 0;
   int num_choices;
   const char *defchoice;
 
@@ -297,8 +458,6 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
   if (name == NULL)
     return;
 
-  status = check_ppd_file(v);
-
   for (i = 0; i < the_parameter_count; i++)
   {
     if (strcmp(name, the_parameters[i].name) == 0)
@@ -310,8 +469,8 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	  {
 	    const char *nickname;
 	    description->bounds.str = stp_string_list_create();
-	    if (m_ppd && stp_mxmlElementGetAttr(m_ppd, "nickname"))
-	      nickname = stp_mxmlElementGetAttr(m_ppd, "nickname");
+	    if (ppd && stp_mxmlElementGetAttr(ppd, "nickname"))
+	      nickname = stp_mxmlElementGetAttr(ppd, "nickname");
 	    else
 	      nickname = _("None; please provide a PPD file");
 	    stp_string_list_add_string(description->bounds.str,
@@ -322,7 +481,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	  }
 	else if (strcmp(name, "PrintingMode") == 0)
 	  {
-	    if (! m_ppd || strcmp(stp_mxmlElementGetAttr(m_ppd, "color"), "1") == 0)
+	    if (! ppd || strcmp(stp_mxmlElementGetAttr(ppd, "color"), "1") == 0)
 	      {
 		description->bounds.str = stp_string_list_create();
 		stp_string_list_add_string
@@ -337,12 +496,41 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	      description->is_active = 0;
 	    return;
 	  }
+	else if (strcmp(name, "ImageCompression") == 0)
+	  {
+	    /* Level 1 has no filters */
+	    if (stp_get_model_id(v) == 0)
+	      return;
+	    description->bounds.str = stp_string_list_create();
+	    stp_string_list_add_string
+	      (description->bounds.str, "None", _("None"));
+	    stp_string_list_add_string
+	      (description->bounds.str, "RunLength", _("Run Length"));
+	    /*
+	     * FlateDecode is only in Level 3, so it's only offered when
+	     * the PPD file says the printer has it.
+	     */
+	    if (ppd && atoi(stp_mxmlElementGetAttr(ppd, "level")) >= 3)
+	      stp_string_list_add_string
+		(description->bounds.str, "Flate", _("Flate (Level 3)"));
+	    description->deflt.str =
+	      stp_string_list_param(description->bounds.str, 0)->name;
+	    description->is_active = 1;
+	    return;
+	  }
+	else if (strcmp(name, "BinaryImageData") == 0)
+	  {
+	    description->deflt.boolean = 0;
+	    if (stp_get_model_id(v) != 0)
+	      description->is_active = 1;
+	    return;
+	  }
       }
   }
 
-  if (!status && strcmp(name, "PageSize") != 0)
+  if (!ppd && strcmp(name, "PageSize") != 0)
     return;
-  if ((option = stpi_xmlppd_find_option_named(m_ppd, name)) == NULL)
+  if ((option = stpi_xmlppd_find_option_named(ppd, name)) == NULL)
   {
     if (strcmp(name, "PageSize") == 0)
       {
@@ -364,7 +552,7 @@ ps_parameters_internal(const stp_vars_t *v, const char *name,
 	char *tmp = stp_malloc(strlen(name) + 4);
 	strcpy(tmp, "Stp");
 	strncat(tmp, name, strlen(name) + 3);
-	if ((option = stpi_xmlppd_find_option_named(m_ppd, tmp)) == NULL)
+	if ((option = stpi_xmlppd_find_option_named(ppd, tmp)) == NULL)
 	  {
 	    stp_dprintf(STP_DBG_PS, v, "no parameter %s", name);
 	    stp_free(tmp);
@@ -419,15 +607,12 @@ static void
 ps_parameters(const stp_vars_t *v, const char *name,
 	      stp_parameter_t *description)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
-  ps_parameters_internal(v, name, description);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_mxml_node_t *ppd;
+  stp_xml_init();
+  ppd = get_ppd_file(v);
+  ps_parameters_internal(v, name, description, ppd);
+  release_ppd_file(ppd);
+  stp_xml_exit();
 }
 
 /*
@@ -440,20 +625,20 @@ ps_media_size_internal(const stp_vars_t *v,		/* I */
 		       int  *height)		/* O - Height in points */
 {
   const char *pagesize = stp_get_string_parameter(v, "PageSize");
-  int status = check_ppd_file(v);
+  stp_mxml_node_t *ppd = get_ppd_file(v);
   if (!pagesize)
     pagesize = "";
 
   stp_dprintf(STP_DBG_PS, v,
 	      "ps_media_size(%d, \'%s\', \'%s\', %p, %p)\n",
-	      stp_get_model_id(v), m_ppd_file, pagesize,
+	      stp_get_model_id(v), stp_get_file_parameter(v, "PPDFile"), pagesize,
 	      (void *) width, (void *) height);
 
   stp_default_media_size(v, width, height);
 
-  if (status)
+  if (ppd)
     {
-      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(m_ppd, pagesize);
+      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(ppd, pagesize);
       if (paper)
 	{
 	  *width = atoi(stp_mxmlElementGetAttr(paper, "width"));
@@ -466,6 +651,7 @@ ps_media_size_internal(const stp_vars_t *v,		/* I */
 	}
     }
 
+  release_ppd_file(ppd);
   stp_dprintf(STP_DBG_PS, v, "dimensions %d %d\n", *width, *height);
   return;
 }
@@ -473,15 +659,9 @@ ps_media_size_internal(const stp_vars_t *v,		/* I */
 static void
 ps_media_size(const stp_vars_t *v, int *width, int *height)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   ps_media_size_internal(v, width, height);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
 }
 
 /*
@@ -498,6 +678,7 @@ ps_imageable_area_internal(const stp_vars_t *v,      /* I */
 {
   int width, height;
   const char *pagesize = stp_get_string_parameter(v, "PageSize");
+  stp_mxml_node_t *ppd;
   if (!pagesize)
     pagesize = "";
 
@@ -508,9 +689,9 @@ ps_imageable_area_internal(const stp_vars_t *v,      /* I */
   *top    = 0;
   *bottom = height;
 
-  if (check_ppd_file(v))
+  if ((ppd = get_ppd_file(v)) != NULL)
     {
-      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(m_ppd, pagesize);
+      stp_mxml_node_t *paper = stpi_xmlppd_find_page_size(ppd, pagesize);
       if (paper)
 	{
 	  double pleft = atoi(stp_mxmlElementGetAttr(paper, "left"));
@@ -526,6 +707,7 @@ ps_imageable_area_internal(const stp_vars_t *v,      /* I */
 	  stp_dprintf(STP_DBG_PS, v, ">>>> l %d r %d b %d t %d h %d w %d\n",
 		      *left, *right, *bottom, *top, height, width);
 	}
+      release_ppd_file(ppd);
     }
 
   if (use_max_area)
@@ -554,15 +736,9 @@ ps_imageable_area(const stp_vars_t *v,      /* I */
                   int  *bottom,		/* O - Bottom position in points */
                   int  *top)		/* O - Top position in points */
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   ps_imageable_area_internal(v, 0, left, right, bottom, top);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
 }
 
 static void
@@ -572,15 +748,9 @@ ps_maximum_imageable_area(const stp_vars_t *v,      /* I */
 			  int  *bottom,	/* O - Bottom position in points */
 			  int  *top)	/* O - Top position in points */
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   ps_imageable_area_internal(v, 1, left, right, bottom, top);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
 }
 
 static void
@@ -613,15 +783,9 @@ ps_describe_resolution_internal(const stp_vars_t *v, int *x, int *y)
 static void
 ps_describe_resolution(const stp_vars_t *v, int *x, int *y)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   ps_describe_resolution_internal(v, x, y);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
 }
 
 static const char *
@@ -644,21 +808,19 @@ ps_describe_output(const stp_vars_t *v)
 static stp_string_list_t *
 ps_external_options(const stp_vars_t *v)
 {
+  stp_mxml_node_t *ppd = get_ppd_file(v);
   stp_parameter_list_t param_list = ps_list_parameters(v);
   stp_string_list_t *answer;
   char *tmp;
   char *ppd_name = NULL;
   int i;
-#ifdef HAVE_LOCALE_H
-  char *locale;
-#endif
   if (! param_list)
-    return NULL;
+    {
+      release_ppd_file(ppd);
+      return NULL;
+    }
   answer = stp_string_list_create();
-#ifdef HAVE_LOCALE_H
-  locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   for (i = 0; i < stp_parameter_list_count(param_list); i++)
     {
       const stp_parameter_t *param = stp_parameter_list_param(param_list, i);
@@ -667,13 +829,13 @@ ps_external_options(const stp_vars_t *v)
       if (desc.is_active)
 	{
 	  stp_mxml_node_t *option;
-	  if (m_ppd &&
-	      (option = stpi_xmlppd_find_option_named(m_ppd, desc.name)) == NULL)
+	  if (ppd &&
+	      (option = stpi_xmlppd_find_option_named(ppd, desc.name)) == NULL)
 	    {
 	      ppd_name = stp_malloc(strlen(desc.name) + 4);
 	      strcpy(ppd_name, "Stp");
 	      strncat(ppd_name, desc.name, strlen(desc.name) + 3);
-	      if ((option = stpi_xmlppd_find_option_named(m_ppd, ppd_name)) == NULL)
+	      if ((option = stpi_xmlppd_find_option_named(ppd, ppd_name)) == NULL)
 		{
 		  stp_dprintf(STP_DBG_PS, v, "no parameter %s", desc.name);
 		  STP_SAFE_FREE(ppd_name);
@@ -763,10 +925,8 @@ ps_external_options(const stp_vars_t *v)
 	}
       stp_parameter_description_destroy(&desc);
     }
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
+  release_ppd_file(ppd);
   return answer;
 }
 
@@ -779,9 +939,13 @@ static void
 ps_print_device_settings(stp_vars_t *v)
 {
   int i;
+  stp_mxml_node_t *ppd = get_ppd_file(v);
   stp_parameter_list_t param_list = ps_list_parameters(v);
   if (! param_list)
-    return;
+    {
+      release_ppd_file(ppd);
+      return;
+    }
   stp_puts("%%BeginSetup\n", v);
   for (i = 0; i < stp_parameter_list_count(param_list); i++)
     {
@@ -813,10 +977,10 @@ ps_print_device_settings(stp_vars_t *v)
 		/* We only include the option's code if it's set to a value other than the default. */
 		if(val && defval && (strcmp(val,defval)!=0))
 		  {
-		    if(m_ppd)
+		    if(ppd)
 		      {
 			/* If we have a PPD xml tree we hunt for the appropriate "option" and "choice"... */
-			stp_mxml_node_t *node=m_ppd;
+			stp_mxml_node_t *node=ppd;
 			node=stp_mxmlFindElement(node,node, "option", "name", desc.name, STP_MXML_DESCEND);
 			if(node)
 			  {
@@ -883,6 +1047,7 @@ ps_print_device_settings(stp_vars_t *v)
     }
   stp_puts("%%EndSetup\n", v);
   stp_parameter_list_destroy(param_list);
+  release_ppd_file(ppd);
 }
 
 /*
@@ -910,18 +1075,28 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
 		paper_height,	/* Height of physical page */
 		out_width,	/* Width of image on page */
 		out_height,	/* Height of image on page */
-		out_channels,	/* Output bytes per pixel */
-		out_ps_height,	/* Output height (Level 2 output) */
-		out_offset;	/* Output offset (Level 2 output) */
+		out_channels;	/* Output bytes per pixel */
   time_t	curtime;	/* Current time of day */
   unsigned	zero_mask;
   int           image_height,
 		image_width;
   int		color_out = 0;
   int		cmyk_out = 0;
+  int		compression = PS_COMPRESSION_NONE;
+  int		binary = 0;
 
   if (print_mode && strcmp(print_mode, "Color") == 0)
     color_out = 1;
+  if (model != 0)
+    {
+      const char *image_compression =
+	stp_get_string_parameter(v, "ImageCompression");
+      if (image_compression && strcmp(image_compression, "RunLength") == 0)
+	compression = PS_COMPRESSION_RUNLENGTH;
+      else if (image_compression && strcmp(image_compression, "Flate") == 0)
+	compression = PS_COMPRESSION_FLATE;
+      binary = stp_get_boolean_parameter(v, "BinaryImageData");
+    }
   if (color_out &&
       input_image_type && (strcmp(input_image_type, "CMYK") == 0 ||
 			   strcmp(input_image_type, "KCMY") == 0))
@@ -976,8 +1151,12 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
   stp_zprintf(v, "%%%%BoundingBox: %d %d %d %d\n",
 	      page_left, paper_height - page_bottom,
 	      page_right, paper_height - page_top);
-  stp_puts("%%DocumentData: Clean7Bit\n", v);
-  stp_zprintf(v, "%%%%LanguageLevel: %d\n", model + 1);
+  if (binary)
+    stp_puts("%%DocumentData: Binary\n", v);
+  else
+    stp_puts("%%DocumentData: Clean7Bit\n", v);
+  stp_zprintf(v, "%%%%LanguageLevel: %d\n",
+	      compression == PS_COMPRESSION_FLATE ? 3 : model + 1);
   stp_puts("%%Pages: 1\n", v);
   stp_puts("%%Orientation: Portrait\n", v);
   stp_puts("%%EndComments\n", v);
@@ -1066,8 +1245,10 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
   }
   else
   {
-    unsigned short *tmp_buf =
-      stp_malloc(sizeof(unsigned short) * (image_width * out_channels + 4));
+    int row_length = image_width * out_channels;
+    unsigned char *row = stp_malloc(row_length);
+    ps_encoder_t *encoder;
+
     if (cmyk_out)
       stp_puts("/DeviceCMYK setcolorspace\n", v);
     else if (color_out)
@@ -1089,7 +1270,14 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
     else
       stp_puts("\t/Decode [ 0 1 ]\n", v);
 
-    stp_puts("\t/DataSource currentfile /ASCII85Decode filter\n", v);
+    stp_puts("\t/DataSource currentfile", v);
+    if (!binary)
+      stp_puts(" /ASCII85Decode filter", v);
+    if (compression == PS_COMPRESSION_RUNLENGTH)
+      stp_puts(" /RunLengthDecode filter", v);
+    else if (compression == PS_COMPRESSION_FLATE)
+      stp_puts(" /FlateDecode filter", v);
+    stp_puts("\n", v);
 
     if ((image_width * 72 / out_width) < 100)
       stp_puts("\t/Interpolate true\n", v);
@@ -1099,58 +1287,34 @@ ps_print_internal(stp_vars_t *v, stp_image_t *image)
     stp_puts(">>\n", v);
     stp_puts("image\n", v);
 
-    for (y = 0, out_offset = 0; y < image_height; y ++)
+    encoder = ps_encoder_create(v, compression, binary, row_length);
+    for (y = 0; y < image_height; y ++)
     {
-      unsigned short *where;
-      /* FIXME!!! */
-      if (stp_color_get_row(v, image, y /*, out + out_offset */ , &zero_mask))
+      int x;
+      if (stp_color_get_row(v, image, y, &zero_mask))
 	{
 	  status = 2;
 	  break;
 	}
       out = stp_channel_get_input(v);
-      if (out_offset > 0)
-	{
-	  memcpy(tmp_buf + out_offset, out,
-		 image_width * out_channels * sizeof(unsigned short));
-	  where = tmp_buf;
-	}
-      else
-	where = out;
 
       /* Convert from KCMY to CMYK */
       if (cmyk_out)
-	{
-	  int x;
-	  unsigned short *pos = where;
-	  for (x = 0; x < image_width; x++, pos += 4)
-	    {
-	      unsigned short p0 = pos[0];
-	      pos[0] = pos[1];
-	      pos[1] = pos[2];
-	      pos[2] = pos[3];
-	      pos[3] = p0;
-	    }
-	}
-
-      out_ps_height = out_offset + image_width * out_channels;
-
-      if (y < (image_height - 1))
-      {
-	ps_ascii85(v, where, out_ps_height & ~3, 0);
-        out_offset = out_ps_height & 3;
-      }
+	for (x = 0; x < row_length; x += 4)
+	  {
+	    row[x] = out[x + 1] >> 8;
+	    row[x + 1] = out[x + 2] >> 8;
+	    row[x + 2] = out[x + 3] >> 8;
+	    row[x + 3] = out[x] >> 8;
+	  }
       else
-      {
-        ps_ascii85(v, where, out_ps_height, 1);
-        out_offset = 0;
-      }
+	for (x = 0; x < row_length; x++)
+	  row[x] = out[x] >> 8;
 
-      if (out_offset > 0)
-        memcpy(tmp_buf, where + out_ps_height - out_offset,
-	       out_offset * sizeof(unsigned short));
+      ps_encode_row(encoder, row, row_length);
     }
-    stp_free(tmp_buf);
+    ps_encoder_destroy(encoder);
+    stp_free(row);
   }
   stp_image_conclude(image);
 
@@ -1165,9 +1329,6 @@ static int
 ps_print(const stp_vars_t *v, stp_image_t *image)
 {
   int status;
-#ifdef HAVE_LOCALE_H
-  char *locale;
-#endif
   stp_vars_t *nv = stp_vars_create_copy(v);
   stp_prune_inactive_options(nv);
   if (!stp_verify(nv))
@@ -1175,15 +1336,9 @@ ps_print(const stp_vars_t *v, stp_image_t *image)
       stp_eprintf(nv, "Print options not verified; cannot print.\n");
       return 0;
     }
-#ifdef HAVE_LOCALE_H
-  locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   status = ps_print_internal(nv, image);
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
   stp_vars_destroy(nv);
   return status;
 }
@@ -1199,6 +1354,7 @@ ps_hex(const stp_vars_t *v,	/* I - File to print to */
        int              length)	/* I - Number of bytes to print */
 {
   int		col;		/* Current column */
+  char		line[75];	/* Line of hex chars */
   static const char	*hex = "0123456789ABCDEF";
 
   col = 0;
@@ -1206,118 +1362,516 @@ ps_hex(const stp_vars_t *v,	/* I - File to print to */
   {
     unsigned char pixel = (*data & 0xff00) >> 8;
    /*
-    * Put the hex chars out to the file; note that we don't use stp_zprintf()
-    * for speed reasons...
+    * Build up a line of hex chars, and write the line at once; note
+    * that we don't use stp_zprintf() for speed reasons...
     */
 
-    stp_putc(hex[pixel >> 4], v);
-    stp_putc(hex[pixel & 15], v);
+    line[col++] = hex[pixel >> 4];
+    line[col++] = hex[pixel & 15];
 
     data ++;
     length --;
 
-    col += 2;
     if (col >= 72)
     {
+      line[col++] = '\n';
+      stp_zfwrite(line, col, 1, v);
       col = 0;
-      stp_putc('\n', v);
     }
   }
 
   if (col > 0)
-    stp_putc('\n', v);
+  {
+    line[col++] = '\n';
+    stp_zfwrite(line, col, 1, v);
+  }
 }
 
 
 /*
- * 'ps_ascii85()' - Print binary data as a series of base-85 numbers.
+ * Flate (zlib format) compression.  This is a simple compressor: it
+ * finds matches in the last 32K of data with a hash table, takes the
+ * longest match found in a limited search, and sends everything in
+ * blocks using the fixed Huffman codes.  That gets most of the benefit
+ * for image data, where the row above is usually the best match.  The
+ * core library builds with nothing but standard C and links no other
+ * libraries, so this is done here rather than with zlib; zlib's
+ * inflate() reads what this writes.
  */
 
-static void
-ps_ascii85(const stp_vars_t *v,	/* I - File to print to */
-	   unsigned short *data,	/* I - Data to print */
-	   int            length,	/* I - Number of bytes to print */
-	   int            last_line)	/* I - Last line of raster data? */
+#define DEFLATE_WINDOW		32768
+#define DEFLATE_HASH_SIZE	32768
+#define DEFLATE_MIN_MATCH	3
+#define DEFLATE_MAX_MATCH	258
+#define DEFLATE_MAX_CHAIN	64
+
+#define DEFLATE_HASH(p) \
+  ((((p)[0] << 10) ^ ((p)[1] << 5) ^ (p)[2]) & (DEFLATE_HASH_SIZE - 1))
+
+struct ps_deflate
+{
+  unsigned char window[2 * DEFLATE_WINDOW];
+  int head[DEFLATE_HASH_SIZE];	/* Latest position with each hash */
+  int prev[DEFLATE_WINDOW];	/* Previous position with the same hash */
+  int end;			/* Bytes in the window */
+  int pos;			/* Next byte to compress */
+  unsigned long bits;		/* Bits not yet output */
+  int nbits;
+  unsigned long adler_a;	/* Adler-32 checksum of the input */
+  unsigned long adler_b;
+  int out_bytes;
+  unsigned char out[512];
+};
+
+static const unsigned short deflate_length_base[29] =
 {
-  int		i;			/* Looping var */
-  unsigned	b;			/* Binary data word */
-  unsigned char	c[5];			/* ASCII85 encoded chars */
-  static int	column = 0;		/* Current column */
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
 
-#define OUTBUF_SIZE 4096
-  unsigned char outbuffer[OUTBUF_SIZE+10];
-  int outp=0;
+static const unsigned char deflate_length_extra[29] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
 
-  while (length > 3)
-  {
-    unsigned char d0 = (data[0] & 0xff00) >> 8;
-    unsigned char d1 = (data[1] & 0xff00) >> 8;
-    unsigned char d2 = (data[2] & 0xff00) >> 8;
-    unsigned char d3 = (data[3] & 0xff00) >> 8;
-    b = (((((d0 << 8) | d1) << 8) | d2) << 8) | d3;
+static const unsigned short deflate_distance_base[30] =
+{
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+  16385, 24577
+};
+
+static const unsigned char deflate_distance_extra[30] =
+{
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void ps_output(ps_encoder_t *, const unsigned char *, int);
+
+/*
+ * Output bits, least significant first.
+ */
+static void
+deflate_put_bits(ps_encoder_t *encoder, unsigned value, int count)
+{
+  ps_deflate_t *d = encoder->deflate;
+  d->bits |= (unsigned long) value << d->nbits;
+  d->nbits += count;
+  while (d->nbits >= 8)
+    {
+      d->out[d->out_bytes++] = d->bits & 0xff;
+      d->bits >>= 8;
+      d->nbits -= 8;
+      if (d->out_bytes == sizeof(d->out))
+	{
+	  ps_output(encoder, d->out, d->out_bytes);
+	  d->out_bytes = 0;
+	}
+    }
+}
 
-    if (b == 0)
+/*
+ * Output a Huffman code, which goes most significant bit first.
+ */
+static void
+deflate_put_code(ps_encoder_t *encoder, unsigned code, int length)
+{
+  unsigned reversed = 0;
+  int i;
+  for (i = 0; i < length; i++)
     {
-      outbuffer[outp++]='z';
-      column ++;
+      reversed = (reversed << 1) | (code & 1);
+      code >>= 1;
     }
-    else
+  deflate_put_bits(encoder, reversed, length);
+}
+
+static void
+deflate_put_symbol(ps_encoder_t *encoder, int symbol)
+{
+  if (symbol < 144)
+    deflate_put_code(encoder, 0x30 + symbol, 8);
+  else if (symbol < 256)
+    deflate_put_code(encoder, 0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    deflate_put_code(encoder, symbol - 256, 7);
+  else
+    deflate_put_code(encoder, 0xc0 + symbol - 280, 8);
+}
+
+static void
+deflate_put_match(ps_encoder_t *encoder, int length, int distance)
+{
+  int i = 28;
+  while (deflate_length_base[i] > length)
+    i--;
+  deflate_put_symbol(encoder, 257 + i);
+  deflate_put_bits(encoder, length - deflate_length_base[i],
+		   deflate_length_extra[i]);
+  i = 29;
+  while (deflate_distance_base[i] > distance)
+    i--;
+  deflate_put_code(encoder, i, 5);
+  deflate_put_bits(encoder, distance - deflate_distance_base[i],
+		   deflate_distance_extra[i]);
+}
+
+static void
+deflate_insert(ps_deflate_t *d, int pos)
+{
+  if (pos + DEFLATE_MIN_MATCH <= d->end)
     {
-      outbuffer[outp+4] = (b % 85) + '!';
-      b /= 85;
-      outbuffer[outp+3] = (b % 85) + '!';
-      b /= 85;
-      outbuffer[outp+2] = (b % 85) + '!';
-      b /= 85;
-      outbuffer[outp+1] = (b % 85) + '!';
-      b /= 85;
-      outbuffer[outp] = b + '!';
+      int hash = DEFLATE_HASH(d->window + pos);
+      d->prev[pos & (DEFLATE_WINDOW - 1)] = d->head[hash];
+      d->head[hash] = pos;
+    }
+}
 
-      outp+=5;
-      column += 5;
+/*
+ * Compress the data in the window, leaving enough unless this is the
+ * end of the data to be sure of finding the longest match.
+ */
+static void
+deflate_compress(ps_encoder_t *encoder, int flush)
+{
+  ps_deflate_t *d = encoder->deflate;
+  while (d->pos < d->end &&
+	 (flush || d->end - d->pos >= DEFLATE_MAX_MATCH))
+    {
+      const unsigned char *here = d->window + d->pos;
+      int max_length = d->end - d->pos;
+      int best_length = 0;
+      int best_distance = 0;
+      int i;
+
+      if (max_length > DEFLATE_MAX_MATCH)
+	max_length = DEFLATE_MAX_MATCH;
+      if (max_length >= DEFLATE_MIN_MATCH)
+	{
+	  int candidate = d->head[DEFLATE_HASH(here)];
+	  int limit = d->pos - DEFLATE_WINDOW;
+	  int chain = DEFLATE_MAX_CHAIN;
+	  while (candidate >= 0 && candidate >= limit && chain-- > 0)
+	    {
+	      const unsigned char *there = d->window + candidate;
+	      if (there[best_length] == here[best_length])
+		{
+		  int length = 0;
+		  while (length < max_length && there[length] == here[length])
+		    length++;
+		  if (length > best_length)
+		    {
+		      best_length = length;
+		      best_distance = d->pos - candidate;
+		      if (length == max_length)
+			break;
+		    }
+		}
+	      candidate = d->prev[candidate & (DEFLATE_WINDOW - 1)];
+	    }
+	}
+      if (best_length >= DEFLATE_MIN_MATCH)
+	{
+	  deflate_put_match(encoder, best_length, best_distance);
+	  for (i = 0; i < best_length; i++)
+	    deflate_insert(d, d->pos + i);
+	  d->pos += best_length;
+	}
+      else
+	{
+	  deflate_put_symbol(encoder, *here);
+	  deflate_insert(d, d->pos);
+	  d->pos++;
+	}
     }
+}
+
+/*
+ * Move the second half of the window to the first, forgetting
+ * positions that drop out of it.
+ */
+static void
+deflate_slide(ps_deflate_t *d)
+{
+  int i;
+  memmove(d->window, d->window + DEFLATE_WINDOW, d->end - DEFLATE_WINDOW);
+  d->end -= DEFLATE_WINDOW;
+  d->pos -= DEFLATE_WINDOW;
+  for (i = 0; i < DEFLATE_HASH_SIZE; i++)
+    d->head[i] = d->head[i] >= DEFLATE_WINDOW ? d->head[i] - DEFLATE_WINDOW : -1;
+  for (i = 0; i < DEFLATE_WINDOW; i++)
+    d->prev[i] = d->prev[i] >= DEFLATE_WINDOW ? d->prev[i] - DEFLATE_WINDOW : -1;
+}
 
-    if (column > 72)
+static void
+deflate_start(ps_encoder_t *encoder)
+{
+  ps_deflate_t *d = stp_malloc(sizeof(ps_deflate_t));
+  int i;
+  for (i = 0; i < DEFLATE_HASH_SIZE; i++)
+    d->head[i] = -1;
+  d->end = 0;
+  d->pos = 0;
+  d->bits = 0;
+  d->nbits = 0;
+  d->adler_a = 1;
+  d->adler_b = 0;
+  d->out_bytes = 0;
+  encoder->deflate = d;
+  /* zlib header (deflate, 32K window), then a block with fixed codes */
+  deflate_put_bits(encoder, 0x78, 8);
+  deflate_put_bits(encoder, 0x01, 8);
+  deflate_put_bits(encoder, 2, 3);
+}
+
+static void
+deflate_write(ps_encoder_t *encoder, const unsigned char *data, int length)
+{
+  ps_deflate_t *d = encoder->deflate;
+  const unsigned char *p = data;
+  int remaining = length;
+
+  while (remaining > 0)
     {
-      outbuffer[outp++]='\n';
-      column = 0;
+      int n = remaining < 5552 ? remaining : 5552;
+      remaining -= n;
+      while (n-- > 0)
+	{
+	  d->adler_a += *p++;
+	  d->adler_b += d->adler_a;
+	}
+      d->adler_a %= 65521;
+      d->adler_b %= 65521;
     }
 
-    if(outp>=OUTBUF_SIZE)
+  while (length > 0)
+    {
+      int n = 2 * DEFLATE_WINDOW - d->end;
+      if (n == 0)
 	{
-		stp_zfwrite((const char *)outbuffer, outp, 1, v);
-		outp=0;
+	  deflate_slide(d);
+	  n = 2 * DEFLATE_WINDOW - d->end;
 	}
+      if (n > length)
+	n = length;
+      memcpy(d->window + d->end, data, n);
+      d->end += n;
+      data += n;
+      length -= n;
+      deflate_compress(encoder, 0);
+    }
+}
 
-    data += 4;
-    length -= 4;
+static void
+deflate_finish(ps_encoder_t *encoder)
+{
+  ps_deflate_t *d = encoder->deflate;
+  unsigned long adler;
+  deflate_compress(encoder, 1);
+  deflate_put_symbol(encoder, 256);	/* End of block */
+  deflate_put_bits(encoder, 3, 3);	/* Final block, fixed codes... */
+  deflate_put_symbol(encoder, 256);	/* ...which is empty */
+  if (d->nbits > 0)
+    deflate_put_bits(encoder, 0, 8 - d->nbits);
+  adler = (d->adler_b << 16) | d->adler_a;
+  deflate_put_bits(encoder, (adler >> 24) & 0xff, 8);
+  deflate_put_bits(encoder, (adler >> 16) & 0xff, 8);
+  deflate_put_bits(encoder, (adler >> 8) & 0xff, 8);
+  deflate_put_bits(encoder, adler & 0xff, 8);
+  ps_output(encoder, d->out, d->out_bytes);
+  stp_free(d);
+  encoder->deflate = NULL;
+}
+
+
+/*
+ * 'ps_ascii85_group()' - Encode a group of 4 bytes as base-85 chars.
+ */
+
+static void
+ps_ascii85_group(ps_encoder_t *encoder, const unsigned char *data)
+{
+  unsigned char *out = encoder->buffer + encoder->bytes;
+  unsigned b = ((unsigned) data[0] << 24) | ((unsigned) data[1] << 16) |
+    ((unsigned) data[2] << 8) | data[3];
+
+  if (b == 0)
+  {
+    out[0] = 'z';
+    encoder->bytes ++;
+    encoder->column ++;
+  }
+  else
+  {
+    out[4] = (b % 85) + '!';
+    b /= 85;
+    out[3] = (b % 85) + '!';
+    b /= 85;
+    out[2] = (b % 85) + '!';
+    b /= 85;
+    out[1] = (b % 85) + '!';
+    b /= 85;
+    out[0] = b + '!';
+
+    encoder->bytes += 5;
+    encoder->column += 5;
+  }
+
+  if (encoder->column > 72)
+  {
+    encoder->buffer[encoder->bytes++] = '\n';
+    encoder->column = 0;
   }
 
-  if(outp)
-    stp_zfwrite((const char *)outbuffer, outp, 1, v);
+  if (encoder->bytes >= PS_OUTBUF_SIZE)
+  {
+    stp_zfwrite((const char *) encoder->buffer, encoder->bytes, 1, encoder->v);
+    encoder->bytes = 0;
+  }
+}
+
 
-  if (last_line)
+/*
+ * 'ps_output()' - Output (compressed) data, encoded as ASCII85 unless
+ *                 it's being sent as binary.  ASCII85 is encoded in
+ *                 whole groups of 4 bytes; any left over are kept until
+ *                 the next call.
+ */
+
+static void
+ps_output(ps_encoder_t *encoder,	/* I - Encoder */
+	  const unsigned char *data,	/* I - Data to print */
+	  int length)			/* I - Number of bytes to print */
+{
+  if (encoder->binary)
+  {
+    stp_zfwrite((const char *) data, length, 1, encoder->v);
+    return;
+  }
+
+  if (encoder->pending > 0)
   {
-    if (length > 0)
+    while (encoder->pending < 4 && length > 0)
     {
-      for (b = 0, i = length; i > 0; b = (b << 8) | data[0], data ++, i --);
+      encoder->group[encoder->pending++] = *data++;
+      length --;
+    }
+    if (encoder->pending < 4)
+      return;
+    ps_ascii85_group(encoder, encoder->group);
+    encoder->pending = 0;
+  }
+
+  for (; length >= 4; data += 4, length -= 4)
+    ps_ascii85_group(encoder, data);
 
-      c[4] = (b % 85) + '!';
+  memcpy(encoder->group, data, length);
+  encoder->pending = length;
+}
+
+
+/*
+ * 'ps_encoder_create()' - Set up to send image data.
+ */
+
+static ps_encoder_t *
+ps_encoder_create(const stp_vars_t *v,	/* I - File to print to */
+		  int compression,	/* I - PS_COMPRESSION_* */
+		  int binary,		/* I - Send binary data? */
+		  int row_length)	/* I - Longest row to be sent */
+{
+  ps_encoder_t *encoder = stp_zalloc(sizeof(ps_encoder_t));
+  encoder->v = v;
+  encoder->compression = compression;
+  encoder->binary = binary;
+  if (compression == PS_COMPRESSION_RUNLENGTH)
+    encoder->packed = stp_malloc(row_length + (row_length + 127) / 128 + 1);
+  else if (compression == PS_COMPRESSION_FLATE)
+    deflate_start(encoder);
+  return encoder;
+}
+
+
+/*
+ * 'ps_encode_row()' - Send a row of image data.
+ */
+
+static void
+ps_encode_row(ps_encoder_t *encoder,	/* I - Encoder */
+	      const unsigned char *data,	/* I - Data to print */
+	      int length)		/* I - Number of bytes to print */
+{
+  unsigned char *packed_end;
+
+  switch (encoder->compression)
+  {
+  case PS_COMPRESSION_RUNLENGTH:
+    /* RunLengthDecode takes the same runs as TIFF PackBits */
+    stp_pack_tiff((stp_vars_t *) encoder->v, data, length, encoder->packed,
+		  &packed_end, NULL, NULL);
+    ps_output(encoder, encoder->packed, packed_end - encoder->packed);
+    break;
+  case PS_COMPRESSION_FLATE:
+    deflate_write(encoder, data, length);
+    break;
+  default:
+    ps_output(encoder, data, length);
+    break;
+  }
+}
+
+
+/*
+ * 'ps_encoder_destroy()' - Finish the image data, and free the encoder.
+ */
+
+static void
+ps_encoder_destroy(ps_encoder_t *encoder)	/* I - Encoder */
+{
+  static const unsigned char eod = 128;
+
+  if (encoder->compression == PS_COMPRESSION_RUNLENGTH)
+    ps_output(encoder, &eod, 1);
+  else if (encoder->compression == PS_COMPRESSION_FLATE)
+    deflate_finish(encoder);
+
+  if (encoder->binary)
+    stp_putc('\n', encoder->v);
+  else
+  {
+    if (encoder->pending > 0)
+    {
+     /*
+      * Pad the last group with zeros, and send one more char than
+      * there are bytes in it.  It's never abbreviated to 'z'.
+      */
+      unsigned b;
+      unsigned char *out = encoder->buffer + encoder->bytes;
+      memset(encoder->group + encoder->pending, 0, 4 - encoder->pending);
+      b = ((unsigned) encoder->group[0] << 24) |
+	((unsigned) encoder->group[1] << 16) |
+	((unsigned) encoder->group[2] << 8) | encoder->group[3];
+      out[4] = (b % 85) + '!';
       b /= 85;
-      c[3] = (b % 85) + '!';
+      out[3] = (b % 85) + '!';
       b /= 85;
-      c[2] = (b % 85) + '!';
+      out[2] = (b % 85) + '!';
       b /= 85;
-      c[1] = (b % 85) + '!';
+      out[1] = (b % 85) + '!';
       b /= 85;
-      c[0] = b + '!';
-
-      stp_zfwrite((const char *)c, length + 1, 1, v);
+      out[0] = b + '!';
+      encoder->bytes += encoder->pending + 1;
     }
-
-    stp_puts("~>\n", v);
-    column = 0;
+    if (encoder->bytes > 0)
+      stp_zfwrite((const char *) encoder->buffer, encoder->bytes, 1,
+		  encoder->v);
+    stp_puts("~>\n", encoder->v);
   }
+
+  STP_SAFE_FREE(encoder->packed);
+  stp_free(encoder);
 }
 
 
@@ -0,0 +1,193 @@
+/*
+ * "$Id$"
+ *
+ *   Worker thread pool
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Revision History:
+ *
+ *   See ChangeLog
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+struct stpi_thread_pool
+{
+  int nthreads;
+#ifdef HAVE_PTHREAD
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;	/* Signalled when there are tasks to run */
+  pthread_cond_t done_cond;	/* Signalled when the last task finishes */
+  stpi_thread_task_t *func;
+  void *data;
+  int ntasks;
+  int next_task;
+  int tasks_done;
+  int shutdown;
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+/*
+ * Run tasks until there are none left to start.  Called with the lock
+ * held, and returns with it held.
+ */
+static void
+run_tasks(stpi_thread_pool_t *pool)
+{
+  while (pool->next_task < pool->ntasks)
+    {
+      int task = pool->next_task++;
+      stpi_thread_task_t *func = pool->func;
+      void *data = pool->data;
+      pthread_mutex_unlock(&(pool->lock));
+      (func)(data, task);
+      pthread_mutex_lock(&(pool->lock));
+      if (++pool->tasks_done == pool->ntasks)
+	pthread_cond_signal(&(pool->done_cond));
+    }
+}
+
+static void *
+worker(void *arg)
+{
+  stpi_thread_pool_t *pool = (stpi_thread_pool_t *) arg;
+  pthread_mutex_lock(&(pool->lock));
+  while (!pool->shutdown)
+    {
+      if (pool->next_task < pool->ntasks)
+	run_tasks(pool);
+      else
+	pthread_cond_wait(&(pool->work_cond), &(pool->lock));
+    }
+  pthread_mutex_unlock(&(pool->lock));
+  return NULL;
+}
+#endif
+
+stpi_thread_pool_t *
+stpi_thread_pool_create(int threads)
+{
+  stpi_thread_pool_t *pool = stp_zalloc(sizeof(stpi_thread_pool_t));
+#ifdef HAVE_PTHREAD
+  int i;
+  pthread_mutex_init(&(pool->lock), NULL);
+  pthread_cond_init(&(pool->work_cond), NULL);
+  pthread_cond_init(&(pool->done_cond), NULL);
+  /* The calling thread is one of the workers */
+  if (threads > 1)
+    pool->threads = stp_malloc((threads - 1) * sizeof(pthread_t));
+  for (i = 0; i < threads - 1; i++)
+    {
+      if (pthread_create(&(pool->threads[i]), NULL, worker, pool) != 0)
+	break;
+      pool->nthreads++;
+    }
+#endif
+  return pool;
+}
+
+void
+stpi_thread_pool_destroy(stpi_thread_pool_t *pool)
+{
+#ifdef HAVE_PTHREAD
+  int i;
+  pthread_mutex_lock(&(pool->lock));
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&(pool->work_cond));
+  pthread_mutex_unlock(&(pool->lock));
+  for (i = 0; i < pool->nthreads; i++)
+    pthread_join(pool->threads[i], NULL);
+  STP_SAFE_FREE(pool->threads);
+  pthread_cond_destroy(&(pool->done_cond));
+  pthread_cond_destroy(&(pool->work_cond));
+  pthread_mutex_destroy(&(pool->lock));
+#endif
+  stp_free(pool);
+}
+
+void
+stpi_thread_pool_run(stpi_thread_pool_t *pool, int ntasks,
+		     stpi_thread_task_t *func, void *data)
+{
+#ifdef HAVE_PTHREAD
+  if (pool->nthreads > 0 && ntasks > 1)
+    {
+      pthread_mutex_lock(&(pool->lock));
+      pool->func = func;
+      pool->data = data;
+      pool->ntasks = ntasks;
+      pool->next_task = 0;
+      pool->tasks_done = 0;
+      pthread_cond_broadcast(&(pool->work_cond));
+      run_tasks(pool);
+      while (pool->tasks_done < pool->ntasks)
+	pthread_cond_wait(&(pool->done_cond), &(pool->lock));
+      pool->ntasks = 0;
+      pool->next_task = 0;
+      pthread_mutex_unlock(&(pool->lock));
+    }
+  else
+#endif
+    {
+      int i;
+      for (i = 0; i < ntasks; i++)
+	(func)(data, i);
+    }
+}
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t data_lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t data_lock;
+
+static void
+init_data_lock(void)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&data_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+#endif
+
+void
+stpi_data_lock(void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_once(&data_lock_once, init_data_lock);
+  pthread_mutex_lock(&data_lock);
+#endif
+}
+
+void
+stpi_data_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&data_lock);
+#endif
+}
@@ -45,7 +45,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "generic-options.h"
+#include "color-kernels.h"
 
 #define FMIN(a, b) ((a) < (b) ? (a) : (b))
 
@@ -86,13 +90,182 @@ typedef struct
     }									\
 }
 
+/*
+ * Drivers write a great deal of output a few bytes at a time (a single
+ * pixel, or a command byte), so rather than calling the output function
+ * for each write, output is collected here and passed on in larger
+ * blocks.  The buffer belongs to the stp_vars_t passed to stp_print()
+ * and friends, and is shared with every copy of it that the driver
+ * makes, so output written through any of them stays in order.  Outside
+ * of those calls (when the application may be writing to the same
+ * stream itself), or if the output function is changed, writes are
+ * passed straight through.
+ *
+ * The buffer size may be set with STP_OUTPUT_BUFFER_SIZE; 0 disables
+ * buffering.
+ */
+
+#define STPI_OUTPUT_BUFFER_SIZE 65536
+
+struct stpi_output_buffer
+{
+  int refcount;
+  int active;			/* Nesting depth of stpi_start_output() */
+  stp_outfunc_t outfunc;	/* Destination of the buffered data */
+  void *outdata;
+  char *data;
+  size_t size;
+  size_t bytes;
+  size_t calls;			/* Calls to the output function */
+  size_t total_bytes;		/* Bytes passed to the output function */
+};
+
+static size_t output_buffer_size = STPI_OUTPUT_BUFFER_SIZE;
+
+static void
+init_output_buffer_size(void)
+{
+  const char *size = getenv("STP_OUTPUT_BUFFER_SIZE");
+  if (size)
+    output_buffer_size = strtoul(size, NULL, 0);
+}
+
+static void
+flush_output_buffer(stpi_output_buffer_t *ob)
+{
+  if (ob->bytes > 0)
+    {
+      (ob->outfunc)(ob->outdata, ob->data, ob->bytes);
+      ob->calls++;
+      ob->total_bytes += ob->bytes;
+      ob->bytes = 0;
+    }
+}
+
+stpi_output_buffer_t *
+stpi_output_buffer_ref(stpi_output_buffer_t *ob)
+{
+  if (ob)
+    ob->refcount++;
+  return ob;
+}
+
+void
+stpi_output_buffer_release(stpi_output_buffer_t *ob)
+{
+  if (--ob->refcount == 0)
+    {
+      flush_output_buffer(ob);
+      STP_SAFE_FREE(ob->data);
+      stp_free(ob);
+    }
+}
+
+void
+stpi_start_output(const stp_vars_t *v, int new_job)
+{
+  stpi_output_buffer_t *ob = stpi_vars_get_output_buffer(v);
+  if (!ob)
+    {
+      ob = stp_zalloc(sizeof(stpi_output_buffer_t));
+      ob->refcount = 1;
+      ob->size = output_buffer_size;
+      if (ob->size > 0)
+	ob->data = stp_malloc(ob->size);
+      stpi_vars_set_output_buffer((stp_vars_t *) v, ob);
+    }
+  if (new_job)
+    {
+      flush_output_buffer(ob);
+      ob->calls = 0;
+      ob->total_bytes = 0;
+    }
+  ob->active++;
+}
+
+void
+stpi_end_output(const stp_vars_t *v)
+{
+  stpi_output_buffer_t *ob = stpi_vars_get_output_buffer(v);
+  if (ob)
+    {
+      flush_output_buffer(ob);
+      if (ob->active > 0)
+	ob->active--;
+    }
+}
+
+void
+stp_flush_output(const stp_vars_t *v)
+{
+  stpi_output_buffer_t *ob = stpi_vars_get_output_buffer(v);
+  if (ob)
+    flush_output_buffer(ob);
+}
+
+void
+stp_get_output_statistics(const stp_vars_t *v, size_t *calls, size_t *bytes)
+{
+  stpi_output_buffer_t *ob = stpi_vars_get_output_buffer(v);
+  if (calls)
+    *calls = ob ? ob->calls : 0;
+  if (bytes)
+    *bytes = ob ? ob->total_bytes : 0;
+}
+
+static void
+write_output(const stp_vars_t *v, const char *buf, size_t bytes)
+{
+  stpi_output_buffer_t *ob = stpi_vars_get_output_buffer(v);
+  stp_outfunc_t outfunc = stp_get_outfunc(v);
+  void *outdata = stp_get_outdata(v);
+  if (!ob)
+    {
+      (outfunc)(outdata, buf, bytes);
+      return;
+    }
+  if (ob->outfunc != outfunc || ob->outdata != outdata)
+    {
+      flush_output_buffer(ob);
+      ob->outfunc = outfunc;
+      ob->outdata = outdata;
+    }
+  if (!ob->active || ob->bytes + bytes > ob->size)
+    flush_output_buffer(ob);
+  if (!ob->active || bytes >= ob->size)
+    {
+      (outfunc)(outdata, buf, bytes);
+      ob->calls++;
+      ob->total_bytes += bytes;
+    }
+  else
+    {
+      memcpy(ob->data + ob->bytes, buf, bytes);
+      ob->bytes += bytes;
+    }
+}
+
 void
 stp_zprintf(const stp_vars_t *v, const char *format, ...)
 {
+  /*
+   * Almost everything printed here is a short command, so try to
+   * format it on the stack before resorting to the heap.
+   */
+  char buf[STP_COMMAND_BUFFER_SIZE];
   char *result;
   int bytes;
+  va_list args;
+  va_start(args, format);
+  bytes = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (bytes >= 0 && (size_t) bytes < sizeof(buf))
+    {
+      write_output(v, buf, bytes);
+      return;
+    }
   STPI_VASPRINTF(result, bytes, format);
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), result, bytes);
+  write_output(v, result, bytes);
   stp_free(result);
 }
 
@@ -121,20 +294,20 @@ stp_catprintf(char **strp, const char *format, ...)
 void
 stp_zfwrite(const char *buf, size_t bytes, size_t nitems, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), buf, bytes * nitems);
+  write_output(v, buf, bytes * nitems);
 }
 
 void
 stp_write_raw(const stp_raw_t *raw, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), raw->data, raw->bytes);
+  write_output(v, raw->data, raw->bytes);
 }
 
 void
 stp_putc(int ch, const stp_vars_t *v)
 {
-  unsigned char a = (unsigned char) ch;
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), (char *) &a, 1);
+  char a = (char) ch;
+  write_output(v, &a, 1);
 }
 
 #define BYTE(expr, byteno) (((expr) >> (8 * byteno)) & 0xff)
@@ -142,45 +315,155 @@ stp_putc(int ch, const stp_vars_t *v)
 void
 stp_put16_le(unsigned short sh, const stp_vars_t *v)
 {
-  stp_putc(BYTE(sh, 0), v);
-  stp_putc(BYTE(sh, 1), v);
+  char a[2];
+  a[0] = BYTE(sh, 0);
+  a[1] = BYTE(sh, 1);
+  write_output(v, a, 2);
 }
 
 void
 stp_put16_be(unsigned short sh, const stp_vars_t *v)
 {
-  stp_putc(BYTE(sh, 1), v);
-  stp_putc(BYTE(sh, 0), v);
+  char a[2];
+  a[0] = BYTE(sh, 1);
+  a[1] = BYTE(sh, 0);
+  write_output(v, a, 2);
 }
 
 void
 stp_put32_le(unsigned int in, const stp_vars_t *v)
 {
-  stp_putc(BYTE(in, 0), v);
-  stp_putc(BYTE(in, 1), v);
-  stp_putc(BYTE(in, 2), v);
-  stp_putc(BYTE(in, 3), v);
+  char a[4];
+  a[0] = BYTE(in, 0);
+  a[1] = BYTE(in, 1);
+  a[2] = BYTE(in, 2);
+  a[3] = BYTE(in, 3);
+  write_output(v, a, 4);
 }
 
 void
 stp_put32_be(unsigned int in, const stp_vars_t *v)
 {
-  stp_putc(BYTE(in, 3), v);
-  stp_putc(BYTE(in, 2), v);
-  stp_putc(BYTE(in, 1), v);
-  stp_putc(BYTE(in, 0), v);
+  char a[4];
+  a[0] = BYTE(in, 3);
+  a[1] = BYTE(in, 2);
+  a[2] = BYTE(in, 1);
+  a[3] = BYTE(in, 0);
+  write_output(v, a, 4);
 }
 
 void
 stp_puts(const char *s, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), s, strlen(s));
+  write_output(v, s, strlen(s));
 }
 
 void
 stp_putraw(const stp_raw_t *r, const stp_vars_t *v)
 {
-  (stp_get_outfunc(v))((void *)(stp_get_outdata(v)), r->data, r->bytes);
+  write_output(v, r->data, r->bytes);
+}
+
+void
+stp_command_start(stp_command_t *cmd, const stp_vars_t *v)
+{
+  cmd->v = v;
+  cmd->bytes = 0;
+}
+
+void
+stp_command_write(stp_command_t *cmd, const char *buf, size_t bytes)
+{
+  if (cmd->bytes + bytes > sizeof(cmd->data))
+    {
+      write_output(cmd->v, cmd->data, cmd->bytes);
+      cmd->bytes = 0;
+      if (bytes > sizeof(cmd->data))
+	{
+	  write_output(cmd->v, buf, bytes);
+	  return;
+	}
+    }
+  memcpy(cmd->data + cmd->bytes, buf, bytes);
+  cmd->bytes += bytes;
+}
+
+void
+stp_command_putc(stp_command_t *cmd, int ch)
+{
+  char a = (char) ch;
+  stp_command_write(cmd, &a, 1);
+}
+
+void
+stp_command_puts(stp_command_t *cmd, const char *s)
+{
+  stp_command_write(cmd, s, strlen(s));
+}
+
+void
+stp_command_put_int(stp_command_t *cmd, int value)
+{
+  char a[12];
+  char *ptr = a + sizeof(a);
+  unsigned int uvalue = value < 0 ? 0u - (unsigned int) value : value;
+  do
+    {
+      *--ptr = '0' + uvalue % 10;
+      uvalue /= 10;
+    }
+  while (uvalue);
+  if (value < 0)
+    *--ptr = '-';
+  stp_command_write(cmd, ptr, a + sizeof(a) - ptr);
+}
+
+void
+stp_command_put16_le(stp_command_t *cmd, unsigned short sh)
+{
+  char a[2];
+  a[0] = BYTE(sh, 0);
+  a[1] = BYTE(sh, 1);
+  stp_command_write(cmd, a, 2);
+}
+
+void
+stp_command_put16_be(stp_command_t *cmd, unsigned short sh)
+{
+  char a[2];
+  a[0] = BYTE(sh, 1);
+  a[1] = BYTE(sh, 0);
+  stp_command_write(cmd, a, 2);
+}
+
+void
+stp_command_put32_le(stp_command_t *cmd, unsigned int in)
+{
+  char a[4];
+  a[0] = BYTE(in, 0);
+  a[1] = BYTE(in, 1);
+  a[2] = BYTE(in, 2);
+  a[3] = BYTE(in, 3);
+  stp_command_write(cmd, a, 4);
+}
+
+void
+stp_command_put32_be(stp_command_t *cmd, unsigned int in)
+{
+  char a[4];
+  a[0] = BYTE(in, 3);
+  a[1] = BYTE(in, 2);
+  a[2] = BYTE(in, 1);
+  a[3] = BYTE(in, 0);
+  stp_command_write(cmd, a, 4);
+}
+
+void
+stp_command_end(stp_command_t *cmd)
+{
+  if (cmd->bytes)
+    write_output(cmd->v, cmd->data, cmd->bytes);
+  cmd->bytes = 0;
 }
 
 void
@@ -192,6 +475,7 @@ stp_send_command(const stp_vars_t *v, const char *command,
   const char *out_str;
   const stp_raw_t *out_raw;
   unsigned short byte_count = 0;
+  stp_command_t cmd;
   va_list args;
 
   if (strlen(format) > 0)
@@ -234,7 +518,8 @@ stp_send_command(const stp_vars_t *v, const char *command,
       va_end(args);
     }
 
-  stp_puts(command, v);
+  stp_command_start(&cmd, v);
+  stp_command_puts(&cmd, command);
 
   va_start(args, format);
   while ((fchar = format[0]) != '\0')
@@ -242,45 +527,47 @@ stp_send_command(const stp_vars_t *v, const char *command,
       switch (fchar)
 	{
 	case 'a':
-	  stp_putc(byte_count, v);
+	  stp_command_putc(&cmd, byte_count);
 	  break;
 	case 'b':
-	  stp_put16_le(byte_count, v);
+	  stp_command_put16_le(&cmd, byte_count);
 	  break;
 	case 'B':
-	  stp_put16_be(byte_count, v);
+	  stp_command_put16_be(&cmd, byte_count);
 	  break;
 	case 'd':
-	  stp_put32_le(byte_count, v);
+	  stp_command_put32_le(&cmd, byte_count);
 	  break;
 	case 'D':
-	  stp_put32_be(byte_count, v);
+	  stp_command_put32_be(&cmd, byte_count);
 	  break;
 	case 'c':
-	  stp_putc(va_arg(args, unsigned int), v);
+	  stp_command_putc(&cmd, va_arg(args, unsigned int));
 	  break;
 	case 'h':
-	  stp_put16_le(va_arg(args, unsigned int), v);
+	  stp_command_put16_le(&cmd, va_arg(args, unsigned int));
 	  break;
 	case 'H':
-	  stp_put16_be(va_arg(args, unsigned int), v);
+	  stp_command_put16_be(&cmd, va_arg(args, unsigned int));
 	  break;
 	case 'l':
-	  stp_put32_le(va_arg(args, unsigned int), v);
+	  stp_command_put32_le(&cmd, va_arg(args, unsigned int));
 	  break;
 	case 'L':
-	  stp_put32_be(va_arg(args, unsigned int), v);
+	  stp_command_put32_be(&cmd, va_arg(args, unsigned int));
 	  break;
 	case 's':
-	  stp_puts(va_arg(args, const char *), v);
+	  stp_command_puts(&cmd, va_arg(args, const char *));
 	  break;
 	case 'r':
-	  stp_putraw(va_arg(args, const stp_raw_t *), v);
+	  out_raw = va_arg(args, const stp_raw_t *);
+	  stp_command_write(&cmd, out_raw->data, out_raw->bytes);
 	  break;
 	}
       format++;
     }
   va_end(args);
+  stp_command_end(&cmd);
 }
 
 void
@@ -320,20 +607,31 @@ stp_erprintf(const char *format, ...)
 
 static unsigned long stpi_debug_level = 0;
 
+static void
+read_debug_level(void)
+{
+  const char *dval = getenv("STP_DEBUG");
+  if (dval)
+    {
+      stpi_debug_level = strtoul(dval, 0, 0);
+      stp_erprintf("Gutenprint %s %s\n", VERSION, RELEASE_DATE);
+    }
+}
+
 static void
 stpi_init_debug(void)
 {
+#ifdef HAVE_PTHREAD
+  static pthread_once_t debug_once = PTHREAD_ONCE_INIT;
+  pthread_once(&debug_once, read_debug_level);
+#else
   static int debug_initialized = 0;
   if (!debug_initialized)
     {
-      const char *dval = getenv("STP_DEBUG");
       debug_initialized = 1;
-      if (dval)
-	{
-	  stpi_debug_level = strtoul(dval, 0, 0);
-	  stp_erprintf("Gutenprint %s %s\n", VERSION, RELEASE_DATE);
-	}
+      read_debug_level();
     }
+#endif
 }
 
 unsigned long
@@ -465,44 +763,58 @@ stp_free(void *ptr)
   stpi_free_func(ptr);
 }
 
+/* Things that are only initialised once */
+static int
+stpi_init_once(void)
+{
+  /* Set up gettext */
+#ifdef ENABLE_NLS
+  bindtextdomain (PACKAGE, PACKAGE_LOCALE_DIR);
+#endif
+  stpi_init_debug();
+  stp_xml_preinit();
+  stpi_init_printer();
+  stpi_init_paper();
+  stpi_init_dither();
+  stpi_init_color_kernels();
+  stpi_init_pack_kernels();
+  stpi_init_dither_kernels();
+  stpi_init_weave_cache();
+  init_output_buffer_size();
+  /* Load modules */
+  if (stp_module_load())
+    return 1;
+  /* Load XML data */
+  if (stp_xml_init_defaults())
+    return 1;
+  stpi_init_printer_db();
+  /* Initialise modules */
+  if (stp_module_init())
+    return 1;
+  /* Set up defaults for core parameters */
+  stp_initialize_printer_defaults();
+  return 0;
+}
+
+/*
+ * stp_init() may be called from several threads at once; the first
+ * call does the work, and the others wait for it to finish.  It leaves
+ * the process locale alone, since that belongs to the application.
+ */
 int
 stp_init(void)
 {
   static int stpi_is_initialised = 0;
+  int status = 0;
+  stpi_data_lock();
   if (!stpi_is_initialised)
     {
-      /* Things that are only initialised once */
-      /* Set up gettext */
-#ifdef HAVE_LOCALE_H
-      char *locale = stp_strdup(setlocale (LC_ALL, ""));
-#endif
-#ifdef ENABLE_NLS
-      bindtextdomain (PACKAGE, PACKAGE_LOCALE_DIR);
-#endif
-#ifdef HAVE_LOCALE_H
-      setlocale(LC_ALL, locale);
-      stp_free(locale);
-#endif
-      stpi_init_debug();
-      stp_xml_preinit();
-      stpi_init_printer();
-      stpi_init_paper();
-      stpi_init_dither();
-      /* Load modules */
-      if (stp_module_load())
-	return 1;
-      /* Load XML data */
-      if (stp_xml_init_defaults())
-	return 1;
-      /* Initialise modules */
-      if (stp_module_init())
-	return 1;
-      /* Set up defaults for core parameters */
-      stp_initialize_printer_defaults();
+      status = stpi_init_once();
+      if (status == 0)
+	stpi_is_initialised = 1;
     }
-
-  stpi_is_initialised = 1;
-  return 0;
+  stpi_data_unlock();
+  return status;
 }
 
 size_t
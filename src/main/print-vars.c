@@ -79,6 +79,7 @@ struct stp_vars			/* Plug-in variables */
   void *outdata;
   void (*errfunc)(void *data, const char *buffer, size_t bytes);
   void *errdata;
+  stpi_output_buffer_t *outbuf;	/* Shared with copies of this object */
   int verified;			/* Ensure that params are OK! */
 };
 
@@ -313,6 +314,7 @@ copy_compdata_list(const stp_list_t *src)
 static void
 initialize_standard_vars(void)
 {
+  stpi_data_lock();
   if (!standard_vars_initialized)
     {
       int i;
@@ -323,6 +325,7 @@ initialize_standard_vars(void)
       default_vars.internal_data = create_compdata_list();
       standard_vars_initialized = 1;
     }
+  stpi_data_unlock();
 }
 
 const stp_vars_t *
@@ -353,6 +356,7 @@ stp_vars_destroy(stp_vars_t *v)
   for (i = 0; i < STP_PARAMETER_TYPE_INVALID; i++)
     stp_list_destroy(v->params[i]);
   stp_list_destroy(v->internal_data);
+  stpi_vars_set_output_buffer(v, NULL);
   STP_SAFE_FREE(v->driver);
   STP_SAFE_FREE(v->color_conversion);
   stp_free(v);
@@ -437,6 +441,22 @@ stp_get_verified(const stp_vars_t *v)
   return v->verified;
 }
 
+stpi_output_buffer_t *
+stpi_vars_get_output_buffer(const stp_vars_t *v)
+{
+  CHECK_VARS(v);
+  return v->outbuf;
+}
+
+void
+stpi_vars_set_output_buffer(stp_vars_t *v, stpi_output_buffer_t *outbuf)
+{
+  CHECK_VARS(v);
+  if (v->outbuf)
+    stpi_output_buffer_release(v->outbuf);
+  v->outbuf = outbuf;
+}
+
 static void
 set_default_raw_parameter(stp_list_t *list, const char *parameter,
 			  const char *value, size_t bytes, int typ)
@@ -1450,6 +1470,7 @@ stp_vars_copy(stp_vars_t *vd, const stp_vars_t *vs)
     }
   stp_list_destroy(vd->internal_data);
   vd->internal_data = copy_compdata_list(vs->internal_data);
+  stpi_vars_set_output_buffer(vd, stpi_output_buffer_ref(vs->outbuf));
   stp_set_verified(vd, stp_get_verified(vs));
 }
 
@@ -1937,10 +1958,7 @@ static void
 fill_vars_from_xmltree(stp_mxml_node_t *prop, stp_mxml_node_t *root,
 		       stp_vars_t *v)
 {
-#ifdef HAVE_LOCALE_H
-  char *locale = stp_strdup(setlocale(LC_ALL, NULL));
-  setlocale(LC_ALL, "C");
-#endif
+  stp_xml_init();
   stp_deprintf(STP_DBG_XML, "Enter fill_vars_from_xmltree()\n");
   while (prop)
     {
@@ -2145,10 +2163,7 @@ fill_vars_from_xmltree(stp_mxml_node_t *prop, stp_mxml_node_t *root,
       prop = prop->next;
     }
   stp_deprintf(STP_DBG_XML, "End fill_vars_from_xmltree()\n");
-#ifdef HAVE_LOCALE_H
-  setlocale(LC_ALL, locale);
-  stp_free(locale);
-#endif
+  stp_xml_exit();
 }
 
 void
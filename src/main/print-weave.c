@@ -28,6 +28,7 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <stdlib.h>
 #include <string.h>
 #include <gutenprint/gutenprint.h>
 #include "gutenprint-internal.h"
@@ -70,7 +71,7 @@ typedef struct stpi_softweave
   int virtual_jets;		/* Number of jets per color, taking into */
 				/* account the head offset */
   int separation;		/* Offset from one jet to the next in rows */
-  void *weaveparm;		/* Weave calculation parameter block */
+  struct weave_schedule *weaveparm; /* Weave schedule for this page */
 
   int horizontal_weave;		/* Number of horizontal passes required */
 				/* This is > 1 for some of the ultra-high */
@@ -94,6 +95,8 @@ typedef struct stpi_softweave
   unsigned char *s[STP_MAX_WEAVE];
   unsigned char *fold_buf;
   unsigned char *comp_buf;
+  unsigned char *blank_buf;	/* A blank line, already packed */
+  int blank_length;
   stp_weave_t wcache;
   int rcache;
   int vcache;
@@ -580,7 +583,7 @@ calculate_pass_map(stp_vars_t *v,
 	}
 }
 
-static void *				/* O - weave parameter block */
+static cooked_t *			/* O - weave parameter block */
 initialize_weave_params(int separation,		/* I - jet separation */
                         int jets,		/* I - number of jets */
                         int oversample,		/* I - oversampling factor */
@@ -601,10 +604,8 @@ initialize_weave_params(int separation,		/* I - jet separation */
 }
 
 static void
-stpi_destroy_weave_params(void *vw)
+stpi_destroy_weave_params(cooked_t *w)
 {
-	cooked_t *w = (cooked_t *) vw;
-
 	if (w->pass_premap) stp_free(w->pass_premap);
 	if (w->stagger_premap) stp_free(w->stagger_premap);
 	if (w->pass_postmap) stp_free(w->pass_postmap);
@@ -613,16 +614,15 @@ stpi_destroy_weave_params(void *vw)
 }
 
 static void
-stpi_calculate_row_parameters(void *vw,		/* I - weave parameters */
-			      int row,		/* I - row number */
-			      int subpass,	/* I - subpass */
-			      int *pass,	/* O - pass containing row */
-			      int *jetnum,	/* O - jet number of row */
-			      int *startingrow,	/* O - phys start of pass */
-			      int *ophantomrows, /* O - missing rows @ start */
-			      int *ojetsused)	/* O - jets used by pass */
+compute_row_parameters(cooked_t *w,		/* I - weave parameters */
+		       int row,			/* I - row number */
+		       int subpass,		/* I - subpass */
+		       int *pass,		/* O - pass containing row */
+		       int *jetnum,		/* O - jet number of row */
+		       int *startingrow,	/* O - phys start of pass */
+		       int *ophantomrows,	/* O - missing rows @ start */
+		       int *ojetsused)		/* O - jets used by pass */
 {
-	cooked_t *w = (cooked_t *) vw;
 	int raw_pass, jet, startrow, phantomrows, jetsused;
 	int stagger = 0;
 	int extra;
@@ -677,6 +677,282 @@ stpi_calculate_row_parameters(void *vw,		/* I - weave parameters */
 	*ojetsused = jetsused;
 }
 
+/* WEAVE SCHEDULES */
+
+/*
+ * A weave schedule is the cooked weave for one page geometry together
+ * with the parameters of every (row, subpass) on the page, so that
+ * looking up a row is a table access.  The parameters depend only on
+ * the geometry, which is the same for every page of a job and usually
+ * for every job printed with the same settings, so schedules are kept
+ * in a cache shared by all of them, most recently used first.  Once
+ * built a schedule is never modified, so it can be used by any number
+ * of pages at once; it's only freed when nothing refers to it and it
+ * falls off the end of the cache.
+ */
+
+typedef struct {
+	int pass;
+	int jet;
+	int startrow;
+	int phantomrows;
+	int jetsused;
+} weave_row_t;
+
+typedef struct weave_schedule {
+	cooked_t *w;
+	int pageheight;		/* Page height the schedule was built for */
+	weave_row_t *rows;	/* Indexed by row and subpass; NULL if the */
+				/* schedule isn't cached */
+	size_t size;		/* Bytes used by rows */
+	int refcount;
+	struct weave_schedule *prev;
+	struct weave_schedule *next;
+} weave_schedule_t;
+
+#define STPI_WEAVE_CACHE_ENTRIES 8
+#define STPI_WEAVE_CACHE_BYTES (32 * 1024 * 1024)
+
+static weave_schedule_t *weave_cache_head = NULL;
+static weave_schedule_t *weave_cache_tail = NULL;
+static int weave_cache_entries = 0;
+static size_t weave_cache_bytes = 0;
+static int weave_cache_max_entries = STPI_WEAVE_CACHE_ENTRIES;
+static unsigned long weave_cache_hits = 0;
+static unsigned long weave_cache_misses = 0;
+
+static void
+destroy_weave_schedule(weave_schedule_t *s)
+{
+	stpi_destroy_weave_params(s->w);
+	STP_SAFE_FREE(s->rows);
+	stp_free(s);
+}
+
+static void
+unlink_weave_schedule(weave_schedule_t *s)
+{
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		weave_cache_head = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+	else
+		weave_cache_tail = s->prev;
+	s->prev = s->next = NULL;
+	weave_cache_entries--;
+	weave_cache_bytes -= s->size;
+}
+
+static void
+link_weave_schedule(weave_schedule_t *s)
+{
+	s->prev = NULL;
+	s->next = weave_cache_head;
+	if (weave_cache_head)
+		weave_cache_head->prev = s;
+	else
+		weave_cache_tail = s;
+	weave_cache_head = s;
+	weave_cache_entries++;
+	weave_cache_bytes += s->size;
+}
+
+/*
+ * Free the least recently used schedules that aren't in use until the
+ * cache is within its limits.  Call with the data lock held.
+ */
+static void
+prune_weave_cache(void)
+{
+	weave_schedule_t *s = weave_cache_tail;
+	while (s && (weave_cache_entries > weave_cache_max_entries ||
+		     weave_cache_bytes > STPI_WEAVE_CACHE_BYTES)) {
+		weave_schedule_t *prev = s->prev;
+		if (s->refcount == 0) {
+			unlink_weave_schedule(s);
+			destroy_weave_schedule(s);
+		}
+		s = prev;
+	}
+}
+
+static weave_schedule_t *
+find_weave_schedule(int separation, int jets, int oversample, int firstrow,
+		    int lastrow, int pageheight,
+		    stp_weave_strategy_t strategy)
+{
+	weave_schedule_t *s;
+	for (s = weave_cache_head; s; s = s->next) {
+		const cooked_t *w = s->w;
+		if (w->rw.separation == separation && w->rw.jets == jets &&
+		    w->rw.oversampling == oversample &&
+		    w->rw.strategy == strategy &&
+		    w->first_row_printed == firstrow &&
+		    w->last_row_printed == lastrow &&
+		    s->pageheight == pageheight)
+			return s;
+	}
+	return NULL;
+}
+
+static weave_schedule_t *
+create_weave_schedule(int separation, int jets, int oversample,
+		      int firstrow, int lastrow, int pageheight,
+		      stp_weave_strategy_t strategy, stp_vars_t *v,
+		      int materialize)
+{
+	weave_schedule_t *s = stp_zalloc(sizeof(weave_schedule_t));
+	s->w = initialize_weave_params(separation, jets, oversample, firstrow,
+				       lastrow, pageheight, strategy, v);
+	s->pageheight = pageheight;
+	s->refcount = 1;
+	if (materialize) {
+		int nrows = lastrow - firstrow + 1;
+		weave_row_t *r;
+		int row, subpass;
+		s->size = sizeof(weave_row_t) * nrows * oversample;
+		s->rows = r = stp_malloc(s->size);
+		for (row = firstrow; row <= lastrow; row++)
+			for (subpass = 0; subpass < oversample; subpass++) {
+				compute_row_parameters(s->w, row, subpass,
+						       &r->pass, &r->jet,
+						       &r->startrow,
+						       &r->phantomrows,
+						       &r->jetsused);
+				r++;
+			}
+		/* Shared schedules outlive the job that built them */
+		s->w->rw.v = NULL;
+	}
+	return s;
+}
+
+static weave_schedule_t *
+acquire_weave_schedule(int separation, int jets, int oversample,
+		       int firstrow, int lastrow, int pageheight,
+		       stp_weave_strategy_t strategy, stp_vars_t *v)
+{
+	weave_schedule_t *s;
+	weave_schedule_t *found;
+	size_t size = sizeof(weave_row_t) * (size_t) (lastrow - firstrow + 1) *
+		oversample;
+
+	/*
+	 * A schedule whose table alone would be more than the cache holds
+	 * would only be thrown away, so don't build the table at all;
+	 * its rows are computed as they're needed.
+	 */
+	stpi_data_lock();
+	if (weave_cache_max_entries <= 0 || size > STPI_WEAVE_CACHE_BYTES) {
+		stpi_data_unlock();
+		return create_weave_schedule(separation, jets, oversample,
+					     firstrow, lastrow, pageheight,
+					     strategy, v, 0);
+	}
+	s = find_weave_schedule(separation, jets, oversample, firstrow,
+				lastrow, pageheight, strategy);
+	if (s) {
+		unlink_weave_schedule(s);
+		link_weave_schedule(s);
+		s->refcount++;
+		weave_cache_hits++;
+		stpi_data_unlock();
+		stp_dprintf(STP_DBG_WEAVE_PARAMS, v,
+			    "Using cached weave schedule\n");
+		return s;
+	}
+	weave_cache_misses++;
+	stpi_data_unlock();
+
+	/*
+	 * Build the schedule without holding the lock; if another thread
+	 * built the same one meanwhile, use that one instead.
+	 */
+	s = create_weave_schedule(separation, jets, oversample, firstrow,
+				  lastrow, pageheight, strategy, v, 1);
+	stpi_data_lock();
+	found = find_weave_schedule(separation, jets, oversample, firstrow,
+				    lastrow, pageheight, strategy);
+	if (found) {
+		found->refcount++;
+		destroy_weave_schedule(s);
+		s = found;
+	} else {
+		link_weave_schedule(s);
+		prune_weave_cache();
+	}
+	stpi_data_unlock();
+	return s;
+}
+
+static void
+release_weave_schedule(weave_schedule_t *s)
+{
+	if (!s->rows) {
+		destroy_weave_schedule(s);
+		return;
+	}
+	stpi_data_lock();
+	s->refcount--;
+	prune_weave_cache();
+	stpi_data_unlock();
+}
+
+static void
+stpi_calculate_row_parameters(weave_schedule_t *s,	/* I - schedule */
+			      int row,		/* I - row number */
+			      int subpass,	/* I - subpass */
+			      int *pass,	/* O - pass containing row */
+			      int *jetnum,	/* O - jet number of row */
+			      int *startingrow,	/* O - phys start of pass */
+			      int *ophantomrows, /* O - missing rows @ start */
+			      int *ojetsused)	/* O - jets used by pass */
+{
+	const cooked_t *w = s->w;
+	if (s->rows && row >= w->first_row_printed &&
+	    row <= w->last_row_printed &&
+	    subpass >= 0 && subpass < w->rw.oversampling) {
+		const weave_row_t *r =
+		  &s->rows[(row - w->first_row_printed) * w->rw.oversampling
+			   + subpass];
+		*pass = r->pass;
+		*jetnum = r->jet;
+		*startingrow = r->startrow;
+		*ophantomrows = r->phantomrows;
+		*ojetsused = r->jetsused;
+	} else
+		compute_row_parameters(s->w, row, subpass, pass, jetnum,
+				       startingrow, ophantomrows, ojetsused);
+}
+
+void
+stpi_set_weave_cache_size(int entries)
+{
+	stpi_data_lock();
+	weave_cache_max_entries = entries > 0 ? entries : 0;
+	prune_weave_cache();
+	stpi_data_unlock();
+}
+
+void
+stpi_init_weave_cache(void)
+{
+	const char *entries = getenv("STP_WEAVE_CACHE_SIZE");
+	if (entries)
+		stpi_set_weave_cache_size(atoi(entries));
+}
+
+void
+stpi_get_weave_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+	stpi_data_lock();
+	*hits = weave_cache_hits;
+	*misses = weave_cache_misses;
+	stpi_data_unlock();
+}
+
 /*
  * "Soft" weave
  *
@@ -973,6 +1249,8 @@ stpi_destroy_weave(void *vsw)
     stp_free(sw->fold_buf);
   if (sw->comp_buf)
     stp_free(sw->comp_buf);
+  if (sw->blank_buf)
+    stp_free(sw->blank_buf);
   for (i = 0; i < STP_MAX_WEAVE; i++)
     if (sw->s[i])
       stp_free(sw->s[i]);
@@ -996,7 +1274,7 @@ stpi_destroy_weave(void *vsw)
   stp_free(sw->linebases);
   stp_free(sw->linebounds);
   stp_free(sw->head_offset);
-  stpi_destroy_weave_params(sw->weaveparm);
+  release_weave_schedule(sw->weaveparm);
   stp_free(vsw);
 }
 
@@ -1095,9 +1373,9 @@ stp_initialize_weave(stp_vars_t *v,
     sw->virtual_jets += (maxHeadOffset + sw->separation - 1) / sw->separation;
   last_line = first_line + line_count - 1 + maxHeadOffset;
 
-  sw->weaveparm = initialize_weave_params(sw->separation, sw->jets,
-                                          sw->oversample, first_line, last_line,
-                                          page_height, weave_strategy, v);
+  sw->weaveparm = acquire_weave_schedule(sw->separation, sw->jets,
+                                         sw->oversample, first_line, last_line,
+                                         page_height, weave_strategy, v);
   /*
    * The value of vmod limits how many passes may be unfinished at a time.
    * If pass x is not yet printed, pass x+vmod cannot be started.
@@ -1632,6 +1910,16 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
       sw->comp_buf = stp_zalloc(sw->bitwidth *
 				(sw->compute_linewidth)(v,ylength));
     }
+  if (!sw->blank_buf)
+    {
+      unsigned char *blank = stp_zalloc(sw->bitwidth * xlength);
+      sw->blank_buf = stp_zalloc(sw->bitwidth *
+				 (sw->compute_linewidth)(v, ylength));
+      (void) (sw->pack)(v, blank, sw->bitwidth * xlength, sw->blank_buf,
+			&comp_ptr, NULL, NULL);
+      sw->blank_length = comp_ptr - sw->blank_buf;
+      stp_free(blank);
+    }
   if (sw->current_vertical_subpass == 0)
     initialize_row(v, sw, sw->lineno, xlength, cols);
 
@@ -1653,6 +1941,26 @@ stp_write_weave(stp_vars_t *v, unsigned char *const cols[])
 		stpi_get_linebounds(v, sw, sw->lineno, pass, offset);
 	    }
 
+	  /*
+	   * Most rows of most pages are blank in at least some colors.
+	   * Those don't need to be folded, split, or compressed; every
+	   * pass gets the same packed blank line, and the line stays
+	   * inactive.
+	   */
+	  if (stpi_line_is_blank(cols[j], length * sw->bitwidth))
+	    {
+	      for (i = 0; i < h_passes; i++)
+		{
+		  if (sw->bitwidth * xlength < linebounds[i]->start_pos[j])
+		    linebounds[i]->start_pos[j] = sw->bitwidth * xlength;
+		  if (linebounds[i]->end_pos[j] < 0)
+		    linebounds[i]->end_pos[j] = 0;
+		  add_to_row(v, sw, sw->lineno, sw->blank_buf, sw->blank_length,
+			     j, 0, cpass + i);
+		}
+	      continue;
+	    }
+
 	  if (sw->bitwidth == 2)
 	    {
 	      stp_fold(cols[j], length, sw->fold_buf);
@@ -0,0 +1,659 @@
+/*
+ * "$Id$"
+ *
+ *   Shared read-only database of printers and paper sizes
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Every process that calls stp_init() would otherwise read printers.xml
+ * and build its own copy of every printer (each with its own set of
+ * default parameters), and read papers.xml the first time it needs a
+ * paper size.  On a print server running many filters at once, that is
+ * a lot of identical data.  Instead, the printer and paper tables are
+ * written once to a file in the XML cache directory (see xml-cache.c),
+ * and later processes map that file read only, so that they all share
+ * one copy of it through the page cache.
+ *
+ * The file contains no pointers: records refer to strings and to other
+ * data by their offset from the start of the data area, so it can be
+ * mapped anywhere.  A printer's default parameters are stored as its
+ * encoded XML node, and are only built (in the process's own memory)
+ * when stp_printer_get_defaults() is first called for that printer.
+ *
+ * The file records the size, modification time and inode of each
+ * printers.xml and papers.xml on the data path, and is ignored if the
+ * set of files or any of those has changed; in that case the XML files
+ * are read as usual, and the file is rewritten if the cache directory
+ * is writable.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define PRINTER_DB_MAGIC "STPPRDB"
+#define PRINTER_DB_VERSION 1
+#define PRINTER_DB_BYTE_ORDER 0x01020304
+#define PRINTER_DB_FILE "printers.db"
+
+/*
+ * Offsets in the header are from the start of the file; offsets in the
+ * records are from the start of the data area, where offset 0 (an empty
+ * string) stands for a null pointer.
+ */
+typedef struct
+{
+  char magic[8];
+  unsigned version;
+  unsigned byte_order;
+  unsigned header_size;		/* sizeof(printer_db_header_t) */
+  unsigned size;		/* Size of the whole file */
+  unsigned source_count;
+  unsigned sources;
+  unsigned printer_count;
+  unsigned printers;
+  unsigned params_count;
+  unsigned params;
+  unsigned paper_count;
+  unsigned papers;
+  unsigned data;
+  unsigned data_size;
+} printer_db_header_t;
+
+typedef struct
+{
+  off_t size;
+  time_t mtime;
+  ino_t inode;
+  unsigned name;		/* Relative to the data path */
+} printer_db_source_t;
+
+typedef struct
+{
+  unsigned driver;
+  unsigned long_name;
+  unsigned family;
+  unsigned manufacturer;
+  unsigned device_id;
+  unsigned foomatic_id;
+  unsigned comment;
+  int model;
+  unsigned node;		/* The <printer> node */
+  unsigned node_size;
+} printer_db_printer_t;
+
+typedef struct
+{
+  unsigned family;
+  unsigned node;		/* The <parameters> node */
+  unsigned node_size;
+} printer_db_params_t;
+
+typedef struct
+{
+  unsigned name;
+  unsigned text;
+  unsigned comment;
+  unsigned width;
+  unsigned height;
+  unsigned top;
+  unsigned left;
+  unsigned bottom;
+  unsigned right;
+  int paper_unit;
+  int paper_size_type;
+} printer_db_paper_t;
+
+typedef struct
+{
+  char *data;
+  size_t size;
+  size_t allocated;
+} db_buffer_t;
+
+/*
+ * The mapped database, if there is a usable one.
+ */
+static const char *db = NULL;
+static const printer_db_header_t *db_header = NULL;
+static const char *db_data = NULL;
+static int db_checked = 0;
+
+/*
+ * Tables being collected from the XML files, to be written out once
+ * they have all been read.
+ */
+static int db_building = 0;
+static db_buffer_t new_printers;
+static db_buffer_t new_params;
+static db_buffer_t new_papers;
+static db_buffer_t new_data;
+
+static const char *source_files[] = { "printers.xml", "papers.xml", NULL };
+
+static void
+append(db_buffer_t *buf, const void *data, size_t size)
+{
+  if (buf->size + size > buf->allocated)
+    {
+      buf->allocated = 2 * (buf->size + size);
+      buf->data = stp_realloc(buf->data, buf->allocated);
+    }
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+}
+
+static unsigned
+append_data(const void *data, size_t size)
+{
+  unsigned offset;
+  if (new_data.size == 0)
+    append(&new_data, "", 1);
+  offset = new_data.size;
+  append(&new_data, data, size);
+  return offset;
+}
+
+static unsigned
+append_string(const char *str)
+{
+  return str ? append_data(str, strlen(str) + 1) : 0;
+}
+
+static unsigned
+append_node(stp_mxml_node_t *node, unsigned *size)
+{
+  size_t node_size;
+  char *data = stpi_xml_cache_encode(node, &node_size);
+  unsigned offset = 0;
+  *size = 0;
+  if (data)
+    {
+      offset = append_data(data, node_size);
+      *size = node_size;
+      stp_free(data);
+    }
+  return offset;
+}
+
+static void
+clear_buffer(db_buffer_t *buf)
+{
+  STP_SAFE_FREE(buf->data);
+  buf->size = 0;
+  buf->allocated = 0;
+}
+
+static void
+stop_building(void)
+{
+  db_building = 0;
+  clear_buffer(&new_printers);
+  clear_buffer(&new_params);
+  clear_buffer(&new_papers);
+  clear_buffer(&new_data);
+}
+
+static const char *
+db_string(unsigned offset)
+{
+  return offset ? db_data + offset : NULL;
+}
+
+/*
+ * Each list of source files must be in the same order and unchanged.
+ */
+static int
+check_sources(const printer_db_source_t *sources, unsigned count)
+{
+  unsigned i = 0;
+  int j;
+  int ok = 1;
+  for (j = 0; ok && source_files[j]; j++)
+    {
+      stp_list_t *file_list = stpi_list_files_on_data_path(source_files[j]);
+      stp_list_item_t *item = stp_list_get_start(file_list);
+      while (ok && item)
+	{
+	  const char *file = (const char *) stp_list_item_get_data(item);
+	  struct stat sbuf;
+	  char *name = stpi_xml_cache_key(file);
+	  ok = (i < count && stat(file, &sbuf) == 0 &&
+		sources[i].size == sbuf.st_size &&
+		sources[i].mtime == sbuf.st_mtime &&
+		sources[i].inode == sbuf.st_ino &&
+		strcmp(db_string(sources[i].name), name) == 0);
+	  stp_free(name);
+	  i++;
+	  item = stp_list_item_next(item);
+	}
+      stp_list_destroy(file_list);
+    }
+  return ok && i == count;
+}
+
+static int
+check_string(const printer_db_header_t *header, const char *data,
+	     unsigned offset)
+{
+  return offset < header->data_size &&
+    memchr(data + offset, 0, header->data_size - offset) != NULL;
+}
+
+static int
+check_node(const printer_db_header_t *header, unsigned offset, unsigned size)
+{
+  return offset <= header->data_size && size <= header->data_size - offset;
+}
+
+static int
+check_table(const printer_db_header_t *header, unsigned offset,
+	    unsigned count, size_t record_size)
+{
+  return offset % sizeof(double) == 0 && offset <= header->size &&
+    count <= (header->size - offset) / record_size;
+}
+
+/*
+ * Returns 1 if the database is intact and up to date.
+ */
+static int
+check_db(const char *image, size_t size)
+{
+  const printer_db_header_t *header = (const printer_db_header_t *) image;
+  const char *data;
+  const printer_db_source_t *sources;
+  const printer_db_printer_t *printers;
+  const printer_db_params_t *params;
+  const printer_db_paper_t *papers;
+  unsigned i;
+  if (size < sizeof(printer_db_header_t) ||
+      memcmp(header->magic, PRINTER_DB_MAGIC, sizeof(PRINTER_DB_MAGIC)) != 0 ||
+      header->version != PRINTER_DB_VERSION ||
+      header->byte_order != PRINTER_DB_BYTE_ORDER ||
+      header->header_size != sizeof(printer_db_header_t) ||
+      header->size != size ||
+      header->data > size || header->data_size != size - header->data ||
+      header->data_size == 0 ||
+      !check_table(header, header->sources, header->source_count,
+		   sizeof(printer_db_source_t)) ||
+      !check_table(header, header->printers, header->printer_count,
+		   sizeof(printer_db_printer_t)) ||
+      !check_table(header, header->params, header->params_count,
+		   sizeof(printer_db_params_t)) ||
+      !check_table(header, header->papers, header->paper_count,
+		   sizeof(printer_db_paper_t)))
+    return 0;
+  data = image + header->data;
+  sources = (const printer_db_source_t *) (image + header->sources);
+  printers = (const printer_db_printer_t *) (image + header->printers);
+  params = (const printer_db_params_t *) (image + header->params);
+  papers = (const printer_db_paper_t *) (image + header->papers);
+  for (i = 0; i < header->source_count; i++)
+    if (!check_string(header, data, sources[i].name) || sources[i].name == 0)
+      return 0;
+  for (i = 0; i < header->printer_count; i++)
+    {
+      const printer_db_printer_t *p = &(printers[i]);
+      if (!check_string(header, data, p->driver) || p->driver == 0 ||
+	  !check_string(header, data, p->long_name) || p->long_name == 0 ||
+	  !check_string(header, data, p->family) || p->family == 0 ||
+	  !check_string(header, data, p->manufacturer) ||
+	  !check_string(header, data, p->device_id) ||
+	  !check_string(header, data, p->foomatic_id) ||
+	  !check_string(header, data, p->comment) ||
+	  !check_node(header, p->node, p->node_size))
+	return 0;
+    }
+  for (i = 0; i < header->params_count; i++)
+    if (!check_string(header, data, params[i].family) ||
+	params[i].family == 0 ||
+	!check_node(header, params[i].node, params[i].node_size))
+      return 0;
+  for (i = 0; i < header->paper_count; i++)
+    if (!check_string(header, data, papers[i].name) || papers[i].name == 0 ||
+	!check_string(header, data, papers[i].text) ||
+	!check_string(header, data, papers[i].comment))
+      return 0;
+  db_data = data;
+  if (!check_sources(sources, header->source_count))
+    {
+      db_data = NULL;
+      return 0;
+    }
+  return 1;
+}
+
+int
+stpi_printer_db_open(void)
+{
+  const char *dir = stpi_xml_cache_dir();
+  struct stat sbuf;
+  char *file;
+  int fd;
+  if (db_checked)
+    return db != NULL;
+  db_checked = 1;
+  if (!dir)
+    return 0;
+  file = stpi_path_merge(dir, PRINTER_DB_FILE);
+  fd = open(file, O_RDONLY);
+  if (fd >= 0 && fstat(fd, &sbuf) == 0 &&
+      (size_t) sbuf.st_size >= sizeof(printer_db_header_t))
+    {
+      size_t size = sbuf.st_size;
+#ifdef HAVE_SYS_MMAN_H
+      void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED)
+	{
+	  if (check_db(data, size))
+	    db = data;
+	  else
+	    munmap(data, size);
+	}
+#else
+      char *data = stp_malloc(size);
+      if (read(fd, data, size) == (ssize_t) size && check_db(data, size))
+	db = data;
+      else
+	stp_free(data);
+#endif
+    }
+  if (fd >= 0)
+    close(fd);
+  if (db)
+    db_header = (const printer_db_header_t *) db;
+  else
+    {
+      /*
+       * Collect the tables while the XML files are read, if there's
+       * somewhere to write them afterwards.
+       */
+      db_building = stpi_cache_dir_writable(dir);
+    }
+  stp_deprintf(STP_DBG_XML, "stpi_printer_db_open: %s %s\n",
+	       db ? "using" : (db_building ? "rebuilding" : "no usable"), file);
+  stp_free(file);
+  return db != NULL;
+}
+
+int
+stpi_printer_db_building(void)
+{
+  return db_building;
+}
+
+void
+stpi_printer_db_add_printer(stp_mxml_node_t *printer, const char *family,
+			    const char *comment)
+{
+  printer_db_printer_t record;
+  const char *driver = stp_mxmlElementGetAttr(printer, "driver");
+  const char *long_name = stp_mxmlElementGetAttr(printer, "name");
+  if (!db_building || !driver || !long_name || !family)
+    return;
+  record.driver = append_string(driver);
+  record.long_name = append_string(long_name);
+  record.family = append_string(family);
+  record.manufacturer =
+    append_string(stp_mxmlElementGetAttr(printer, "manufacturer"));
+  record.device_id = append_string(stp_mxmlElementGetAttr(printer, "deviceid"));
+  record.foomatic_id =
+    append_string(stp_mxmlElementGetAttr(printer, "foomaticid"));
+  record.comment = append_string(comment);
+  record.model = stp_xmlstrtol(stp_mxmlElementGetAttr(printer, "model"));
+  record.node = append_node(printer, &(record.node_size));
+  if (record.node_size == 0)
+    stop_building();
+  else
+    append(&new_printers, &record, sizeof(record));
+}
+
+void
+stpi_printer_db_add_params(stp_mxml_node_t *params, const char *family)
+{
+  printer_db_params_t record;
+  if (!db_building || !family)
+    return;
+  record.family = append_string(family);
+  record.node = append_node(params, &(record.node_size));
+  if (record.node_size == 0)
+    stop_building();
+  else
+    append(&new_params, &record, sizeof(record));
+}
+
+void
+stpi_printer_db_add_paper(const stp_papersize_t *paper)
+{
+  printer_db_paper_t record;
+  if (!db_building)
+    return;
+  record.name = append_string(paper->name);
+  record.text = append_string(paper->text);
+  record.comment = append_string(paper->comment);
+  record.width = paper->width;
+  record.height = paper->height;
+  record.top = paper->top;
+  record.left = paper->left;
+  record.bottom = paper->bottom;
+  record.right = paper->right;
+  record.paper_unit = paper->paper_unit;
+  record.paper_size_type = paper->paper_size_type;
+  append(&new_papers, &record, sizeof(record));
+}
+
+static unsigned
+align(unsigned offset)
+{
+  return (offset + sizeof(double) - 1) & ~(sizeof(double) - 1);
+}
+
+static int
+add_sources(db_buffer_t *sources)
+{
+  int j;
+  for (j = 0; source_files[j]; j++)
+    {
+      stp_list_t *file_list = stpi_list_files_on_data_path(source_files[j]);
+      stp_list_item_t *item = stp_list_get_start(file_list);
+      while (item)
+	{
+	  const char *file = (const char *) stp_list_item_get_data(item);
+	  printer_db_source_t record;
+	  struct stat sbuf;
+	  char *name;
+	  if (stat(file, &sbuf) != 0)
+	    {
+	      stp_list_destroy(file_list);
+	      return 0;
+	    }
+	  memset(&record, 0, sizeof(record));
+	  name = stpi_xml_cache_key(file);
+	  record.size = sbuf.st_size;
+	  record.mtime = sbuf.st_mtime;
+	  record.inode = sbuf.st_ino;
+	  record.name = append_string(name);
+	  stp_free(name);
+	  append(sources, &record, sizeof(record));
+	  item = stp_list_item_next(item);
+	}
+      stp_list_destroy(file_list);
+    }
+  return 1;
+}
+
+static void
+write_db(const char *dir, const printer_db_header_t *header,
+	 const db_buffer_t *sources)
+{
+  char *file = stpi_path_merge(dir, PRINTER_DB_FILE);
+  const db_buffer_t *tables[5];
+  unsigned offsets[5];
+  stpi_cache_chunk_t chunks[11];
+  static const char zeros[sizeof(double)] = { 0 };
+  unsigned where = sizeof(printer_db_header_t);
+  int count = 0;
+  int i;
+  tables[0] = sources;
+  offsets[0] = header->sources;
+  tables[1] = &new_printers;
+  offsets[1] = header->printers;
+  tables[2] = &new_params;
+  offsets[2] = header->params;
+  tables[3] = &new_papers;
+  offsets[3] = header->papers;
+  tables[4] = &new_data;
+  offsets[4] = header->data;
+
+  chunks[count].data = (const char *) header;
+  chunks[count++].size = sizeof(printer_db_header_t);
+  for (i = 0; i < 5; i++)
+    {
+      /* Each table is aligned with zeros */
+      chunks[count].data = zeros;
+      chunks[count++].size = offsets[i] - where;
+      chunks[count].data = tables[i]->data;
+      chunks[count++].size = tables[i]->size;
+      where = offsets[i] + tables[i]->size;
+    }
+  if (stpi_cache_write_file(file, chunks, count))
+    stp_deprintf(STP_DBG_XML, "stpi_printer_db_save: wrote %s\n", file);
+  stp_free(file);
+}
+
+void
+stpi_printer_db_save(void)
+{
+  const char *dir = stpi_xml_cache_dir();
+  printer_db_header_t header;
+  db_buffer_t sources;
+  if (!db_building)
+    return;
+
+  /* Papers are otherwise only read when they're first needed */
+  (void) stp_known_papersizes();
+  if (!db_building)
+    return;
+
+  memset(&sources, 0, sizeof(sources));
+  if (dir && add_sources(&sources) && new_data.size > 0)
+    {
+      memset(&header, 0, sizeof(header));
+      strcpy(header.magic, PRINTER_DB_MAGIC);
+      header.version = PRINTER_DB_VERSION;
+      header.byte_order = PRINTER_DB_BYTE_ORDER;
+      header.header_size = sizeof(printer_db_header_t);
+      header.source_count = sources.size / sizeof(printer_db_source_t);
+      header.sources = align(sizeof(printer_db_header_t));
+      header.printer_count = new_printers.size / sizeof(printer_db_printer_t);
+      header.printers = align(header.sources + sources.size);
+      header.params_count = new_params.size / sizeof(printer_db_params_t);
+      header.params = align(header.printers + new_printers.size);
+      header.paper_count = new_papers.size / sizeof(printer_db_paper_t);
+      header.papers = align(header.params + new_params.size);
+      header.data = align(header.papers + new_papers.size);
+      header.data_size = new_data.size;
+      header.size = header.data + header.data_size;
+      write_db(dir, &header, &sources);
+    }
+  clear_buffer(&sources);
+  stop_building();
+}
+
+int
+stpi_printer_db_printer_count(void)
+{
+  return db ? db_header->printer_count : 0;
+}
+
+void
+stpi_printer_db_get_printer(int i, stpi_printer_db_entry_t *entry)
+{
+  const printer_db_printer_t *record =
+    ((const printer_db_printer_t *) (db + db_header->printers)) + i;
+  entry->driver = db_string(record->driver);
+  entry->long_name = db_string(record->long_name);
+  entry->family = db_string(record->family);
+  entry->manufacturer = db_string(record->manufacturer);
+  entry->device_id = db_string(record->device_id);
+  entry->foomatic_id = db_string(record->foomatic_id);
+  entry->comment = db_string(record->comment);
+  entry->model = record->model;
+  entry->node = db_data + record->node;
+  entry->node_size = record->node_size;
+}
+
+int
+stpi_printer_db_params_count(void)
+{
+  return db ? db_header->params_count : 0;
+}
+
+const char *
+stpi_printer_db_get_params(int i, const char **node, size_t *node_size)
+{
+  const printer_db_params_t *record =
+    ((const printer_db_params_t *) (db + db_header->params)) + i;
+  *node = db_data + record->node;
+  *node_size = record->node_size;
+  return db_string(record->family);
+}
+
+int
+stpi_printer_db_paper_count(void)
+{
+  return db ? db_header->paper_count : 0;
+}
+
+void
+stpi_printer_db_get_paper(int i, stp_papersize_t *paper)
+{
+  const printer_db_paper_t *record =
+    ((const printer_db_paper_t *) (db + db_header->papers)) + i;
+  paper->name = (char *) stpi_cast_safe(db_string(record->name));
+  paper->text = (char *) stpi_cast_safe(db_string(record->text));
+  paper->comment = (char *) stpi_cast_safe(db_string(record->comment));
+  paper->width = record->width;
+  paper->height = record->height;
+  paper->top = record->top;
+  paper->left = record->left;
+  paper->bottom = record->bottom;
+  paper->right = record->right;
+  paper->paper_unit = record->paper_unit;
+  paper->paper_size_type = record->paper_size_type;
+}
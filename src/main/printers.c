@@ -72,6 +72,8 @@ struct stp_printer
   int	     vars_initialized;
   const stp_printfuncs_t *printfuncs;
   stp_vars_t *printvars;
+  const char *vars_node;	/* Printer node in the printer database */
+  size_t     vars_node_size;
 };
 
 static void
@@ -131,6 +133,12 @@ static void
 stpi_printer_freefunc(void *item)
 {
   stp_printer_t *printer = (stp_printer_t *) item;
+  if (printer->vars_node)
+    {
+      /* The strings are in the printer database */
+      stp_free(printer);
+      return;
+    }
   if (printer->comment)
     {
       stp_free(printer->comment);
@@ -461,16 +469,46 @@ stp_initialize_printer_defaults(void)
     }
 }
 
+static stp_vars_t *stpi_printer_create_vars(stp_mxml_node_t *printer,
+					    const char *family);
+
+/*
+ * Printers from the printer database only get their parameters when
+ * they're first needed.
+ */
+static void
+stpi_printer_load_vars(stp_printer_t *printer)
+{
+  stp_mxml_node_t *node;
+  stp_xml_init();
+  node = stpi_xml_cache_decode(printer->vars_node, printer->vars_node_size);
+  if (node)
+    {
+      printer->printvars = stpi_printer_create_vars(node, printer->family);
+      stp_mxmlDelete(node);
+    }
+  else
+    {
+      printer->printvars = stp_vars_create();
+      stp_set_driver(printer->printvars, printer->driver);
+    }
+  stp_xml_exit();
+}
+
 const stp_vars_t *
 stp_printer_get_defaults(const stp_printer_t *printer)
 {
+  stpi_data_lock();
   if (! printer->vars_initialized)
     {
       stp_printer_t *nc_printer = (stp_printer_t *) stpi_cast_safe(printer);
       stp_deprintf(STP_DBG_PRINTERS, "  ==>init %s\n", printer->driver);
+      if (! nc_printer->printvars)
+	stpi_printer_load_vars(nc_printer);
       set_printer_defaults (nc_printer->printvars, 1, 0);
       nc_printer->vars_initialized = 1;
     }
+  stpi_data_unlock();
   return printer->printvars;
 }
 
@@ -544,7 +582,11 @@ stp_print(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  return (printfuncs->print)(v, image);
+  int status;
+  stpi_start_output(v, 0);
+  status = (printfuncs->print)(v, image);
+  stpi_end_output(v);
+  return status;
 }
 
 int
@@ -552,13 +594,14 @@ stp_start_job(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  if (!stp_get_string_parameter(v, "JobMode") ||
-      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
-    return 1;
-  if (printfuncs->start_job)
-    return (printfuncs->start_job)(v, image);
-  else
-    return 1;
+  int status = 1;
+  stpi_start_output(v, 1);
+  if (stp_get_string_parameter(v, "JobMode") &&
+      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") != 0 &&
+      printfuncs->start_job)
+    status = (printfuncs->start_job)(v, image);
+  stpi_end_output(v);
+  return status;
 }
 
 int
@@ -566,13 +609,18 @@ stp_end_job(const stp_vars_t *v, stp_image_t *image)
 {
   const stp_printfuncs_t *printfuncs =
     stpi_get_printfuncs(stp_get_printer(v));
-  if (!stp_get_string_parameter(v, "JobMode") ||
-      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") == 0)
-    return 1;
-  if (printfuncs->end_job)
-    return (printfuncs->end_job)(v, image);
-  else
-    return 1;
+  int status = 1;
+  size_t calls, bytes;
+  stpi_start_output(v, 0);
+  if (stp_get_string_parameter(v, "JobMode") &&
+      strcmp(stp_get_string_parameter(v, "JobMode"), "Page") != 0 &&
+      printfuncs->end_job)
+    status = (printfuncs->end_job)(v, image);
+  stpi_end_output(v);
+  stp_get_output_statistics(v, &calls, &bytes);
+  stp_deprintf(STP_DBG_PRINTERS, "stp_end_job: %lu bytes in %lu writes\n",
+	       (unsigned long) bytes, (unsigned long) calls);
+  return status;
 }
 
 stp_string_list_t *
@@ -1081,6 +1129,75 @@ stp_printvars_create_from_xmltree(stp_mxml_node_t *printer,
 }
 
 
+/*
+ * Build a printer's default parameters from its node.
+ */
+static stp_vars_t *
+stpi_printer_create_vars(stp_mxml_node_t *printer, const char *family)
+{
+  const char *stmp;		/* Temporary string */
+  const stp_vars_t *params = NULL;
+  stp_vars_t *printvars;
+
+  stmp = stp_mxmlElementGetAttr(printer, "parameters");
+  if (stmp)
+    {
+      params = stp_find_params(stmp, family);
+      if (!params)
+	stp_erprintf("stp_printer_create_from_xmltree: cannot find parameters %s::%s\n",
+		     family, stmp);
+    }
+  if (params)
+    printvars = stp_vars_create_copy(params);
+  else
+    printvars = stp_vars_create();
+  if (printvars == NULL)
+    return NULL;
+
+  stmp = stp_mxmlElementGetAttr(printer, "driver");
+  stp_set_driver(printvars, (const char *) stmp);
+  stp_vars_fill_from_xmltree(printer->child, printvars);
+  return printvars;
+}
+
+/*
+ * The text in the printer node is its comment.
+ */
+static char *
+stpi_printer_comment(stp_mxml_node_t *printer)
+{
+  stp_mxml_node_t *child;
+  char *comment = NULL;
+  size_t slen = 0;
+
+  child = printer->child;
+  while (child)
+    {
+      if (child->type == STP_MXML_TEXT)
+	{
+	  if (comment)
+	    {
+	      size_t oslen = slen;
+	      slen += strlen(child->value.text.string);
+	      if (child->value.text.whitespace)
+		slen += 1;
+	      comment = stp_realloc(comment, slen + 1);
+	      (void) memset(comment + oslen, 0, slen - oslen);
+	      if (child->value.text.whitespace)
+		  comment[oslen++] = ' ';
+	      strncat(comment + oslen, child->value.text.string, slen - oslen);
+	    }
+	  else
+	    {
+	      comment = stp_strdup(child->value.text.string);
+	      slen = strlen(comment);
+	    }
+	}
+      child = child->next;
+    }
+  return comment;
+}
+
 /*
  * Parse the printer node, and return the generated printer.  Returns
  * NULL on failure.
@@ -1091,11 +1208,8 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
 				const stp_printfuncs_t *printfuncs)
                                                        /* Family printfuncs */
 {
-  stp_mxml_node_t *prop;	/* Temporary node pointer */
-  stp_mxml_node_t *child;
   const char *stmp;		/* Temporary string */
   stp_printer_t *outprinter;	/* Generated printer */
-  size_t slen = 0;
   int
     driver = 0,			/* Check driver */
     long_name = 0;
@@ -1103,23 +1217,13 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
   outprinter = stp_zalloc(sizeof(stp_printer_t));
   if (!outprinter)
     return NULL;
-  stmp = stp_mxmlElementGetAttr(printer, "parameters");
-  if (stmp && !stp_find_params(stmp, family))
-    stp_erprintf("stp_printer_create_from_xmltree: cannot find parameters %s::%s\n",
-		 family, stmp);
-  if (stmp && stp_find_params(stmp, family))
-    outprinter->printvars = stp_vars_create_copy(stp_find_params(stmp, family));
-  else
-    outprinter->printvars = stp_vars_create();
+  outprinter->printvars = stpi_printer_create_vars(printer, family);
   if (outprinter->printvars == NULL)
     {
       stp_free(outprinter);
       return NULL;
     }
 
-  stmp = stp_mxmlElementGetAttr(printer, "driver");
-  stp_set_driver(outprinter->printvars, (const char *) stmp);
-
   outprinter->long_name = stp_strdup(stp_mxmlElementGetAttr(printer, "name"));
   outprinter->manufacturer = stp_strdup(stp_mxmlElementGetAttr(printer, "manufacturer"));
   outprinter->model = stp_xmlstrtol(stp_mxmlElementGetAttr(printer, "model"));
@@ -1130,33 +1234,7 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
   stmp = stp_mxmlElementGetAttr(printer, "foomaticid");
   if (stmp)
     outprinter->foomatic_id = stp_strdup(stmp);
-
-  child = printer->child;
-  while (child)
-    {
-      if (child->type == STP_MXML_TEXT)
-	{
-	  if (outprinter->comment)
-	    {
-	      size_t oslen = slen;
-	      slen += strlen(child->value.text.string);
-	      if (child->value.text.whitespace)
-		slen += 1;
-	      outprinter->comment = stp_realloc(outprinter->comment, slen + 1);
-	      (void) memset(outprinter->comment + oslen, 0, slen - oslen);
-	      if (child->value.text.whitespace)
-		  outprinter->comment[oslen++] = ' ';
-	      strncat(outprinter->comment + oslen,
-		      child->value.text.string, slen - oslen);
-	    }
-	  else
-	    {
-	      outprinter->comment = stp_strdup(child->value.text.string);
-	      slen = strlen(outprinter->comment);
-	    }
-	}
-      child = child->next;
-    }
+  outprinter->comment = stpi_printer_comment(printer);
 
   if (stp_get_driver(outprinter->printvars))
     driver = 1;
@@ -1165,8 +1243,6 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
 
   outprinter->printfuncs = printfuncs;
 
-  prop = printer->child;
-  stp_vars_fill_from_xmltree(prop, outprinter->printvars);
   if (driver && long_name && printfuncs)
     {
       if (stp_get_debug_level() & STP_DBG_XML)
@@ -1182,24 +1258,16 @@ stp_printer_create_from_xmltree(stp_mxml_node_t *printer, /* The printer node */
 }
 
 /*
- * Parse the <family> node.
+ * Find the module for a family of printers, and make sure that it has
+ * a list to put them in.  Returns NULL if there isn't one.
  */
-static void
-stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
+static stp_family_t *
+stpi_find_family(stp_list_t *family_module_list, const char *family_name)
 {
-  stp_list_t *family_module_list = NULL;      /* List of valid families */
   stp_list_item_t *family_module_item;        /* Current family */
-  const char *family_name;                       /* Name of family */
-  stp_mxml_node_t *printer;                         /* printer child node */
   stp_module_t *family_module_data;           /* Family module data */
   stp_family_t *family_data = NULL;  /* Family data */
-  int family_valid = 0;                       /* Is family valid? */
 
-  family_module_list = stp_module_get_class(STP_MODULE_CLASS_FAMILY);
-  if (!family_module_list)
-    return;
-
-  family_name = stp_mxmlElementGetAttr(family, "name");
   family_module_item = stp_list_get_start(family_module_list);
   while (family_module_item)
     {
@@ -1213,34 +1281,72 @@ stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
 	  family_data = family_module_data->syms;
 	  if (family_data->printer_list == NULL)
 	    family_data->printer_list = stp_list_create();
-	  family_valid = 1;
 	}
       family_module_item = stp_list_item_next(family_module_item);
     }
+  return family_data;
+}
+
+/*
+ * Parse the <family> node.
+ */
+static void
+stpi_xml_process_family(stp_mxml_node_t *family)     /* The family node */
+{
+  stp_list_t *family_module_list = NULL;      /* List of valid families */
+  const char *family_name;                       /* Name of family */
+  stp_mxml_node_t *printer;                         /* printer child node */
+  stp_family_t *family_data = NULL;  /* Family data */
+  int building = stpi_printer_db_building();
+
+  family_module_list = stp_module_get_class(STP_MODULE_CLASS_FAMILY);
+  if (!family_module_list)
+    return;
+
+  family_name = stp_mxmlElementGetAttr(family, "name");
+  family_data = stpi_find_family(family_module_list, family_name);
 
+  /*
+   * The printer database has every family, in case another process has
+   * modules that this one doesn't.
+   */
   printer = family->child;
-  while (family_valid && printer)
+  while ((family_data || building) && printer)
     {
       if (printer->type == STP_MXML_ELEMENT)
 	{
 	  const char *printer_name = printer->value.element.name;
 	  if (!strcmp(printer_name, "printer"))
 	    {
-	      stp_printer_t *outprinter =
-		stp_printer_create_from_xmltree(printer, family_name,
-						family_data->printfuncs);
-	      if (outprinter)
-		stp_list_item_create(family_data->printer_list, NULL,
-				      outprinter);
+	      if (building)
+		{
+		  char *comment = stpi_printer_comment(printer);
+		  stpi_printer_db_add_printer(printer, family_name, comment);
+		  STP_SAFE_FREE(comment);
+		}
+	      if (family_data)
+		{
+		  stp_printer_t *outprinter =
+		    stp_printer_create_from_xmltree(printer, family_name,
+						    family_data->printfuncs);
+		  if (outprinter)
+		    stp_list_item_create(family_data->printer_list, NULL,
+					 outprinter);
+		}
 	    }
 	  else if (!strcmp(printer_name, "parameters"))
 	    {
-	      stp_printvars_t *printvars =
-		stp_printvars_create_from_xmltree(printer, family_name);
-	      if (printvars)
+	      if (building)
+		stpi_printer_db_add_params(printer, family_name);
+	      if (family_data)
 		{
-		  stpi_init_printvars_list();
-		  stp_list_item_create(printvars_list, NULL, printvars);
+		  stp_printvars_t *printvars =
+		    stp_printvars_create_from_xmltree(printer, family_name);
+		  if (printvars)
+		    {
+		      stpi_init_printvars_list();
+		      stp_list_item_create(printvars_list, NULL, printvars);
+		    }
 		}
 	    }
 	}
@@ -1279,5 +1385,89 @@ void
 stpi_init_printer(void)
 {
   stp_register_xml_parser("printdef", stpi_xml_process_printdef);
-  stp_register_xml_preload("printers.xml");
+  if (!stpi_printer_db_open())
+    stp_register_xml_preload("printers.xml");
+}
+
+/*
+ * Take the printers from the printer database.  Their strings stay in
+ * the database; their parameters are built by stp_printer_get_defaults().
+ */
+static void
+stpi_load_printers_from_db(void)
+{
+  stp_list_t *family_module_list;
+  stp_family_t *family_data = NULL;
+  const char *family_name = NULL;
+  int count;
+  int i;
+
+  family_module_list = stp_module_get_class(STP_MODULE_CLASS_FAMILY);
+  if (!family_module_list)
+    return;
+
+  stp_xml_init();
+  count = stpi_printer_db_params_count();
+  for (i = 0; i < count; i++)
+    {
+      const char *data;
+      size_t size;
+      const char *family = stpi_printer_db_get_params(i, &data, &size);
+      stp_mxml_node_t *node = stpi_xml_cache_decode(data, size);
+      if (node && stpi_find_family(family_module_list, family))
+	{
+	  stp_printvars_t *printvars =
+	    stp_printvars_create_from_xmltree(node, family);
+	  if (printvars)
+	    {
+	      stpi_init_printvars_list();
+	      stp_list_item_create(printvars_list, NULL, printvars);
+	    }
+	}
+      if (node)
+	stp_mxmlDelete(node);
+    }
+  stp_xml_exit();
+
+  count = stpi_printer_db_printer_count();
+  for (i = 0; i < count; i++)
+    {
+      stpi_printer_db_entry_t entry;
+      stp_printer_t *outprinter;
+      stpi_printer_db_get_printer(i, &entry);
+      if (!family_name || strcmp(family_name, entry.family) != 0)
+	{
+	  family_name = entry.family;
+	  family_data = stpi_find_family(family_module_list, family_name);
+	}
+      if (!family_data || !family_data->printfuncs)
+	continue;
+      outprinter = stp_zalloc(sizeof(stp_printer_t));
+      outprinter->driver = entry.driver;
+      outprinter->long_name = stpi_cast_safe(entry.long_name);
+      outprinter->family = stpi_cast_safe(entry.family);
+      outprinter->manufacturer = stpi_cast_safe(entry.manufacturer);
+      outprinter->device_id = stpi_cast_safe(entry.device_id);
+      outprinter->foomatic_id = stpi_cast_safe(entry.foomatic_id);
+      outprinter->comment = stpi_cast_safe(entry.comment);
+      outprinter->model = entry.model;
+      outprinter->printfuncs = family_data->printfuncs;
+      outprinter->vars_node = entry.node;
+      outprinter->vars_node_size = entry.node_size;
+      stp_list_item_create(family_data->printer_list, NULL, outprinter);
+    }
+  stp_list_destroy(family_module_list);
+}
+
+/*
+ * Called once the XML data has been read, and before the family modules
+ * register their printers.
+ */
+void
+stpi_init_printer_db(void)
+{
+  if (stpi_printer_db_open())
+    stpi_load_printers_from_db();
+  else
+    stpi_printer_db_save();
 }
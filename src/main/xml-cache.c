@@ -0,0 +1,569 @@
+/*
+ * "$Id$"
+ *
+ *   Precompiled cache of parsed XML files
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Parsing the XML data files character by character is a large part of
+ * the startup time of a short lived process such as a CUPS filter.  So
+ * that it needn't be repeated, the node tree of each file that is read
+ * is saved in a compact binary form in the cache directory, and later
+ * loads of an unchanged file rebuild the tree directly from that.
+ *
+ * Only the library's own data files, read through stpi_xml_load_file(),
+ * are cached; stp_mxmlLoadFromFile() reads just the file it's given.
+ *
+ * The cache directory is STP_XML_CACHE_DIR if that is set (to an empty
+ * string to disable the cache), or else PKGXMLCACHEDIR.  Each entry
+ * records the size, modification time and inode of the file it was made
+ * from, and is ignored if any of those has changed; it is rewritten the
+ * next time the file is parsed by a process that can write to the cache
+ * directory.  Entries are named after the file's path relative to the
+ * data path, so a cache built at install time under DESTDIR remains
+ * valid once the files are in place.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+#include <gutenprint/gutenprint-intl-internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#define XML_CACHE_MAGIC "STPXMLC"
+#define XML_CACHE_VERSION 1
+#define XML_CACHE_BYTE_ORDER 0x01020304
+
+/*
+ * Node records in the cache body.  Strings are null terminated.
+ */
+#define RECORD_END 0		/* End of an element's children */
+#define RECORD_ELEMENT 1	/* name, count, (name, value) * count, children */
+#define RECORD_TEXT 2		/* string */
+#define RECORD_TEXT_WS 3	/* string, with leading whitespace */
+#define RECORD_OPAQUE 4		/* string */
+
+typedef struct
+{
+  char magic[8];
+  unsigned version;
+  unsigned byte_order;
+  unsigned header_size;		/* sizeof(xml_cache_header_t) */
+  unsigned key_size;		/* Including the terminating null */
+  off_t source_size;
+  time_t source_mtime;
+  ino_t source_inode;
+  size_t body_size;
+} xml_cache_header_t;
+
+typedef struct
+{
+  char *data;
+  size_t size;
+  size_t allocated;
+} cache_buffer_t;
+
+const char *
+stpi_xml_cache_dir(void)
+{
+  const char *dir = getenv("STP_XML_CACHE_DIR");
+  if (!dir)
+    {
+#ifdef PKGXMLCACHEDIR
+      dir = PKGXMLCACHEDIR;
+#else
+      dir = "";
+#endif
+    }
+  return dir[0] ? dir : NULL;
+}
+
+/*
+ * The key of a file is its name relative to the data path directory
+ * that it is in, or its full name if it isn't in any of them.
+ */
+char *
+stpi_xml_cache_key(const char *file)
+{
+  stp_list_t *dir_list = stpi_data_path();
+  stp_list_item_t *item = stp_list_get_start(dir_list);
+  const char *key = file;
+  char *ret;
+  while (item)
+    {
+      const char *dir = (const char *) stp_list_item_get_data(item);
+      size_t len = strlen(dir);
+      while (len > 1 && dir[len - 1] == '/')
+	len--;
+      if (strncmp(file, dir, len) == 0 && file[len] == '/')
+	{
+	  key = file + len + 1;
+	  break;
+	}
+      item = stp_list_item_next(item);
+    }
+  ret = stp_strdup(key);
+  stp_list_destroy(dir_list);
+  return ret;
+}
+
+static char *
+xml_cache_file(const char *dir, const char *key)
+{
+  unsigned hash = 2166136261u;
+  const char *p = key;
+  char name[32];
+  while (*p)
+    {
+      hash ^= (unsigned char) *p++;
+      hash *= 16777619u;
+    }
+  sprintf(name, "%08x-%u.xmlc", hash, (unsigned) strlen(key));
+  return stpi_path_merge(dir, name);
+}
+
+static int
+read_string(const char **ptr, const char *end, const char **str)
+{
+  const char *nul = memchr(*ptr, 0, end - *ptr);
+  if (!nul)
+    return 0;
+  *str = *ptr;
+  *ptr = nul + 1;
+  return 1;
+}
+
+static int
+read_count(const char **ptr, const char *end, unsigned *count)
+{
+  if ((size_t) (end - *ptr) < sizeof(unsigned))
+    return 0;
+  memcpy(count, *ptr, sizeof(unsigned));
+  *ptr += sizeof(unsigned);
+  return 1;
+}
+
+/*
+ * Rebuild the node starting at *ptr (and, for an element, its children)
+ * under parent.  Returns 0 if the data is malformed.
+ */
+static int
+read_node(const char **ptr, const char *end, stp_mxml_node_t *parent)
+{
+  const char *str;
+  const char *value;
+  stp_mxml_node_t *node;
+  unsigned count;
+  unsigned i;
+  int record;
+  if (*ptr >= end)
+    return 0;
+  record = *(*ptr)++;
+  switch (record)
+    {
+    case RECORD_TEXT:
+    case RECORD_TEXT_WS:
+      if (!read_string(ptr, end, &str))
+	return 0;
+      stp_mxmlNewText(parent, record == RECORD_TEXT_WS, str);
+      return 1;
+    case RECORD_OPAQUE:
+      if (!read_string(ptr, end, &str))
+	return 0;
+      stp_mxmlNewOpaque(parent, str);
+      return 1;
+    case RECORD_ELEMENT:
+      if (!read_string(ptr, end, &str) || !read_count(ptr, end, &count))
+	return 0;
+      node = stp_mxmlNewElement(parent, str);
+      /*
+       * The attributes are known to be distinct, so fill in the array
+       * directly rather than searching and growing it for each one.  It
+       * is allocated the way mxml allocates it, since mxml frees it.
+       */
+      if (count > 0)
+	node->value.element.attrs = malloc(count * sizeof(stp_mxml_attr_t));
+      for (i = 0; i < count; i++)
+	{
+	  stp_mxml_attr_t *attr = &(node->value.element.attrs[i]);
+	  if (!read_string(ptr, end, &str) || !read_string(ptr, end, &value))
+	    return 0;
+	  attr->name = strdup(str);
+	  attr->value = strdup(value);
+	  node->value.element.num_attrs++;
+	}
+      while (*ptr < end && **ptr != RECORD_END)
+	if (!read_node(ptr, end, node))
+	  return 0;
+      if (*ptr >= end)
+	return 0;
+      (*ptr)++;
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/*
+ * Rebuild a single node (and its children) from data written by
+ * stpi_xml_cache_encode().  Returns NULL if the data is malformed.
+ */
+stp_mxml_node_t *
+stpi_xml_cache_decode(const char *data, size_t size)
+{
+  const char *ptr = data;
+  stp_mxml_node_t *container = stp_mxmlNewElement(NULL, "cache");
+  stp_mxml_node_t *node = NULL;
+  if (read_node(&ptr, data + size, container) && ptr == data + size)
+    {
+      node = container->child;
+      stp_mxmlRemove(node);
+    }
+  stp_mxmlDelete(container);
+  return node;
+}
+
+static stp_mxml_node_t *
+read_cache(const char *data, size_t size, const char *key,
+	   const struct stat *sbuf)
+{
+  const xml_cache_header_t *header = (const xml_cache_header_t *) data;
+  const char *ptr = data + sizeof(xml_cache_header_t);
+  if (size < sizeof(xml_cache_header_t) ||
+      memcmp(header->magic, XML_CACHE_MAGIC, sizeof(XML_CACHE_MAGIC)) != 0 ||
+      header->version != XML_CACHE_VERSION ||
+      header->byte_order != XML_CACHE_BYTE_ORDER ||
+      header->header_size != sizeof(xml_cache_header_t) ||
+      header->source_size != sbuf->st_size ||
+      header->source_mtime != sbuf->st_mtime ||
+      header->source_inode != sbuf->st_ino ||
+      header->key_size != strlen(key) + 1 ||
+      size != sizeof(xml_cache_header_t) + header->key_size +
+      header->body_size ||
+      memcmp(ptr, key, header->key_size) != 0)
+    return NULL;
+  return stpi_xml_cache_decode(ptr + header->key_size, header->body_size);
+}
+
+stp_mxml_node_t *
+stpi_xml_cache_load(const char *file)
+{
+  const char *dir = stpi_xml_cache_dir();
+  stp_mxml_node_t *doc = NULL;
+  struct stat sbuf, cbuf;
+  char *key;
+  char *cache_file;
+  int fd;
+  if (!dir || stat(file, &sbuf) != 0)
+    return NULL;
+  key = stpi_xml_cache_key(file);
+  cache_file = xml_cache_file(dir, key);
+  fd = open(cache_file, O_RDONLY);
+  if (fd >= 0 && fstat(fd, &cbuf) == 0 &&
+      (size_t) cbuf.st_size >= sizeof(xml_cache_header_t))
+    {
+      size_t size = cbuf.st_size;
+#ifdef HAVE_SYS_MMAN_H
+      void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+	{
+	  doc = read_cache(data, size, key, &sbuf);
+	  munmap(data, size);
+	}
+#else
+      char *data = stp_malloc(size);
+      if (read(fd, data, size) == (ssize_t) size)
+	doc = read_cache(data, size, key, &sbuf);
+      stp_free(data);
+#endif
+    }
+  if (fd >= 0)
+    close(fd);
+  stp_deprintf(STP_DBG_XML, "stpi_xml_cache_load: %s %s (%s)\n",
+	       doc ? "using" : "no usable", cache_file, key);
+  stp_free(cache_file);
+  stp_free(key);
+  return doc;
+}
+
+static void
+append(cache_buffer_t *buf, const void *data, size_t size)
+{
+  if (buf->size + size > buf->allocated)
+    {
+      buf->allocated = 2 * (buf->size + size);
+      buf->data = stp_realloc(buf->data, buf->allocated);
+    }
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+}
+
+static void
+append_byte(cache_buffer_t *buf, char byte)
+{
+  append(buf, &byte, 1);
+}
+
+static void
+append_string(cache_buffer_t *buf, const char *str)
+{
+  append(buf, str, strlen(str) + 1);
+}
+
+/*
+ * Returns 0 if the tree contains something that the cache can't
+ * represent.
+ */
+static int
+write_node(cache_buffer_t *buf, stp_mxml_node_t *node)
+{
+  stp_mxml_node_t *child;
+  unsigned count;
+  int i;
+  switch (node->type)
+    {
+    case STP_MXML_TEXT:
+      append_byte(buf, node->value.text.whitespace ?
+		  RECORD_TEXT_WS : RECORD_TEXT);
+      append_string(buf, node->value.text.string);
+      return 1;
+    case STP_MXML_OPAQUE:
+      append_byte(buf, RECORD_OPAQUE);
+      append_string(buf, node->value.opaque);
+      return 1;
+    case STP_MXML_ELEMENT:
+      append_byte(buf, RECORD_ELEMENT);
+      append_string(buf, node->value.element.name);
+      count = node->value.element.num_attrs;
+      append(buf, &count, sizeof(unsigned));
+      for (i = 0; i < node->value.element.num_attrs; i++)
+	{
+	  const stp_mxml_attr_t *attr = &(node->value.element.attrs[i]);
+	  if (!attr->name || !attr->value)
+	    return 0;
+	  append_string(buf, attr->name);
+	  append_string(buf, attr->value);
+	}
+      for (child = node->child; child; child = child->next)
+	if (!write_node(buf, child))
+	  return 0;
+      append_byte(buf, RECORD_END);
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/*
+ * Encode a single node (and its children) in the form used in cache
+ * entries.  Returns NULL if the tree can't be represented.
+ */
+char *
+stpi_xml_cache_encode(stp_mxml_node_t *node, size_t *size)
+{
+  cache_buffer_t buf;
+  buf.data = NULL;
+  buf.size = 0;
+  buf.allocated = 0;
+  if (!write_node(&buf, node))
+    {
+      STP_SAFE_FREE(buf.data);
+      return NULL;
+    }
+  *size = buf.size;
+  return buf.data;
+}
+
+/*
+ * Create the cache directory and any missing parents.
+ */
+static void
+stpi_xml_cache_make_dir(const char *dir)
+{
+  char *path = stp_strdup(dir);
+  char *p;
+  for (p = path + 1; *p; p++)
+    if (*p == '/')
+      {
+	*p = '\0';
+	(void) mkdir(path, 0755);
+	*p = '/';
+      }
+  (void) mkdir(path, 0755);
+  stp_free(path);
+}
+
+/*
+ * Returns nonzero if files can be written in the cache directory,
+ * creating it if it doesn't exist.  A filter that can't write to it
+ * (such as one running as an unprivileged user) finds that out once,
+ * rather than preparing each entry only to fail to write it.
+ */
+int
+stpi_cache_dir_writable(const char *dir)
+{
+  static char *checked_dir = NULL;
+  static int writable = 0;
+  int ret;
+  stpi_data_lock();
+  if (!checked_dir || strcmp(checked_dir, dir) != 0)
+    {
+      STP_SAFE_FREE(checked_dir);
+      checked_dir = stp_strdup(dir);
+      if (access(dir, W_OK) != 0 && errno == ENOENT)
+	stpi_xml_cache_make_dir(dir);
+      writable = (access(dir, W_OK) == 0);
+      stp_deprintf(STP_DBG_XML, "stpi_cache_dir_writable: %s is %swritable\n",
+		   dir, writable ? "" : "not ");
+    }
+  ret = writable;
+  stpi_data_unlock();
+  return ret;
+}
+
+static int
+write_all(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+    {
+      ssize_t bytes = write(fd, data, size);
+      if (bytes < 0 && errno == EINTR)
+	continue;
+      else if (bytes <= 0)
+	return 0;
+      data += bytes;
+      size -= bytes;
+    }
+  return 1;
+}
+
+/*
+ * Write the chunks to a new temporary file in the same directory and
+ * rename it into place, so that other processes and threads never see
+ * a partial file.  mkstemp() gives the temporary file a name that can't
+ * be guessed and won't follow a link planted in the directory.
+ * Returns 1 on success.
+ */
+int
+stpi_cache_write_file(const char *file, const stpi_cache_chunk_t *chunks,
+		      int count)
+{
+  char *tmp_file = stp_malloc(strlen(file) + 8);
+  int ok = 1;
+  int fd;
+  int i;
+  sprintf(tmp_file, "%s.XXXXXX", file);
+  fd = mkstemp(tmp_file);
+  if (fd < 0)
+    {
+      stp_free(tmp_file);
+      return 0;
+    }
+  for (i = 0; ok && i < count; i++)
+    ok = write_all(fd, chunks[i].data, chunks[i].size);
+  /* mkstemp() creates the file readable only by its owner */
+  if (ok)
+    ok = (fchmod(fd, 0644) == 0);
+  if (close(fd) != 0)
+    ok = 0;
+  if (ok)
+    ok = (rename(tmp_file, file) == 0);
+  if (!ok)
+    (void) unlink(tmp_file);
+  stp_free(tmp_file);
+  return ok;
+}
+
+void
+stpi_xml_cache_save(const char *file, stp_mxml_node_t *doc)
+{
+  const char *dir = stpi_xml_cache_dir();
+  xml_cache_header_t header;
+  stpi_cache_chunk_t chunks[3];
+  char *data;
+  size_t size;
+  struct stat sbuf;
+  char *key;
+  char *cache_file;
+  if (!dir || !doc || doc->next || stat(file, &sbuf) != 0 ||
+      !stpi_cache_dir_writable(dir))
+    return;
+
+  data = stpi_xml_cache_encode(doc, &size);
+  if (!data)
+    return;
+  key = stpi_xml_cache_key(file);
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, XML_CACHE_MAGIC);
+  header.version = XML_CACHE_VERSION;
+  header.byte_order = XML_CACHE_BYTE_ORDER;
+  header.header_size = sizeof(xml_cache_header_t);
+  header.key_size = strlen(key) + 1;
+  header.source_size = sbuf.st_size;
+  header.source_mtime = sbuf.st_mtime;
+  header.source_inode = sbuf.st_ino;
+  header.body_size = size;
+
+  chunks[0].data = (const char *) &header;
+  chunks[0].size = sizeof(header);
+  chunks[1].data = key;
+  chunks[1].size = header.key_size;
+  chunks[2].data = data;
+  chunks[2].size = size;
+  cache_file = xml_cache_file(dir, key);
+  if (stpi_cache_write_file(cache_file, chunks, 3))
+    stp_deprintf(STP_DBG_XML, "stpi_xml_cache_save: wrote %s (%s)\n",
+		 cache_file, key);
+  stp_free(cache_file);
+  stp_free(key);
+  stp_free(data);
+}
+
+/*
+ * Load one of the library's data files, from the cache if there is a
+ * usable entry for it, and otherwise by parsing it (saving the result
+ * in the cache if possible).
+ */
+stp_mxml_node_t *
+stpi_xml_load_file(const char *file)
+{
+  stp_mxml_node_t *doc = stpi_xml_cache_load(file);
+  if (doc)
+    return doc;
+  doc = stp_mxmlLoadFromFile(NULL, file, STP_MXML_NO_CALLBACK);
+  if (doc)
+    stpi_xml_cache_save(file, doc);
+  return doc;
+}
@@ -36,6 +36,12 @@
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#ifdef HAVE_LOCALE_H
+#include <locale.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #if defined(HAVE_VARARGS_H) && !defined(HAVE_STDARG_H)
 #include <varargs.h>
 #else
@@ -125,8 +131,76 @@ stp_unregister_xml_preload(const char *name)
 
 static void stpi_xml_process_gutenprint(stp_mxml_node_t *gutenprint, const char *file);
 
-static char *saved_locale;                 /* Saved LC_ALL */
-static int xml_is_initialised;                 /* Flag for init */
+/*
+ * stp_xml_init() switches the calling thread to the C locale, so that
+ * numbers are read and written the same way everywhere, and the last
+ * matching stp_xml_exit() switches it back.  Where uselocale() is
+ * available only the calling thread's locale changes, so other
+ * threads (including the application's) are unaffected; otherwise the
+ * process locale has to be changed.
+ */
+#if defined(HAVE_LOCALE_H) && defined(HAVE_USELOCALE)
+#define XML_THREAD_LOCALE
+#endif
+
+typedef struct
+{
+  int depth;
+#ifdef XML_THREAD_LOCALE
+  locale_t saved_locale;
+#else
+  char *saved_locale;
+#endif
+} xml_locale_state_t;
+
+#ifdef XML_THREAD_LOCALE
+static locale_t xml_c_locale;
+#endif
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t xml_locale_once = PTHREAD_ONCE_INIT;
+static pthread_key_t xml_locale_key;
+
+static void
+xml_locale_state_free(void *state)
+{
+  stp_free(state);
+}
+
+static void
+xml_locale_setup(void)
+{
+#ifdef XML_THREAD_LOCALE
+  xml_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+#endif
+  pthread_key_create(&xml_locale_key, xml_locale_state_free);
+}
+
+static xml_locale_state_t *
+xml_locale_state(void)
+{
+  xml_locale_state_t *state;
+  pthread_once(&xml_locale_once, xml_locale_setup);
+  state = (xml_locale_state_t *) pthread_getspecific(xml_locale_key);
+  if (!state)
+    {
+      state = stp_zalloc(sizeof(xml_locale_state_t));
+      pthread_setspecific(xml_locale_key, state);
+    }
+  return state;
+}
+#else
+static xml_locale_state_t *
+xml_locale_state(void)
+{
+  static xml_locale_state_t state;
+#ifdef XML_THREAD_LOCALE
+  if (!xml_c_locale)
+    xml_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+#endif
+  return &state;
+}
+#endif
 
 void
 stp_xml_preinit(void)
@@ -140,6 +214,7 @@ stp_xml_preinit(void)
       stpi_xml_preloads = stp_list_create();
       stp_list_set_freefunc(stpi_xml_preloads, xml_preload_freefunc);
       stp_list_set_namefunc(stpi_xml_preloads, xml_preload_namefunc);
+      xml_is_preinitialized = 1;
     }
 }    
 
@@ -151,22 +226,27 @@ stp_xml_preinit(void)
 void
 stp_xml_init(void)
 {
+  xml_locale_state_t *state = xml_locale_state();
   stp_deprintf(STP_DBG_XML, "stp_xml_init: entering at level %d\n",
-	       xml_is_initialised);
-  if (xml_is_initialised >= 1)
+	       state->depth);
+  if (state->depth >= 1)
     {
-      xml_is_initialised++;
+      state->depth++;
       return;
     }
 
   /* Set some locale facets to "C" */
-#ifdef HAVE_LOCALE_H
-  saved_locale = stp_strdup(setlocale(LC_ALL, NULL));
-  stp_deprintf(STP_DBG_XML, "stp_xml_init: saving locale %s\n", saved_locale);
+#ifdef XML_THREAD_LOCALE
+  if (xml_c_locale)
+    state->saved_locale = uselocale(xml_c_locale);
+#elif defined(HAVE_LOCALE_H)
+  state->saved_locale = stp_strdup(setlocale(LC_ALL, NULL));
+  stp_deprintf(STP_DBG_XML, "stp_xml_init: saving locale %s\n",
+	       state->saved_locale);
   setlocale(LC_ALL, "C");
 #endif
 
-  xml_is_initialised = 1;
+  state->depth = 1;
 }
 
 /*
@@ -176,24 +256,29 @@ stp_xml_init(void)
 void
 stp_xml_exit(void)
 {
+  xml_locale_state_t *state = xml_locale_state();
   stp_deprintf(STP_DBG_XML, "stp_xml_exit: entering at level %d\n",
-	       xml_is_initialised);
-  if (xml_is_initialised > 1) /* don't restore original state */
+	       state->depth);
+  if (state->depth > 1) /* don't restore original state */
     {
-      xml_is_initialised--;
+      state->depth--;
       return;
     }
-  else if (xml_is_initialised < 1)
+  else if (state->depth < 1)
     return;
 
   /* Restore locale */
-#ifdef HAVE_LOCALE_H
-  stp_deprintf(STP_DBG_XML, "stp_xml_init: restoring locale %s\n", saved_locale);
-  setlocale(LC_ALL, saved_locale);
-  stp_free(saved_locale);
-  saved_locale = NULL;
+#ifdef XML_THREAD_LOCALE
+  if (xml_c_locale)
+    uselocale(state->saved_locale);
+#elif defined(HAVE_LOCALE_H)
+  stp_deprintf(STP_DBG_XML, "stp_xml_init: restoring locale %s\n",
+	       state->saved_locale);
+  setlocale(LC_ALL, state->saved_locale);
+  stp_free(state->saved_locale);
+  state->saved_locale = NULL;
 #endif
-  xml_is_initialised = 0;
+  state->depth = 0;
 }
 
 void
@@ -249,23 +334,21 @@ stp_xml_parse_file(const char *file) /* File to parse */
 {
   stp_mxml_node_t *doc;
   stp_mxml_node_t *cur;
-  FILE *fp;
 
   stp_deprintf(STP_DBG_XML, "stp_xml_parse_file: reading  `%s'...\n", file);
 
-  fp = fopen(file, "r");
-  if (!fp)
+  stp_xml_init();
+
+  errno = 0;
+  doc = stpi_xml_load_file(file);
+  if (!doc)
     {
-      stp_erprintf("stp_xml_parse_file: unable to open %s: %s\n", file,
-		   strerror(errno));
+      stp_erprintf("stp_xml_parse_file: unable to read %s: %s\n", file,
+		   errno ? strerror(errno) : "parse error");
+      stp_xml_exit();
       return 1;
     }
 
-  stp_xml_init();
-
-  doc = stp_mxmlLoadFile(NULL, fp, STP_MXML_NO_CALLBACK);
-  fclose(fp);
-
   cur = doc->child;
   while (cur &&
 	 (cur->type != STP_MXML_ELEMENT ||
@@ -277,6 +360,7 @@ stp_xml_parse_file(const char *file) /* File to parse */
     {
       stp_erprintf("stp_xml_parse_file: %s: parse error\n", file);
       stp_mxmlDelete(doc);
+      stp_xml_exit();
       return 1;
     }
 
@@ -287,6 +371,7 @@ stp_xml_parse_file(const char *file) /* File to parse */
 	("XML file of the wrong type, root node is %s != (gutenprint || gimp-print)",
 	 cur->value.element.name);
       stp_mxmlDelete(doc);
+      stp_xml_exit();
       return 1;
     }
 
@@ -0,0 +1,252 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time stp_channel_convert() with the channel sets of inkjet printers.
+ *
+ * Usage: channel-bench [width [rows]]
+ *
+ * The channel sets are built the way the Epson driver builds them:
+ * an 8 channel set with light black, cyan and magenta inks, a 10
+ * channel set that adds orange and green inks (which are generated from
+ * the hue of the input), and plain CMYK that is only scaled and ink
+ * limited.  All of them use GCR.  The rows mix flat areas, gradients
+ * and noise.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <gutenprint/gutenprint.h>
+#include <gutenprint/gutenprint-module.h>
+
+#define INPUT_CHANNELS 4
+#define DISTINCT_ROWS 64
+#define RUNS 5
+
+typedef struct
+{
+  const char *name;
+  int special_inks;
+  double ink_limit;
+} inkset_t;
+
+static const inkset_t inksets[] =
+{
+  { "8 channel",  0, 0 },
+  { "10 channel", 1, 2.0 },
+  { "CMYK",       -1, 2.5 },
+};
+
+static const double hue_curves[5][6] =
+{
+  { 1, .5, 0, 0, 0, .5 },	/* Cyan */
+  { 0, .5, 1, .5, 0, 0 },	/* Magenta */
+  { 0, 0, 0, .5, 1, .5 },	/* Yellow */
+  { 0, 0, .5, 1, .5, 0 },	/* Orange */
+  { .5, 0, 0, 0, .5, 1 },	/* Green */
+};
+
+static int image_columns;
+
+static int
+image_width(stp_image_t *image)
+{
+  return image_columns;
+}
+
+static double
+compute_interval(struct timeval *tv1, struct timeval *tv2)
+{
+  return ((double) tv2->tv_sec + (double) tv2->tv_usec / 1000000.) -
+    ((double) tv1->tv_sec + (double) tv1->tv_usec / 1000000.);
+}
+
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffffff;
+}
+
+static void
+fill_row(unsigned short *row, int width, int y)
+{
+  int x = 0;
+  while (x < width)
+    {
+      int span = 1 + next_random() % 400;
+      int kind = next_random() % 4;
+      unsigned short base[INPUT_CHANNELS];
+      int i, j;
+      for (j = 0; j < INPUT_CHANNELS; j++)
+	base[j] = next_random() & 0xffff;
+      if (span > width - x)
+	span = width - x;
+      for (i = 0; i < span; i++, x++)
+	for (j = 0; j < INPUT_CHANNELS; j++)
+	  {
+	    unsigned short *p = &row[x * INPUT_CHANNELS + j];
+	    switch (kind)
+	      {
+	      case 0:
+		*p = 0;
+		break;
+	      case 1:
+		*p = base[j];
+		break;
+	      case 2:
+		*p = (base[j] + (i + y) * 97 * (j + 1)) & 0xffff;
+		break;
+	      default:
+		*p = next_random() & 0xffff;
+		break;
+	      }
+	  }
+    }
+}
+
+static void
+add_hue_curve(stp_vars_t *v, int channel, const double *data)
+{
+  stp_curve_t *curve = stp_curve_create(STP_CURVE_WRAP_AROUND);
+  stp_curve_set_bounds(curve, 0, 1);
+  stp_curve_set_data(curve, 6, data);
+  stp_channel_set_curve(v, channel, curve);
+  stp_curve_destroy(curve);
+}
+
+static stp_vars_t *
+setup_inkset(const inkset_t *ink, stp_image_t *image)
+{
+  stp_vars_t *v = stp_vars_create();
+  stp_curve_t *gcr = stp_curve_create(STP_CURVE_WRAP_NONE);
+  static const double gcr_data[3] = { 0, 16384, 65535 };
+  stp_set_float_parameter(v, "CyanBalance", 1.0);
+  stp_set_float_parameter(v, "MagentaBalance", 1.0);
+  stp_set_float_parameter(v, "YellowBalance", 1.0);
+
+  if (ink->special_inks >= 0)
+    {
+      stp_channel_add(v, STP_ECOLOR_K, 0, 1.0);
+      stp_channel_add(v, STP_ECOLOR_K, 1, 0.5);
+      stp_channel_add(v, STP_ECOLOR_K, 2, 0.25);
+      stp_channel_add(v, STP_ECOLOR_C, 0, 1.0);
+      stp_channel_add(v, STP_ECOLOR_C, 1, 0.35);
+      stp_channel_add(v, STP_ECOLOR_M, 0, 1.0);
+      stp_channel_add(v, STP_ECOLOR_M, 1, 0.35);
+      stp_channel_add(v, STP_ECOLOR_Y, 0, 1.0);
+    }
+  else
+    {
+      int i;
+      for (i = 0; i < INPUT_CHANNELS; i++)
+	stp_channel_add(v, i, 0, 1.0);
+    }
+  if (ink->special_inks > 0)
+    {
+      int i;
+      stp_channel_add(v, STP_ECOLOR_Y + 1, 0, 1.0);
+      stp_channel_add(v, STP_ECOLOR_Y + 2, 0, 1.0);
+      for (i = 0; i < 5; i++)
+	add_hue_curve(v, STP_ECOLOR_C + i, hue_curves[i]);
+    }
+  stp_channel_set_black_channel(v, STP_ECOLOR_K);
+  stp_curve_set_bounds(gcr, 0, 65535);
+  stp_curve_set_data(gcr, 3, gcr_data);
+  stp_channel_set_gcr_curve(v, gcr);
+  stp_curve_destroy(gcr);
+  if (ink->ink_limit > 0)
+    stp_channel_set_ink_limit(v, ink->ink_limit);
+  stp_channel_initialize(v, image, INPUT_CHANNELS);
+  return v;
+}
+
+static double
+time_convert(stp_vars_t *v, unsigned short *rows, int width, int nrows,
+	     unsigned *mask_sum)
+{
+  struct timeval tv1, tv2;
+  size_t row_size = width * INPUT_CHANNELS * sizeof(unsigned short);
+  int i;
+  *mask_sum = 0;
+  (void) gettimeofday(&tv1, NULL);
+  for (i = 0; i < nrows; i++)
+    {
+      unsigned zero_mask;
+      memcpy(stp_channel_get_input(v),
+	     rows + (i % DISTINCT_ROWS) * width * INPUT_CHANNELS, row_size);
+      stp_channel_convert(v, &zero_mask);
+      *mask_sum += zero_mask;
+    }
+  (void) gettimeofday(&tv2, NULL);
+  return compute_interval(&tv1, &tv2);
+}
+
+int
+main(int argc, char **argv)
+{
+  int width = argc > 1 ? atoi(argv[1]) : 5760;
+  int nrows = argc > 2 ? atoi(argv[2]) : 1000;
+  stp_image_t image;
+  unsigned short *rows;
+  int i;
+
+  if (width < 1)
+    width = 1;
+  if (nrows < 1)
+    nrows = 1;
+  stp_init();
+  memset(&image, 0, sizeof(image));
+  image.width = image_width;
+  image_columns = width;
+  rows = malloc(sizeof(unsigned short) * width * INPUT_CHANNELS *
+		DISTINCT_ROWS);
+  for (i = 0; i < DISTINCT_ROWS; i++)
+    fill_row(rows + i * width * INPUT_CHANNELS, width, i);
+
+  printf("%d rows of %d pixels:\n", nrows, width);
+  for (i = 0; i < sizeof(inksets) / sizeof(inkset_t); i++)
+    {
+      stp_vars_t *v = setup_inkset(&inksets[i], &image);
+      unsigned masks;
+      double best = 0;
+      int run;
+      for (run = 0; run < RUNS; run++)
+	{
+	  double elapsed = time_convert(v, rows, width, nrows, &masks);
+	  if (run == 0 || elapsed < best)
+	    best = elapsed;
+	}
+      printf("  %-12s %8.2f ms, %6.2f ns/pixel (best of %d)\n",
+	     inksets[i].name, best * 1000,
+	     best * 1e9 / ((double) width * nrows), RUNS);
+      stp_vars_destroy(v);
+    }
+  free(rows);
+  return 0;
+}
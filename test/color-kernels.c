@@ -0,0 +1,293 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that every set of color conversion kernels that this CPU can
+ * run produces exactly the same output as the plain C kernels.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint.h>
+#include "color-kernels.h"
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define MAX_WIDTH 1031
+#define GUARD 64
+#define SENTINEL 0xa5a5
+
+static const char *kernel_sets[] = { "sse4.1", "avx2" };
+
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffff;
+}
+
+static unsigned short *pre_8;
+static unsigned short *pre_16;
+static unsigned short *tables[3];
+static unsigned char *in_8;
+static unsigned short *in_16;
+static unsigned short *out_ref;
+static unsigned short *out_test;
+
+/*
+ * Inputs mix runs of repeated pixels, extreme values (which hit the last
+ * table entry) and noise.  Small widths are all zero, so that the
+ * nonzero masks get exercised both ways.
+ */
+static void
+fill_input(int width)
+{
+  int i;
+  for (i = 0; i < 4 * MAX_WIDTH; i++)
+    {
+      unsigned r = next_random();
+      if (width < 8)
+	r = 0;
+      else if (i % 37 < 5 && i > 0)
+	{
+	  in_8[i] = in_8[i - 1];
+	  in_16[i] = in_16[i - 1];
+	  continue;
+	}
+      else if (r % 7 == 0)
+	r = (r & 1) ? 0xffff : 0;
+      in_8[i] = r >> 8;
+      in_16[i] = r;
+    }
+}
+
+static void
+fill_tables(void)
+{
+  int i, j;
+  pre_8 = malloc(256 * sizeof(unsigned short));
+  pre_16 = malloc(65536 * sizeof(unsigned short));
+  for (i = 0; i < 256; i++)
+    pre_8[i] = i == 255 ? 65535 : next_random();
+  for (i = 0; i < 65536; i++)
+    pre_16[i] = i == 65535 ? 65535 : next_random();
+  for (j = 0; j < 3; j++)
+    {
+      tables[j] = malloc(65536 * sizeof(unsigned short));
+      for (i = 0; i < 65536; i++)
+	tables[j][i] = i < 64 ? 0 : next_random();
+      tables[j][65535] = 0x1234 + j;
+    }
+}
+
+static void
+clear_output(void)
+{
+  int i;
+  for (i = 0; i < 4 * MAX_WIDTH + GUARD; i++)
+    {
+      out_ref[i] = SENTINEL;
+      out_test[i] = SENTINEL;
+    }
+}
+
+static int
+compare_output(unsigned ref, unsigned test, const char *what, int width)
+{
+  if (ref != test)
+    {
+      printf("(%s width %d returned %x, expected %x) ", what, width,
+	     test, ref);
+      return 1;
+    }
+  if (memcmp(out_ref, out_test, (4 * MAX_WIDTH + GUARD) *
+	     sizeof(unsigned short)) != 0)
+    {
+      int i;
+      for (i = 0; out_ref[i] == out_test[i]; i++)
+	;
+      printf("(%s width %d differs at %d: %x, expected %x) ", what, width,
+	     i, out_test[i], out_ref[i]);
+      return 1;
+    }
+  return 0;
+}
+
+static int
+check_width(const stpi_color_kernels_t *ref, const stpi_color_kernels_t *k,
+	    int width)
+{
+  const unsigned char *i8 = in_8;
+  const unsigned char *i16 = (const unsigned char *) in_16;
+  const unsigned short *const *t = (const unsigned short *const *) tables;
+  int errors = 0;
+  unsigned mask;
+  unsigned r, s;
+  int channels;
+
+  fill_input(width);
+  for (mask = 0; mask <= 0xffff; mask += 0xffff)
+    {
+      for (channels = 1; channels <= 4; channels++)
+	{
+	  clear_output();
+	  r = ref->scale_8(i8, out_ref, channels * width, channels, 257, mask);
+	  s = k->scale_8(i8, out_test, channels * width, channels, 257, mask);
+	  errors += compare_output(r, s, "scale_8", width);
+	  clear_output();
+	  r = ref->scale_16(i16, out_ref, channels * width, channels, 1, mask);
+	  s = k->scale_16(i16, out_test, channels * width, channels, 1, mask);
+	  errors += compare_output(r, s, "scale_16", width);
+	}
+      clear_output();
+      r = ref->gray_expand_8(i8, out_ref, width, 255, mask);
+      s = k->gray_expand_8(i8, out_test, width, 255, mask);
+      errors += compare_output(r, s, "gray_expand_8", width);
+      clear_output();
+      r = ref->gray_expand_16(i16, out_ref, width, 0, mask);
+      s = k->gray_expand_16(i16, out_test, width, 0, mask);
+      errors += compare_output(r, s, "gray_expand_16", width);
+
+      clear_output();
+      r = ref->luminance_8(i8, out_ref, width, 257, 31, 61, 8, mask);
+      s = k->luminance_8(i8, out_test, width, 257, 31, 61, 8, mask);
+      errors += compare_output(r, s, "luminance_8", width);
+      clear_output();
+      r = ref->luminance_16(i16, out_ref, width, 1, 34, 19, 46, mask);
+      s = k->luminance_16(i16, out_test, width, 1, 34, 19, 46, mask);
+      errors += compare_output(r, s, "luminance_16", width);
+    }
+  clear_output();
+  r = ref->luminance_8(i8, out_ref, width, 1, 31, 61, 8, 0);
+  s = k->luminance_8(i8, out_test, width, 1, 31, 61, 8, 0);
+  errors += compare_output(r, s, "luminance_8 unscaled", width);
+
+  clear_output();
+  r = ref->lookup_8(i8, out_ref, width, pre_8, 256, t);
+  s = k->lookup_8(i8, out_test, width, pre_8, 256, t);
+  errors += compare_output(r, s, "lookup_8", width);
+  clear_output();
+  r = ref->lookup_16(i16, out_ref, width, pre_16, 65536, t);
+  s = k->lookup_16(i16, out_test, width, pre_16, 65536, t);
+  errors += compare_output(r, s, "lookup_16", width);
+
+  for (channels = 1; channels <= 3; channels += 2)
+    {
+      clear_output();
+      r = ref->gray_lookup_8(i8, out_ref, width, pre_8, 256, t, channels);
+      s = k->gray_lookup_8(i8, out_test, width, pre_8, 256, t, channels);
+      errors += compare_output(r, s, "gray_lookup_8", width);
+      clear_output();
+      r = ref->gray_lookup_16(i16, out_ref, width, pre_16, 65536, t,
+			      channels);
+      s = k->gray_lookup_16(i16, out_test, width, pre_16, 65536, t,
+			    channels);
+      errors += compare_output(r, s, "gray_lookup_16", width);
+    }
+  return errors;
+}
+
+/*
+ * Pin down the plain C kernels themselves on a few hand-computed pixels.
+ */
+static int
+check_scalar(const stpi_color_kernels_t *k)
+{
+  static const unsigned char rgb_8[6] = { 255, 0, 128, 10, 20, 30 };
+  static const unsigned short rgb_16[3] = { 65535, 65535, 65535 };
+  unsigned short out[6];
+  int errors = 0;
+
+  errors += k->scale_8(rgb_8, out, 6, 3, 257, 0) != 7;
+  errors += out[0] != 65535 || out[1] != 0 || out[2] != 128 * 257;
+  errors += k->scale_8(rgb_8, out, 3, 3, 257, 0xffff) != 6;
+  errors += out[0] != 0 || out[1] != 65535 || out[2] != (128 * 257 ^ 0xffff);
+  errors += k->gray_expand_8(rgb_8 + 1, out, 1, 255, 0) != 0;
+  errors += k->luminance_8(rgb_8 + 3, out, 1, 257, 31, 61, 8, 0) != 1;
+  errors += out[0] != (10 * 257 * 31 + 20 * 257 * 61 + 30 * 257 * 8) / 100;
+  errors += k->luminance_16((const unsigned char *) rgb_16, out, 1, 1,
+			    31, 61, 8, 0) != 1;
+  errors += out[0] != 65535;
+  return errors;
+}
+
+int
+main(void)
+{
+  const stpi_color_kernels_t *ref = stpi_find_color_kernels("scalar");
+  int i;
+
+  in_8 = malloc(4 * MAX_WIDTH);
+  in_16 = malloc(4 * MAX_WIDTH * sizeof(unsigned short));
+  out_ref = malloc((4 * MAX_WIDTH + GUARD) * sizeof(unsigned short));
+  out_test = malloc((4 * MAX_WIDTH + GUARD) * sizeof(unsigned short));
+  fill_tables();
+
+  global_test_count++;
+  printf("%d: Checking scalar kernels... ", global_test_count);
+  if (ref && check_scalar(ref) == 0)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+      return 1;
+    }
+
+  for (i = 0; i < (int) (sizeof(kernel_sets) / sizeof(const char *)); i++)
+    {
+      const stpi_color_kernels_t *k = stpi_find_color_kernels(kernel_sets[i]);
+      int errors = 0;
+      int width;
+      global_test_count++;
+      printf("%d: Checking %s kernels against scalar... ",
+	     global_test_count, kernel_sets[i]);
+      if (!k)
+	{
+	  printf("skipped (not supported)\n");
+	  continue;
+	}
+      for (width = 0; width <= 72; width++)
+	errors += check_width(ref, k, width);
+      errors += check_width(ref, k, MAX_WIDTH - 1);
+      errors += check_width(ref, k, MAX_WIDTH);
+      if (errors)
+	{
+	  printf("FAIL\n");
+	  global_error_count++;
+	}
+      else
+	printf("PASS\n");
+    }
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that the interpolated color lattice (ColorLatticeSize) stays
+ * within tolerance of the exact RGB -> CMY transform.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint-module.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define WIDTH 1024
+#define HEIGHT 16
+
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffff;
+}
+
+/*
+ * A synthetic RGB image: smooth ramps along each row, with noise mixed in
+ * on alternate rows so that every part of the cube gets sampled.
+ */
+static int image_bits;
+
+static int
+image_width(stp_image_t *image)
+{
+  return WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return HEIGHT;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  int i, c;
+  random_state = row + 1;
+  for (i = 0; i < WIDTH; i++)
+    for (c = 0; c < 3; c++)
+      {
+	unsigned v;
+	if (row & 1)
+	  v = next_random();
+	else
+	  v = ((i * (c + 1) * 64) + row * 4096 * c) & 0xffff;
+	if (image_bits == 8)
+	  data[i * 3 + c] = v >> 8;
+	else
+	  ((unsigned short *) data)[i * 3 + c] = v;
+      }
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "color-lattice";
+}
+
+static stp_image_t test_image =
+{
+  NULL,
+  NULL,
+  image_width,
+  image_height,
+  image_get_row,
+  image_get_appname,
+  NULL,
+  NULL
+};
+
+static unsigned short *
+convert(const char *correction, int bits, double saturation,
+	double brightness, int lattice_size)
+{
+  stp_vars_t *v = stp_vars_create();
+  unsigned short *out = malloc(WIDTH * HEIGHT * 3 * sizeof(unsigned short));
+  int row, i;
+  image_bits = bits;
+  stp_set_string_parameter(v, "InputImageType", "RGB");
+  stp_set_string_parameter(v, "STPIOutputType", "CMY");
+  stp_set_string_parameter(v, "ChannelBitDepth", bits == 8 ? "8" : "16");
+  stp_set_string_parameter(v, "ColorCorrection", correction);
+  stp_set_float_parameter(v, "Saturation", saturation);
+  stp_set_float_parameter(v, "Brightness", brightness);
+  stp_set_int_parameter(v, "ColorLatticeSize", lattice_size);
+  for (i = 0; i < 3; i++)
+    stp_channel_add(v, i, 0, 1.0);
+  /* Normally done by the driver while verifying the settings */
+  stp_parameter_list_destroy(stp_color_list_parameters(v));
+  stp_color_init(v, &test_image, 65536);
+  for (row = 0; row < HEIGHT; row++)
+    {
+      unsigned zero_mask;
+      stp_color_get_row(v, &test_image, row, &zero_mask);
+      memcpy(out + row * WIDTH * 3, stp_channel_get_input(v),
+	     WIDTH * 3 * sizeof(unsigned short));
+    }
+  stp_vars_destroy(v);
+  return out;
+}
+
+static void
+check_lattice(const char *correction, int bits, double saturation,
+	      double brightness, int lattice_size, int max_tolerance,
+	      double mean_tolerance)
+{
+  unsigned short *exact =
+    convert(correction, bits, saturation, brightness, 0);
+  unsigned short *approx =
+    convert(correction, bits, saturation, brightness, lattice_size);
+  int max_error = 0;
+  double total_error = 0;
+  double mean_error;
+  int i;
+  for (i = 0; i < WIDTH * HEIGHT * 3; i++)
+    {
+      int error = abs((int) exact[i] - (int) approx[i]);
+      if (error > max_error)
+	max_error = error;
+      total_error += error;
+    }
+  mean_error = total_error / (WIDTH * HEIGHT * 3);
+  global_test_count++;
+  printf("%d: Checking %s %d bit, saturation %.1f brightness %.1f, "
+	 "lattice %d... ", global_test_count, correction, bits, saturation,
+	 brightness, lattice_size);
+  if (max_error > max_tolerance || mean_error > mean_tolerance)
+    {
+      printf("(max error %d, mean %.2f) FAIL\n", max_error, mean_error);
+      global_error_count++;
+    }
+  else
+    printf("(max error %d, mean %.2f) PASS\n", max_error, mean_error);
+  free(exact);
+  free(approx);
+}
+
+int
+main(void)
+{
+  stp_init();
+
+  /*
+   * With 8 bit input the exact path looks up its output curves with only
+   * 256 entries, so it is a staircase that the lattice smooths over; allow
+   * for a step or so of that.  At 16 bits the error shrinks as the
+   * lattice gets finer.
+   */
+  check_lattice("Accurate", 8, 1.0, 1.0, 33, 768, 192);
+  check_lattice("Accurate", 8, 1.6, 1.0, 33, 1536, 192);
+  check_lattice("Accurate", 16, 1.0, 1.0, 33, 64, 8);
+  check_lattice("Accurate", 16, 0.5, 1.3, 33, 1536, 16);
+  check_lattice("Accurate", 16, 0.5, 1.3, 65, 1024, 8);
+  check_lattice("Bright", 8, 1.0, 1.0, 33, 768, 192);
+  check_lattice("Hue", 16, 1.2, 1.0, 33, 512, 16);
+  check_lattice("Uncorrected", 8, 1.0, 0.7, 17, 0, 0);
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Dither random rows with the ordered dithers using every set of row
+ * kernels this CPU can run, checking that the output and the row ends
+ * are exactly what dithering a pixel at a time produces.  The rows are
+ * scaled up and down as well as dithered at their own width, and some
+ * are masked.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define ROWS 24
+#define MAX_WIDTH 1100
+#define MAX_CHANNELS 6
+#define MAX_BYTES (2 * ((MAX_WIDTH + 7) / 8))
+
+static const char *kernel_sets[] = { "scalar", "sse2", "avx2" };
+
+static const char *algorithms[] =
+  { "Ordered", "OrderedNew", "Fast", "Adaptive", "Segmented" };
+
+static const int widths[][2] =	/* Input and output widths */
+  { { 1000, 1000 }, { 997, 997 }, { 1000, 731 }, { 640, 1003 }, { 37, 37 },
+    { 8, 8 } };
+
+typedef enum
+{
+  INKS_1BIT,
+  INKS_2BIT,
+  INKS_PHOTO_2BIT
+} inks_t;
+
+static const char *ink_names[] = { "1-bit", "2-bit", "photo 2-bit" };
+
+#define SHADE(density, name)					\
+{  density, sizeof(name)/sizeof(stp_dotsize_t), name  }
+
+static const stp_dotsize_t single_dotsize[] =
+{
+  { 0x1, 1.0 }
+};
+
+static const stp_dotsize_t variable_dotsizes[] =
+{
+  { 0x1, 0.28 },
+  { 0x2, 0.58 },
+  { 0x3, 1.0  }
+};
+
+static const stp_shade_t normal_1bit_shades[] =
+{
+  SHADE(1.0, single_dotsize)
+};
+
+static const stp_shade_t normal_2bit_shades[] =
+{
+  SHADE(1.0, variable_dotsizes)
+};
+
+static const stp_shade_t photo_2bit_shades[] =
+{
+  SHADE(0.33, variable_dotsizes),
+  SHADE(1.0, variable_dotsizes)
+};
+
+static int src_width;
+
+static int
+image_width(stp_image_t *image)
+{
+  return src_width;
+}
+
+static stp_image_t image =
+{
+  NULL,
+  NULL,
+  image_width,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffffff;
+}
+
+/*
+ * Input is made of spans of zeros, full and nearly full ink, light
+ * values near the bottom of the ranges, and noise.
+ */
+static void
+fill_row(unsigned short *input, int count)
+{
+  int i = 0;
+  while (i < count)
+    {
+      int span = 1 + next_random() % 90;
+      int kind = next_random() % 5;
+      int j;
+      if (span > count - i)
+	span = count - i;
+      for (j = 0; j < span; j++)
+	{
+	  switch (kind)
+	    {
+	    case 0:
+	      input[i + j] = 0;
+	      break;
+	    case 1:
+	      input[i + j] = next_random() & 1 ? 65535 : 65534;
+	      break;
+	    case 2:
+	      input[i + j] = next_random() % 600;
+	      break;
+	    default:
+	      input[i + j] = next_random();
+	      break;
+	    }
+	}
+      i += span;
+    }
+}
+
+/*
+ * Dither ROWS rows, saving the output of each channel and its first and
+ * last positions.
+ */
+static void
+dither_rows(const char *algorithm, inks_t inks, int dst_width, int masked,
+	    unsigned char *out, int *ends)
+{
+  static unsigned short input[MAX_WIDTH * MAX_CHANNELS];
+  static unsigned char buffers[MAX_CHANNELS][MAX_BYTES];
+  static unsigned char mask[MAX_BYTES];
+  static const int colors[MAX_CHANNELS] =
+    { STP_ECOLOR_K, STP_ECOLOR_C, STP_ECOLOR_M, STP_ECOLOR_Y,
+      STP_ECOLOR_C, STP_ECOLOR_M };
+  static const int subchannels[MAX_CHANNELS] = { 0, 0, 0, 0, 1, 1 };
+  int nchannels = inks == INKS_PHOTO_2BIT ? 6 : 4;
+  stp_vars_t *v = stp_vars_create();
+  int row, i;
+
+  stp_set_driver(v, "escp2-ex");
+  stp_set_string_parameter(v, "DitherAlgorithm", algorithm);
+  stp_set_string_parameter(v, "PrintingMode", "Color");
+  stp_set_string_parameter(v, "InputImageType", "CMYK");
+  stp_dither_init(v, &image, dst_width, 1, 1);
+  for (i = 0; i < nchannels; i++)
+    stp_dither_add_channel(v, buffers[i], colors[i], subchannels[i]);
+  switch (inks)
+    {
+    case INKS_1BIT:
+      for (i = 0; i < 4; i++)
+	stp_dither_set_inks_full(v, colors[i], 1, normal_1bit_shades,
+				 1.0, 1.0);
+      break;
+    case INKS_2BIT:
+      stp_dither_set_transition(v, 0.5);
+      for (i = 0; i < 4; i++)
+	stp_dither_set_inks_full(v, colors[i], 1, normal_2bit_shades,
+				 1.0, 1.0);
+      break;
+    case INKS_PHOTO_2BIT:
+      stp_dither_set_transition(v, 0.7);
+      stp_dither_set_inks_full(v, STP_ECOLOR_K, 1, normal_2bit_shades,
+			       1.0, 1.0);
+      stp_dither_set_inks_full(v, STP_ECOLOR_C, 2, photo_2bit_shades,
+			       1.0, 0.65);
+      stp_dither_set_inks_full(v, STP_ECOLOR_M, 2, photo_2bit_shades,
+			       1.0, 0.6);
+      stp_dither_set_inks_full(v, STP_ECOLOR_Y, 1, normal_2bit_shades,
+			       1.0, 0.08);
+      break;
+    }
+
+  random_state = 1;
+  for (row = 0; row < ROWS; row++)
+    {
+      fill_row(input, src_width * nchannels);
+      for (i = 0; i < MAX_BYTES; i++)
+	mask[i] = next_random();
+      stp_dither_internal(v, row, input, 0, 0, masked ? mask : NULL);
+      for (i = 0; i < nchannels; i++)
+	{
+	  memcpy(out, buffers[i], MAX_BYTES);
+	  out += MAX_BYTES;
+	  *ends++ = stp_dither_get_first_position(v, colors[i],
+						  subchannels[i]);
+	  *ends++ = stp_dither_get_last_position(v, colors[i],
+						 subchannels[i]);
+	}
+    }
+  stp_vars_destroy(v);
+}
+
+int
+main(void)
+{
+  size_t out_size = ROWS * MAX_CHANNELS * MAX_BYTES;
+  size_t ends_size = ROWS * MAX_CHANNELS * 2 * sizeof(int);
+  unsigned char *ref_out = malloc(out_size);
+  unsigned char *test_out = malloc(out_size);
+  int *ref_ends = malloc(ends_size);
+  int *test_ends = malloc(ends_size);
+  int k;
+
+  stp_init();
+  for (k = 0; k < (int) (sizeof(kernel_sets) / sizeof(const char *)); k++)
+    {
+      int errors = 0;
+      int a, w, inks, masked;
+      global_test_count++;
+      printf("%d: Checking %s dither kernels against dithering a pixel at a time... ",
+	     global_test_count, kernel_sets[k]);
+      if (!stpi_set_dither_kernels(kernel_sets[k]))
+	{
+	  printf("skipped (not supported)\n");
+	  continue;
+	}
+      for (a = 0; a < (int) (sizeof(algorithms) / sizeof(const char *)); a++)
+	for (inks = INKS_1BIT; inks <= INKS_PHOTO_2BIT; inks++)
+	  for (w = 0; w < (int) (sizeof(widths) / sizeof(widths[0])); w++)
+	    for (masked = 0; masked < 2; masked++)
+	      {
+		src_width = widths[w][0];
+		memset(ref_out, 0, out_size);
+		memset(test_out, 0, out_size);
+		memset(ref_ends, 0, ends_size);
+		memset(test_ends, 0, ends_size);
+		stpi_set_dither_kernels("none");
+		dither_rows(algorithms[a], inks, widths[w][1], masked,
+			    ref_out, ref_ends);
+		stpi_set_dither_kernels(kernel_sets[k]);
+		dither_rows(algorithms[a], inks, widths[w][1], masked,
+			    test_out, test_ends);
+		if (memcmp(ref_out, test_out, out_size) != 0 ||
+		    memcmp(ref_ends, test_ends, ends_size) != 0)
+		  {
+		    if (errors < 10)
+		      printf("(%s %s %d to %d%s differs) ", algorithms[a],
+			     ink_names[inks], widths[w][0], widths[w][1],
+			     masked ? " masked" : "");
+		    errors++;
+		  }
+	      }
+      if (errors)
+	{
+	  printf("FAIL\n");
+	  global_error_count++;
+	}
+      else
+	printf("PASS\n");
+    }
+
+  free(ref_out);
+  free(test_out);
+  free(ref_ends);
+  free(test_ends);
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that converting rows lent by the image gives the same output as
+ * having them copied, that every lent row is released, and that rows
+ * read through a buffered image, which lends its rows, are mirrored
+ * correctly.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint.h>
+#include <gutenprint/gutenprint-module.h>
+#include "gutenprint-internal.h"
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define WIDTH 517
+#define HEIGHT 12
+#define MAX_CHANNELS 4
+
+typedef struct
+{
+  const char *input;
+  const char *output;
+  int channels;
+  int bits;
+} setting_t;
+
+static const setting_t settings[] =
+{
+  { "RGB",       "CMYK",      4, 8 },
+  { "RGB",       "CMYK",      4, 16 },
+  { "CMYK",      "CMYK",      4, 16 },
+  { "Grayscale", "Grayscale", 1, 8 },
+};
+
+static const int setting_count = sizeof(settings) / sizeof(setting_t);
+
+static unsigned char rows[HEIGHT][WIDTH * MAX_CHANNELS * 2];
+static int lent, released;
+
+static void
+fill_rows(void)
+{
+  unsigned state = 1;
+  int row, i;
+  for (row = 0; row < HEIGHT; row++)
+    for (i = 0; i < WIDTH * MAX_CHANNELS * 2; i++)
+      {
+	state = state * 1103515245 + 12345;
+	rows[row][i] = (row & 1) ? (state >> 16) : (i * 7 + row);
+      }
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return HEIGHT;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  memcpy(data, rows[row], byte_limit);
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const unsigned char *
+image_lend_row(stp_image_t *image, size_t byte_limit, int row)
+{
+  lent++;
+  return rows[row];
+}
+
+static void
+image_release_row(stp_image_t *image, const unsigned char *data, int row)
+{
+  if (data == rows[row])
+    released++;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "lend-row";
+}
+
+static stp_image_t copy_image =
+{
+  NULL,
+  NULL,
+  image_width,
+  image_height,
+  image_get_row,
+  image_get_appname,
+  NULL,
+  NULL
+};
+
+static stp_image_t lend_image =
+{
+  NULL,
+  NULL,
+  image_width,
+  image_height,
+  image_get_row,
+  image_get_appname,
+  NULL,
+  NULL
+};
+
+static const stp_image_row_funcs_t lend_funcs =
+{
+  sizeof(stp_image_row_funcs_t),
+  image_lend_row,
+  image_release_row,
+  NULL				/* skip_rows */
+};
+
+static unsigned short *
+convert(const setting_t *s, stp_image_t *image)
+{
+  size_t row_size = WIDTH * s->channels * sizeof(unsigned short);
+  unsigned short *out = malloc(row_size * HEIGHT);
+  stp_vars_t *v = stp_vars_create();
+  int row, i;
+  stp_set_string_parameter(v, "InputImageType", s->input);
+  stp_set_string_parameter(v, "STPIOutputType", s->output);
+  stp_set_string_parameter(v, "ChannelBitDepth", s->bits == 8 ? "8" : "16");
+  for (i = 0; i < s->channels; i++)
+    stp_channel_add(v, i, 0, 1.0);
+  /* Normally done by the driver while verifying the settings */
+  stp_parameter_list_destroy(stp_color_list_parameters(v));
+  stp_color_init(v, image, 65536);
+  for (row = 0; row < HEIGHT; row++)
+    {
+      unsigned zero_mask;
+      stp_color_get_row(v, image, row, &zero_mask);
+      memcpy((char *) out + row * row_size, stp_channel_get_output(v),
+	     row_size);
+    }
+  stp_vars_destroy(v);
+  return out;
+}
+
+static void
+check(const char *what, int ok)
+{
+  global_test_count++;
+  printf("%d: Checking %s... ", global_test_count, what);
+  if (ok)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+}
+
+/*
+ * Read every row of a buffered image both ways, comparing them with
+ * the source rows flipped by hand.
+ */
+static int
+check_buffered(unsigned flags, int bytes_per_pixel)
+{
+  size_t byte_limit = WIDTH * bytes_per_pixel;
+  stp_image_t *image = stpi_buffer_image(&copy_image, flags);
+  unsigned char data[WIDTH * MAX_CHANNELS * 2];
+  unsigned char expected[WIDTH * MAX_CHANNELS * 2];
+  int errors = 0;
+  int row, i;
+  for (row = 0; row < HEIGHT; row++)
+    {
+      const unsigned char *src =
+	rows[flags & BUFFER_FLAG_FLIP_Y ? HEIGHT - row - 1 : row];
+      const unsigned char *lent_row;
+      for (i = 0; i < WIDTH; i++)
+	memcpy(expected + i * bytes_per_pixel,
+	       src + (flags & BUFFER_FLAG_FLIP_X ? WIDTH - i - 1 : i) *
+	       bytes_per_pixel, bytes_per_pixel);
+      lent_row = stp_image_lend_row(image, byte_limit, row);
+      if (!lent_row || memcmp(lent_row, expected, byte_limit) != 0)
+	errors++;
+      if (stp_image_get_row(image, data, byte_limit, row) !=
+	  STP_IMAGE_STATUS_OK || memcmp(data, expected, byte_limit) != 0)
+	errors++;
+    }
+  stp_image_conclude(image);
+  return errors == 0;
+}
+
+int
+main(void)
+{
+  int i;
+  int errors = 0;
+  stp_image_row_funcs_t short_funcs = lend_funcs;
+  unsigned short *short_reference;
+  unsigned short *short_test;
+  stp_init();
+  fill_rows();
+  stp_image_set_row_funcs(&lend_image, &lend_funcs);
+
+  for (i = 0; i < setting_count; i++)
+    {
+      const setting_t *s = &settings[i];
+      unsigned short *reference = convert(s, &copy_image);
+      unsigned short *test;
+      lent = released = 0;
+      test = convert(s, &lend_image);
+      if (memcmp(reference, test, WIDTH * HEIGHT * s->channels *
+		 sizeof(unsigned short)) != 0)
+	{
+	  printf("(%s to %s %d bit differs) ", s->input, s->output, s->bits);
+	  errors++;
+	}
+      if (lent != HEIGHT || released != HEIGHT)
+	{
+	  printf("(%s to %s %d bit lent %d released %d) ", s->input,
+		 s->output, s->bits, lent, released);
+	  errors++;
+	}
+      free(reference);
+      free(test);
+    }
+  check("conversion of lent rows", errors == 0);
+
+  /*
+   * Callbacks past the size the application registered are left out,
+   * as they would be for an application built before they existed.
+   */
+  short_funcs.size = offsetof(stp_image_row_funcs_t, release_row);
+  stp_image_set_row_funcs(&lend_image, &short_funcs);
+  lent = released = 0;
+  short_reference = convert(&settings[0], &copy_image);
+  short_test = convert(&settings[0], &lend_image);
+  check("callbacks past the registered size",
+	memcmp(short_reference, short_test, WIDTH * HEIGHT *
+	       settings[0].channels * sizeof(unsigned short)) == 0 &&
+	lent == HEIGHT && released == 0);
+  free(short_reference);
+  free(short_test);
+  stp_image_set_row_funcs(&lend_image, NULL);
+
+  check("unflipped buffered rows", check_buffered(0, 3));
+  check("buffered rows flipped horizontally",
+	check_buffered(BUFFER_FLAG_FLIP_X, 6));
+  check("buffered rows flipped vertically",
+	check_buffered(BUFFER_FLAG_FLIP_Y, 1));
+  check("buffered rows flipped both ways",
+	check_buffered(BUFFER_FLAG_FLIP_X | BUFFER_FLAG_FLIP_Y, 8));
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
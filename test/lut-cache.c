@@ -0,0 +1,286 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that color conversion with curves restored from the LUT cache
+ * gives exactly the same output, and the same LUT dump, as computing
+ * the curves.  Each setting is converted with the cache disabled, then
+ * with an empty cache directory (which saves the curves), and then
+ * again with the curves in the cache.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint-module.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define WIDTH 1024
+#define HEIGHT 8
+
+typedef struct
+{
+  const char *input;
+  int in_channels;
+  const char *output;
+  int channels;
+  int bits;
+  const char *correction;
+  double gamma;
+  double brightness;
+  double contrast;
+  int curves;			/* Set a channel curve and a GCR curve */
+} setting_t;
+
+static const setting_t settings[] =
+{
+  { "RGB",       3, "CMYK",      4, 8,  "Accurate",    1.0, 1.0, 1.0, 0 },
+  { "RGB",       3, "CMYK",      4, 16, "Bright",      1.2, 1.3, 0.8, 0 },
+  { "RGB",       3, "CMYK",      4, 8,  "Hue",         1.0, 0.9, 1.1, 1 },
+  { "RGB",       3, "CMY",       3, 16, "Accurate",    0.8, 1.0, 1.0, 1 },
+  { "CMYK",      4, "CMYK",      4, 16, "Uncorrected", 1.0, 1.0, 1.0, 0 },
+  { "Grayscale", 1, "Grayscale", 1, 8,  "Accurate",    1.5, 1.0, 1.2, 0 },
+  { "RGB",       3, "RGB",       3, 8,  "Desaturated", 1.0, 1.1, 1.0, 0 },
+};
+
+static const int setting_count = sizeof(settings) / sizeof(setting_t);
+
+static const setting_t *current;
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffff;
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return HEIGHT;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  int i;
+  int count = WIDTH * current->in_channels;
+  random_state = row + 1;
+  for (i = 0; i < count; i++)
+    {
+      unsigned v = (row & 1) ? next_random() : (i * 65535 / count);
+      if (current->bits == 8)
+	data[i] = v >> 8;
+      else
+	((unsigned short *) data)[i] = v;
+    }
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "lut-cache";
+}
+
+static stp_image_t test_image =
+{
+  NULL,
+  NULL,
+  image_width,
+  image_height,
+  image_get_row,
+  image_get_appname,
+  NULL,
+  NULL
+};
+
+static char *
+read_file(const char *file)
+{
+  FILE *fp = fopen(file, "r");
+  char *data;
+  long size = 0;
+  if (fp && fseek(fp, 0, SEEK_END) == 0)
+    size = ftell(fp);
+  data = calloc(size + 1, 1);
+  if (fp)
+    {
+      rewind(fp);
+      if (fread(data, 1, size, fp) != (size_t) size)
+	data[0] = '\0';
+      fclose(fp);
+    }
+  return data;
+}
+
+/*
+ * Convert the image with the given setting, returning the output of
+ * the channel conversion followed by the LUT dump.
+ */
+static unsigned short *
+convert(const setting_t *s, const char *dump_file, char **dump)
+{
+  static const double curve_data[4] = { 0, 0.3, 0.8, 1.0 };
+  static const double gcr_data[3] = { 0, 16384, 65535 };
+  size_t row_size = WIDTH * s->channels * sizeof(unsigned short);
+  unsigned short *out = malloc(row_size * HEIGHT);
+  stp_vars_t *v = stp_vars_create();
+  int row, i;
+  current = s;
+  stp_set_string_parameter(v, "InputImageType", s->input);
+  stp_set_string_parameter(v, "STPIOutputType", s->output);
+  stp_set_string_parameter(v, "ChannelBitDepth", s->bits == 8 ? "8" : "16");
+  stp_set_string_parameter(v, "ColorCorrection", s->correction);
+  stp_set_float_parameter(v, "Gamma", s->gamma);
+  stp_set_float_parameter(v, "Brightness", s->brightness);
+  stp_set_float_parameter(v, "Contrast", s->contrast);
+  stp_set_file_parameter(v, "LUTDumpFile", dump_file);
+  if (s->curves)
+    {
+      stp_curve_t *curve = stp_curve_create(STP_CURVE_WRAP_NONE);
+      stp_curve_set_data(curve, 4, curve_data);
+      stp_set_curve_parameter(v, "CyanCurve", curve);
+      stp_set_curve_parameter_active(v, "CyanCurve", STP_PARAMETER_ACTIVE);
+      stp_curve_destroy(curve);
+      curve = stp_curve_create(STP_CURVE_WRAP_NONE);
+      stp_curve_set_bounds(curve, 0, 65535);
+      stp_curve_set_data(curve, 3, gcr_data);
+      stp_set_curve_parameter(v, "GCRCurve", curve);
+      stp_curve_destroy(curve);
+    }
+  for (i = 0; i < s->channels; i++)
+    stp_channel_add(v, i, 0, 1.0);
+  /* Normally done by the driver while verifying the settings */
+  stp_parameter_list_destroy(stp_color_list_parameters(v));
+  stp_color_init(v, &test_image, 65536);
+  for (row = 0; row < HEIGHT; row++)
+    {
+      unsigned zero_mask;
+      stp_color_get_row(v, &test_image, row, &zero_mask);
+      memcpy((char *) out + row * row_size, stp_channel_get_output(v),
+	     row_size);
+    }
+  stp_vars_destroy(v);
+  *dump = read_file(dump_file);
+  return out;
+}
+
+static void
+check(const char *what, int ok)
+{
+  global_test_count++;
+  printf("%d: Checking %s... ", global_test_count, what);
+  if (ok)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+}
+
+int
+main(void)
+{
+  char cache_dir[] = "/tmp/lut-cache-XXXXXX";
+  char dump_file[64];
+  char command[64];
+  unsigned short *reference[sizeof(settings) / sizeof(setting_t)];
+  char *reference_dump[sizeof(settings) / sizeof(setting_t)];
+  unsigned long hits, misses, old_hits, old_misses;
+  int pass, i;
+
+  if (!mkdtemp(cache_dir))
+    {
+      perror("mkdtemp");
+      return 1;
+    }
+  sprintf(dump_file, "%s/dump", cache_dir);
+  setenv("STP_XML_CACHE_DIR", "", 1);
+  stp_init();
+
+  for (i = 0; i < setting_count; i++)
+    reference[i] = convert(&settings[i], dump_file, &reference_dump[i]);
+  stp_color_get_lut_cache_stats(&hits, &misses);
+  check("that nothing is counted with the cache disabled",
+	hits == 0 && misses == 0);
+
+  setenv("STP_XML_CACHE_DIR", cache_dir, 1);
+  for (pass = 0; pass < 2; pass++)
+    {
+      int errors = 0;
+      stp_color_get_lut_cache_stats(&old_hits, &old_misses);
+      for (i = 0; i < setting_count; i++)
+	{
+	  const setting_t *s = &settings[i];
+	  char *dump;
+	  unsigned short *out = convert(s, dump_file, &dump);
+	  if (memcmp(out, reference[i], WIDTH * HEIGHT * s->channels *
+		     sizeof(unsigned short)) != 0 ||
+	      strcmp(dump, reference_dump[i]) != 0)
+	    {
+	      printf("(%s to %s %d bit %s differs) ", s->input, s->output,
+		     s->bits, s->correction);
+	      errors++;
+	    }
+	  free(out);
+	  free(dump);
+	}
+      stp_color_get_lut_cache_stats(&hits, &misses);
+      if (pass == 0)
+	check("conversion while saving the curves",
+	      errors == 0 && hits == old_hits &&
+	      misses == old_misses + setting_count);
+      else
+	check("conversion with the curves from the cache",
+	      errors == 0 && hits == old_hits + setting_count &&
+	      misses == old_misses);
+    }
+
+  for (i = 0; i < setting_count; i++)
+    {
+      free(reference[i]);
+      free(reference_dump[i]);
+    }
+  sprintf(command, "rm -rf %s", cache_dir);
+  if (system(command) != 0)
+    fprintf(stderr, "Unable to remove %s\n", cache_dir);
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Fuzz stp_pack_tiff() and stp_pack_uncompressed() with every set of
+ * pack kernels this CPU can run, checking that the compressed data and
+ * the first and last nonzero bytes are exactly what the original byte
+ * at a time encoder produced.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define MAX_LENGTH 5000
+#define ITERATIONS 20000
+
+static const char *kernel_sets[] = { "scalar", "sse2", "avx2" };
+
+static unsigned random_state = 1;
+
+static unsigned
+next_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 8) & 0xffffff;
+}
+
+/*
+ * The encoder as it was before it was vectorized.
+ */
+static void
+reference_first_and_last(const unsigned char *line, int length,
+			 int *first, int *last)
+{
+  int i;
+  int found_first = 0;
+  *first = 0;
+  *last = 0;
+  for (i = 0; i < length; i++)
+    {
+      if (line[i] == 0)
+	{
+	  if (!found_first)
+	    (*first)++;
+	}
+      else
+	{
+	  *last = i;
+	  found_first = 1;
+	}
+    }
+}
+
+static int
+reference_pack_tiff(const unsigned char *line, int length,
+		    unsigned char *comp_buf, unsigned char **comp_ptr,
+		    int *first, int *last)
+{
+  const unsigned char *start;
+  unsigned char repeat;
+  int count;
+  int tcount;
+  const unsigned char *xline = line;
+  int xlength = length;
+  reference_first_and_last(line, length, first, last);
+  (*comp_ptr) = comp_buf;
+  while (xlength > 0)
+    {
+      start  = xline;
+      xline   += 2;
+      xlength -= 2;
+      while (xlength > 0 && (xline[-2] != xline[-1] || xline[-1] != xline[0]))
+	{
+	  xline ++;
+	  xlength --;
+	}
+      xline   -= 2;
+      xlength += 2;
+      count = xline - start;
+      while (count > 0)
+	{
+	  tcount = count > 128 ? 128 : count;
+	  (*comp_ptr)[0] = tcount - 1;
+	  memcpy((*comp_ptr) + 1, start, tcount);
+	  (*comp_ptr) += tcount + 1;
+	  start    += tcount;
+	  count    -= tcount;
+	}
+      if (xlength <= 0)
+	break;
+      start  = xline;
+      repeat = xline[0];
+      xline ++;
+      xlength --;
+      if (xlength > 0)
+	{
+	  int ylength = xlength;
+	  while (ylength && *xline == repeat)
+	    {
+	      xline ++;
+	      ylength --;
+	    }
+	  xlength = ylength;
+	}
+      count = xline - start;
+      while (count > 0)
+	{
+	  tcount = count > 128 ? 128 : count;
+	  (*comp_ptr)[0] = 1 - tcount;
+	  (*comp_ptr)[1] = repeat;
+	  (*comp_ptr) += 2;
+	  count    -= tcount;
+	}
+    }
+  return *first <= *last;
+}
+
+/*
+ * Lines are built from spans of zeros (which dominate the light ink
+ * channels), runs of other values, short pairs, and noise, with span
+ * lengths clustered around the 128 byte limit and the vector widths.
+ */
+static int
+span_length(void)
+{
+  static const int interesting[] =
+    { 1, 2, 3, 4, 15, 16, 17, 31, 32, 33, 127, 128, 129, 130, 256, 257 };
+  unsigned r = next_random();
+  if (r % 4 == 0)
+    return interesting[(r >> 4) % (sizeof(interesting) / sizeof(int))];
+  else if (r % 4 == 1)
+    return 1 + (r >> 4) % 8;
+  else
+    return 1 + (r >> 4) % 600;
+}
+
+static int
+fill_line(unsigned char *line)
+{
+  int length;
+  int i = 0;
+  unsigned r = next_random();
+  if (r % 8 == 0)
+    length = r % 8;
+  else if (r % 8 == 1)
+    length = MAX_LENGTH;
+  else
+    length = (r >> 3) % MAX_LENGTH;
+  while (i < length)
+    {
+      int span = span_length();
+      int kind = next_random() % 6;
+      int j;
+      if (span > length - i)
+	span = length - i;
+      for (j = 0; j < span; j++)
+	{
+	  switch (kind)
+	    {
+	    case 0:
+	    case 1:
+	      line[i + j] = 0;
+	      break;
+	    case 2:
+	      line[i + j] = span & 1 ? 0xff : span;
+	      break;
+	    case 3:
+	      line[i + j] = (j / 2) & 1 ? 0 : 0x55;
+	      break;
+	    case 4:
+	      line[i + j] = next_random() & 3;
+	      break;
+	    default:
+	      line[i + j] = next_random();
+	      break;
+	    }
+	}
+      i += span;
+    }
+  return length;
+}
+
+static int
+check_line(const unsigned char *line, int length, unsigned char *ref_buf,
+	   unsigned char *test_buf)
+{
+  unsigned char *ref_ptr;
+  unsigned char *test_ptr;
+  int ref_first, ref_last, ref_status;
+  int first, last, status;
+  ref_status = reference_pack_tiff(line, length, ref_buf, &ref_ptr,
+				   &ref_first, &ref_last);
+  status = stp_pack_tiff(NULL, line, length, test_buf, &test_ptr,
+			 &first, &last);
+  if (status != ref_status || first != ref_first || last != ref_last ||
+      test_ptr - test_buf != ref_ptr - ref_buf ||
+      memcmp(test_buf, ref_buf, ref_ptr - ref_buf) != 0)
+    {
+      printf("(pack_tiff length %d: %d bytes, %d %d %d, expected %d bytes, "
+	     "%d %d %d) ", length, (int) (test_ptr - test_buf), status, first,
+	     last, (int) (ref_ptr - ref_buf), ref_status, ref_first, ref_last);
+      return 1;
+    }
+  status = stp_pack_tiff(NULL, line, length, test_buf, &test_ptr,
+			 NULL, NULL);
+  if (test_ptr - test_buf != ref_ptr - ref_buf ||
+      memcmp(test_buf, ref_buf, ref_ptr - ref_buf) != 0)
+    {
+      printf("(pack_tiff length %d without first/last differs) ", length);
+      return 1;
+    }
+  status = stp_pack_uncompressed(NULL, line, length, test_buf, &test_ptr,
+				 &first, &last);
+  if (status != ref_status || first != ref_first || last != ref_last ||
+      test_ptr - test_buf != length || memcmp(test_buf, line, length) != 0)
+    {
+      printf("(pack_uncompressed length %d: %d %d %d, expected %d %d %d) ",
+	     length, status, first, last, ref_status, ref_first, ref_last);
+      return 1;
+    }
+  return 0;
+}
+
+int
+main(void)
+{
+  /*
+   * Lines are placed at varying offsets into the buffer so that the
+   * vector loads see every alignment, and end against the end of it so
+   * that reading past the end would be caught by memory checkers.
+   */
+  unsigned char *buf = malloc(MAX_LENGTH + 64);
+  unsigned char *line_buf = malloc(MAX_LENGTH);
+  unsigned char *ref_buf = malloc(MAX_LENGTH * 2 + 2);
+  unsigned char *test_buf = malloc(MAX_LENGTH * 2 + 2);
+  int i;
+
+  for (i = 0; i < (int) (sizeof(kernel_sets) / sizeof(const char *)); i++)
+    {
+      int errors = 0;
+      int j;
+      global_test_count++;
+      printf("%d: Checking %s pack kernels against the reference encoder... ",
+	     global_test_count, kernel_sets[i]);
+      if (!stpi_set_pack_kernels(kernel_sets[i]))
+	{
+	  printf("skipped (not supported)\n");
+	  continue;
+	}
+      random_state = 1;
+      for (j = 0; j < ITERATIONS && errors < 10; j++)
+	{
+	  int length = fill_line(line_buf);
+	  unsigned char *line = buf + MAX_LENGTH + 64 - length;
+	  memmove(line, line_buf, length);
+	  errors += check_line(line, length, ref_buf, test_buf);
+	}
+      if (errors)
+	{
+	  printf("FAIL\n");
+	  global_error_count++;
+	}
+      else
+	printf("PASS\n");
+    }
+
+  free(buf);
+  free(line_buf);
+  free(ref_buf);
+  free(test_buf);
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that commands built with stp_command_*() come out as they
+ * would have with stp_zprintf() and stp_send_command(), and count the
+ * memory allocated while printing a page with several drivers, to
+ * check that none of it is allocated for each row or pass.  A page
+ * twice as tall, with hundreds more rows, may need a few more
+ * allocations (the weave may need another pass or two), but no more
+ * than that.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include <gutenprint/gutenprint.h>
+
+extern void *(*stp_malloc_func)(size_t size);
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define IMAGE_WIDTH 300
+#define IMAGE_HEIGHT 300
+#define ALLOCATION_SLACK 100
+
+/*
+ * Lexmark printers, which use error diffusion by default, are left
+ * out: the error diffusion dither still allocates memory for each row.
+ */
+static const char *drivers[] =
+{
+  "pcl-900",
+  "pcl-1100",
+  "pcl-4",
+  "escp2-c80",
+  "escp2-r800",
+  "bjc-PIXMA-iP4000R",
+};
+
+#define DRIVER_COUNT ((int) (sizeof(drivers) / sizeof(const char *)))
+
+static unsigned long allocations;
+
+static void *
+counting_malloc(size_t size)
+{
+  allocations++;
+  return malloc(size);
+}
+
+typedef struct
+{
+  char data[1024];
+  size_t bytes;
+} output_t;
+
+static void
+write_output(void *data, const char *buffer, size_t bytes)
+{
+  output_t *o = (output_t *) data;
+  if (o && o->bytes + bytes <= sizeof(o->data))
+    memcpy(o->data + o->bytes, buffer, bytes);
+  if (o)
+    o->bytes += bytes;
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return IMAGE_WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return IMAGE_HEIGHT;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  size_t x;
+  for (x = 0; x < byte_limit; x++)
+    data[x] = (x * 7 + row * 3) & 255;
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "page-allocs";
+}
+
+static void
+check(const char *what, int ok)
+{
+  global_test_count++;
+  printf("%d: Checking %s... ", global_test_count, what);
+  if (ok)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+}
+
+static int
+same_output(const output_t *a, const output_t *b)
+{
+  return a->bytes == b->bytes && a->bytes <= sizeof(a->data) &&
+    memcmp(a->data, b->data, a->bytes) == 0;
+}
+
+static void
+check_commands(void)
+{
+  stp_vars_t *v = stp_vars_create();
+  stp_command_t cmd;
+  output_t expected, built;
+  char raster[300];
+  stp_raw_t raw;
+  int i;
+
+  for (i = 0; i < sizeof(raster); i++)
+    raster[i] = i * 13;
+  stp_set_outfunc(v, write_output);
+
+  memset(&expected, 0, sizeof(expected));
+  memset(&built, 0, sizeof(built));
+  stp_set_outdata(v, &expected);
+  stp_zprintf(v, "\033*b%dm%d%c", 3, 0, 'V');
+  stp_zprintf(v, "%d %d %d %d", INT_MIN, INT_MAX, -1, 10);
+  stp_zfwrite(raster, sizeof(raster), 1, v);
+  stp_set_outdata(v, &built);
+  stp_command_start(&cmd, v);
+  stp_command_puts(&cmd, "\033*b");
+  stp_command_put_int(&cmd, 3);
+  stp_command_putc(&cmd, 'm');
+  stp_command_put_int(&cmd, 0);
+  stp_command_putc(&cmd, 'V');
+  stp_command_put_int(&cmd, INT_MIN);
+  stp_command_putc(&cmd, ' ');
+  stp_command_put_int(&cmd, INT_MAX);
+  stp_command_putc(&cmd, ' ');
+  stp_command_put_int(&cmd, -1);
+  stp_command_putc(&cmd, ' ');
+  stp_command_put_int(&cmd, 10);
+  stp_command_write(&cmd, raster, sizeof(raster));
+  stp_command_end(&cmd);
+  check("formatted commands", same_output(&expected, &built));
+
+  memset(&expected, 0, sizeof(expected));
+  memset(&built, 0, sizeof(built));
+  raw.bytes = 6;
+  raw.data = "REMOTE";
+  stp_set_outdata(v, &expected);
+  stp_puts("\033(R", v);
+  stp_put16_le(11, v);
+  stp_putc(0, v);
+  stp_puts("AB", v);
+  stp_put16_be(0x1234, v);
+  stp_putraw(&raw, v);
+  stp_put32_le(0x89abcdef, v);
+  stp_put32_be(0x89abcdef, v);
+  stp_set_outdata(v, &built);
+  stp_send_command(v, "\033(R", "bcsHr", 0, "AB", 0x1234, &raw);
+  stp_command_start(&cmd, v);
+  stp_command_put32_le(&cmd, 0x89abcdef);
+  stp_command_put32_be(&cmd, 0x89abcdef);
+  stp_command_end(&cmd);
+  check("binary commands", same_output(&expected, &built));
+
+  /* A long string still has to be formatted on the heap */
+  memset(&built, 0, sizeof(built));
+  stp_zprintf(v, "%300s", "x");
+  check("long formatted output", built.bytes == 300);
+  stp_vars_destroy(v);
+}
+
+/*
+ * Print one page of the given height, returning the number of
+ * allocations made while printing it.
+ */
+static unsigned long
+print_page(const char *driver, int height)
+{
+  stp_image_t image =
+    {
+      NULL, NULL, image_width, image_height, image_get_row,
+      image_get_appname, NULL, NULL
+    };
+  const stp_printer_t *printer = stp_get_printer_by_driver(driver);
+  stp_vars_t *v;
+  int left, right, bottom, top;
+  unsigned long count = 0;
+
+  if (!printer)
+    return 0;
+  v = stp_vars_create();
+  stp_set_driver(v, driver);
+  stp_set_printer_defaults(v, printer);
+  stp_set_outfunc(v, write_output);
+  stp_set_outdata(v, NULL);
+  stp_set_errfunc(v, write_output);
+  stp_set_errdata(v, NULL);
+  stp_set_string_parameter(v, "InputImageType", "RGB");
+  stp_set_int_parameter(v, "RenderThreads", 1);
+  stp_set_printer_defaults_soft(v, printer);
+  stp_get_imageable_area(v, &left, &right, &bottom, &top);
+  stp_set_left(v, left);
+  stp_set_top(v, top);
+  stp_set_width(v, 144);
+  stp_set_height(v, height);
+  stp_merge_printvars(v, stp_printer_get_defaults(printer));
+  if (stp_verify(v))
+    {
+      stp_start_job(v, &image);
+      allocations = 0;
+      stp_malloc_func = counting_malloc;
+      if (stp_print(v, &image) == 1)
+	count = allocations;
+      stp_malloc_func = malloc;
+      stp_end_job(v, &image);
+    }
+  stp_vars_destroy(v);
+  return count;
+}
+
+int
+main(void)
+{
+  int i;
+
+  stp_init();
+  check_commands();
+  for (i = 0; i < DRIVER_COUNT; i++)
+    {
+      unsigned long short_page = print_page(drivers[i], 144);
+      unsigned long tall_page = print_page(drivers[i], 288);
+      char what[128];
+      printf("(%s: %lu allocations for 2 inches, %lu for 4) ", drivers[i],
+	     short_page, tall_page);
+      sprintf(what, "allocations per page for %s", drivers[i]);
+      check(what, short_page > 0 && tall_page > 0 &&
+	    tall_page <= short_page + ALLOCATION_SLACK);
+    }
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
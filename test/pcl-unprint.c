@@ -214,6 +214,8 @@ void write_grey (output_t *output, image_t *image);
 void write_colour (output_t *output, image_t *image);
 int decode_tiff (char *in_buffer, int data_length, char *decode_buf,
                  int maxlen);
+int decode_delta (char *in_buffer, int data_length, char *seed_buf,
+                  int maxlen);
 void pcl_reset (image_t *i);
 int depth_to_rows (int depth);
 
@@ -755,6 +757,51 @@ int decode_tiff(char *in_buffer,		/* I: Data buffer */
     return(dpos);
 }
 
+/*
+ * decode_delta() - Apply a delta row (mode 3) encoded buffer to the
+ * seed row, which is the last row received for the plane.  Returns
+ * the end of the last run of bytes replaced.
+ */
+
+int decode_delta(char *in_buffer,		/* I: Data buffer */
+		 int data_length,		/* I: Length of data */
+		 char *seed_buf,		/* I/O: seed row */
+		 int maxlen)			/* I: Max length of seed_buf */
+{
+/* Each run of replacement bytes is preceded by a command byte:-
+ *
+ * (bits 7-5) number of bytes to replace - 1
+ * (bits 4-0) offset from the end of the last run; if 31, the offset
+ *            continues in the following bytes until one less than 255
+ */
+
+    int pos = 0;
+    int dpos = 0;
+
+    while (pos < data_length) {
+	int command = (unsigned char) in_buffer[pos++];
+	int count = (command >> 5) + 1;
+	int offset = command & 31;
+
+	if (offset == 31) {
+	    int more;
+	    do {
+		more = (unsigned char) in_buffer[pos++];
+		offset += more;
+	    } while (more == 255 && pos < data_length);
+	}
+	dpos += offset;
+	if (dpos + count > maxlen || pos + count > data_length) {
+	    fprintf(stderr, "ERROR: Delta row data past the end of the row (%d)!\n", dpos + count);
+	    exit(EXIT_FAILURE);
+	}
+	memcpy(&seed_buf[dpos], &in_buffer[pos], (size_t) count);
+	dpos += count;
+	pos += count;
+    }
+    return(dpos);
+}
+
 /*
  * pcl_reset() - Rest image parameters to default
  */
@@ -990,9 +1037,10 @@ int main(int argc, char *argv[])
 		}
 
 		if ((image_data.compression_type != PCL_COMPRESSION_NONE) &&
-			(image_data.compression_type != PCL_COMPRESSION_TIFF)) {
+			(image_data.compression_type != PCL_COMPRESSION_TIFF) &&
+			(image_data.compression_type != PCL_COMPRESSION_DELTA)) {
 		    fprintf(stderr,
-			"Sorry, only 'no compression' or 'tiff compression' handled.\n");
+			"Sorry, only 'no compression', 'tiff compression' or 'delta row compression' handled.\n");
 		    i++;
 		}
 
@@ -1048,37 +1096,37 @@ int main(int argc, char *argv[])
 		    if (output_data.black_data_rows_per_row != 0) {
 			output_data.black_bufs = stp_malloc(output_data.black_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.black_data_rows_per_row; i++) {
-			    output_data.black_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			    output_data.black_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 		    if (output_data.cyan_data_rows_per_row != 0) {
 			output_data.cyan_bufs = stp_malloc(output_data.cyan_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.cyan_data_rows_per_row; i++) {
-			    output_data.cyan_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			    output_data.cyan_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 		    if (output_data.magenta_data_rows_per_row != 0) {
 			output_data.magenta_bufs = stp_malloc(output_data.magenta_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.magenta_data_rows_per_row; i++) {
-			    output_data.magenta_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			    output_data.magenta_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 		    if (output_data.yellow_data_rows_per_row != 0) {
 			output_data.yellow_bufs = stp_malloc(output_data.yellow_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.yellow_data_rows_per_row; i++) {
-			    output_data.yellow_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			    output_data.yellow_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 		    if (output_data.lcyan_data_rows_per_row != 0) {
 			output_data.lcyan_bufs = stp_malloc(output_data.lcyan_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.lcyan_data_rows_per_row; i++) {
-			     output_data.lcyan_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			     output_data.lcyan_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 		    if (output_data.lmagenta_data_rows_per_row != 0) {
 			output_data.lmagenta_bufs = stp_malloc(output_data.lmagenta_data_rows_per_row * sizeof (char *));
 			for (i=0; i < output_data.lmagenta_data_rows_per_row; i++) {
-			    output_data.lmagenta_bufs[i] = stp_malloc(output_data.buffer_length * sizeof (char));
+			    output_data.lmagenta_bufs[i] = stp_zalloc(output_data.buffer_length * sizeof (char));
 			}
 		    }
 
@@ -1482,6 +1530,9 @@ int main(int argc, char *argv[])
 		    case PCL_COMPRESSION_TIFF :
 			fprintf(stderr, "TIFF\n");
 			break;
+		    case PCL_COMPRESSION_DELTA :
+			fprintf(stderr, "Delta Row\n");
+			break;
 		    case PCL_COMPRESSION_CRDR :
 			fprintf(stderr, "Compressed Row Delta Replacement\n");
 			break;
@@ -1647,6 +1698,11 @@ int main(int argc, char *argv[])
 			memcpy(received_rows[current_data_row], &data_buffer, (size_t) numeric_arg);
 			output_data.active_length = numeric_arg;
 		    }
+		    else if (image_data.compression_type == PCL_COMPRESSION_DELTA) {
+			int length = decode_delta(data_buffer, numeric_arg, received_rows[current_data_row], output_data.buffer_length);
+			if (length > output_data.active_length)
+			    output_data.active_length = length;
+		    }
 		    else
 			output_data.active_length = decode_tiff(data_buffer, numeric_arg, received_rows[current_data_row], output_data.buffer_length);
 
@@ -0,0 +1,236 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Check that the printers and paper sizes that come from the shared
+ * printer database are the same as the ones read from the XML files.
+ * Each pass is a fresh process: one with the cache disabled, one that
+ * writes the database into a scratch cache directory, and one that
+ * reads it from there.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <gutenprint/gutenprint.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+static unsigned
+hash_string(unsigned hash, const char *s)
+{
+  if (!s)
+    s = "(null)";
+  do
+    {
+      hash ^= (unsigned char) *s;
+      hash *= 16777619u;
+    }
+  while (*s++);
+  return hash;
+}
+
+static unsigned
+hash_number(unsigned hash, double n)
+{
+  char buf[64];
+  sprintf(buf, "%g", n);
+  return hash_string(hash, buf);
+}
+
+static unsigned
+hash_parameters(unsigned hash, const stp_vars_t *v, stp_parameter_type_t type)
+{
+  stp_string_list_t *list = stp_list_parameters(v, type);
+  int i;
+  if (!list)
+    return hash;
+  for (i = 0; i < stp_string_list_count(list); i++)
+    {
+      const char *name = stp_string_list_param(list, i)->name;
+      hash = hash_string(hash, name);
+      switch (type)
+	{
+	case STP_PARAMETER_TYPE_STRING_LIST:
+	  hash = hash_string(hash, stp_get_string_parameter(v, name));
+	  break;
+	case STP_PARAMETER_TYPE_INT:
+	  hash = hash_number(hash, stp_get_int_parameter(v, name));
+	  break;
+	case STP_PARAMETER_TYPE_DOUBLE:
+	  hash = hash_number(hash, stp_get_float_parameter(v, name));
+	  break;
+	default:
+	  break;
+	}
+    }
+  stp_string_list_destroy(list);
+  return hash;
+}
+
+/*
+ * Hash everything about every printer and paper size.  Returns 0 if
+ * looking something up by name doesn't find it.
+ */
+static unsigned
+hash_tables(void)
+{
+  unsigned hash = 2166136261u;
+  int count;
+  int i;
+  stp_init();
+  count = stp_printer_model_count();
+  hash = hash_number(hash, count);
+  for (i = 0; i < count; i++)
+    {
+      const stp_printer_t *p = stp_get_printer_by_index(i);
+      const stp_vars_t *v = stp_printer_get_defaults(p);
+      if (stp_get_printer_by_driver(stp_printer_get_driver(p)) != p)
+	return 0;
+      hash = hash_string(hash, stp_printer_get_driver(p));
+      hash = hash_string(hash, stp_printer_get_long_name(p));
+      hash = hash_string(hash, stp_printer_get_family(p));
+      hash = hash_string(hash, stp_printer_get_manufacturer(p));
+      hash = hash_string(hash, stp_printer_get_device_id(p));
+      hash = hash_string(hash, stp_printer_get_foomatic_id(p));
+      hash = hash_string(hash, stp_printer_get_comment(p));
+      hash = hash_number(hash, stp_printer_get_model(p));
+      hash = hash_parameters(hash, v, STP_PARAMETER_TYPE_STRING_LIST);
+      hash = hash_parameters(hash, v, STP_PARAMETER_TYPE_INT);
+      hash = hash_parameters(hash, v, STP_PARAMETER_TYPE_DOUBLE);
+    }
+  count = stp_known_papersizes();
+  hash = hash_number(hash, count);
+  for (i = 0; i < count; i++)
+    {
+      const stp_papersize_t *p = stp_get_papersize_by_index(i);
+      if (stp_get_papersize_by_name(p->name) != p)
+	return 0;
+      hash = hash_string(hash, p->name);
+      hash = hash_string(hash, p->text);
+      hash = hash_string(hash, p->comment);
+      hash = hash_number(hash, p->width);
+      hash = hash_number(hash, p->height);
+      hash = hash_number(hash, p->top);
+      hash = hash_number(hash, p->left);
+      hash = hash_number(hash, p->bottom);
+      hash = hash_number(hash, p->right);
+      hash = hash_number(hash, p->paper_unit);
+      hash = hash_number(hash, p->paper_size_type);
+    }
+  return hash;
+}
+
+/*
+ * Hash the tables in a child process using the given cache directory.
+ * Returns 0 on failure.
+ */
+static unsigned
+run_pass(const char *cache_dir)
+{
+  int fds[2];
+  pid_t pid;
+  int status;
+  unsigned hash = 0;
+  if (pipe(fds) != 0)
+    return 0;
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+    {
+      close(fds[0]);
+      setenv("STP_XML_CACHE_DIR", cache_dir, 1);
+      hash = hash_tables();
+      if (write(fds[1], &hash, sizeof(hash)) != sizeof(hash))
+	_exit(1);
+      _exit(0);
+    }
+  close(fds[1]);
+  if (pid < 0 || read(fds[0], &hash, sizeof(hash)) != sizeof(hash))
+    hash = 0;
+  close(fds[0]);
+  if (pid > 0 && (waitpid(pid, &status, 0) != pid || status != 0))
+    hash = 0;
+  return hash;
+}
+
+static void
+check(const char *what, unsigned hash, unsigned expected)
+{
+  global_test_count++;
+  printf("%d: Checking %s... ", global_test_count, what);
+  if (hash == 0 || hash != expected)
+    {
+      printf("(%08x, expected %08x) FAIL\n", hash, expected);
+      global_error_count++;
+    }
+  else
+    printf("PASS\n");
+}
+
+int
+main(void)
+{
+  char cache_dir[] = "/tmp/printer-db-XXXXXX";
+  char command[64];
+  char db_file[64];
+  struct stat sbuf;
+  unsigned expected;
+
+  if (!mkdtemp(cache_dir))
+    {
+      perror("mkdtemp");
+      return 1;
+    }
+  sprintf(db_file, "%s/printers.db", cache_dir);
+
+  expected = run_pass("");
+  check("printers from the XML files while writing the database",
+	run_pass(cache_dir), expected);
+  global_test_count++;
+  printf("%d: Checking that the database was written... ", global_test_count);
+  if (stat(db_file, &sbuf) != 0)
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+  else
+    printf("PASS\n");
+  check("printers from the database", run_pass(cache_dir), expected);
+
+  sprintf(command, "rm -rf %s", cache_dir);
+  if (system(command) != 0)
+    fprintf(stderr, "Unable to remove %s\n", cache_dir);
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
@@ -0,0 +1,707 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Print the same image with the Level 2 PostScript driver using each
+ * image data encoding (ASCII85 or binary, with or without RunLength or
+ * Flate compression), decode the image data the way a PostScript
+ * interpreter would, and check that it comes out the same as the plain
+ * ASCII85 data, that it's the size the image dictionary says, and that
+ * the page carries on properly after it.
+ *
+ * Flate is only offered for Level 3 printers, so the jobs are printed
+ * with a small Level 3 PPD file.  The file is then rewritten as Level 2,
+ * to check that the driver reads it again.  The Flate decoder here only
+ * handles stored blocks and blocks with fixed Huffman codes, which is
+ * all the driver writes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <gutenprint/gutenprint.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define IMAGE_WIDTH 301
+#define IMAGE_HEIGHT 203
+
+typedef struct
+{
+  const char *image_type;
+  const char *printing_mode;
+  int channels;
+} image_type_t;
+
+static const image_type_t image_types[] =
+{
+  { "RGB", "Color", 3 },
+  { "CMYK", "Color", 4 },
+  { "Grayscale", "BW", 1 },
+};
+
+#define IMAGE_TYPE_COUNT ((int) (sizeof(image_types) / sizeof(image_type_t)))
+
+typedef struct
+{
+  const char *compression;
+  int binary;
+} encoding_t;
+
+static const encoding_t encodings[] =
+{
+  { "RunLength", 0 },
+  { "Flate", 0 },
+  { "None", 1 },
+  { "RunLength", 1 },
+  { "Flate", 1 },
+};
+
+#define ENCODING_COUNT ((int) (sizeof(encodings) / sizeof(encoding_t)))
+
+static const char level3_ppd[] =
+  "*PPD-Adobe: \"4.3\"\n"
+  "*LanguageLevel: \"3\"\n"
+  "*ColorDevice: True\n"
+  "*OpenUI *PageSize/Page Size: PickOne\n"
+  "*DefaultPageSize: Letter\n"
+  "*PageSize Letter/US Letter: \"<</PageSize[612 792]>>setpagedevice\"\n"
+  "*CloseUI: *PageSize\n"
+  "*ImageableArea Letter/US Letter: \"18 36 594 756\"\n"
+  "*PaperDimension Letter/US Letter: \"612 792\"\n";
+
+/*
+ * The same printer at Level 2.  It's a different size, so that the
+ * change is noticed even if the file is rewritten within a second.
+ */
+static const char level2_ppd[] =
+  "*PPD-Adobe: \"4.3\"\n"
+  "*Product: \"(Level 2)\"\n"
+  "*LanguageLevel: \"2\"\n"
+  "*ColorDevice: True\n"
+  "*OpenUI *PageSize/Page Size: PickOne\n"
+  "*DefaultPageSize: Letter\n"
+  "*PageSize Letter/US Letter: \"<</PageSize[612 792]>>setpagedevice\"\n"
+  "*CloseUI: *PageSize\n"
+  "*ImageableArea Letter/US Letter: \"18 36 594 756\"\n"
+  "*PaperDimension Letter/US Letter: \"612 792\"\n";
+
+static char ppd_file[] = "/tmp/ps-encodings.XXXXXX";
+
+typedef struct
+{
+  unsigned char *data;
+  size_t bytes;
+  size_t size;
+} buffer_t;
+
+static int image_channels;
+
+static void
+buffer_append(buffer_t *b, const unsigned char *data, size_t bytes)
+{
+  if (b->bytes + bytes > b->size)
+    {
+      b->size = (b->bytes + bytes) * 2;
+      b->data = realloc(b->data, b->size);
+    }
+  memcpy(b->data + b->bytes, data, bytes);
+  b->bytes += bytes;
+}
+
+static void
+write_output(void *data, const char *buffer, size_t bytes)
+{
+  buffer_append((buffer_t *) data, (const unsigned char *) buffer, bytes);
+}
+
+static void
+discard_output(void *data, const char *buffer, size_t bytes)
+{
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return IMAGE_WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return IMAGE_HEIGHT;
+}
+
+/*
+ * Some solid rows, so that there are long runs and all-zero ASCII85
+ * groups, and some noisy ones, so that there aren't.
+ */
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  size_t x;
+  if (row % 40 < 6)
+    memset(data, row % 80 < 6 ? 0 : 255, byte_limit);
+  else
+    for (x = 0; x < byte_limit; x++)
+      data[x] = ((x / image_channels) * 3 + row +
+		 (x % image_channels) * 50 + (x * x * row) % 7) & 255;
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "ps-encodings";
+}
+
+static stp_vars_t *
+job_vars(const char *ppd)
+{
+  const stp_printer_t *printer = stp_get_printer_by_driver("ps2");
+  stp_vars_t *v;
+  if (!printer)
+    return NULL;
+  v = stp_vars_create();
+  stp_set_driver(v, "ps2");
+  stp_set_printer_defaults(v, printer);
+  if (ppd)
+    {
+      stp_set_file_parameter(v, "PPDFile", ppd);
+      stp_set_string_parameter(v, "PageSize", "Letter");
+    }
+  return v;
+}
+
+/*
+ * Is Flate offered as an image compression with this PPD file?
+ */
+static int
+flate_offered(const char *ppd)
+{
+  stp_vars_t *v = job_vars(ppd);
+  stp_parameter_t desc;
+  int offered;
+  if (!v)
+    return -1;
+  stp_describe_parameter(v, "ImageCompression", &desc);
+  offered = (desc.p_type == STP_PARAMETER_TYPE_STRING_LIST &&
+	     desc.bounds.str &&
+	     stp_string_list_is_present(desc.bounds.str, "Flate"));
+  stp_parameter_description_destroy(&desc);
+  stp_vars_destroy(v);
+  return offered;
+}
+
+static int
+print_job(const image_type_t *type, const encoding_t *encoding,
+	  buffer_t *output)
+{
+  stp_image_t image =
+    {
+      NULL, NULL, image_width, image_height, image_get_row,
+      image_get_appname, NULL, NULL
+    };
+  stp_vars_t *v = job_vars(ppd_file);
+  int status = 0;
+
+  if (!v)
+    return 0;
+  image_channels = type->channels;
+  stp_set_outfunc(v, write_output);
+  stp_set_outdata(v, output);
+  stp_set_errfunc(v, discard_output);
+  stp_set_errdata(v, NULL);
+  stp_set_string_parameter(v, "InputImageType", type->image_type);
+  stp_set_string_parameter(v, "PrintingMode", type->printing_mode);
+  stp_set_string_parameter(v, "ImageCompression", encoding->compression);
+  stp_set_boolean_parameter(v, "BinaryImageData", encoding->binary);
+  stp_set_left(v, 36);
+  stp_set_top(v, 36);
+  stp_set_width(v, 300);
+  stp_set_height(v, 200);
+  if (stp_verify(v))
+    {
+      stp_start_job(v, &image);
+      status = stp_print(v, &image);
+      stp_end_job(v, &image);
+    }
+  stp_vars_destroy(v);
+  return status;
+}
+
+/*
+ * Each decoder appends what it decodes to out, and returns the number
+ * of bytes of input it used, or 0 if the input is invalid or
+ * unterminated.
+ */
+
+static size_t
+decode_ascii85(const unsigned char *in, size_t bytes, buffer_t *out)
+{
+  unsigned long value = 0;
+  int count = 0;
+  size_t i;
+  for (i = 0; i < bytes; i++)
+    {
+      unsigned char ch = in[i];
+      if (ch == '\n')
+	continue;
+      else if (ch == '~')
+	{
+	  unsigned char tail[4];
+	  int j;
+	  if (i + 1 >= bytes || in[i + 1] != '>' || count == 1)
+	    return 0;
+	  if (count > 0)
+	    {
+	      for (j = count; j < 5; j++)
+		value = value * 85 + 84;
+	      for (j = 0; j < 4; j++)
+		tail[j] = (value >> (24 - 8 * j)) & 255;
+	      buffer_append(out, tail, count - 1);
+	    }
+	  return i + 2;
+	}
+      else if (ch == 'z' && count == 0)
+	{
+	  static const unsigned char zero[4] = { 0, 0, 0, 0 };
+	  buffer_append(out, zero, 4);
+	}
+      else if (ch >= '!' && ch <= 'u')
+	{
+	  value = value * 85 + (ch - '!');
+	  if (++count == 5)
+	    {
+	      unsigned char group[4];
+	      int j;
+	      for (j = 0; j < 4; j++)
+		group[j] = (value >> (24 - 8 * j)) & 255;
+	      buffer_append(out, group, 4);
+	      value = 0;
+	      count = 0;
+	    }
+	}
+      else
+	return 0;
+    }
+  return 0;
+}
+
+static size_t
+decode_runlength(const unsigned char *in, size_t bytes, buffer_t *out)
+{
+  size_t i = 0;
+  while (i < bytes)
+    {
+      int length = in[i++];
+      if (length == 128)
+	return i;
+      else if (length < 128)
+	{
+	  if (i + length + 1 > bytes)
+	    return 0;
+	  buffer_append(out, in + i, length + 1);
+	  i += length + 1;
+	}
+      else if (i < bytes)
+	{
+	  unsigned char run[128];
+	  memset(run, in[i++], 257 - length);
+	  buffer_append(out, run, 257 - length);
+	}
+    }
+  return 0;
+}
+
+typedef struct
+{
+  const unsigned char *in;
+  size_t bytes;
+  size_t pos;
+  int bit;
+} bit_reader_t;
+
+static int
+get_bits(bit_reader_t *r, int count)
+{
+  int value = 0;
+  int i;
+  for (i = 0; i < count; i++)
+    {
+      if (r->pos >= r->bytes)
+	return -1;
+      value |= ((r->in[r->pos] >> r->bit) & 1) << i;
+      if (++r->bit == 8)
+	{
+	  r->bit = 0;
+	  r->pos++;
+	}
+    }
+  return value;
+}
+
+/* Read one literal/length symbol coded with the fixed Huffman codes */
+static int
+get_fixed_symbol(bit_reader_t *r)
+{
+  int code = 0;
+  int length;
+  for (length = 1; length <= 9; length++)
+    {
+      int bit = get_bits(r, 1);
+      if (bit < 0)
+	return -1;
+      code = (code << 1) | bit;
+      if (length == 7 && code <= 0x17)
+	return code + 256;
+      else if (length == 8 && code >= 0x30 && code <= 0xbf)
+	return code - 0x30;
+      else if (length == 8 && code >= 0xc0 && code <= 0xc7)
+	return code - 0xc0 + 280;
+      else if (length == 9 && code >= 0x190)
+	return code - 0x190 + 144;
+    }
+  return -1;
+}
+
+static const int length_base[] =
+{
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int length_extra[] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int distance_base[] =
+{
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+  8193, 12289, 16385, 24577
+};
+static const int distance_extra[] =
+{
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static size_t
+decode_flate(const unsigned char *in, size_t bytes, buffer_t *out)
+{
+  bit_reader_t r;
+  size_t start = out->bytes;
+  unsigned long a = 1, b = 0;
+  size_t i;
+  int last = 0;
+
+  if (bytes < 2 || (in[0] & 0x0f) != 8 || ((in[0] << 8) | in[1]) % 31 != 0)
+    return 0;
+  r.in = in;
+  r.bytes = bytes;
+  r.pos = 2;
+  r.bit = 0;
+  while (!last)
+    {
+      int type;
+      last = get_bits(&r, 1);
+      type = get_bits(&r, 2);
+      if (last < 0 || type < 0)
+	return 0;
+      if (type == 0)
+	{
+	  unsigned length;
+	  if (r.bit)
+	    {
+	      r.bit = 0;
+	      r.pos++;
+	    }
+	  if (r.pos + 4 > bytes)
+	    return 0;
+	  length = r.in[r.pos] | (r.in[r.pos + 1] << 8);
+	  if ((length ^ (r.in[r.pos + 2] | (r.in[r.pos + 3] << 8))) != 0xffff ||
+	      r.pos + 4 + length > bytes)
+	    return 0;
+	  buffer_append(out, r.in + r.pos + 4, length);
+	  r.pos += 4 + length;
+	}
+      else if (type == 1)
+	{
+	  for (;;)
+	    {
+	      int symbol = get_fixed_symbol(&r);
+	      int length_bits, distance_bits, code;
+	      size_t length, distance;
+	      if (symbol < 0 || symbol > 285)
+		return 0;
+	      else if (symbol < 256)
+		{
+		  unsigned char ch = symbol;
+		  buffer_append(out, &ch, 1);
+		  continue;
+		}
+	      else if (symbol == 256)
+		break;
+	      length_bits = get_bits(&r, length_extra[symbol - 257]);
+	      /* Distance codes are Huffman codes, so most significant bit first */
+	      code = 0;
+	      for (i = 0; i < 5; i++)
+		{
+		  int bit = get_bits(&r, 1);
+		  if (bit < 0)
+		    return 0;
+		  code = (code << 1) | bit;
+		}
+	      if (length_bits < 0 || code > 29)
+		return 0;
+	      distance_bits = get_bits(&r, distance_extra[code]);
+	      if (distance_bits < 0)
+		return 0;
+	      length = length_base[symbol - 257] + length_bits;
+	      distance = distance_base[code] + distance_bits;
+	      if (distance > out->bytes - start)
+		return 0;
+	      /* The match may overlap what it copies, so copy a byte at a time */
+	      while (length-- > 0)
+		{
+		  unsigned char ch = out->data[out->bytes - distance];
+		  buffer_append(out, &ch, 1);
+		}
+	    }
+	}
+      else
+	return 0;
+    }
+
+  if (r.bit)
+    r.pos++;
+  if (r.pos + 4 > bytes)
+    return 0;
+  for (i = start; i < out->bytes; i++)
+    {
+      a = (a + out->data[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+  if (((b << 16) | a) != (((unsigned long) in[r.pos] << 24) |
+			  (in[r.pos + 1] << 16) | (in[r.pos + 2] << 8) |
+			  in[r.pos + 3]))
+    return 0;
+  return r.pos + 4;
+}
+
+static const char *
+find_string(const buffer_t *b, size_t from, const char *s)
+{
+  size_t length = strlen(s);
+  size_t i;
+  for (i = from; i + length <= b->bytes; i++)
+    if (memcmp(b->data + i, s, length) == 0)
+      return (const char *) b->data + i;
+  return NULL;
+}
+
+/*
+ * Find the image data in the output and decode it into data.  Returns
+ * a description of what's wrong, or NULL if nothing is.
+ */
+static const char *
+extract_image(const buffer_t *output, int channels, buffer_t *data)
+{
+  const char *header = find_string(output, 0, "/DataSource currentfile");
+  const char *header_end;
+  const unsigned char *in;
+  size_t bytes, used;
+  size_t expected = (size_t) channels;
+  const char *width, *height;
+  char filters[128];
+  buffer_t ascii85;
+
+  if (!header)
+    return "no image";
+  header_end = find_string(output, header - (const char *) output->data,
+			   "image\n");
+  width = find_string(output, 0, "/Width ");
+  height = find_string(output, 0, "/Height ");
+  if (!header_end || !width || !height)
+    return "no image";
+  expected *= atoi(width + 7) * atoi(height + 8);
+  sscanf(header, "/DataSource currentfile%127[^\n]", filters);
+  in = (const unsigned char *) header_end + 6;
+  bytes = output->bytes - (in - output->data);
+
+  memset(&ascii85, 0, sizeof(ascii85));
+  if (strstr(filters, "/ASCII85Decode"))
+    {
+      used = decode_ascii85(in, bytes, &ascii85);
+      if (!used)
+	{
+	  free(ascii85.data);
+	  return "bad ASCII85 data";
+	}
+      in += used;
+      bytes -= used;
+    }
+
+  if (strstr(filters, "/RunLengthDecode"))
+    used = ascii85.data ?
+      decode_runlength(ascii85.data, ascii85.bytes, data) :
+      decode_runlength(in, bytes, data);
+  else if (strstr(filters, "/FlateDecode"))
+    used = ascii85.data ?
+      decode_flate(ascii85.data, ascii85.bytes, data) :
+      decode_flate(in, bytes, data);
+  else if (ascii85.data)
+    {
+      buffer_append(data, ascii85.data, ascii85.bytes);
+      used = 1;
+    }
+  else
+    {
+      used = bytes < expected ? bytes : expected;
+      buffer_append(data, in, used);
+    }
+  if (!ascii85.data)
+    {
+      in += used;
+      bytes -= used;
+    }
+  free(ascii85.data);
+  if (!used)
+    return "bad compressed data";
+  if (data->bytes != expected)
+    return "wrong amount of data";
+  while (bytes > 0 && *in == '\n')
+    {
+      in++;
+      bytes--;
+    }
+  if (bytes < 8 || memcmp(in, "grestore", 8) != 0)
+    return "no grestore after the data";
+  return NULL;
+}
+
+int
+main(void)
+{
+  int i, j;
+  int fd;
+  FILE *fp;
+
+  stp_init();
+  fd = mkstemp(ppd_file);
+  if (fd < 0 ||
+      write(fd, level3_ppd, sizeof(level3_ppd) - 1) !=
+      (ssize_t) (sizeof(level3_ppd) - 1) ||
+      close(fd) != 0)
+    {
+      printf("Can't write %s\n", ppd_file);
+      return 1;
+    }
+
+  global_test_count++;
+  printf("%d: Checking that Flate is only offered for Level 3... ",
+	 global_test_count);
+  if (flate_offered(NULL) == 0 && flate_offered(ppd_file) == 1)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+
+  for (i = 0; i < IMAGE_TYPE_COUNT; i++)
+    {
+      const image_type_t *type = &image_types[i];
+      static const encoding_t plain = { "None", 0 };
+      buffer_t output, reference;
+      const char *error;
+
+      memset(&output, 0, sizeof(output));
+      memset(&reference, 0, sizeof(reference));
+      if (print_job(type, &plain, &output) != 1)
+	error = "printing failed";
+      else
+	error = extract_image(&output, type->channels, &reference);
+      free(output.data);
+
+      for (j = 0; j < ENCODING_COUNT; j++)
+	{
+	  const encoding_t *encoding = &encodings[j];
+	  const char *problem = error;
+	  buffer_t data;
+	  memset(&output, 0, sizeof(output));
+	  memset(&data, 0, sizeof(data));
+	  global_test_count++;
+	  printf("%d: Checking %s %s %s image data... ", global_test_count,
+		 type->image_type, encoding->compression,
+		 encoding->binary ? "binary" : "ASCII85");
+	  if (!problem && print_job(type, encoding, &output) != 1)
+	    problem = "printing failed";
+	  if (!problem)
+	    problem = extract_image(&output, type->channels, &data);
+	  if (!problem && encoding->binary &&
+	      !find_string(&output, 0, "%%DocumentData: Binary"))
+	    problem = "binary data not declared";
+	  if (!problem && (data.bytes != reference.bytes ||
+			   memcmp(data.data, reference.data, data.bytes) != 0))
+	    problem = "data differs";
+	  if (problem)
+	    {
+	      printf("(%s) FAIL\n", problem);
+	      global_error_count++;
+	    }
+	  else
+	    printf("(%lu bytes) PASS\n", (unsigned long) output.bytes);
+	  free(output.data);
+	  free(data.data);
+	}
+      free(reference.data);
+    }
+
+  global_test_count++;
+  printf("%d: Checking that a changed PPD file is read again... ",
+	 global_test_count);
+  fp = fopen(ppd_file, "w");
+  if (fp && fputs(level2_ppd, fp) != EOF && fclose(fp) == 0 &&
+      flate_offered(ppd_file) == 0)
+    printf("PASS\n");
+  else
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+  unlink(ppd_file);
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
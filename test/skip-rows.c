@@ -0,0 +1,265 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Print an image that's much taller than the output with several
+ * drivers, and check that every row of the image is either requested
+ * or skipped, exactly once and in order, and that the output is the
+ * same whether or not the image takes the skipped rows.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gutenprint/gutenprint.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#define IMAGE_WIDTH 48
+#define IMAGE_HEIGHT 2000
+
+typedef struct
+{
+  const char *driver;
+  int threads;
+} job_t;
+
+static const job_t jobs[] =
+{
+  { "escp2-c80", 1 },
+  { "escp2-r800", 3 },
+  { "bjc-PIXMA-iP4000R", 1 },
+  { "pcl-900", 1 },
+  { "pcl-900", 2 },
+  { "lexmark-z52", 1 },
+  { "kodak-1400", 1 },
+};
+
+#define JOB_COUNT ((int) (sizeof(jobs) / sizeof(job_t)))
+
+typedef struct
+{
+  unsigned hash;
+  size_t size;
+  int next_row;			/* Next row not yet requested or skipped */
+  int requested;
+  int skipped;
+  int gaps;			/* Rows neither requested nor skipped */
+  int out_of_order;
+} result_t;
+
+static void
+write_output(void *data, const char *buffer, size_t bytes)
+{
+  result_t *r = (result_t *) data;
+  size_t i;
+  for (i = 0; i < bytes; i++)
+    {
+      r->hash ^= (unsigned char) buffer[i];
+      r->hash *= 16777619u;
+    }
+  r->size += bytes;
+}
+
+static void
+discard_output(void *data, const char *buffer, size_t bytes)
+{
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return IMAGE_WIDTH;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return IMAGE_HEIGHT;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  result_t *r = (result_t *) image->rep;
+  int x;
+  if (row < r->next_row)
+    r->out_of_order++;
+  else if (row > r->next_row)
+    r->gaps++;
+  r->next_row = row + 1;
+  r->requested++;
+  for (x = 0; x < IMAGE_WIDTH; x++)
+    {
+      data[3 * x] = x * 255 / (IMAGE_WIDTH - 1);
+      data[3 * x + 1] = (row * 7) & 255;
+      data[3 * x + 2] = (x + row) & 255;
+    }
+  return STP_IMAGE_STATUS_OK;
+}
+
+static stp_image_status_t
+image_skip_rows(stp_image_t *image, int row, int count)
+{
+  result_t *r = (result_t *) image->rep;
+  if (row < r->next_row || count <= 0)
+    r->out_of_order++;
+  else if (row > r->next_row)
+    r->gaps++;
+  r->next_row = row + count;
+  r->skipped += count;
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "skip-rows";
+}
+
+static int
+print_job(const job_t *job, int skip, result_t *result)
+{
+  stp_image_t image =
+    {
+      NULL, NULL, image_width, image_height, image_get_row,
+      image_get_appname, NULL, NULL
+    };
+  stp_image_row_funcs_t funcs;
+  const stp_printer_t *printer = stp_get_printer_by_driver(job->driver);
+  stp_vars_t *v;
+  int left, right, bottom, top;
+  int status = 0;
+
+  memset(result, 0, sizeof(result_t));
+  result->hash = 2166136261u;
+  if (!printer)
+    return 0;
+  image.rep = result;
+  if (skip)
+    {
+      memset(&funcs, 0, sizeof(funcs));
+      funcs.size = sizeof(funcs);
+      funcs.skip_rows = image_skip_rows;
+      stp_image_set_row_funcs(&image, &funcs);
+    }
+  v = stp_vars_create();
+  stp_set_driver(v, job->driver);
+  stp_set_printer_defaults(v, printer);
+  stp_set_outfunc(v, write_output);
+  stp_set_outdata(v, result);
+  stp_set_errfunc(v, discard_output);
+  stp_set_errdata(v, NULL);
+  stp_set_string_parameter(v, "InputImageType", "RGB");
+  stp_set_string_parameter(v, "ChannelBitDepth", "8");
+  stp_set_string_parameter(v, "PrintingMode", "Color");
+  stp_set_int_parameter(v, "RenderThreads", job->threads);
+  stp_set_printer_defaults_soft(v, printer);
+  stp_get_imageable_area(v, &left, &right, &bottom, &top);
+  stp_set_left(v, left);
+  stp_set_top(v, top);
+  stp_set_width(v, 72);
+  stp_set_height(v, 72);
+  stp_merge_printvars(v, stp_printer_get_defaults(printer));
+  if (stp_verify(v))
+    {
+      stp_start_job(v, &image);
+      status = stp_print(v, &image);
+      stp_end_job(v, &image);
+    }
+  stp_vars_destroy(v);
+  stp_image_set_row_funcs(&image, NULL);
+  return status;
+}
+
+int
+main(void)
+{
+  int i;
+
+  stp_init();
+  for (i = 0; i < JOB_COUNT; i++)
+    {
+      const job_t *job = &jobs[i];
+      result_t plain, skipping;
+      int errors = 0;
+      global_test_count++;
+      printf("%d: Checking rows skipped by %s with %d thread%s... ",
+	     global_test_count, job->driver, job->threads,
+	     job->threads == 1 ? "" : "s");
+      if (print_job(job, 0, &plain) != 1 || print_job(job, 1, &skipping) != 1)
+	{
+	  printf("(printing failed) ");
+	  errors++;
+	}
+      else
+	{
+	  if (skipping.out_of_order || plain.out_of_order)
+	    {
+	      printf("(%d rows out of order) ",
+		     skipping.out_of_order + plain.out_of_order);
+	      errors++;
+	    }
+	  if (skipping.gaps ||
+	      skipping.requested + skipping.skipped != IMAGE_HEIGHT ||
+	      skipping.next_row != IMAGE_HEIGHT)
+	    {
+	      printf("(%d rows requested, %d skipped) ",
+		     skipping.requested, skipping.skipped);
+	      errors++;
+	    }
+	  if (skipping.skipped == 0)
+	    {
+	      printf("(no rows skipped) ");
+	      errors++;
+	    }
+	  if (skipping.requested != plain.requested)
+	    {
+	      printf("(%d rows requested, %d without skipping) ",
+		     skipping.requested, plain.requested);
+	      errors++;
+	    }
+	  if (skipping.size != plain.size || skipping.hash != plain.hash)
+	    {
+	      printf("(output differs) ");
+	      errors++;
+	    }
+	}
+      if (errors)
+	{
+	  printf("FAIL\n");
+	  global_error_count++;
+	}
+      else
+	printf("PASS\n");
+    }
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
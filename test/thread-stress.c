@@ -0,0 +1,396 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Print small jobs with several drivers from several threads at once,
+ * and check that each job's output is exactly what the same job
+ * produces when it's printed on its own.  The threads start before the
+ * library is initialised and before any printer data has been loaded,
+ * so that they race to do both.  Then every thread prints the same
+ * series of media types on one ESC/P2 model, so that they all miss in
+ * that model's media cache together.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <gutenprint/gutenprint.h>
+
+int global_test_count = 0;
+int global_error_count = 0;
+
+#ifdef HAVE_PTHREAD
+
+#define THREADS 4
+#define IMAGE_SIZE 48		/* Pixels on a side */
+
+static const char *drivers[] =
+{
+  "escp2-c80",
+  "escp2-r800",
+  "bjc-PIXMA-iP4000R",
+  "pcl-900",
+  "lexmark-z52",
+  "olympus-p10",
+  "ps2",
+};
+
+#define DRIVER_COUNT ((int) (sizeof(drivers) / sizeof(const char *)))
+
+#define MEDIA_DRIVER "escp2-r800"
+#define MEDIA_COUNT 8
+
+static char *media_types[MEDIA_COUNT];
+static int media_count;
+
+typedef struct
+{
+  unsigned char *data;
+  size_t size;
+  size_t allocated;
+} output_t;
+
+typedef struct
+{
+  unsigned hash;
+  size_t size;
+  int status;
+} result_t;
+
+static void
+write_output(void *data, const char *buffer, size_t bytes)
+{
+  output_t *out = (output_t *) data;
+  if (out->size + bytes > out->allocated)
+    {
+      out->allocated = 2 * (out->size + bytes);
+      out->data = realloc(out->data, out->allocated);
+    }
+  memcpy(out->data + out->size, buffer, bytes);
+  out->size += bytes;
+}
+
+static void
+discard_output(void *data, const char *buffer, size_t bytes)
+{
+}
+
+/*
+ * Hash the output, leaving out the PostScript creation date.
+ */
+static unsigned
+hash_output(const output_t *out)
+{
+  static const char date[] = "%%CreationDate";
+  unsigned hash = 2166136261u;
+  size_t i = 0;
+  while (i < out->size)
+    {
+      if (out->size - i >= sizeof(date) - 1 &&
+	  memcmp(out->data + i, date, sizeof(date) - 1) == 0)
+	{
+	  while (i < out->size && out->data[i] != '\n')
+	    i++;
+	  continue;
+	}
+      hash ^= out->data[i++];
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+static void
+image_init(stp_image_t *image)
+{
+}
+
+static void
+image_reset(stp_image_t *image)
+{
+}
+
+static int
+image_width(stp_image_t *image)
+{
+  return IMAGE_SIZE;
+}
+
+static int
+image_height(stp_image_t *image)
+{
+  return IMAGE_SIZE;
+}
+
+static stp_image_status_t
+image_get_row(stp_image_t *image, unsigned char *data, size_t byte_limit,
+	      int row)
+{
+  int x;
+  for (x = 0; x < IMAGE_SIZE; x++)
+    {
+      data[3 * x] = x * 255 / (IMAGE_SIZE - 1);
+      data[3 * x + 1] = row * 255 / (IMAGE_SIZE - 1);
+      data[3 * x + 2] = (x + row) * 127 / (IMAGE_SIZE - 1);
+    }
+  return STP_IMAGE_STATUS_OK;
+}
+
+static const char *
+image_get_appname(stp_image_t *image)
+{
+  return "thread-stress";
+}
+
+static void
+image_conclude(stp_image_t *image)
+{
+}
+
+static void
+print_job(const char *driver, const char *media_type, result_t *result)
+{
+  stp_image_t image =
+    {
+      image_init, image_reset, image_width, image_height, image_get_row,
+      image_get_appname, image_conclude, NULL
+    };
+  const stp_printer_t *printer;
+  output_t out;
+  stp_vars_t *v;
+  int left, right, bottom, top;
+
+  result->status = 0;
+  result->size = 0;
+  result->hash = 0;
+  stp_init();
+  printer = stp_get_printer_by_driver(driver);
+  if (!printer)
+    return;
+  memset(&out, 0, sizeof(out));
+  v = stp_vars_create();
+  stp_set_driver(v, driver);
+  stp_set_printer_defaults(v, printer);
+  stp_set_outfunc(v, write_output);
+  stp_set_outdata(v, &out);
+  stp_set_errfunc(v, discard_output);
+  stp_set_errdata(v, NULL);
+  stp_set_string_parameter(v, "InputImageType", "RGB");
+  stp_set_string_parameter(v, "ChannelBitDepth", "8");
+  stp_set_string_parameter(v, "PrintingMode", "Color");
+  if (media_type)
+    stp_set_string_parameter(v, "MediaType", media_type);
+  stp_set_printer_defaults_soft(v, printer);
+  stp_get_imageable_area(v, &left, &right, &bottom, &top);
+  stp_set_left(v, left);
+  stp_set_top(v, top);
+  stp_set_width(v, 72);
+  stp_set_height(v, 72);
+  stp_merge_printvars(v, stp_printer_get_defaults(printer));
+  if (stp_verify(v))
+    {
+      stp_start_job(v, &image);
+      result->status = stp_print(v, &image);
+      stp_end_job(v, &image);
+    }
+  stp_vars_destroy(v);
+  result->size = out.size;
+  result->hash = hash_output(&out);
+  free(out.data);
+}
+
+typedef struct
+{
+  int thread;
+  result_t results[DRIVER_COUNT];
+  result_t media_results[MEDIA_COUNT];
+} thread_data_t;
+
+/*
+ * Each thread prints with every driver, starting with a different one.
+ */
+static void *
+print_jobs(void *data)
+{
+  thread_data_t *td = (thread_data_t *) data;
+  int i;
+  for (i = 0; i < DRIVER_COUNT; i++)
+    {
+      int driver = (td->thread + i) % DRIVER_COUNT;
+      print_job(drivers[driver], NULL, &(td->results[driver]));
+    }
+  return NULL;
+}
+
+/*
+ * Each thread prints with every media type, all in the same order.
+ */
+static void *
+print_media(void *data)
+{
+  thread_data_t *td = (thread_data_t *) data;
+  int i;
+  for (i = 0; i < media_count; i++)
+    print_job(MEDIA_DRIVER, media_types[i], &(td->media_results[i]));
+  return NULL;
+}
+
+static void
+run_threads(thread_data_t *thread_data, void *(*func)(void *))
+{
+  pthread_t threads[THREADS];
+  int i;
+  for (i = 0; i < THREADS; i++)
+    {
+      thread_data[i].thread = i;
+      if (pthread_create(&(threads[i]), NULL, func, &(thread_data[i])))
+	{
+	  printf("Unable to create thread %d\n", i);
+	  exit(1);
+	}
+    }
+  for (i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+}
+
+/*
+ * Print a job on its own and check that every thread's copy matches it.
+ */
+static void
+check_results(const char *driver, const char *media_type,
+	      const result_t *(*get_result)(const thread_data_t *, int),
+	      const thread_data_t *thread_data, int which)
+{
+  result_t expected;
+  int errors = 0;
+  int j;
+  global_test_count++;
+  if (media_type)
+    printf("%d: Checking %s output on %s from %d threads... ",
+	   global_test_count, driver, media_type, THREADS);
+  else
+    printf("%d: Checking %s output from %d threads... ",
+	   global_test_count, driver, THREADS);
+  print_job(driver, media_type, &expected);
+  if (expected.status != 1 || expected.size == 0)
+    {
+      printf("(printing on its own failed) ");
+      errors++;
+    }
+  for (j = 0; j < THREADS; j++)
+    {
+      const result_t *r = get_result(&(thread_data[j]), which);
+      if (r->status != expected.status || r->size != expected.size ||
+	  r->hash != expected.hash)
+	{
+	  printf("(thread %d: %lu bytes, expected %lu) ", j,
+		 (unsigned long) r->size, (unsigned long) expected.size);
+	  errors++;
+	}
+    }
+  if (errors)
+    {
+      printf("FAIL\n");
+      global_error_count++;
+    }
+  else
+    printf("PASS\n");
+}
+
+static const result_t *
+driver_result(const thread_data_t *td, int which)
+{
+  return &(td->results[which]);
+}
+
+static const result_t *
+media_result(const thread_data_t *td, int which)
+{
+  return &(td->media_results[which]);
+}
+
+/*
+ * The first few media types the model offers.  Listing them doesn't
+ * build any of them.
+ */
+static void
+find_media_types(void)
+{
+  const stp_printer_t *printer = stp_get_printer_by_driver(MEDIA_DRIVER);
+  stp_vars_t *v;
+  stp_parameter_t desc;
+  size_t i;
+  if (!printer)
+    return;
+  v = stp_vars_create();
+  stp_set_driver(v, MEDIA_DRIVER);
+  stp_set_printer_defaults(v, printer);
+  stp_describe_parameter(v, "MediaType", &desc);
+  if (desc.p_type == STP_PARAMETER_TYPE_STRING_LIST && desc.bounds.str)
+    for (i = 0; i < stp_string_list_count(desc.bounds.str) &&
+	   media_count < MEDIA_COUNT; i++)
+      media_types[media_count++] =
+	strdup(stp_string_list_param(desc.bounds.str, i)->name);
+  stp_parameter_description_destroy(&desc);
+  stp_vars_destroy(v);
+}
+
+int
+main(void)
+{
+  thread_data_t thread_data[THREADS];
+  int i;
+
+  run_threads(thread_data, print_jobs);
+  for (i = 0; i < DRIVER_COUNT; i++)
+    check_results(drivers[i], NULL, driver_result, thread_data, i);
+
+  find_media_types();
+  run_threads(thread_data, print_media);
+  for (i = 0; i < media_count; i++)
+    {
+      check_results(MEDIA_DRIVER, media_types[i], media_result,
+		    thread_data, i);
+      free(media_types[i]);
+    }
+
+  if (global_error_count)
+    printf("%d/%d tests FAILED.\n", global_error_count, global_test_count);
+  else
+    printf("All tests passed successfully.\n");
+  return global_error_count ? 1 : 0;
+}
+
+#else
+
+int
+main(void)
+{
+  printf("Threads are not supported; skipping.\n");
+  return 77;
+}
+
+#endif
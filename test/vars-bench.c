@@ -0,0 +1,204 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time parameter lookups and copies on a fully populated stp_vars_t.
+ *
+ * Usage: vars-bench [driver [iterations]]
+ *
+ * The driver defaults to escp2-r2400, which has one of the larger
+ * parameter sets.  Every parameter the driver describes is first set to
+ * its default, as the CUPS and GIMP front ends do; each iteration then
+ * checks and fetches every one of them, the way a driver does while
+ * setting up a job.  Lookups are timed both in the order the parameters
+ * were set and in a shuffled order, since the list caches the most
+ * recently found entry and so favors walking the list in order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <gutenprint/gutenprint.h>
+
+static double
+compute_interval(struct timeval *tv1, struct timeval *tv2)
+{
+  return ((double) tv2->tv_sec + (double) tv2->tv_usec / 1000000.) -
+    ((double) tv1->tv_sec + (double) tv1->tv_usec / 1000000.);
+}
+
+static int
+lookup_parameter(const stp_vars_t *v, const stp_parameter_t *p)
+{
+  const char *name = p->name;
+  switch (p->p_type)
+    {
+    case STP_PARAMETER_TYPE_STRING_LIST:
+      return (stp_check_string_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_string_parameter(v, name) != NULL);
+    case STP_PARAMETER_TYPE_INT:
+      return (stp_check_int_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_int_parameter(v, name) != 0);
+    case STP_PARAMETER_TYPE_BOOLEAN:
+      return (stp_check_boolean_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_boolean_parameter(v, name));
+    case STP_PARAMETER_TYPE_DOUBLE:
+      return (stp_check_float_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_float_parameter(v, name) != 0);
+    case STP_PARAMETER_TYPE_CURVE:
+      return (stp_check_curve_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_curve_parameter(v, name) != NULL);
+    case STP_PARAMETER_TYPE_FILE:
+      return (stp_check_file_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_file_parameter(v, name) != NULL);
+    case STP_PARAMETER_TYPE_RAW:
+      return (stp_check_raw_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_raw_parameter(v, name) != NULL);
+    case STP_PARAMETER_TYPE_ARRAY:
+      return (stp_check_array_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_array_parameter(v, name) != NULL);
+    case STP_PARAMETER_TYPE_DIMENSION:
+      return (stp_check_dimension_parameter(v, name, STP_PARAMETER_DEFAULTED) &&
+	      stp_get_dimension_parameter(v, name) != 0);
+    default:
+      return 0;
+    }
+}
+
+static void
+set_parameter_default(stp_vars_t *v, const stp_parameter_t *p)
+{
+  stp_parameter_t desc;
+  stp_describe_parameter(v, p->name, &desc);
+  switch (p->p_type)
+    {
+    case STP_PARAMETER_TYPE_STRING_LIST:
+      if (desc.deflt.str)
+	stp_set_string_parameter(v, p->name, desc.deflt.str);
+      break;
+    case STP_PARAMETER_TYPE_INT:
+      stp_set_int_parameter(v, p->name, desc.deflt.integer);
+      break;
+    case STP_PARAMETER_TYPE_BOOLEAN:
+      stp_set_boolean_parameter(v, p->name, desc.deflt.boolean);
+      break;
+    case STP_PARAMETER_TYPE_DOUBLE:
+      stp_set_float_parameter(v, p->name, desc.deflt.dbl);
+      break;
+    case STP_PARAMETER_TYPE_CURVE:
+      if (desc.deflt.curve)
+	stp_set_curve_parameter(v, p->name, desc.deflt.curve);
+      break;
+    case STP_PARAMETER_TYPE_DIMENSION:
+      stp_set_dimension_parameter(v, p->name, desc.deflt.dimension);
+      break;
+    default:
+      break;
+    }
+  stp_parameter_description_destroy(&desc);
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *driver = argc > 1 ? argv[1] : "escp2-r2400";
+  int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+  const stp_printer_t *printer;
+  stp_vars_t *v;
+  stp_vars_t *copy;
+  stp_parameter_list_t params;
+  size_t count;
+  size_t i;
+  size_t *order;
+  unsigned random_state = 1;
+  int j;
+  int found = 0;
+  struct timeval tv1, tv2;
+  double lookup_time, shuffled_time, copy_time;
+
+  stp_init();
+  printer = stp_get_printer_by_driver(driver);
+  if (!printer)
+    {
+      fprintf(stderr, "Unknown driver %s\n", driver);
+      return 1;
+    }
+  v = stp_vars_create();
+  stp_set_driver(v, driver);
+  stp_set_printer_defaults(v, printer);
+  params = stp_get_parameter_list(v);
+  count = stp_parameter_list_count(params);
+  order = malloc(count * sizeof(size_t));
+  for (i = 0; i < count; i++)
+    {
+      set_parameter_default(v, stp_parameter_list_param(params, i));
+      order[i] = i;
+    }
+  for (i = count; i > 1; i--)
+    {
+      size_t k;
+      size_t tmp;
+      random_state = random_state * 1103515245 + 12345;
+      k = (random_state >> 8) % i;
+      tmp = order[i - 1];
+      order[i - 1] = order[k];
+      order[k] = tmp;
+    }
+
+  (void) gettimeofday(&tv1, NULL);
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < count; i++)
+      found += lookup_parameter(v, stp_parameter_list_param(params, i));
+  (void) gettimeofday(&tv2, NULL);
+  lookup_time = compute_interval(&tv1, &tv2);
+
+  (void) gettimeofday(&tv1, NULL);
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < count; i++)
+      lookup_parameter(v, stp_parameter_list_param(params, order[i]));
+  (void) gettimeofday(&tv2, NULL);
+  shuffled_time = compute_interval(&tv1, &tv2);
+
+  copy = stp_vars_create();
+  (void) gettimeofday(&tv1, NULL);
+  for (j = 0; j < iterations / 10; j++)
+    stp_vars_copy(copy, v);
+  (void) gettimeofday(&tv2, NULL);
+  copy_time = compute_interval(&tv1, &tv2);
+
+  printf("%s: %lu parameters (%d set)\n", driver, (unsigned long) count,
+	 found / (iterations > 0 ? iterations : 1));
+  printf("  %.1f ns per parameter lookup in order\n",
+	 lookup_time * 1e9 / ((double) iterations * count));
+  printf("  %.1f ns per parameter lookup shuffled\n",
+	 shuffled_time * 1e9 / ((double) iterations * count));
+  printf("  %.2f us per stp_vars_copy\n",
+	 copy_time * 1e6 * 10 / (iterations > 0 ? iterations : 1));
+
+  free(order);
+  stp_parameter_list_destroy(params);
+  stp_vars_destroy(copy);
+  stp_vars_destroy(v);
+  return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time setting up the weave and looking up the weave parameters of
+ * every row of a job, with and without the weave schedule cache.
+ *
+ * Usage: weave-bench [pages [head limit [strategy]]]
+ *
+ * The weaves are the ones run-weavetest checks: every number of jets,
+ * jet separation and pass arrangement used by any printer, with no head
+ * offsets, as long as the jets times the separation is no more than the
+ * head limit (384 by default; run-weavetest uses 3072, which takes a
+ * very long time without the cache).  Each job prints the given number
+ * of pages (4 by default) of the same height, which is five times the
+ * height of the print head as in run-weavetest.  Unless a strategy is
+ * given, jobs are run with all of them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <gutenprint/gutenprint.h>
+#include "gutenprint-internal.h"
+
+static const int passes[][3] =
+{
+  { 1, 1, 1 }, { 2, 1, 1 }, { 1, 2, 1 }, { 1, 2, 2 }, { 1, 4, 1 },
+  { 4, 1, 1 }, { 1, 8, 1 }, { 1, 16, 1 }, { 4, 2, 1 }, { 4, 4, 1 },
+  { 4, 8, 1 }, { 4, 16, 1 }, { 2, 2, 1 }, { 2, 4, 1 }, { 2, 8, 1 },
+  { 2, 16, 1 }, { 1, 4, 2 }, { 1, 8, 2 }, { 1, 16, 2 }, { 2, 2, 2 },
+  { 2, 4, 2 }, { 2, 8, 2 }, { 2, 16, 2 }, { 8, 1, 1 }, { 4, 4, 2 },
+  { 4, 8, 2 }, { 8, 2, 1 }, { 8, 4, 1 }, { 8, 8, 1 }, { 16, 1, 1 },
+  { 16, 2, 1 }, { 16, 4, 1 }
+};
+
+static const int jets[] =
+  { 1, 2, 4, 8, 15, 16, 20, 21, 24, 29, 32, 42, 47, 48, 59, 60, 64, 90, 96,
+    128, 144, 180, 192, 208, 358, 360, 384 };
+
+static const int separations[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24 };
+
+static void
+flush_pass(stp_vars_t *v, int passno, int vertical_subpass)
+{
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Run one job, returning the number of (row, subpass) lookups and
+ * adding the time spent in each part to setup and lookup.
+ */
+static long
+run_job(int pages, int physjets, int sep, const int *p, int strategy,
+	double *setup, double *lookup)
+{
+  static const int head_offset[1] = { 0 };
+  int subpasses = p[0] * p[1] * p[2];
+  int nrows = physjets * sep * 5;
+  long rows = 0;
+  stp_vars_t *v;
+  int page;
+
+  if (nrows < 200)
+    nrows = 200;
+  if (subpasses > physjets)
+    return 0;
+  v = stp_vars_create();
+  for (page = 0; page < pages; page++)
+    {
+      double start = now();
+      double end;
+      int i, j;
+      stp_initialize_weave(v, physjets, sep, p[0], p[1], p[2], 1, 1, 128,
+			   nrows, 0, nrows + physjets * sep, head_offset,
+			   strategy, flush_pass, stp_fill_tiff, stp_pack_tiff,
+			   stp_compute_tiff_linewidth);
+      end = now();
+      *setup += end - start;
+      start = end;
+      for (i = 0; i < nrows; i++)
+	for (j = 0; j < subpasses; j++)
+	  {
+	    stp_weave_t w;
+	    stp_weave_parameters_by_row(v, i, j, &w);
+	  }
+      *lookup += now() - start;
+      rows += nrows * subpasses;
+      stp_destroy_component_data(v, "Weave");
+    }
+  stp_vars_destroy(v);
+  return rows;
+}
+
+int
+main(int argc, char **argv)
+{
+  int pages = argc > 1 ? atoi(argv[1]) : 4;
+  int head_limit = argc > 2 ? atoi(argv[2]) : 384;
+  int first_strategy = argc > 3 ? atoi(argv[3]) : 0;
+  int last_strategy = argc > 3 ? first_strategy : 4;
+  int cached;
+
+  stp_init();
+  printf("%d pages per job, head limit %d\n", pages, head_limit);
+  printf("%-10s %8s %10s %10s %10s %8s\n", "cache", "jobs", "lookups",
+	 "setup (s)", "lookup (s)", "ns each");
+  for (cached = 0; cached < 2; cached++)
+    {
+      double setup = 0, lookup = 0;
+      long rows = 0;
+      int jobs = 0;
+      unsigned long hits, misses;
+      int s, j, k, p;
+      stpi_set_weave_cache_size(cached ? 8 : 0);
+      for (s = first_strategy; s <= last_strategy; s++)
+	for (j = 0; j < (int) (sizeof(jets) / sizeof(int)); j++)
+	  for (k = 0; k < (int) (sizeof(separations) / sizeof(int)); k++)
+	    if (jets[j] * separations[k] <= head_limit)
+	      for (p = 0; p < (int) (sizeof(passes) / sizeof(passes[0])); p++)
+		{
+		  long job_rows = run_job(pages, jets[j], separations[k],
+					  passes[p], s, &setup, &lookup);
+		  if (job_rows)
+		    {
+		      rows += job_rows;
+		      jobs++;
+		    }
+		}
+      stpi_get_weave_cache_stats(&hits, &misses);
+      printf("%-10s %8d %10ld %10.3f %10.3f %8.1f\n",
+	     cached ? "enabled" : "disabled", jobs, rows, setup, lookup,
+	     (setup + lookup) * 1e9 / rows);
+      if (cached)
+	printf("%lu hits, %lu misses\n", hits, misses);
+      fflush(stdout);
+    }
+  return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * "$Id$"
+ *
+ *   Copyright 2016 Robert Krawitz (rlk@alum.mit.edu)
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time library startup with and without the XML cache.
+ *
+ * Usage: xml-bench [driver [runs]]
+ *
+ * Each run is a fresh process that calls stp_init() and then fetches the
+ * parameter list of the driver (escp2-r2400 by default), which loads the
+ * printer's model data; that is roughly what a CUPS filter does before it
+ * can start printing.  Runs are made with the cache disabled, and then
+ * against a cache in a scratch directory: the first run there fills the
+ * cache, and the rest use it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <gutenprint/gutenprint.h>
+
+static double
+compute_interval(struct timeval *tv1, struct timeval *tv2)
+{
+  return ((double) tv2->tv_sec + (double) tv2->tv_usec / 1000000.) -
+    ((double) tv1->tv_sec + (double) tv1->tv_usec / 1000000.);
+}
+
+static int
+start_printer(const char *driver)
+{
+  const stp_printer_t *printer;
+  stp_vars_t *v;
+  stp_init();
+  printer = stp_get_printer_by_driver(driver);
+  if (!printer)
+    {
+      fprintf(stderr, "Unknown driver %s\n", driver);
+      return 0;
+    }
+  v = stp_vars_create();
+  stp_set_driver(v, driver);
+  stp_set_printer_defaults(v, printer);
+  stp_parameter_list_destroy(stp_get_parameter_list(v));
+  stp_vars_destroy(v);
+  return 1;
+}
+
+/*
+ * Start the printer in a child process with the given cache directory,
+ * and return how long that took, or a negative value on failure.
+ */
+static double
+time_startup(const char *driver, const char *cache_dir)
+{
+  int fds[2];
+  pid_t pid;
+  int status;
+  double elapsed = -1;
+  if (pipe(fds) != 0)
+    return -1;
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+    {
+      struct timeval tv1, tv2;
+      close(fds[0]);
+      setenv("STP_XML_CACHE_DIR", cache_dir, 1);
+      (void) gettimeofday(&tv1, NULL);
+      if (!start_printer(driver))
+	_exit(1);
+      (void) gettimeofday(&tv2, NULL);
+      elapsed = compute_interval(&tv1, &tv2);
+      if (write(fds[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+	_exit(1);
+      _exit(0);
+    }
+  close(fds[1]);
+  if (pid < 0 ||
+      read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+    elapsed = -1;
+  close(fds[0]);
+  if (pid > 0 && (waitpid(pid, &status, 0) != pid || status != 0))
+    elapsed = -1;
+  return elapsed;
+}
+
+static int
+report(const char *what, const char *driver, const char *cache_dir, int runs)
+{
+  double total = 0;
+  double best = 0;
+  int i;
+  for (i = 0; i < runs; i++)
+    {
+      double elapsed = time_startup(driver, cache_dir);
+      if (elapsed < 0)
+	{
+	  fprintf(stderr, "%s: run %d failed\n", what, i);
+	  return 1;
+	}
+      total += elapsed;
+      if (i == 0 || elapsed < best)
+	best = elapsed;
+    }
+  printf("  %-18s %8.2f ms mean, %8.2f ms best (%d runs)\n", what,
+	 total * 1000 / runs, best * 1000, runs);
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *driver = argc > 1 ? argv[1] : "escp2-r2400";
+  int runs = argc > 2 ? atoi(argv[2]) : 10;
+  char cache_dir[] = "/tmp/xml-bench-XXXXXX";
+  char command[64];
+  int status = 0;
+
+  if (runs < 1)
+    runs = 1;
+  if (!mkdtemp(cache_dir))
+    {
+      perror("mkdtemp");
+      return 1;
+    }
+  printf("%s startup:\n", driver);
+  status = (report("uncached", driver, "", runs) ||
+	    report("filling cache", driver, cache_dir, 1) ||
+	    report("cached", driver, cache_dir, runs));
+
+  sprintf(command, "rm -rf %s", cache_dir);
+  if (system(command) != 0)
+    fprintf(stderr, "Unable to remove %s\n", cache_dir);
+  return status;
+}